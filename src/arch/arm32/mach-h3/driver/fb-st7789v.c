@@ -190,7 +190,7 @@ static int fb_getbl(struct framebuffer_t * fb)
 static struct surface_t * fb_create(struct framebuffer_t * fb)
 {
 	struct fb_st7789v_pdata_t * pdat = (struct fb_st7789v_pdata_t *)fb->priv;
-	return surface_alloc(pdat->width, pdat->height, NULL);
+	return surface_alloc_format(pdat->width, pdat->height, SURFACE_FORMAT_RGB565, NULL);
 }
 
 static void fb_destroy(struct framebuffer_t * fb, struct surface_t * s)
@@ -198,6 +198,34 @@ static void fb_destroy(struct framebuffer_t * fb, struct surface_t * s)
 	surface_free(s);
 }
 
+static void st7789v_pack(struct surface_t * s, struct region_t * r, u8_t * q)
+{
+	for(int y = 0; y < r->h; y++)
+	{
+		if(s->format == SURFACE_FORMAT_RGB565)
+		{
+			u16_t * p = s->pixels + (r->y + y) * s->stride + (r->x << 1);
+			for(int x = 0; x < r->w; x++)
+			{
+				u16_t c = *p++;
+				*q++ = (c >> 8) & 0xff;
+				*q++ = (c >> 0) & 0xff;
+			}
+		}
+		else
+		{
+			u32_t * p = s->pixels + (r->y + y) * s->stride + (r->x << 2);
+			for(int x = 0; x < r->w; x++)
+			{
+				u32_t v = *p++;
+				u16_t c = (((v & 0x00ff0000) >> 19) << 11) | (((v & 0x0000ff00) >> 10) << 5) | (((v & 0x000000ff) >> 3) << 0);
+				*q++ = (c >> 8) & 0xff;
+				*q++ = (c >> 0) & 0xff;
+			}
+		}
+	}
+}
+
 static void fb_present(struct framebuffer_t * fb, struct surface_t * s, struct region_list_t * rl)
 {
 	struct fb_st7789v_pdata_t * pdat = (struct fb_st7789v_pdata_t *)fb->priv;
@@ -208,18 +236,7 @@ static void fb_present(struct framebuffer_t * fb, struct surface_t * s, struct r
 		for(int i = 0; i < rl->count; i++)
 		{
 			struct region_t * r = &rl->region[i];
-			u8_t * q = txbuf;
-			for(int y = 0; y < r->h; y++)
-			{
-				u32_t * p = s->pixels + (r->y + y) * s->stride + (r->x << 2);
-				for(int x = 0; x < r->w; x++)
-				{
-					u32_t v = *p++;
-					u16_t c = (((v & 0x00ff0000) >> 19) << 11) | (((v & 0x0000ff00) >> 10) << 5) | (((v & 0x000000ff) >> 3) << 0);
-					*q++ = (c >> 8) & 0xff;
-					*q++ = (c >> 0) & 0xff;
-				}
-			}
+			st7789v_pack(s, r, txbuf);
 			st7789v_set_window(pdat, r->x, r->y, r->w, r->h);
 			st7789v_write_command(pdat, 0x2c);
 			spi_device_select(pdat->dev);
@@ -229,18 +246,7 @@ static void fb_present(struct framebuffer_t * fb, struct surface_t * s, struct r
 	}
 	else
 	{
-		u32_t * p = s->pixels;
-		u8_t * q = txbuf;
-		for(int y = 0; y < pdat->height; y++)
-		{
-			for(int x = 0; x < pdat->width; x++)
-			{
-				u32_t v = *p++;
-				u16_t c = (((v & 0x00ff0000) >> 19) << 11) | (((v & 0x0000ff00) >> 10) << 5) | (((v & 0x000000ff) >> 3) << 0);
-				*q++ = (c >> 8) & 0xff;
-				*q++ = (c >> 0) & 0xff;
-			}
-		}
+		st7789v_pack(s, &(struct region_t){ 0, 0, pdat->width, pdat->height }, txbuf);
 		st7789v_set_window(pdat, 0, 0, pdat->width, pdat->height);
 		st7789v_write_command(pdat, 0x2c);
 		spi_device_select(pdat->dev);
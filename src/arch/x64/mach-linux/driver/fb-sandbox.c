@@ -79,6 +79,7 @@ static struct surface_t * fb_create(struct framebuffer_t * fb)
 	s->height = surface->height;
 	s->stride = surface->stride;
 	s->pixlen = surface->pixlen;
+	s->format = SURFACE_FORMAT_ARGB32;
 	s->pixels = surface->pixels;
 	s->r = search_render();
 	s->rctx = s->r->create(s);
@@ -568,21 +568,24 @@ static void pcba_window(struct xui_context_t * ctx)
 						static int start = 0;
 						static struct camera_t * c = NULL;
 						static struct surface_t * s = NULL;
-						struct video_frame_t frame;
+						struct camera_buffer_t * buf;
 						if(start)
 						{
 							if(!c)
 							{
 								c = search_first_camera();
-								if(c && camera_start(c, VIDEO_FORMAT_MJPG, 320, 240) && camera_capture(c, &frame, 3000))
-									s = surface_alloc(frame.width, frame.height, NULL);
+								if(c && camera_stream_on(c, VIDEO_FORMAT_MJPG, 320, 240, 4) && (buf = camera_dequeue(c, 3000)))
+								{
+									s = surface_alloc(buf->frame.width, buf->frame.height, NULL);
+									camera_enqueue(c, buf);
+								}
 							}
 						}
 						else
 						{
 							if(c)
 							{
-								camera_stop(c);
+								camera_stream_off(c);
 								surface_free(s);
 								c = NULL;
 								s = NULL;
@@ -594,8 +597,11 @@ static void pcba_window(struct xui_context_t * ctx)
 							if(start)
 							{
 								xui_layout_row(ctx, 1, (int[]){ -1 }, -1);
-								if(c && camera_capture(c, &frame, 0))
-									video_frame_to_argb(&frame, s->pixels);
+								if(c && s && (buf = camera_dequeue(c, 0)))
+								{
+									video_frame_to_argb(&buf->frame, s->pixels);
+									camera_enqueue(c, buf);
+								}
 								if(s)
 									xui_image_ex(ctx, s, 0, XUI_IMAGE_CONTAIN | XUI_IMAGE_REFRESH);
 							}
@@ -47,7 +47,15 @@ static int cam_start(struct camera_t * cam, enum video_format_t fmt, int width,
 	pdat->width = width;
 	pdat->height = height;
 	if((pdat->ctx = sandbox_cam_start(pdat->path, (int *)&pdat->fmt, &pdat->width, &pdat->height)))
+	{
+		if(cam->queue && !camera_queue_setup(cam, video_frame_size(pdat->fmt, pdat->width, pdat->height)))
+		{
+			sandbox_cam_stop(pdat->ctx);
+			pdat->ctx = NULL;
+			return 0;
+		}
 		return 1;
+	}
 	return 0;
 }
 
@@ -55,7 +63,10 @@ static int cam_stop(struct camera_t * cam)
 {
 	struct cam_sandbox_pdata_t * pdat = (struct cam_sandbox_pdata_t *)cam->priv;
 	if(pdat->ctx)
+	{
 		sandbox_cam_stop(pdat->ctx);
+		pdat->ctx = NULL;
+	}
 	return 1;
 }
 
@@ -27,8 +27,35 @@
  */
 
 #include <xboot.h>
+#include <dma/dmapool.h>
+#include <time/timer.h>
 #include <camera/camera.h>
 
+#define CAMERA_POLL_INTERVAL	(2)
+
+struct camera_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+};
+
+static ssize_t camera_read_frames(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct camera_t * cam = (struct camera_t *)kobj->priv;
+	struct camera_stat_t stat;
+
+	camera_get_stat(cam, &stat);
+	return sprintf(buf, "%llu", (unsigned long long)stat.frames);
+}
+
+static ssize_t camera_read_dropped(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct camera_t * cam = (struct camera_t *)kobj->priv;
+	struct camera_stat_t stat;
+
+	camera_get_stat(cam, &stat);
+	return sprintf(buf, "%llu", (unsigned long long)stat.dropped);
+}
+
 struct camera_t * search_camera(const char * name)
 {
 	struct device_t * dev;
@@ -56,18 +83,21 @@ struct device_t * register_camera(struct camera_t * cam, struct driver_t * drv)
 	if(!cam || !cam->name)
 		return NULL;
 
-	if(!cam->start || !cam->stop || !cam->capture)
+	if(!cam->start || !cam->stop)
 		return NULL;
 
 	dev = malloc(sizeof(struct device_t));
 	if(!dev)
 		return NULL;
 
+	cam->queue = NULL;
 	dev->name = strdup(cam->name);
 	dev->type = DEVICE_TYPE_CAMERA;
 	dev->driver = drv;
 	dev->priv = cam;
 	dev->kobj = kobj_alloc_directory(dev->name);
+	kobj_add_regular(dev->kobj, "frames", camera_read_frames, NULL, cam);
+	kobj_add_regular(dev->kobj, "dropped", camera_read_dropped, NULL, cam);
 
 	if(!register_device(dev))
 	{
@@ -88,6 +118,7 @@ void unregister_camera(struct camera_t * cam)
 		dev = search_device(cam->name, DEVICE_TYPE_CAMERA);
 		if(dev && unregister_device(dev))
 		{
+			camera_stream_off(cam);
 			kobj_remove_self(dev->kobj);
 			free(dev->name);
 			free(dev);
@@ -119,6 +150,7 @@ int camera_capture(struct camera_t * cam, struct video_frame_t * frame, int time
 			do {
 				if(cam->capture(cam, frame))
 					return 1;
+				task_yield();
 			} while(ktime_before(ktime_get(), t));
 		}
 		else
@@ -135,3 +167,377 @@ int camera_ioctl(struct camera_t * cam, const char * cmd, void * arg)
 		return cam->ioctl(cam, cmd, arg);
 	return -1;
 }
+
+static int camera_wakeup_timer(struct timer_t * timer, void * data)
+{
+	task_wakeup((struct task_t *)data);
+	return 0;
+}
+
+/*
+ * Feeds the ring for drivers which can only be polled, sleeping between polls
+ * instead of spinning. Frames are copied once, into the ring buffer.
+ */
+static void camera_poll_task(struct task_t * task, void * data)
+{
+	struct camera_t * cam = (struct camera_t *)data;
+	struct camera_queue_t * q = cam->queue;
+	struct camera_buffer_t * buf;
+	struct video_frame_t frame;
+	struct timer_t timer;
+	irq_flags_t flags;
+
+	timer_init(&timer, camera_wakeup_timer, task);
+	while(!q->exit)
+	{
+		if(cam->capture(cam, &frame))
+		{
+			buf = camera_buffer_get(cam);
+			if(buf)
+			{
+				if((frame.buflen > 0) && (frame.buflen <= buf->size))
+				{
+					memcpy(buf->mem, frame.buf, frame.buflen);
+					memcpy(&buf->frame, &frame, sizeof(struct video_frame_t));
+					camera_buffer_done(cam, buf);
+				}
+				else
+				{
+					spin_lock_irqsave(&q->lock, flags);
+					list_add(&buf->entry, &q->idle);
+					q->dropped++;
+					spin_unlock_irqrestore(&q->lock, flags);
+				}
+			}
+		}
+		else
+		{
+			timer_start_now(&timer, ms_to_ktime(CAMERA_POLL_INTERVAL));
+			task_suspend(task);
+			timer_cancel(&timer);
+		}
+	}
+	q->task = NULL;
+}
+
+/*
+ * The stream and every consumer inside camera_dequeue hold a reference, the
+ * ring is only freed by the last one. Taking one is serialized with stream off
+ * clearing cam->queue.
+ */
+static spinlock_t __camera_lock = SPIN_LOCK_INIT();
+
+static void camera_queue_free(struct camera_queue_t * q)
+{
+	int i;
+
+	if(q)
+	{
+		if(q->bufs)
+		{
+			for(i = 0; i < q->count; i++)
+			{
+				if(q->bufs[i].mem)
+					dma_free_noncoherent(q->bufs[i].mem);
+			}
+			free(q->bufs);
+		}
+		free(q);
+	}
+}
+
+static struct camera_queue_t * camera_queue_get(struct camera_t * cam)
+{
+	struct camera_queue_t * q;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__camera_lock, flags);
+	q = cam->queue;
+	if(q)
+		q->ref++;
+	spin_unlock_irqrestore(&__camera_lock, flags);
+	return q;
+}
+
+static void camera_queue_put(struct camera_queue_t * q)
+{
+	irq_flags_t flags;
+	int ref;
+
+	spin_lock_irqsave(&__camera_lock, flags);
+	ref = --q->ref;
+	spin_unlock_irqrestore(&__camera_lock, flags);
+	if(ref == 0)
+		camera_queue_free(q);
+}
+
+/*
+ * Start streaming into a ring of count buffers. Drivers which fill buffers
+ * themselves call camera_queue_setup from their start callback, the others are
+ * polled through their capture callback.
+ */
+int camera_stream_on(struct camera_t * cam, enum video_format_t fmt, int width, int height, int count)
+{
+	struct camera_queue_t * q;
+
+	if(!cam || cam->queue)
+		return 0;
+
+	q = malloc(sizeof(struct camera_queue_t));
+	if(!q)
+		return 0;
+	memset(q, 0, sizeof(struct camera_queue_t));
+	q->count = clamp(count, 2, CAMERA_BUFFER_MAX);
+	init_list_head(&q->idle);
+	init_list_head(&q->done);
+	init_list_head(&q->wait);
+	spin_lock_init(&q->lock);
+	q->ref = 1;
+	cam->queue = q;
+
+	if(!cam->start(cam, fmt, width, height))
+	{
+		cam->queue = NULL;
+		camera_queue_free(q);
+		return 0;
+	}
+	if(!q->bufs && !camera_queue_setup(cam, video_frame_size(fmt, width, height)))
+	{
+		cam->stop(cam);
+		cam->queue = NULL;
+		camera_queue_free(q);
+		return 0;
+	}
+	if(cam->capture)
+	{
+		q->task = task_create(NULL, "camera", camera_poll_task, cam, 0, -5);
+		if(!q->task)
+		{
+			cam->stop(cam);
+			cam->queue = NULL;
+			camera_queue_free(q);
+			return 0;
+		}
+		task_resume(q->task);
+	}
+	return 1;
+}
+
+/*
+ * Stop streaming and drop the stream reference, dequeued buffers become invalid.
+ * Consumers still waking up in camera_dequeue keep the ring alive until they leave.
+ */
+void camera_stream_off(struct camera_t * cam)
+{
+	struct camera_queue_t * q;
+	struct camera_waiter_t * pos, * n;
+	irq_flags_t flags;
+
+	if(!cam || !cam->queue)
+		return;
+	q = cam->queue;
+	spin_lock_irqsave(&q->lock, flags);
+	q->exit = 1;
+	list_for_each_entry_safe(pos, n, &q->wait, entry)
+	{
+		list_del_init(&pos->entry);
+		task_wakeup(pos->task);
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+	while(q->task)
+		task_yield();
+	cam->stop(cam);
+	spin_lock_irqsave(&__camera_lock, flags);
+	cam->queue = NULL;
+	spin_unlock_irqrestore(&__camera_lock, flags);
+	camera_queue_put(q);
+}
+
+/*
+ * Take the oldest filled buffer, waiting up to timeout ms with the task
+ * suspended. A zero timeout never waits and a negative one waits forever.
+ * Wakeups only set the task's wakeup flag, one landing before the suspend
+ * makes it return at once, so none is lost.
+ */
+struct camera_buffer_t * camera_dequeue(struct camera_t * cam, int timeout)
+{
+	struct camera_queue_t * q;
+	struct camera_buffer_t * buf = NULL;
+	struct camera_waiter_t w;
+	struct timer_t timer;
+	irq_flags_t flags;
+	ktime_t deadline;
+
+	if(!cam || !(q = camera_queue_get(cam)))
+		return NULL;
+	deadline = ktime_add_ms(ktime_get(), timeout > 0 ? timeout : 0);
+	w.task = task_self();
+	init_list_head(&w.entry);
+	timer_init(&timer, camera_wakeup_timer, w.task);
+	if(timeout > 0)
+		timer_start_now(&timer, ms_to_ktime(timeout));
+
+	spin_lock_irqsave(&q->lock, flags);
+	while(list_empty(&q->done) && !q->exit && (timeout != 0))
+	{
+		if((timeout > 0) && !ktime_before(ktime_get(), deadline))
+			break;
+		if(list_empty(&w.entry))
+			list_add_tail(&w.entry, &q->wait);
+		spin_unlock_irqrestore(&q->lock, flags);
+		task_suspend(w.task);
+		spin_lock_irqsave(&q->lock, flags);
+	}
+	list_del_init(&w.entry);
+	if(!q->exit && !list_empty(&q->done))
+	{
+		buf = list_first_entry(&q->done, struct camera_buffer_t, entry);
+		list_del_init(&buf->entry);
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+	if(timeout > 0)
+		timer_cancel(&timer);
+	camera_queue_put(q);
+
+	return buf;
+}
+
+/*
+ * Give a dequeued buffer back to the driver
+ */
+void camera_enqueue(struct camera_t * cam, struct camera_buffer_t * buf)
+{
+	struct camera_queue_t * q;
+	irq_flags_t flags;
+
+	if(!cam || !cam->queue || !buf)
+		return;
+	q = cam->queue;
+	spin_lock_irqsave(&q->lock, flags);
+	list_add_tail(&buf->entry, &q->idle);
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+void camera_get_stat(struct camera_t * cam, struct camera_stat_t * stat)
+{
+	struct camera_queue_t * q;
+	struct camera_buffer_t * pos;
+	irq_flags_t flags;
+
+	if(!stat)
+		return;
+	memset(stat, 0, sizeof(struct camera_stat_t));
+	if(!cam || !cam->queue)
+		return;
+	q = cam->queue;
+	spin_lock_irqsave(&q->lock, flags);
+	stat->frames = q->frames;
+	stat->dropped = q->dropped;
+	list_for_each_entry(pos, &q->done, entry)
+		stat->queued++;
+	stat->count = q->count;
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+/*
+ * Allocate the ring with buffers of size bytes, called by drivers from their
+ * start callback once the real frame geometry is known.
+ */
+int camera_queue_setup(struct camera_t * cam, size_t size)
+{
+	struct camera_queue_t * q;
+	int i;
+
+	if(!cam || !cam->queue || (size == 0))
+		return 0;
+	q = cam->queue;
+	if(q->bufs)
+		return (q->size >= size) ? 1 : 0;
+
+	q->bufs = malloc(sizeof(struct camera_buffer_t) * q->count);
+	if(!q->bufs)
+		return 0;
+	memset(q->bufs, 0, sizeof(struct camera_buffer_t) * q->count);
+	for(i = 0; i < q->count; i++)
+	{
+		q->bufs[i].mem = dma_alloc_noncoherent(size);
+		if(!q->bufs[i].mem)
+		{
+			while(--i >= 0)
+				dma_free_noncoherent(q->bufs[i].mem);
+			free(q->bufs);
+			q->bufs = NULL;
+			return 0;
+		}
+		q->bufs[i].index = i;
+		q->bufs[i].size = size;
+		list_add_tail(&q->bufs[i].entry, &q->idle);
+	}
+	q->size = size;
+	return 1;
+}
+
+/*
+ * Get an empty buffer to fill, may be called from interrupt context. When the
+ * consumer falls behind the oldest unread frame is recycled and counted as
+ * dropped, returns NULL only if the consumer holds every buffer.
+ */
+struct camera_buffer_t * camera_buffer_get(struct camera_t * cam)
+{
+	struct camera_queue_t * q;
+	struct camera_buffer_t * buf = NULL;
+	irq_flags_t flags;
+
+	if(!cam || !cam->queue)
+		return NULL;
+	q = cam->queue;
+	spin_lock_irqsave(&q->lock, flags);
+	if(!list_empty(&q->idle))
+	{
+		buf = list_first_entry(&q->idle, struct camera_buffer_t, entry);
+		list_del_init(&buf->entry);
+	}
+	else if(!list_empty(&q->done))
+	{
+		buf = list_first_entry(&q->done, struct camera_buffer_t, entry);
+		list_del_init(&buf->entry);
+		q->dropped++;
+	}
+	else
+	{
+		q->dropped++;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return buf;
+}
+
+/*
+ * Queue a filled buffer for the consumer, the driver sets the frame format,
+ * geometry and length. May be called from interrupt context.
+ */
+void camera_buffer_done(struct camera_t * cam, struct camera_buffer_t * buf)
+{
+	struct camera_queue_t * q;
+	struct camera_waiter_t * w;
+	irq_flags_t flags;
+
+	if(!cam || !cam->queue || !buf)
+		return;
+	q = cam->queue;
+	if(!cam->capture)
+		dma_cache_sync(buf->mem, buf->frame.buflen, DMA_FROM_DEVICE);
+	buf->frame.buf = buf->mem;
+	buf->timestamp = ktime_get();
+	spin_lock_irqsave(&q->lock, flags);
+	buf->sequence = q->sequence++;
+	q->frames++;
+	list_add_tail(&buf->entry, &q->done);
+	if(!list_empty(&q->wait))
+	{
+		w = list_first_entry(&q->wait, struct camera_waiter_t, entry);
+		list_del_init(&w->entry);
+		task_wakeup(w->task);
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+}
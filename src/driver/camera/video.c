@@ -31,178 +31,175 @@
 #include <jerror.h>
 #include <camera/video.h>
 
-static inline unsigned char yuv_to_red(int y, int u, int v)
+#define VIDEO_ROW_GRAIN		(16)
+#define VIDEO_PARALLEL_MIN	(320 * 240)
+
+/*
+ * Full range bt.601 in q8 fixed point, the chroma terms are computed once
+ * for each pair of pixels sharing them.
+ */
+#define YUV_RV				(359)
+#define YUV_GU				(88)
+#define YUV_GV				(183)
+#define YUV_BU				(454)
+
+static inline uint32_t yuv_clamp(int x)
 {
-	int r = y + (v - 128) + ((v - 128) * 103 >> 8);
-	return (r < 0) ? 0 : ((r > 255) ? 255 : r);
+	return ((unsigned int)x > 255) ? ((~x >> 31) & 0xff) : x;
 }
 
-static inline unsigned char yuv_to_green(int y, int u, int v)
+static inline uint32_t yuv_pixel(int y, int rv, int guv, int bu)
 {
-	int g = y - ((u - 128) * 88 >> 8) - ((v - 128) * 183 >> 8);
-	return (g < 0) ? 0 : ((g > 255) ? 255 : g);
+	return 0xff000000 | (yuv_clamp(y + rv) << 16) | (yuv_clamp(y - guv) << 8) | yuv_clamp(y + bu);
 }
 
-static inline unsigned char yuv_to_blue(int y, int u, int v)
+static inline void yuv_chroma(int u, int v, int * rv, int * guv, int * bu)
 {
-	int b = y + (u - 128) + ((u - 128) * 198 >> 8);
-	return (b < 0) ? 0 : ((b > 255) ? 255 : b);
+	u -= 128;
+	v -= 128;
+	*rv = (YUV_RV * v + 128) >> 8;
+	*guv = (YUV_GU * u + YUV_GV * v + 128) >> 8;
+	*bu = (YUV_BU * u + 128) >> 8;
 }
 
-static inline void yuyv_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+/*
+ * Packed 4:2:2 row, the offsets locate y0, u, y1 and v inside each 4 bytes
+ */
+static void yuv422_row_to_argb(uint32_t * q, const unsigned char * p, int width, int oy0, int ou, int oy1, int ov)
 {
-	unsigned char * q = argb;
-	unsigned char * p = yuv;
-	int len = width * height;
-	int y0, u, y1, v;
+	int rv, guv, bu;
 	int i;
 
-	for(i = 0; i < len; i += 2)
+	for(i = 0; i < width - 1; i += 2, p += 4)
 	{
-		y0 = *p++;
-		u = *p++;
-		y1 = *p++;
-		v = *p++;
-
-		*q++ = yuv_to_blue(y0, u, v);
-		*q++ = yuv_to_green(y0, u, v);
-		*q++ = yuv_to_red(y0, u, v);
-		*q++ = 255;
-
-		*q++ = yuv_to_blue(y1, u, v);
-		*q++ = yuv_to_green(y1, u, v);
-		*q++ = yuv_to_red(y1, u, v);
-		*q++ = 255;
+		yuv_chroma(p[ou], p[ov], &rv, &guv, &bu);
+		*q++ = yuv_pixel(p[oy0], rv, guv, bu);
+		*q++ = yuv_pixel(p[oy1], rv, guv, bu);
+	}
+	if(i < width)
+	{
+		yuv_chroma(p[ou], p[ov], &rv, &guv, &bu);
+		*q = yuv_pixel(p[oy0], rv, guv, bu);
 	}
 }
 
-static inline void uyvy_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+/*
+ * Planar or semi planar 4:2:0 row, step is the distance between two chroma samples
+ */
+static void yuv420_row_to_argb(uint32_t * q, const unsigned char * py, const unsigned char * pu, const unsigned char * pv, int step, int width)
 {
-	unsigned char * q = argb;
-	unsigned char * p = yuv;
-	int len = width * height;
-	int y0, u, y1, v;
+	int rv, guv, bu;
 	int i;
 
-	for(i = 0; i < len; i += 2)
+	for(i = 0; i < width - 1; i += 2, pu += step, pv += step)
 	{
-		u = *p++;
-		y0 = *p++;
-		v = *p++;
-		y1 = *p++;
-
-		*q++ = yuv_to_blue(y0, u, v);
-		*q++ = yuv_to_green(y0, u, v);
-		*q++ = yuv_to_red(y0, u, v);
-		*q++ = 255;
-
-		*q++ = yuv_to_blue(y1, u, v);
-		*q++ = yuv_to_green(y1, u, v);
-		*q++ = yuv_to_red(y1, u, v);
-		*q++ = 255;
+		yuv_chroma(*pu, *pv, &rv, &guv, &bu);
+		*q++ = yuv_pixel(*py++, rv, guv, bu);
+		*q++ = yuv_pixel(*py++, rv, guv, bu);
 	}
-}
-
-static inline void nv12_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
-{
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * puv = yuv + width * height;
-	int y, u, v, t;
-	int i, j;
-
-	for(j = 0; j < height; j++)
+	if(i < width)
 	{
-		for(i = 0; i < width; i++)
-		{
-			y = *py++;
-			t = ((j >> 1) * ((width + 1) >> 1) + (i >> 1)) << 1;
-			u = puv[t];
-			v = puv[t + 1];
-
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
-		}
+		yuv_chroma(*pu, *pv, &rv, &guv, &bu);
+		*q = yuv_pixel(*py, rv, guv, bu);
 	}
 }
 
-static inline void nv21_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+static void video_rows_to_argb(struct video_frame_t * frame, void * pixels, int start, int end)
 {
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * puv = yuv + width * height;
-	int y, u, v, t;
-	int i, j;
-
-	for(j = 0; j < height; j++)
+	unsigned char * yuv = frame->buf;
+	int width = frame->width;
+	int height = frame->height;
+	int cw = (width + 1) >> 1;
+	int ch = (height + 1) >> 1;
+	unsigned char * py, * puv;
+	uint32_t * q;
+	int j;
+
+	for(j = start; j < end; j++)
 	{
-		for(i = 0; i < width; i++)
+		q = (uint32_t *)pixels + j * width;
+		py = yuv + j * width;
+		switch(frame->fmt)
 		{
-			y = *py++;
-			t = ((j >> 1) * ((width + 1) >> 1) + (i >> 1)) << 1;
-			u = puv[t + 1];
-			v = puv[t];
-
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
+		case VIDEO_FORMAT_YUYV:
+			yuv422_row_to_argb(q, yuv + j * (cw << 2), width, 0, 1, 2, 3);
+			break;
+		case VIDEO_FORMAT_UYVY:
+			yuv422_row_to_argb(q, yuv + j * (cw << 2), width, 1, 0, 3, 2);
+			break;
+		case VIDEO_FORMAT_NV12:
+			puv = yuv + width * height + (j >> 1) * (cw << 1);
+			yuv420_row_to_argb(q, py, puv, puv + 1, 2, width);
+			break;
+		case VIDEO_FORMAT_NV21:
+			puv = yuv + width * height + (j >> 1) * (cw << 1);
+			yuv420_row_to_argb(q, py, puv + 1, puv, 2, width);
+			break;
+		case VIDEO_FORMAT_YU12:
+			puv = yuv + width * height + (j >> 1) * cw;
+			yuv420_row_to_argb(q, py, puv, puv + cw * ch, 1, width);
+			break;
+		case VIDEO_FORMAT_YV12:
+			puv = yuv + width * height + (j >> 1) * cw;
+			yuv420_row_to_argb(q, py, puv + cw * ch, puv, 1, width);
+			break;
+		default:
+			break;
 		}
 	}
 }
 
-static inline void yu12_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
+static void video_rows_to_gray(struct video_frame_t * frame, void * gray, int start, int end)
 {
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * pu = yuv + width * height;
-	unsigned char * pv = yuv + width * height + ((width + 1) >> 1) * ((height + 1) >> 1);
-	int y, u, v, t;
+	unsigned char * buf = frame->buf;
+	int width = frame->width;
+	int cw = (width + 1) >> 1;
+	unsigned char * p, * q;
 	int i, j;
 
-	for(j = 0; j < height; j++)
+	for(j = start; j < end; j++)
 	{
-		for(i = 0; i < width; i++)
+		q = (unsigned char *)gray + j * width;
+		switch(frame->fmt)
 		{
-			y = *py++;
-			t = (j >> 1) * ((width + 1) >> 1) + (i >> 1);
-			u = pu[t];
-			v = pv[t];
-
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
+		case VIDEO_FORMAT_ARGB:
+			p = buf + j * (width << 2);
+			for(i = 0; i < width; i++, p += 4)
+				*q++ = (p[2] * 19595 + p[1] * 38470 + p[0] * 7471) >> 16;
+			break;
+		case VIDEO_FORMAT_YUYV:
+		case VIDEO_FORMAT_UYVY:
+			p = buf + j * (cw << 2) + ((frame->fmt == VIDEO_FORMAT_YUYV) ? 0 : 1);
+			for(i = 0; i < width; i++, p += 2)
+				*q++ = *p;
+			break;
+		case VIDEO_FORMAT_NV12:
+		case VIDEO_FORMAT_NV21:
+		case VIDEO_FORMAT_YU12:
+		case VIDEO_FORMAT_YV12:
+			memcpy(q, buf + j * width, width);
+			break;
+		default:
+			break;
 		}
 	}
 }
 
-static inline void yv12_to_argb(unsigned char * argb, unsigned char * yuv, int width, int height)
-{
-	unsigned char * q = argb;
-	unsigned char * py = yuv;
-	unsigned char * pu = yuv + width * height + ((width + 1) >> 1) * ((height + 1) >> 1);
-	unsigned char * pv = yuv + width * height;
-	int y, u, v, t;
-	int i, j;
+struct video_job_t {
+	struct video_frame_t * frame;
+	void * pixels;
+};
 
-	for(j = 0; j < height; j++)
-	{
-		for(i = 0; i < width; i++)
-		{
-			y = *py++;
-			t = (j >> 1) * ((width + 1) >> 1) + (i >> 1);
-			u = pu[t];
-			v = pv[t];
+static void video_argb_band(int start, int end, void * data)
+{
+	struct video_job_t * job = (struct video_job_t *)data;
+	video_rows_to_argb(job->frame, job->pixels, start, end);
+}
 
-			*q++ = yuv_to_blue(y, u, v);
-			*q++ = yuv_to_green(y, u, v);
-			*q++ = yuv_to_red(y, u, v);
-			*q++ = 255;
-		}
-	}
+static void video_gray_band(int start, int end, void * data)
+{
+	struct video_job_t * job = (struct video_job_t *)data;
+	video_rows_to_gray(job->frame, job->pixels, start, end);
 }
 
 static const unsigned char dc_lumi_len[] = {
@@ -341,36 +338,119 @@ static void mjpg_to_argb(unsigned char * argb, unsigned char * mjpg, int len, in
 	jpeg_destroy_decompress(&dinfo);
 }
 
-void video_frame_to_argb(struct video_frame_t * frame, void * pixels)
+static void mjpg_to_gray(unsigned char * gray, unsigned char * mjpg, int len, int width, int height)
 {
-	switch(frame->fmt)
+	struct jpeg_decompress_struct dinfo;
+	struct x_error_mgr jerr;
+	JSAMPARRAY buf;
+	int w;
+
+	dinfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = x_error_exit;
+	jerr.pub.emit_message = x_emit_message;
+	if(setjmp(jerr.setjmp_buffer))
+	{
+		jpeg_destroy_decompress(&dinfo);
+		return;
+	}
+	jpeg_create_decompress(&dinfo);
+	jpeg_mem_src(&dinfo, mjpg, len);
+	jpeg_read_header(&dinfo, TRUE);
+	if(dinfo.dc_huff_tbl_ptrs[0] == NULL)
+		insert_huff_tables(&dinfo);
+	dinfo.out_color_space = JCS_GRAYSCALE;
+	dinfo.dct_method = JDCT_IFAST;
+	jpeg_start_decompress(&dinfo);
+	buf = (*dinfo.mem->alloc_sarray)((j_common_ptr)&dinfo, JPOOL_IMAGE, dinfo.output_width, 1);
+	w = min((int)dinfo.output_width, width);
+	while(dinfo.output_scanline < dinfo.output_height)
+	{
+		if(dinfo.output_scanline >= height)
+		{
+			jpeg_abort_decompress(&dinfo);
+			jpeg_destroy_decompress(&dinfo);
+			return;
+		}
+		jpeg_read_scanlines(&dinfo, buf, 1);
+		memcpy(gray + (dinfo.output_scanline - 1) * width, buf[0], w);
+	}
+	jpeg_finish_decompress(&dinfo);
+	jpeg_destroy_decompress(&dinfo);
+}
+
+/*
+ * Bytes needed to hold one frame, compressed formats get the packed 4:2:2 size
+ */
+int video_frame_size(enum video_format_t fmt, int width, int height)
+{
+	switch(fmt)
 	{
 	case VIDEO_FORMAT_ARGB:
-		memcpy(pixels, frame->buf, frame->buflen);
-		break;
+		return width * height * 4;
 	case VIDEO_FORMAT_YUYV:
-		yuyv_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_UYVY:
-		uyvy_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
+	case VIDEO_FORMAT_MJPG:
+		return width * height * 2;
 	case VIDEO_FORMAT_NV12:
-		nv12_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_NV21:
-		nv21_to_argb(pixels, frame->buf, frame->width, frame->height);
-		break;
 	case VIDEO_FORMAT_YU12:
-		yu12_to_argb(pixels, frame->buf, frame->width, frame->height);
+	case VIDEO_FORMAT_YV12:
+		return width * height * 3 / 2;
+	default:
 		break;
+	}
+	return 0;
+}
+
+void video_frame_to_argb(struct video_frame_t * frame, void * pixels)
+{
+	struct video_job_t job;
+
+	switch(frame->fmt)
+	{
+	case VIDEO_FORMAT_YUYV:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_NV21:
+	case VIDEO_FORMAT_YU12:
 	case VIDEO_FORMAT_YV12:
-		yv12_to_argb(pixels, frame->buf, frame->width, frame->height);
+		job.frame = frame;
+		job.pixels = pixels;
+		if(frame->width * frame->height >= VIDEO_PARALLEL_MIN)
+			parallel_for(frame->height, VIDEO_ROW_GRAIN, video_argb_band, &job);
+		else
+			video_rows_to_argb(frame, pixels, 0, frame->height);
 		break;
 	case VIDEO_FORMAT_MJPG:
 		mjpg_to_argb(pixels, frame->buf, frame->buflen, frame->width << 2);
 		break;
+	case VIDEO_FORMAT_ARGB:
 	default:
 		memcpy(pixels, frame->buf, frame->buflen);
 		break;
 	}
 }
+
+/*
+ * Extract the luma plane as width * height bytes, without going through argb.
+ * Motion jpeg frames only decode their luma component.
+ */
+void video_frame_to_gray(struct video_frame_t * frame, void * gray)
+{
+	struct video_job_t job;
+
+	switch(frame->fmt)
+	{
+	case VIDEO_FORMAT_MJPG:
+		mjpg_to_gray(gray, frame->buf, frame->buflen, frame->width, frame->height);
+		break;
+	default:
+		job.frame = frame;
+		job.pixels = gray;
+		if(frame->width * frame->height >= VIDEO_PARALLEL_MIN)
+			parallel_for(frame->height, VIDEO_ROW_GRAIN, video_gray_band, &job);
+		else
+			video_rows_to_gray(frame, gray, 0, frame->height);
+		break;
+	}
+}
@@ -71,6 +71,160 @@ static ssize_t framebuffer_write_brightness(struct kobj_t * kobj, void * buf, si
 	return size;
 }
 
+static ssize_t framebuffer_read_buffers(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct framebuffer_t * fb = (struct framebuffer_t *)kobj->priv;
+	return sprintf(buf, "%d", framebuffer_get_buffers(fb));
+}
+
+static ssize_t framebuffer_write_buffers(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct framebuffer_t * fb = (struct framebuffer_t *)kobj->priv;
+	int buffers = strtol(buf, NULL, 0);
+
+	framebuffer_set_buffers(fb, buffers);
+	return size;
+}
+
+static ssize_t framebuffer_read_present_frames(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct framebuffer_t * fb = (struct framebuffer_t *)kobj->priv;
+	return sprintf(buf, "%llu", fb->swap ? (unsigned long long)fb->swap->frames : 0ULL);
+}
+
+static ssize_t framebuffer_read_present_dropped(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct framebuffer_t * fb = (struct framebuffer_t *)kobj->priv;
+	return sprintf(buf, "%llu", fb->swap ? (unsigned long long)fb->swap->dropped : 0ULL);
+}
+
+static ssize_t framebuffer_read_present_latency(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct framebuffer_t * fb = (struct framebuffer_t *)kobj->priv;
+	struct framebuffer_swap_t * swap = fb->swap;
+	uint64_t ns = (swap && (swap->frames > 0)) ? swap->latency / swap->frames : 0;
+	return sprintf(buf, "%llu.%06llums", ns / 1000000ULL, ns % 1000000ULL);
+}
+
+static ssize_t framebuffer_read_present_latency_max(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct framebuffer_t * fb = (struct framebuffer_t *)kobj->priv;
+	uint64_t ns = fb->swap ? fb->swap->latency_max : 0;
+	return sprintf(buf, "%llu.%06llums", ns / 1000000ULL, ns % 1000000ULL);
+}
+
+struct framebuffer_waiter_t {
+	struct list_head entry;
+	struct task_t * task;
+};
+
+/*
+ * Called with the swap lock held whenever a pending or busy surface goes away
+ */
+static void framebuffer_swap_wakeup(struct framebuffer_swap_t * swap)
+{
+	struct framebuffer_waiter_t * pos, * n;
+
+	list_for_each_entry_safe(pos, n, &swap->wait, entry)
+	{
+		list_del_init(&pos->entry);
+		task_wakeup(pos->task);
+	}
+}
+
+static void framebuffer_present_task(struct task_t * task, void * data)
+{
+	struct framebuffer_t * fb = (struct framebuffer_t *)data;
+	struct framebuffer_swap_t * swap = fb->swap;
+	struct region_list_t * rl;
+	uint64_t latency;
+	unsigned char c;
+
+	while(1)
+	{
+		channel_recv(swap->wake, &c, 1);
+		spin_lock(&swap->lock);
+		if(swap->exit)
+		{
+			spin_unlock(&swap->lock);
+			break;
+		}
+		if(!swap->pending.s)
+		{
+			spin_unlock(&swap->lock);
+			continue;
+		}
+		rl = swap->busy.rl;
+		swap->busy.s = swap->pending.s;
+		swap->busy.rl = swap->pending.rl;
+		swap->busy.stamp = swap->pending.stamp;
+		swap->pending.s = NULL;
+		swap->pending.rl = rl;
+		spin_unlock(&swap->lock);
+
+		fb->present(fb, swap->busy.s, swap->busy.rl);
+
+		latency = ktime_to_ns(ktime_get()) - swap->busy.stamp;
+		spin_lock(&swap->lock);
+		swap->busy.s = NULL;
+		framebuffer_swap_wakeup(swap);
+		swap->frames++;
+		swap->latency += latency;
+		if(latency > swap->latency_max)
+			swap->latency_max = latency;
+		spin_unlock(&swap->lock);
+	}
+	channel_free(swap->wake);
+	region_list_free(swap->pending.rl);
+	region_list_free(swap->busy.rl);
+	free(swap);
+}
+
+static struct framebuffer_swap_t * framebuffer_swap_alloc(struct framebuffer_t * fb)
+{
+	struct framebuffer_swap_t * swap;
+
+	swap = malloc(sizeof(struct framebuffer_swap_t));
+	if(!swap)
+		return NULL;
+	memset(swap, 0, sizeof(struct framebuffer_swap_t));
+	init_list_head(&swap->wait);
+	spin_lock_init(&swap->lock);
+	swap->buffers = 1;
+	swap->wake = channel_alloc(16);
+	swap->pending.rl = region_list_alloc(0);
+	swap->busy.rl = region_list_alloc(0);
+	swap->task = task_create(NULL, "fb-present", framebuffer_present_task, fb, SZ_16K, -10);
+	if(!swap->wake || !swap->pending.rl || !swap->busy.rl || !swap->task)
+	{
+		if(swap->task)
+			task_destroy(swap->task);
+		if(swap->wake)
+			channel_free(swap->wake);
+		region_list_free(swap->pending.rl);
+		region_list_free(swap->busy.rl);
+		free(swap);
+		return NULL;
+	}
+	return swap;
+}
+
+static void framebuffer_swap_free(struct framebuffer_t * fb)
+{
+	struct framebuffer_swap_t * swap = fb->swap;
+	unsigned char c = 0;
+
+	if(swap)
+	{
+		framebuffer_present_wait(fb, NULL);
+		spin_lock(&swap->lock);
+		swap->exit = 1;
+		spin_unlock(&swap->lock);
+		fb->swap = NULL;
+		channel_send(swap->wake, &c, 1);
+	}
+}
+
 struct framebuffer_t * search_framebuffer(const char * name)
 {
 	struct device_t * dev;
@@ -112,6 +266,12 @@ struct device_t * register_framebuffer(struct framebuffer_t * fb, struct driver_
 	kobj_add_regular(dev->kobj, "pwidth", framebuffer_read_pwidth, NULL, fb);
 	kobj_add_regular(dev->kobj, "pheight", framebuffer_read_pheight, NULL, fb);
 	kobj_add_regular(dev->kobj, "brightness", framebuffer_read_brightness, framebuffer_write_brightness, fb);
+	kobj_add_regular(dev->kobj, "buffers", framebuffer_read_buffers, framebuffer_write_buffers, fb);
+	kobj_add_regular(dev->kobj, "present-frames", framebuffer_read_present_frames, NULL, fb);
+	kobj_add_regular(dev->kobj, "present-dropped", framebuffer_read_present_dropped, NULL, fb);
+	kobj_add_regular(dev->kobj, "present-latency", framebuffer_read_present_latency, NULL, fb);
+	kobj_add_regular(dev->kobj, "present-latency-max", framebuffer_read_present_latency_max, NULL, fb);
+	fb->swap = NULL;
 
 	if(fb->setbl)
 		fb->setbl(fb, 0);
@@ -134,6 +294,7 @@ void unregister_framebuffer(struct framebuffer_t * fb)
 	{
 		if(fb->setbl)
 			fb->setbl(fb, 0);
+		framebuffer_swap_free(fb);
 		dev = search_device(fb->name, DEVICE_TYPE_FRAMEBUFFER);
 		if(dev && unregister_device(dev))
 		{
@@ -162,3 +323,95 @@ int framebuffer_get_backlight(struct framebuffer_t * fb)
 		return fb->getbl(fb);
 	return 0;
 }
+
+void framebuffer_set_buffers(struct framebuffer_t * fb, int buffers)
+{
+	struct framebuffer_swap_t * swap;
+
+	if(fb)
+	{
+		if(buffers < 1)
+			buffers = 1;
+		else if(buffers > FRAMEBUFFER_BUFFER_MAX)
+			buffers = FRAMEBUFFER_BUFFER_MAX;
+		if(!fb->swap && (buffers > 1))
+		{
+			swap = framebuffer_swap_alloc(fb);
+			if(!swap)
+				return;
+			swap->buffers = buffers;
+			task_resume(swap->task);
+			smp_wmb();
+			fb->swap = swap;
+		}
+		else if(fb->swap)
+		{
+			fb->swap->buffers = buffers;
+		}
+	}
+}
+
+int framebuffer_get_buffers(struct framebuffer_t * fb)
+{
+	if(fb && fb->swap)
+		return fb->swap->buffers;
+	return 1;
+}
+
+void framebuffer_present_async(struct framebuffer_t * fb, struct surface_t * s, struct region_list_t * rl)
+{
+	struct framebuffer_swap_t * swap = fb->swap;
+	unsigned char c = 0;
+	int wake = 0;
+
+	if(!swap || (swap->buffers <= 1))
+	{
+		framebuffer_present_wait(fb, NULL);
+		fb->present(fb, s, rl);
+		return;
+	}
+	spin_lock(&swap->lock);
+	if(swap->pending.s)
+	{
+		region_list_merge(swap->pending.rl, rl);
+		swap->dropped++;
+		framebuffer_swap_wakeup(swap);
+	}
+	else
+	{
+		region_list_clone(swap->pending.rl, rl);
+		wake = 1;
+	}
+	swap->pending.s = s;
+	swap->pending.stamp = ktime_to_ns(ktime_get());
+	spin_unlock(&swap->lock);
+	if(wake)
+		channel_send(swap->wake, &c, 1);
+}
+
+/*
+ * Sleep until the surface, or every surface if NULL, left the queue. The waiter is
+ * queued under the swap lock and woken through its wakeup flag, so none is lost.
+ */
+void framebuffer_present_wait(struct framebuffer_t * fb, struct surface_t * s)
+{
+	struct framebuffer_swap_t * swap = fb->swap;
+	struct framebuffer_waiter_t w;
+
+	if(swap)
+	{
+		w.task = task_self();
+		init_list_head(&w.entry);
+		spin_lock(&swap->lock);
+		while(s ? ((swap->pending.s == s) || (swap->busy.s == s)) : (swap->pending.s || swap->busy.s))
+		{
+			if(list_empty(&w.entry))
+				list_add_tail(&w.entry, &swap->wait);
+			spin_unlock(&swap->lock);
+			task_suspend(w.task);
+			spin_lock(&swap->lock);
+		}
+		list_del_init(&w.entry);
+		spin_unlock(&swap->lock);
+	}
+}
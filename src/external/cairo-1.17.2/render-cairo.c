@@ -17,10 +17,18 @@ static void * render_cairo_create(struct surface_t * s)
 {
 	struct render_cairo_context_t * ctx;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return NULL;
 	ctx = malloc(sizeof(struct render_cairo_context_t));
 	if(!ctx)
 		return NULL;
 	ctx->cs = cairo_image_surface_create_for_data((unsigned char *)s->pixels, CAIRO_FORMAT_ARGB32, s->width, s->height, s->stride);
+	if(cairo_surface_status(ctx->cs) != CAIRO_STATUS_SUCCESS)
+	{
+		cairo_surface_destroy(ctx->cs);
+		free(ctx);
+		return NULL;
+	}
 	ctx->cr = cairo_create(ctx->cs);
 	return ctx;
 }
@@ -38,6 +46,14 @@ static void render_cairo_blit(struct surface_t * s, struct region_t * clip, stru
 	cairo_t * cr = ((struct render_cairo_context_t *)s->rctx)->cr;
 	struct region_t r;
 
+	if(src->r != s->r)
+	{
+		/* Sources in other formats live on the default render */
+		cairo_surface_flush(cairo_get_target(cr));
+		render_default_blit(s, clip, m, src, type);
+		cairo_surface_mark_dirty(cairo_get_target(cr));
+		return;
+	}
 	cairo_save(cr);
 	if(clip)
 	{
@@ -529,6 +545,7 @@ static struct render_t render_cairo = {
 	.filter_opacity		= render_default_filter_opacity,
 	.filter_haldclut	= render_default_filter_haldclut,
 	.filter_blur		= render_default_filter_blur,
+	.filter_chain		= render_default_filter_chain,
 };
 
 static __init void render_cairo_init(void)
@@ -39,20 +39,25 @@ local DisplayNinepatch = DisplayNinepatch
 local M = Class()
 
 function M:init()
-	self._images = {}
 	self._themes = {}
 end
 
-function M:loadImage(name)
-	if type(name) == "string" then
-		if not self._images[name] and Xfs.isfile(name) then
-			self._images[name] = Image.new(name)
-		end
-		return self._images[name]
+function M:loadImage(name, width, height)
+	if type(name) == "string" and Xfs.isfile(name) then
+		return Image.load(name, width, height)
 	end
 	return nil
 end
 
+function M:loadImageAsync(name, width, height, func)
+	if type(name) == "string" and Xfs.isfile(name) then
+		if Image.loadAsync(name, width, height, func) then
+			return true
+		end
+	end
+	return false
+end
+
 function M:loadTheme(name)
 	local default = "assets/themes/default"
 	local name = type(name) == "string" and name or default
@@ -95,7 +100,6 @@ function M:loadDisplay(name)
 end
 
 function M:clear()
-	self._images = {}
 	self._themes = {}
 end
 
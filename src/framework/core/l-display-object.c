@@ -30,17 +30,23 @@
 
 static const char display_object_lua[] = X(
 local Dobject = Dobject
-local Easing = Easing
 local Event = Event
 local table = table
 
 local M = Class(EventDispatcher)
+local owners = setmetatable({}, {__mode = "k"})
+local pointers = {
+	["mouse-down"] = 1, ["touch-begin"] = 1,
+	["mouse-move"] = 2, ["touch-move"] = 2, ["mouse-wheel"] = 2,
+	["mouse-up"] = 3, ["touch-end"] = 3,
+}
 
 function M:init(width, height, content)
 	self.super:init()
 	self._parent = nil
 	self._children = {}
 	self._dobj = Dobject.new(width, height, content)
+	owners[self._dobj] = self
 end
 
 function M:getParent()
@@ -57,9 +63,10 @@ end
 function M:addChild(child)
 	if child and child ~= self and child._parent ~= self then
 		if child._parent ~= nil then
-			for i, v in ipairs(child._parent) do
+			local children = child._parent._children
+			for i, v in ipairs(children) do
 				if v == child then
-					table.remove(self._children, i)
+					table.remove(children, i)
 					break
 				end
 			end
@@ -398,84 +405,30 @@ function M:hitTestPoint(x, y)
 	return self._dobj:hitTestPoint(x, y)
 end
 
+function M:pick(x, y)
+	return owners[self._dobj:pick(x, y)]
+end
+
 function M:markDirty()
 	return self._dobj:markDirty()
 end
 
+function M:isDirty()
+	return self._dobj:isDirty()
+end
+
 function M:getBounds()
 	return self._dobj:getBounds()
 end
 
 function M:animate(properties, duration, easing)
-	local function listener(d, e)
-		if next(d._tweenlist) then
-			local tween = d._tweenlist[1]
-			if not tween.easinglist then
-				tween.easinglist = {}
-				for k, v in pairs(tween.properties) do
-					local b = nil
-					if k == "x" then
-						b = d:getX()
-					elseif k == "y" then
-						b = d:getY()
-					elseif k == "rotation" then
-						b = d:getRotation()
-					elseif k == "scalex" then
-						b = d:getScaleX()
-					elseif k == "scaley" then
-						b = d:getScaleY()
-					elseif k == "skewx" then
-						b = d:getSkewX()
-					elseif k == "skewy" then
-						b = d:getSkewY()
-					elseif k == "width" then
-						b = d:getWidth()
-					elseif k == "height" then
-						b = d:getHeight()
-					end
-					if b ~= nil then
-						tween.easinglist[k] = Easing.new(b, v - b, tween.duration, tween.easing)
-					end
-				end
-			end
-
-			local elapsed = d._awatch:elapsed()
-			if elapsed > tween.duration then
-				elapsed = tween.duration
-			end
-
-			for k, v in pairs(tween.easinglist) do
-				if k == "x" then
-					d:setX(v(elapsed))
-				elseif k == "y" then
-					d:setY(v(elapsed))
-				elseif k == "rotation" then
-					d:setRotation(v(elapsed))
-				elseif k == "scalex" then
-					d:setScaleX(v(elapsed))
-				elseif k == "scaley" then
-					d:setScaleY(v(elapsed))
-				elseif k == "skewx" then
-					d:setSkewX(v(elapsed))
-				elseif k == "skewy" then
-					d:setSkewY(v(elapsed))
-				elseif k == "width" then
-					d:setWidth(v(elapsed))
-				elseif k == "height" then
-					d:setHeight(v(elapsed))
-				end
-			end
-
-			if elapsed >= tween.duration then
-				table.remove(d._tweenlist, 1)
-				d._awatch:reset()
-			end
+	local function tween(d)
+		local t = table.remove(d._tweenlist, 1)
+		if t then
+			d._tween = d._dobj:animate(t, nil, function() tween(d) end)
 		else
+			d._tween = nil
 			d:dispatchEvent(Event.new("animate-complete"))
-			if not next(d._tweenlist) then
-				d:removeEventListener("enter-frame", listener)
-				d._awatch = nil
-			end
 		end
 	end
 
@@ -489,110 +442,98 @@ function M:animate(properties, duration, easing)
 		self._tweenlist = {}
 	end
 
-	local tween = {properties = {}, duration = duration or 1, easing = easing}
+	local t = {}
 	for k, v in pairs(properties) do
-		tween.properties[k] = v
+		t[k] = v
 	end
-	table.insert(self._tweenlist, tween)
+	t.type = "tween"
+	t.duration = duration or 1
+	t.easing = easing
+	table.insert(self._tweenlist, t)
 
-	if next(self._tweenlist) and not self._awatch then
-		self:addEventListener("enter-frame", listener)
-		self._awatch = Stopwatch.new()
+	if not self._tween then
+		tween(self)
 	end
 	return self
 end
 
 function M:spring(properties, velocity, tension, friction)
-	local function listener(d, e)
-		if d._spring and type(d._spring) == "table" and next(d._spring) then
-			local complete = true
-			local delta = d._swatch:elapsed()
-			d._swatch:reset()
-
-			for k, v in pairs(d._spring) do
-				local flag, np, nv = v(delta)
-				if flag then
-					if k == "x" then
-						d:setX(np)
-					elseif k == "y" then
-						d:setY(np)
-					elseif k == "rotation" then
-						d:setRotation(np)
-					elseif k == "scalex" then
-						d:setScaleX(np)
-					elseif k == "scaley" then
-						d:setScaleY(np)
-					elseif k == "skewx" then
-						d:setSkewX(np)
-					elseif k == "skewy" then
-						d:setSkewY(np)
-					elseif k == "width" then
-						d:setWidth(np)
-					elseif k == "height" then
-						d:setHeight(np)
-					end
-					complete = false
-				end
-			end
-			if complete then
-				d:removeEventListener("enter-frame", listener)
-				d:dispatchEvent(Event.new("animate-complete"))
-				d._spring = nil
-				d._swatch = nil
-			end
-		else
-			d:removeEventListener("enter-frame", listener)
-			d._spring = nil
-			d._swatch = nil
-		end
+	if self._spring then
+		self._spring:stop()
+		self._spring = nil
 	end
-
-	self._spring = nil
 	if properties and type(properties) == "table" and next(properties) then
-		self._spring = {}
+		local t = {}
 		for k, v in pairs(properties) do
-			local s = nil
-			if k == "x" then
-				s = self:getX()
-			elseif k == "y" then
-				s = self:getY()
-			elseif k == "rotation" then
-				s = self:getRotation()
-			elseif k == "scalex" then
-				s = self:getScaleX()
-			elseif k == "scaley" then
-				s = self:getScaleY()
-			elseif k == "skewx" then
-				s = self:getSkewX()
-			elseif k == "skewy" then
-				s = self:getSkewY()
-			elseif k == "width" then
-				s = self:getWidth()
-			elseif k == "height" then
-				s = self:getHeight()
-			end
-			if s ~= nil then
-				self._spring[k] = Spring.new(s, v, velocity, tension, friction)
-			end
-		end
-		if next(self._spring) and not self._swatch then
-			self:addEventListener("enter-frame", listener)
-			self._swatch = Stopwatch.new()
+			t[k] = v
 		end
+		t.type = "spring"
+		t.velocity = velocity
+		t.tension = tension
+		t.friction = friction
+		self._spring = self._dobj:animate(t, nil, function()
+			self._spring = nil
+			self:dispatchEvent(Event.new("animate-complete"))
+		end)
 	end
 	return self
 end
 
+function M:route(target, event)
+	local path = {}
+	while target and target ~= self do
+		table.insert(path, target)
+		target = target._parent
+	end
+	table.insert(path, self)
+	for i = #path, 1, -1 do
+		path[i]:dispatchEvent(event)
+	end
+end
+
 function M:dispatch(event)
-	self:dispatchEvent(event)
-	local children = self._children
-	for i = #children, 1, -1 do
-		children[i]:dispatch(event)
+	local kind = pointers[event.type]
+	if kind then
+		local id = event.id or "mouse"
+		local captures = self._captures
+		local target
+		if not captures then
+			captures = {}
+			self._captures = captures
+		end
+		if event.x then
+			self._px, self._py = event.x, event.y
+		end
+		if kind == 1 then
+			target = self:pick(event.x, event.y)
+			captures[id] = target
+		else
+			target = captures[id]
+			if not target and self._px then
+				target = self:pick(self._px, self._py)
+			end
+			if kind == 3 then
+				captures[id] = nil
+			end
+		end
+		self:route(target, event)
+	else
+		local list = EventDispatcher.getListeners(event.type)
+		for i = 1, list.n do
+			local v = list[i]
+			local o = v
+			while o and o ~= self do
+				o = o._parent
+			end
+			if o then
+				v:dispatchEvent(event)
+			end
+		end
 	end
 end
 
 function M:render(display)
-	self._dobj:render(display)
+	return self._dobj:render(display)
 end
 
 return M
@@ -33,8 +33,14 @@
 #include <core/l-text.h>
 #include <core/l-icon.h>
 #include <core/l-window.h>
+#include <core/l-easing.h>
 #include <core/l-dobject.h>
 
+#define MT_ANIMATION	"__mt_animation__"
+
+static const char __dobject_refs_key = 0;
+static const char __dobject_animator_key = 0;
+
 enum {
 	MFLAG_TRANSLATE					= (0x1 << 0),
 	MFLAG_ROTATE					= (0x1 << 1),
@@ -45,8 +51,33 @@ enum {
 	MFLAG_GLOBAL_MATRIX				= (0x1 << 6),
 	MFLAG_GLOBAL_BOUNDS				= (0x1 << 7),
 	MFLAG_DIRTY						= (0x1 << 8),
+	MFLAG_TREE_BOUNDS				= (0x1 << 9),
+	MFLAG_LAYOUT					= (0x1 << 10),
+	MFLAG_LAYOUT_CHILDREN			= (0x1 << 11),
+	MFLAG_TREE_DIRTY				= (0x1 << 12),
+};
+
+/*
+ * Per vm list of running animations, all of them are stepped once a frame by render.
+ * The update counters reported by render live here too, every object points at them.
+ */
+struct lanimator_t {
+	struct list_head running;
+	struct list_head pending;
+	ktime_t stamp;
+	struct ldobject_stats_t stats;
 };
 
+static struct lanimator_t * dobject_animator(lua_State * L)
+{
+	struct lanimator_t * m;
+
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__dobject_animator_key);
+	m = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return m;
+}
+
 static inline struct matrix_t * dobject_local_matrix(struct ldobject_t * o)
 {
 	struct matrix_t * m = &o->local_matrix;
@@ -99,54 +130,81 @@ static inline struct matrix_t * dobject_local_matrix(struct ldobject_t * o)
 	return m;
 }
 
-static inline struct matrix_t * dobject_global_matrix(struct ldobject_t * o)
+/*
+ * A stale global matrix is flagged on the object or on one of its ancestors,
+ * refreshing an object pushes the flags down to its direct children only.
+ */
+static void dobject_refresh(struct ldobject_t * o)
 {
 	struct matrix_t * t, * m = &o->global_matrix;
-	struct ldobject_t * p;
+	struct ldobject_t * pos;
+
 	if(o->mflag & MFLAG_GLOBAL_MATRIX)
 	{
-		p = o;
-		memcpy(m, dobject_local_matrix(p), sizeof(struct matrix_t));
-		while(p->parent)
+		if(o->parent)
 		{
-			p = p->parent;
-			t = dobject_local_matrix(p);
-			if(p->mflag & (MFLAG_ROTATE | MFLAG_SCALE | MFLAG_SKEW))
+			t = &o->parent->global_matrix;
+			if((t->a == 1) && (t->b == 0) && (t->c == 0) && (t->d == 1))
 			{
-				matrix_multiply(m, m, t);
+				memcpy(m, dobject_local_matrix(o), sizeof(struct matrix_t));
+				m->tx += t->tx;
+				m->ty += t->ty;
 			}
 			else
 			{
-				m->tx += t->tx;
-				m->ty += t->ty;
+				matrix_multiply(m, dobject_local_matrix(o), t);
 			}
 		}
+		else
+		{
+			memcpy(m, dobject_local_matrix(o), sizeof(struct matrix_t));
+		}
+		list_for_each_entry(pos, &o->children, entry)
+		{
+			pos->mflag |= MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS | MFLAG_TREE_BOUNDS;
+		}
 		o->mflag &= ~MFLAG_GLOBAL_MATRIX;
+		o->stats->matrix_updates++;
 	}
-	return m;
-}
-
-static inline struct region_t * dobject_global_bounds(struct ldobject_t * o)
-{
-	struct region_t * r = &o->global_bounds;
 	if(o->mflag & MFLAG_GLOBAL_BOUNDS)
 	{
 		double x1 = 0;
 		double y1 = 0;
 		double x2 = o->width;
 		double y2 = o->height;
-		matrix_transform_bounds(dobject_global_matrix(o), &x1, &y1, &x2, &y2);
-		region_init(r, x1, y1, x2 - x1 + 2, y2 - y1 + 2);
+		matrix_transform_bounds(m, &x1, &y1, &x2, &y2);
+		region_init(&o->global_bounds, x1, y1, x2 - x1 + 2, y2 - y1 + 2);
 		o->mflag &= ~MFLAG_GLOBAL_BOUNDS;
 	}
-	return r;
 }
 
-static inline struct region_t * dobject_parent_global_bounds(struct ldobject_t * o)
+static inline void dobject_refresh_path(struct ldobject_t * o)
+{
+	if(o->parent)
+		dobject_refresh_path(o->parent);
+	dobject_refresh(o);
+}
+
+static inline struct matrix_t * dobject_global_matrix(struct ldobject_t * o)
+{
+	dobject_refresh_path(o);
+	return &o->global_matrix;
+}
+
+static inline struct region_t * dobject_global_bounds(struct ldobject_t * o)
+{
+	dobject_refresh_path(o);
+	return &o->global_bounds;
+}
+
+/*
+ * Only valid while drawing, the render pass has refreshed the whole tree.
+ */
+static inline struct region_t * dobject_clip_bounds(struct ldobject_t * o)
 {
 	struct ldobject_t * parent = o->parent;
 	if(parent)
-		return dobject_global_bounds(parent);
+		return &parent->global_bounds;
 	return NULL;
 }
 
@@ -155,19 +213,59 @@ static inline struct region_t * dobject_dirty_bounds(struct ldobject_t * o)
 	return &o->dirty_bounds;
 }
 
-static inline void dobject_mark(struct ldobject_t * o, int mark)
+/*
+ * The tree bounds of an object is the union of its own and all descendants
+ * global bounds, a flagged object always has flagged ancestors. Clean subtrees
+ * are fully refreshed and skipped by the single pass below.
+ */
+static inline void dobject_mark_tree(struct ldobject_t * o)
 {
-	o->mflag |= mark;
+	while(o && !(o->mflag & MFLAG_TREE_BOUNDS))
+	{
+		o->mflag |= MFLAG_TREE_BOUNDS;
+		o = o->parent;
+	}
 }
 
-static void dobject_mark_children(struct ldobject_t * o, int mark)
+static struct region_t * dobject_tree_bounds(struct ldobject_t * o)
 {
+	struct region_t * r = &o->tree_bounds;
 	struct ldobject_t * pos;
 
+	if(o->mflag & MFLAG_TREE_BOUNDS)
+	{
+		dobject_refresh(o);
+		region_clone(r, &o->global_bounds);
+		list_for_each_entry(pos, &o->children, entry)
+		{
+			region_union(r, r, dobject_tree_bounds(pos));
+		}
+		o->mflag &= ~MFLAG_TREE_BOUNDS;
+	}
+	return r;
+}
+
+static inline void dobject_mark(struct ldobject_t * o, int mark)
+{
 	o->mflag |= mark;
-	list_for_each_entry(pos, &o->children, entry)
+}
+
+static inline void dobject_mark_global(struct ldobject_t * o)
+{
+	o->mflag |= MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS;
+	dobject_mark_tree(o);
+}
+
+/*
+ * Like the tree bounds, a subtree holding a dirty object is flagged up to the
+ * root, so the stage only has to test itself.
+ */
+static inline void dobject_mark_tree_dirty(struct ldobject_t * o)
+{
+	while(o && !(o->mflag & MFLAG_TREE_DIRTY))
 	{
-		dobject_mark_children(pos, mark);
+		o->mflag |= MFLAG_TREE_DIRTY;
+		o = o->parent;
 	}
 }
 
@@ -178,6 +276,8 @@ static inline void dobject_mark_dirty(struct ldobject_t * o)
 		region_clone(&o->dirty_bounds, dobject_global_bounds(o));
 		o->mflag |= MFLAG_DIRTY;
 	}
+	dobject_mark_tree_dirty(o);
+	dobject_mark_tree(o);
 }
 
 enum layout_direction_t {
@@ -496,7 +596,26 @@ static inline double dobject_layout_container_cross_size(struct ldobject_t * o)
 	return o->height;
 }
 
-static void dobject_layout(struct ldobject_t * o)
+/*
+ * A container flagged for layout re-runs flex over its children, ancestors of
+ * flagged objects carry the children bit so clean subtrees are skipped.
+ */
+static inline void dobject_mark_layout(struct ldobject_t * o)
+{
+	struct ldobject_t * p;
+
+	o->mflag |= MFLAG_LAYOUT;
+	for(p = o->parent; p && !(p->mflag & MFLAG_LAYOUT_CHILDREN); p = p->parent)
+		p->mflag |= MFLAG_LAYOUT_CHILDREN;
+}
+
+static inline void dobject_mark_layout_parent(struct ldobject_t * o)
+{
+	if(o->parent && dobject_layout_get_enable(o))
+		dobject_mark_layout(o->parent);
+}
+
+static void dobject_layout_children(struct ldobject_t * o)
 {
 	struct ldobject_t * pos;
 	double consumed, grow, shrink, cms, ccs;
@@ -508,6 +627,7 @@ static void dobject_layout(struct ldobject_t * o)
 
 	if(list_empty(&o->children))
 		return;
+	o->stats->layout_updates++;
 
 	consumed = 0;
 	grow = 0;
@@ -524,7 +644,8 @@ static void dobject_layout(struct ldobject_t * o)
 			}
 			else
 			{
-				basis = dobject_layout_main_size(pos);
+				basis = pos->layout.main = dobject_layout_main_size(pos);
+				pos->layout.cross = dobject_layout_cross_size(pos);
 				consumed += basis + dobject_layout_main_margin(pos);
 				grow += pos->layout.grow;
 				shrink += pos->layout.shrink * basis;
@@ -609,15 +730,15 @@ static void dobject_layout(struct ldobject_t * o)
 					switch(align)
 					{
 					case LAYOUT_ALIGN_START:
-						cs = dobject_layout_cross_size(pos);
+						cs = pos->layout.cross;
 						cp = dobject_layout_cross_leading_margin(pos);
 						break;
 					case LAYOUT_ALIGN_END:
-						cs = dobject_layout_cross_size(pos);
+						cs = pos->layout.cross;
 						cp = ccs - (cs + dobject_layout_cross_trailing_margin(pos));
 						break;
 					case LAYOUT_ALIGN_CENTER:
-						cs = dobject_layout_cross_size(pos);
+						cs = pos->layout.cross;
 						cp = (ccs - (cs + dobject_layout_cross_margin(pos))) / 2 + dobject_layout_cross_leading_margin(pos);
 						break;
 					case LAYOUT_ALIGN_STRETCH:
@@ -625,12 +746,12 @@ static void dobject_layout(struct ldobject_t * o)
 						cp = dobject_layout_cross_leading_margin(pos);
 						break;
 					default:
-						cs = dobject_layout_cross_size(pos);
+						cs = pos->layout.cross;
 						cp = dobject_layout_cross_leading_margin(pos);
 						break;
 					}
 
-					ms = basis = dobject_layout_main_size(pos);
+					ms = basis = pos->layout.main;
 					if((space >= 0) && (pos->layout.grow > 0))
 						ms += space * (pos->layout.grow / grow);
 					else if((space < 0) && (pos->layout.shrink > 0))
@@ -756,121 +877,88 @@ static void dobject_layout(struct ldobject_t * o)
 				pos->scalex != scalex || pos->scaley != scaley || pos->skewx != 0 || pos->skewy != 0 || pos->anchorx != 0 || pos->anchory != 0)
 			{
 				dobject_mark_dirty(pos);
+				if((pos->width != width) || (pos->height != height))
+				{
+					pos->mflag |= MFLAG_LAYOUT;
+					o->mflag |= MFLAG_LAYOUT_CHILDREN;
+				}
+				pos->width = width;
+				pos->height = height;
+				pos->x = pos->layout.x;
+				pos->y = pos->layout.y;
+				pos->rotation = 0.0;
+				pos->scalex = scalex;
+				pos->scaley = scaley;
+				pos->skewx = 0.0;
+				pos->skewy = 0.0;
+				pos->anchorx = 0.0;
+				pos->anchory = 0.0;
+				pos->mflag &= ~(MFLAG_TRANSLATE | MFLAG_ROTATE | MFLAG_SCALE | MFLAG_SKEW | MFLAG_ANCHOR);
+				pos->mflag |= MFLAG_LOCAL_MATRIX;
+				if((pos->x == 0.0) && (pos->y == 0.0))
+					pos->mflag &= ~MFLAG_TRANSLATE;
+				else
+					pos->mflag |= MFLAG_TRANSLATE;
+				if((pos->scalex == 1.0) && (pos->scaley == 1.0))
+					pos->mflag &= ~MFLAG_SCALE;
+				else
+					pos->mflag |= MFLAG_SCALE;
+				dobject_mark_global(pos);
 			}
-			pos->width = width;
-			pos->height = height;
-			pos->x = pos->layout.x;
-			pos->y = pos->layout.y;
-			pos->rotation = 0.0;
-			pos->scalex = scalex;
-			pos->scaley = scaley;
-			pos->skewx = 0.0;
-			pos->skewy = 0.0;
-			pos->anchorx = 0.0;
-			pos->anchory = 0.0;
-			pos->mflag &= ~(MFLAG_TRANSLATE | MFLAG_ROTATE | MFLAG_SCALE | MFLAG_SKEW | MFLAG_ANCHOR | MFLAG_LOCAL_MATRIX | MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
-			pos->mflag |= MFLAG_LOCAL_MATRIX | MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS;
-			if((pos->x == 0.0) && (pos->y == 0.0))
-				pos->mflag &= ~MFLAG_TRANSLATE;
-			else
-				pos->mflag |= MFLAG_TRANSLATE;
-			if((pos->scalex == 1.0) && (pos->scaley == 1.0))
-				pos->mflag &= ~MFLAG_SCALE;
-			else
-				pos->mflag |= MFLAG_SCALE;
 		}
-		dobject_layout(pos);
+	}
+}
+
+static void dobject_layout(struct ldobject_t * o)
+{
+	struct ldobject_t * pos;
+
+	if(o->mflag & MFLAG_LAYOUT)
+	{
+		o->mflag &= ~MFLAG_LAYOUT;
+		dobject_layout_children(o);
+	}
+	if(o->mflag & MFLAG_LAYOUT_CHILDREN)
+	{
+		o->mflag &= ~MFLAG_LAYOUT_CHILDREN;
+		list_for_each_entry(pos, &o->children, entry)
+		{
+			if(pos->mflag & (MFLAG_LAYOUT | MFLAG_LAYOUT_CHILDREN))
+				dobject_layout(pos);
+		}
 	}
 }
 
 static void dobject_draw_image(struct ldobject_t * o, struct window_t * w)
 {
 	struct limage_t * img = o->priv;
-	surface_blit(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), img->s, RENDER_TYPE_GOOD);
+	surface_blit(w->s, dobject_clip_bounds(o), &o->global_matrix, img->s, RENDER_TYPE_GOOD);
 }
 
 static void dobject_draw_ninepatch(struct ldobject_t * o, struct window_t * w)
 {
 	struct lninepatch_t * ninepatch = o->priv;
-	struct surface_t * s = w->s;
-	struct matrix_t m;
-	if(ninepatch->lt)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, 0);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lt, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->mt)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, 0);
-		matrix_scale(&m, ninepatch->__sx, 1);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mt, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->rt)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, 0);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rt, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->lm)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, ninepatch->top);
-		matrix_scale(&m, 1, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lm, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->mm)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, ninepatch->top);
-		matrix_scale(&m, ninepatch->__sx, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mm, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->rm)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, ninepatch->top);
-		matrix_scale(&m, 1, ninepatch->__sy);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rm, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->lb)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, 0, ninepatch->__h - ninepatch->bottom);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->lb, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->mb)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->left, ninepatch->__h - ninepatch->bottom);
-		matrix_scale(&m, ninepatch->__sx, 1);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->mb, RENDER_TYPE_FAST);
-	}
-	if(ninepatch->rb)
-	{
-		memcpy(&m, dobject_global_matrix(o), sizeof(struct matrix_t));
-		matrix_translate(&m, ninepatch->__w - ninepatch->right, ninepatch->__h - ninepatch->bottom);
-		surface_blit(s, dobject_parent_global_bounds(o), &m, ninepatch->rb, RENDER_TYPE_FAST);
-	}
+	struct surface_t * s = ninepatch_surface(ninepatch);
+	if(s)
+		surface_blit(w->s, dobject_clip_bounds(o), &o->global_matrix, s, RENDER_TYPE_FAST);
 }
 
 static void dobject_draw_text(struct ldobject_t * o, struct window_t * w)
 {
 	struct ltext_t * text = o->priv;
-	surface_text(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), &text->txt);
+	surface_text(w->s, dobject_clip_bounds(o), &o->global_matrix, &text->txt);
 }
 
 static void dobject_draw_icon(struct ldobject_t * o, struct window_t * w)
 {
 	struct licon_t * icon = o->priv;
-	surface_icon(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), &icon->ico);
+	surface_icon(w->s, dobject_clip_bounds(o), &o->global_matrix, &icon->ico);
 }
 
 static void dobject_draw_container(struct ldobject_t * o, struct window_t * w)
 {
 	if(o->bgcolor.a != 0)
-		surface_fill(w->s, dobject_parent_global_bounds(o), dobject_global_matrix(o), o->width, o->height, &o->bgcolor, RENDER_TYPE_GOOD);
+		surface_fill(w->s, dobject_clip_bounds(o), &o->global_matrix, o->width, o->height, &o->bgcolor, RENDER_TYPE_GOOD);
 }
 
 static int l_dobject_new(lua_State * L)
@@ -948,11 +1036,17 @@ static int l_dobject_new(lua_State * L)
 	matrix_init_identity(&o->global_matrix);
 	region_init(&o->global_bounds, o->x, o->y, o->width, o->height);
 	region_init(&o->dirty_bounds, o->x, o->y, o->width, o->height);
+	region_init(&o->tree_bounds, o->x, o->y, o->width, o->height);
+	o->stats = &dobject_animator(L)->stats;
 	o->dtype = dtype;
 	o->draw = draw;
 	o->priv = userdata;
 
 	luaL_setmetatable(L, MT_DOBJECT);
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__dobject_refs_key);
+	lua_pushvalue(L, -2);
+	lua_rawsetp(L, -2, o);
+	lua_pop(L, 1);
 	return 1;
 }
 
@@ -986,7 +1080,7 @@ static int m_add_child(lua_State * L)
 		{
 			dobject_mark_dirty(c);
 			c->parent = o;
-			list_add_tail(&c->entry, &o->children);
+			list_move_tail(&c->entry, &o->children);
 		}
 		else
 		{
@@ -995,7 +1089,11 @@ static int m_add_child(lua_State * L)
 			c->mflag &= ~MFLAG_DIRTY;
 			dobject_mark_dirty(c);
 		}
-		dobject_mark_children(c, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(c);
+		dobject_mark_tree(o);
+		dobject_mark_tree_dirty(o);
+		dobject_mark_layout(o);
+		o->mflag |= MFLAG_LAYOUT_CHILDREN;
 	}
 	return 0;
 }
@@ -1013,6 +1111,7 @@ static int m_remove_child(lua_State * L)
 		{
 			region_clone(r, dobject_dirty_bounds(c));
 			o->mflag |= MFLAG_DIRTY;
+			dobject_mark_tree_dirty(o);
 		}
 		else
 		{
@@ -1021,7 +1120,8 @@ static int m_remove_child(lua_State * L)
 		c->mflag &= ~MFLAG_DIRTY;
 		c->parent = NULL;
 		list_del_init(&c->entry);
-		dobject_mark_children(c, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(c);
+		dobject_mark_layout(o);
 	}
 	return 0;
 }
@@ -1033,6 +1133,7 @@ static int m_to_front(lua_State * L)
 	{
 		dobject_mark_dirty(o);
 		list_move_tail(&o->entry, &o->parent->children);
+		dobject_mark_layout(o->parent);
 	}
 	return 0;
 }
@@ -1044,6 +1145,7 @@ static int m_to_back(lua_State * L)
 	{
 		dobject_mark_dirty(o);
 		list_move(&o->entry, &o->parent->children);
+		dobject_mark_layout(o->parent);
 	}
 	return 0;
 }
@@ -1058,7 +1160,9 @@ static int m_set_width(lua_State * L)
 		o->width = width;
 		o->layout.width = NAN;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1080,7 +1184,9 @@ static int m_set_height(lua_State * L)
 		o->height = height;
 		o->layout.height = NAN;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1105,7 +1211,9 @@ static int m_set_size(lua_State * L)
 		o->layout.width = NAN;
 		o->layout.height = NAN;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1131,7 +1239,8 @@ static int m_set_x(lua_State * L)
 		else
 			o->mflag |= MFLAG_TRANSLATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1156,7 +1265,8 @@ static int m_set_y(lua_State * L)
 		else
 			o->mflag |= MFLAG_TRANSLATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1183,7 +1293,8 @@ static int m_set_position(lua_State * L)
 		else
 			o->mflag |= MFLAG_TRANSLATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1209,7 +1320,8 @@ static int m_set_rotation(lua_State * L)
 		else
 			o->mflag |= MFLAG_ROTATE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1234,7 +1346,8 @@ static int m_set_scale_x(lua_State * L)
 		else
 			o->mflag |= MFLAG_SCALE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1259,7 +1372,8 @@ static int m_set_scale_y(lua_State * L)
 		else
 			o->mflag |= MFLAG_SCALE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1286,7 +1400,8 @@ static int m_set_scale(lua_State * L)
 		else
 			o->mflag |= MFLAG_SCALE;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1312,7 +1427,8 @@ static int m_set_skew_x(lua_State * L)
 		else
 			o->mflag |= MFLAG_SKEW;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1337,7 +1453,8 @@ static int m_set_skew_y(lua_State * L)
 		else
 			o->mflag |= MFLAG_SKEW;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1364,7 +1481,8 @@ static int m_set_skew(lua_State * L)
 		else
 			o->mflag |= MFLAG_SKEW;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1392,7 +1510,8 @@ static int m_set_archor(lua_State * L)
 		else
 			o->mflag |= MFLAG_ANCHOR;
 		dobject_mark(o, MFLAG_LOCAL_MATRIX);
-		dobject_mark_children(o, MFLAG_GLOBAL_MATRIX | MFLAG_GLOBAL_BOUNDS);
+		dobject_mark_global(o);
+		dobject_mark_layout_parent(o);
 	}
 	return 0;
 }
@@ -1430,6 +1549,8 @@ static int m_set_layout_enable(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	dobject_layout_set_enable(o, lua_toboolean(L, 2));
+	if(o->parent)
+		dobject_mark_layout(o->parent);
 	return 0;
 }
 
@@ -1444,6 +1565,7 @@ static int m_set_layout_special(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	dobject_layout_set_special(o, lua_toboolean(L, 2));
+	dobject_mark_layout_parent(o);
 	return 0;
 }
 
@@ -1475,6 +1597,7 @@ static int m_set_layout_direction(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout(o);
 	return 0;
 }
 
@@ -1529,6 +1652,7 @@ static int m_set_layout_justify(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout(o);
 	return 0;
 }
 
@@ -1583,6 +1707,7 @@ static int m_set_layout_align(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout(o);
 	return 0;
 }
 
@@ -1634,6 +1759,7 @@ static int m_set_layout_align_self(lua_State * L)
 	default:
 		break;
 	}
+	dobject_mark_layout_parent(o);
 	return 0;
 }
 
@@ -1668,6 +1794,7 @@ static int m_set_layout_grow(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	o->layout.grow = luaL_checknumber(L, 2);
+	dobject_mark_layout_parent(o);
 	return 0;
 }
 
@@ -1682,6 +1809,7 @@ static int m_set_layout_shrink(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	o->layout.shrink = luaL_checknumber(L, 2);
+	dobject_mark_layout_parent(o);
 	return 0;
 }
 
@@ -1696,6 +1824,7 @@ static int m_set_layout_basis(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	o->layout.basis = luaL_checknumber(L, 2);
+	dobject_mark_layout_parent(o);
 	return 0;
 }
 
@@ -1713,6 +1842,7 @@ static int m_set_layout_margin(lua_State * L)
 	o->layout.margin.top = luaL_optnumber(L, 3, 0);
 	o->layout.margin.right = luaL_optnumber(L, 4, 0);
 	o->layout.margin.bottom = luaL_optnumber(L, 5, 0);
+	dobject_mark_layout_parent(o);
 	return 0;
 }
 
@@ -2008,14 +2138,12 @@ static inline int polygon_hit_test_point(struct ldobject_t * o, double x, double
 	return c;
 }
 
-static int m_hit_test_point(lua_State * L)
+static int dobject_hit_test_point(struct ldobject_t * o, double x, double y)
 {
-	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	int hit = 0;
 	if(o->visible && o->touchable)
 	{
-		double nx, x = luaL_checknumber(L, 2);
-		double ny, y = luaL_checknumber(L, 3);
+		double nx, ny;
 		struct matrix_t * m = dobject_global_matrix(o);
 		double id = 1.0 / (m->a * m->d - m->c * m->b);
 		nx = ((x - m->tx) * m->d + (m->ty - y) * m->c) * id;
@@ -2045,10 +2173,51 @@ static int m_hit_test_point(lua_State * L)
 			break;
 		}
 	}
-	lua_pushboolean(L, hit);
+	return hit;
+}
+
+static int m_hit_test_point(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	double x = luaL_checknumber(L, 2);
+	double y = luaL_checknumber(L, 3);
+	lua_pushboolean(L, dobject_hit_test_point(o, x, y));
 	return 1;
 }
 
+static struct ldobject_t * dobject_pick(struct ldobject_t * o, double x, double y)
+{
+	struct ldobject_t * pos, * hit;
+
+	if(!o->visible || !region_hit(dobject_tree_bounds(o), x, y))
+		return NULL;
+	list_for_each_entry_reverse(pos, &o->children, entry)
+	{
+		if((hit = dobject_pick(pos, x, y)))
+			return hit;
+	}
+	if(dobject_hit_test_point(o, x, y))
+		return o;
+	return NULL;
+}
+
+static int m_pick(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	double x = luaL_checknumber(L, 2);
+	double y = luaL_checknumber(L, 3);
+	struct ldobject_t * hit;
+	dobject_refresh_path(o);
+	hit = dobject_pick(o, x, y);
+	if(hit)
+	{
+		lua_rawgetp(L, LUA_REGISTRYINDEX, &__dobject_refs_key);
+		lua_rawgetp(L, -1, hit);
+		return 1;
+	}
+	return 0;
+}
+
 static int m_mark_dirty(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
@@ -2067,10 +2236,19 @@ static int m_get_bounds(lua_State * L)
 	return 4;
 }
 
+static int m_is_dirty(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	lua_pushboolean(L, (o->mflag & MFLAG_TREE_DIRTY) ? 1 : 0);
+	return 1;
+}
+
 static void window_region_list_fill(struct window_t * w, struct ldobject_t * o)
 {
 	struct ldobject_t * pos;
 
+	if(!(o->mflag & MFLAG_TREE_DIRTY))
+		return;
 	if(o->mflag & MFLAG_DIRTY)
 	{
 		window_region_list_add(w, dobject_global_bounds(o));
@@ -2082,6 +2260,7 @@ static void window_region_list_fill(struct window_t * w, struct ldobject_t * o)
 	{
 		window_region_list_fill(w, pos);
 	}
+	o->mflag &= ~MFLAG_TREE_DIRTY;
 }
 
 static void display_draw(struct window_t * w, struct ldobject_t * o)
@@ -2098,18 +2277,606 @@ static void display_draw(struct window_t * w, struct ldobject_t * o)
 	}
 }
 
+enum dobject_prop_t {
+	DOBJECT_PROP_X					= 0,
+	DOBJECT_PROP_Y					= 1,
+	DOBJECT_PROP_ROTATION			= 2,
+	DOBJECT_PROP_SCALEX				= 3,
+	DOBJECT_PROP_SCALEY				= 4,
+	DOBJECT_PROP_SKEWX				= 5,
+	DOBJECT_PROP_SKEWY				= 6,
+	DOBJECT_PROP_WIDTH				= 7,
+	DOBJECT_PROP_HEIGHT				= 8,
+	DOBJECT_PROP_MAX				= 9,
+};
+
+static const char * dobject_prop_names[DOBJECT_PROP_MAX] = {
+	"x", "y", "rotation", "scalex", "scaley", "skewx", "skewy", "width", "height",
+};
+
+static double dobject_get_prop(struct ldobject_t * o, enum dobject_prop_t prop)
+{
+	switch(prop)
+	{
+	case DOBJECT_PROP_X:
+		return o->x;
+	case DOBJECT_PROP_Y:
+		return o->y;
+	case DOBJECT_PROP_ROTATION:
+		return o->rotation * (180.0 / M_PI);
+	case DOBJECT_PROP_SCALEX:
+		return o->scalex;
+	case DOBJECT_PROP_SCALEY:
+		return o->scaley;
+	case DOBJECT_PROP_SKEWX:
+		return o->skewx * (180.0 / M_PI);
+	case DOBJECT_PROP_SKEWY:
+		return o->skewy * (180.0 / M_PI);
+	case DOBJECT_PROP_WIDTH:
+		return o->width;
+	case DOBJECT_PROP_HEIGHT:
+		return o->height;
+	default:
+		break;
+	}
+	return 0;
+}
+
+/*
+ * Same marking as the lua setters, with angles in degrees
+ */
+static void dobject_set_prop(struct ldobject_t * o, enum dobject_prop_t prop, double v)
+{
+	switch(prop)
+	{
+	case DOBJECT_PROP_X:
+	case DOBJECT_PROP_Y:
+		if(((prop == DOBJECT_PROP_X) ? o->x : o->y) == v)
+			return;
+		dobject_mark_dirty(o);
+		if(prop == DOBJECT_PROP_X)
+			o->x = v;
+		else
+			o->y = v;
+		if((o->x == 0.0) && (o->y == 0.0))
+			o->mflag &= ~MFLAG_TRANSLATE;
+		else
+			o->mflag |= MFLAG_TRANSLATE;
+		break;
+	case DOBJECT_PROP_ROTATION:
+		v *= (M_PI / 180.0);
+		if(o->rotation == v)
+			return;
+		dobject_mark_dirty(o);
+		o->rotation = v;
+		if(o->rotation == 0.0)
+			o->mflag &= ~MFLAG_ROTATE;
+		else
+			o->mflag |= MFLAG_ROTATE;
+		break;
+	case DOBJECT_PROP_SCALEX:
+	case DOBJECT_PROP_SCALEY:
+		if(((prop == DOBJECT_PROP_SCALEX) ? o->scalex : o->scaley) == v)
+			return;
+		dobject_mark_dirty(o);
+		if(prop == DOBJECT_PROP_SCALEX)
+			o->scalex = v;
+		else
+			o->scaley = v;
+		if((o->scalex == 1.0) && (o->scaley == 1.0))
+			o->mflag &= ~MFLAG_SCALE;
+		else
+			o->mflag |= MFLAG_SCALE;
+		break;
+	case DOBJECT_PROP_SKEWX:
+	case DOBJECT_PROP_SKEWY:
+		v *= (M_PI / 180.0);
+		if(((prop == DOBJECT_PROP_SKEWX) ? o->skewx : o->skewy) == v)
+			return;
+		dobject_mark_dirty(o);
+		if(prop == DOBJECT_PROP_SKEWX)
+			o->skewx = v;
+		else
+			o->skewy = v;
+		if((o->skewx == 0.0) && (o->skewy == 0.0))
+			o->mflag &= ~MFLAG_SKEW;
+		else
+			o->mflag |= MFLAG_SKEW;
+		break;
+	case DOBJECT_PROP_WIDTH:
+		if(o->width == v)
+			return;
+		dobject_mark_dirty(o);
+		o->width = v;
+		o->layout.width = NAN;
+		dobject_mark_layout(o);
+		break;
+	case DOBJECT_PROP_HEIGHT:
+		if(o->height == v)
+			return;
+		dobject_mark_dirty(o);
+		o->height = v;
+		o->layout.height = NAN;
+		dobject_mark_layout(o);
+		break;
+	default:
+		return;
+	}
+	dobject_mark(o, MFLAG_LOCAL_MATRIX);
+	dobject_mark_global(o);
+	dobject_mark_layout_parent(o);
+}
+
+enum anim_type_t {
+	ANIM_TYPE_TWEEN					= 0,
+	ANIM_TYPE_SPRING				= 1,
+	ANIM_TYPE_SEQUENCE				= 2,
+	ANIM_TYPE_GROUP					= 3,
+};
+
+struct anim_track_t {
+	enum dobject_prop_t prop;
+	double * keys;
+	int nkeys;
+	double from;
+	struct spring_t spring;
+};
+
+/*
+ * A node of an animation tree, tweens and springs drive the tracks of
+ * their target, sequences and groups run their children one after
+ * another or side by side.
+ */
+struct anim_t {
+	struct list_head entry;
+	struct list_head children;
+	struct anim_t * cursor;
+	enum anim_type_t type;
+	struct ldobject_t * target;
+	struct anim_track_t tracks[DOBJECT_PROP_MAX];
+	int ntracks;
+	struct leasing_t easing;
+	double duration;
+	double elapsed;
+	double velocity;
+	double tension;
+	double friction;
+	int started;
+	int done;
+};
+
+enum {
+	ANIMATION_RUNNING				= (0x1 << 0),
+	ANIMATION_STARTED				= (0x1 << 1),
+	ANIMATION_EVENT_START			= (0x1 << 2),
+	ANIMATION_EVENT_FINISH			= (0x1 << 3),
+};
+
+struct lanimation_t {
+	struct list_head entry;
+	struct anim_t * root;
+	int state;
+	int ref;
+};
+
+static void anim_free(struct anim_t * a)
+{
+	struct anim_t * pos, * n;
+	int i;
+
+	if(a)
+	{
+		list_for_each_entry_safe(pos, n, &a->children, entry)
+		{
+			anim_free(pos);
+		}
+		for(i = 0; i < a->ntracks; i++)
+			free(a->tracks[i].keys);
+		free(a);
+	}
+}
+
+static void anim_parse(lua_State * L, int idx, struct lanimation_t * h, struct anim_t * parent, struct ldobject_t * target, int refs)
+{
+	struct anim_t * a;
+	struct anim_track_t * t;
+	struct ldobject_t * o;
+	const char * type;
+	int i, j, n;
+
+	a = malloc(sizeof(struct anim_t));
+	if(!a)
+		return;
+	memset(a, 0, sizeof(struct anim_t));
+	init_list_head(&a->entry);
+	init_list_head(&a->children);
+	if(parent)
+		list_add_tail(&a->entry, &parent->children);
+	else
+		h->root = a;
+
+	lua_getfield(L, idx, "target");
+	if((o = luaL_testudata(L, -1, MT_DOBJECT)))
+	{
+		lua_pushvalue(L, -1);
+		lua_rawsetp(L, refs, o);
+		target = o;
+	}
+	lua_pop(L, 1);
+	a->target = target;
+
+	lua_getfield(L, idx, "type");
+	type = lua_tostring(L, -1);
+	if(type)
+	{
+		switch(shash(type))
+		{
+		case 0x1c4b4df8: /* "spring" */
+			a->type = ANIM_TYPE_SPRING;
+			break;
+		case 0x0c15489e: /* "sequence" */
+			a->type = ANIM_TYPE_SEQUENCE;
+			break;
+		case 0x0f8746f2: /* "group" */
+			a->type = ANIM_TYPE_GROUP;
+			break;
+		default:
+			a->type = ANIM_TYPE_TWEEN;
+			break;
+		}
+	}
+	else
+		a->type = (lua_rawlen(L, idx) > 0) ? ANIM_TYPE_SEQUENCE : ANIM_TYPE_TWEEN;
+	lua_pop(L, 1);
+
+	if((a->type == ANIM_TYPE_SEQUENCE) || (a->type == ANIM_TYPE_GROUP))
+	{
+		n = lua_rawlen(L, idx);
+		for(i = 1; i <= n; i++)
+		{
+			if(lua_rawgeti(L, idx, i) == LUA_TTABLE)
+				anim_parse(L, lua_gettop(L), h, a, target, refs);
+			lua_pop(L, 1);
+		}
+		return;
+	}
+
+	lua_getfield(L, idx, "duration");
+	a->duration = luaL_optnumber(L, -1, 1);
+	if(a->duration < 0)
+		a->duration = 0;
+	lua_getfield(L, idx, "easing");
+	leasing_init(L, -1, &a->easing, 0, 1, 1);
+	lua_getfield(L, idx, "velocity");
+	a->velocity = luaL_optnumber(L, -1, 0);
+	lua_getfield(L, idx, "tension");
+	a->tension = luaL_optnumber(L, -1, 500);
+	lua_getfield(L, idx, "friction");
+	a->friction = luaL_optnumber(L, -1, 60);
+	lua_pop(L, 5);
+
+	for(i = 0; i < DOBJECT_PROP_MAX; i++)
+	{
+		t = &a->tracks[a->ntracks];
+		switch(lua_getfield(L, idx, dobject_prop_names[i]))
+		{
+		case LUA_TNUMBER:
+			if((t->keys = malloc(sizeof(double))))
+			{
+				t->keys[0] = lua_tonumber(L, -1);
+				t->nkeys = 1;
+			}
+			break;
+		case LUA_TTABLE:
+			n = lua_rawlen(L, -1);
+			if((n > 0) && (t->keys = malloc(sizeof(double) * n)))
+			{
+				for(j = 0; j < n; j++)
+				{
+					lua_rawgeti(L, -1, j + 1);
+					t->keys[j] = lua_tonumber(L, -1);
+					lua_pop(L, 1);
+				}
+				t->nkeys = n;
+			}
+			break;
+		default:
+			break;
+		}
+		lua_pop(L, 1);
+		if(t->nkeys > 0)
+		{
+			t->prop = i;
+			a->ntracks++;
+		}
+	}
+}
+
+static void anim_start(struct anim_t * a)
+{
+	struct anim_track_t * t;
+	struct anim_t * pos;
+	int i;
+
+	for(i = 0; i < a->ntracks; i++)
+	{
+		t = &a->tracks[i];
+		t->from = dobject_get_prop(a->target, t->prop);
+		if(a->type == ANIM_TYPE_SPRING)
+			spring_init(&t->spring, t->from, t->keys[t->nkeys - 1], a->velocity, a->tension, a->friction);
+	}
+	list_for_each_entry(pos, &a->children, entry)
+	{
+		pos->started = 0;
+	}
+	a->cursor = list_empty(&a->children) ? NULL : list_first_entry(&a->children, struct anim_t, entry);
+	a->elapsed = 0;
+	a->done = 0;
+	a->started = 1;
+}
+
+/*
+ * Keyframes are spaced evenly over the eased progress, starting from the captured value
+ */
+static inline double anim_track_value(struct anim_track_t * t, double p)
+{
+	double s = p * t->nkeys;
+	double a, b;
+	int i = floor(s);
+
+	if(i < 0)
+		i = 0;
+	else if(i > t->nkeys - 1)
+		i = t->nkeys - 1;
+	a = (i == 0) ? t->from : t->keys[i - 1];
+	b = t->keys[i];
+	return a + (b - a) * (s - i);
+}
+
+/*
+ * Advance by dt seconds, the time left over after finishing is given back
+ * through dt so that a sequence can hand it on to the next child.
+ */
+static int anim_step(struct anim_t * a, double * dt)
+{
+	struct anim_track_t * t;
+	struct anim_t * pos;
+	double left, d, p;
+	int running, i;
+
+	if(!a->started)
+		anim_start(a);
+	switch(a->type)
+	{
+	case ANIM_TYPE_TWEEN:
+		if(*dt >= a->duration - a->elapsed)
+		{
+			*dt -= a->duration - a->elapsed;
+			a->elapsed = a->duration;
+			for(i = 0; i < a->ntracks; i++)
+			{
+				t = &a->tracks[i];
+				dobject_set_prop(a->target, t->prop, t->keys[t->nkeys - 1]);
+			}
+			return 1;
+		}
+		a->elapsed += *dt;
+		*dt = 0;
+		p = a->easing.func(&a->easing, a->elapsed / a->duration);
+		for(i = 0; i < a->ntracks; i++)
+		{
+			t = &a->tracks[i];
+			dobject_set_prop(a->target, t->prop, anim_track_value(t, p));
+		}
+		return 0;
+
+	case ANIM_TYPE_SPRING:
+		running = 0;
+		for(i = 0; i < a->ntracks; i++)
+		{
+			t = &a->tracks[i];
+			if(spring_step(&t->spring, *dt))
+				running = 1;
+			dobject_set_prop(a->target, t->prop, spring_position(&t->spring));
+		}
+		*dt = 0;
+		return !running;
+
+	case ANIM_TYPE_SEQUENCE:
+		while(a->cursor)
+		{
+			if(!anim_step(a->cursor, dt))
+				return 0;
+			if(list_is_last(&a->cursor->entry, &a->children))
+				a->cursor = NULL;
+			else
+				a->cursor = list_next_entry(a->cursor, entry);
+		}
+		return 1;
+
+	case ANIM_TYPE_GROUP:
+		running = 0;
+		left = *dt;
+		list_for_each_entry(pos, &a->children, entry)
+		{
+			if(!pos->done)
+			{
+				d = *dt;
+				if(anim_step(pos, &d))
+				{
+					pos->done = 1;
+					if(d < left)
+						left = d;
+				}
+				else
+					running = 1;
+			}
+		}
+		*dt = running ? 0 : left;
+		return !running;
+
+	default:
+		break;
+	}
+	return 1;
+}
+
+/*
+ * Advance every running animation, then fire the start and finish callbacks once
+ * all nodes are written, so a callback may freely start or stop animations.
+ */
+static int dobject_animate(lua_State * L)
+{
+	struct lanimator_t * m = dobject_animator(L);
+	struct lanimation_t * pos, * n;
+	ktime_t now = ktime_get();
+	double dt, d;
+	int state, count = 0;
+
+	dt = (double)ktime_us_delta(now, m->stamp) / 1000000.0;
+	if(dt < 0)
+		dt = 0;
+	m->stamp = now;
+
+	list_for_each_entry_safe(pos, n, &m->running, entry)
+	{
+		if(!(pos->state & ANIMATION_STARTED))
+			pos->state |= ANIMATION_STARTED | ANIMATION_EVENT_START;
+		d = dt;
+		if(anim_step(pos->root, &d))
+		{
+			pos->state &= ~ANIMATION_RUNNING;
+			pos->state |= ANIMATION_EVENT_FINISH;
+		}
+		if(pos->state & (ANIMATION_EVENT_START | ANIMATION_EVENT_FINISH))
+			list_move_tail(&pos->entry, &m->pending);
+	}
+
+	while(!list_empty(&m->pending))
+	{
+		pos = list_first_entry(&m->pending, struct lanimation_t, entry);
+		state = pos->state;
+		pos->state &= ~(ANIMATION_EVENT_START | ANIMATION_EVENT_FINISH);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, pos->ref);
+		if(state & ANIMATION_EVENT_FINISH)
+		{
+			list_del_init(&pos->entry);
+			luaL_unref(L, LUA_REGISTRYINDEX, pos->ref);
+			pos->ref = LUA_NOREF;
+		}
+		else
+			list_move_tail(&pos->entry, &m->running);
+		lua_getiuservalue(L, -1, 1);
+		if((state & ANIMATION_EVENT_START) && (lua_rawgeti(L, -1, 1) == LUA_TFUNCTION))
+			lua_call(L, 0, 0);
+		else
+			lua_pop(L, 1);
+		if((state & ANIMATION_EVENT_FINISH) && (lua_rawgeti(L, -1, 2) == LUA_TFUNCTION))
+			lua_call(L, 0, 0);
+		else
+			lua_pop(L, 1);
+		lua_pop(L, 2);
+	}
+
+	list_for_each_entry(pos, &m->running, entry)
+	{
+		count++;
+	}
+	return count;
+}
+
+static int m_animate(lua_State * L)
+{
+	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
+	struct lanimator_t * m = dobject_animator(L);
+	struct lanimation_t * h;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	h = lua_newuserdatauv(L, sizeof(struct lanimation_t), 1);
+	init_list_head(&h->entry);
+	h->root = NULL;
+	h->state = 0;
+	h->ref = LUA_NOREF;
+	luaL_setmetatable(L, MT_ANIMATION);
+	lua_createtable(L, 2, 1);
+	lua_pushvalue(L, 3);
+	lua_rawseti(L, -2, 1);
+	lua_pushvalue(L, 4);
+	lua_rawseti(L, -2, 2);
+	lua_pushvalue(L, 1);
+	lua_rawsetp(L, -2, o);
+	anim_parse(L, 2, h, NULL, o, lua_gettop(L));
+	lua_setiuservalue(L, -2, 1);
+
+	if(h->root)
+	{
+		if(list_empty(&m->running) && list_empty(&m->pending))
+			m->stamp = ktime_get();
+		list_add_tail(&h->entry, &m->running);
+		lua_pushvalue(L, -1);
+		h->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		h->state = ANIMATION_RUNNING;
+		dobject_mark_dirty(o);
+	}
+	return 1;
+}
+
+static int m_animation_gc(lua_State * L)
+{
+	struct lanimation_t * h = luaL_checkudata(L, 1, MT_ANIMATION);
+	anim_free(h->root);
+	h->root = NULL;
+	return 0;
+}
+
+static int m_animation_stop(lua_State * L)
+{
+	struct lanimation_t * h = luaL_checkudata(L, 1, MT_ANIMATION);
+	if(!list_empty(&h->entry))
+	{
+		list_del_init(&h->entry);
+		luaL_unref(L, LUA_REGISTRYINDEX, h->ref);
+		h->ref = LUA_NOREF;
+	}
+	h->state = 0;
+	return 0;
+}
+
+static int m_animation_is_running(lua_State * L)
+{
+	struct lanimation_t * h = luaL_checkudata(L, 1, MT_ANIMATION);
+	lua_pushboolean(L, h->state & ANIMATION_RUNNING);
+	return 1;
+}
+
+static const luaL_Reg m_animation[] = {
+	{"__gc",				m_animation_gc},
+	{"stop",				m_animation_stop},
+	{"isRunning",			m_animation_is_running},
+	{NULL, NULL}
+};
+
 static int m_render(lua_State * L)
 {
 	struct ldobject_t * o = luaL_checkudata(L, 1, MT_DOBJECT);
 	struct window_t * w = luaL_checkudata(L, 2, MT_WINDOW);
+	struct ldobject_stats_t * stats = o->stats;
+	int animations = dobject_animate(L);
 	if(window_is_active(w))
 	{
 		dobject_layout(o);
+		dobject_refresh_path(o);
+		dobject_tree_bounds(o);
 		window_region_list_clear(w);
 		window_region_list_fill(w, o);
 		window_present(w, o, (void (*)(struct window_t *, void *))display_draw);
 	}
-	return 0;
+	lua_pushinteger(L, stats->matrix_updates);
+	lua_pushinteger(L, stats->layout_updates);
+	lua_pushinteger(L, animations);
+	stats->matrix_updates = 0;
+	stats->layout_updates = 0;
+	return 3;
 }
 
 static const luaL_Reg m_dobject[] = {
@@ -2177,15 +2944,42 @@ static const luaL_Reg m_dobject[] = {
 	{"globalToLocal",		m_global_to_local},
 	{"localToGlobal",		m_local_to_global},
 	{"hitTestPoint",		m_hit_test_point},
+	{"pick",				m_pick},
 	{"markDirty",			m_mark_dirty},
+	{"isDirty",				m_is_dirty},
 	{"getBounds",			m_get_bounds},
+	{"animate",				m_animate},
 	{"render",				m_render},
 	{NULL, NULL}
 };
 
 int luaopen_dobject(lua_State * L)
 {
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__dobject_refs_key);
+	if(lua_isnil(L, -1))
+	{
+		lua_newtable(L);
+		lua_newtable(L);
+		lua_pushstring(L, "v");
+		lua_setfield(L, -2, "__mode");
+		lua_setmetatable(L, -2);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &__dobject_refs_key);
+	}
+	lua_pop(L, 1);
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__dobject_animator_key);
+	if(lua_isnil(L, -1))
+	{
+		struct lanimator_t * m = lua_newuserdatauv(L, sizeof(struct lanimator_t), 0);
+		init_list_head(&m->running);
+		init_list_head(&m->pending);
+		m->stamp = ktime_get();
+		m->stats.matrix_updates = 0;
+		m->stats.layout_updates = 0;
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &__dobject_animator_key);
+	}
+	lua_pop(L, 1);
 	luaL_newlib(L, l_dobject);
 	luahelper_create_metatable(L, MT_DOBJECT, m_dobject);
+	luahelper_create_metatable(L, MT_ANIMATION, m_animation);
 	return 1;
 }
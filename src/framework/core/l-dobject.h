@@ -28,6 +28,11 @@ enum collider_type_t {
 	COLLIDER_TYPE_POLYGON			= 5,
 };
 
+struct ldobject_stats_t {
+	unsigned int matrix_updates;
+	unsigned int layout_updates;
+};
+
 struct ldobject_t {
 	struct ldobject_t * parent;
 	struct list_head entry;
@@ -55,6 +60,7 @@ struct ldobject_t {
 			double bottom;
 		} margin;
 
+		double main, cross;
 		double x, y;
 		double w, h;
 	} layout;
@@ -102,6 +108,8 @@ struct ldobject_t {
 	struct matrix_t global_matrix;
 	struct region_t global_bounds;
 	struct region_t dirty_bounds;
+	struct region_t tree_bounds;
+	struct ldobject_stats_t * stats;
 
 	void (*draw)(struct ldobject_t * o, struct window_t * w);
 	void * priv;
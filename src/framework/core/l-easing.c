@@ -29,23 +29,6 @@
 #include <xboot.h>
 #include <core/l-easing.h>
 
-/*
- * t = elapsed time
- * b = begin value
- * c = change value (ending - beginning)
- * d = duration (total time)
- * func = easing function will be invoked in '__call' method
- */
-struct leasing_t {
-	double b;
-	double c;
-	double d;
-	double ax, bx, cx;
-	double ay, by, cy;
-	double start, end;
-	double (*func)(struct leasing_t * e, double t);
-};
-
 static double linear(struct leasing_t * e, double t)
 {
 	return e->c * t / e->d + e->b;
@@ -475,16 +458,21 @@ static double cubic_bezier(struct leasing_t * e, double t)
 	return e->c * r / e->d + e->b;
 }
 
-static int l_new(lua_State * L)
+void leasing_init(lua_State * L, int idx, struct leasing_t * e, double b, double c, double d)
 {
-	double b = luaL_optnumber(L, 1, 0);
-	double c = luaL_optnumber(L, 2, 1);
-	double d = luaL_optnumber(L, 3, 1);
-	struct leasing_t * e;
-	if(lua_isstring(L, 4))
+	struct leasing_t * o;
+
+	idx = lua_absindex(L, idx);
+	if((o = luaL_testudata(L, idx, MT_EASING)))
 	{
-		const char * type = luaL_optstring(L, 4, "linear");
-		e = lua_newuserdata(L, sizeof(struct leasing_t));
+		memcpy(e, o, sizeof(struct leasing_t));
+		e->b = b;
+		e->c = c;
+		e->d = d;
+	}
+	else if(lua_isstring(L, idx))
+	{
+		const char * type = lua_tostring(L, idx);
 		e->b = b;
 		e->c = c;
 		e->d = d;
@@ -588,15 +576,14 @@ static int l_new(lua_State * L)
 			break;
 		}
 	}
-	else if(lua_istable(L, 4) && (lua_rawlen(L, 4) == 4))
+	else if(lua_istable(L, idx) && (lua_rawlen(L, idx) == 4))
 	{
 		double x1, y1;
 		double x2, y2;
-		lua_rawgeti(L, 4, 1); x1 = lua_tonumber(L, -1); lua_pop(L, 1);
-		lua_rawgeti(L, 4, 2); y1 = lua_tonumber(L, -1); lua_pop(L, 1);
-		lua_rawgeti(L, 4, 3); x2 = lua_tonumber(L, -1); lua_pop(L, 1);
-		lua_rawgeti(L, 4, 4); y2 = lua_tonumber(L, -1); lua_pop(L, 1);
-		e = lua_newuserdata(L, sizeof(struct leasing_t));
+		lua_rawgeti(L, idx, 1); x1 = lua_tonumber(L, -1); lua_pop(L, 1);
+		lua_rawgeti(L, idx, 2); y1 = lua_tonumber(L, -1); lua_pop(L, 1);
+		lua_rawgeti(L, idx, 3); x2 = lua_tonumber(L, -1); lua_pop(L, 1);
+		lua_rawgeti(L, idx, 4); y2 = lua_tonumber(L, -1); lua_pop(L, 1);
 		e->b = b;
 		e->c = c;
 		e->d = d;
@@ -622,12 +609,20 @@ static int l_new(lua_State * L)
 	}
 	else
 	{
-		e = lua_newuserdata(L, sizeof(struct leasing_t));
 		e->b = b;
 		e->c = c;
 		e->d = d;
 		e->func = linear;
 	}
+}
+
+static int l_new(lua_State * L)
+{
+	double b = luaL_optnumber(L, 1, 0);
+	double c = luaL_optnumber(L, 2, 1);
+	double d = luaL_optnumber(L, 3, 1);
+	struct leasing_t * e = lua_newuserdata(L, sizeof(struct leasing_t));
+	leasing_init(L, 4, e, b, c, d);
 	luaL_setmetatable(L, MT_EASING);
 	return 1;
 }
@@ -9,6 +9,24 @@ extern "C" {
 
 #define	MT_EASING	"__mt_easing__"
 
+/*
+ * t = elapsed time
+ * b = begin value
+ * c = change value (ending - beginning)
+ * d = duration (total time)
+ * func = easing function will be invoked in '__call' method
+ */
+struct leasing_t {
+	double b;
+	double c;
+	double d;
+	double ax, bx, cx;
+	double ay, by, cy;
+	double start, end;
+	double (*func)(struct leasing_t * e, double t);
+};
+
+void leasing_init(lua_State * L, int idx, struct leasing_t * e, double b, double c, double d);
 int luaopen_easing(lua_State * L);
 
 #ifdef __cplusplus
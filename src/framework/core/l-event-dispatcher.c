@@ -31,6 +31,40 @@
 static const char event_dispatcher_lua[] = X(
 local table = table
 local M = Class()
+local registry = {}
+local weak = {__mode = "v"}
+local empty = {n = 0}
+
+local function compact(r, skip)
+	local list = setmetatable({n = 0}, weak)
+	for i = 1, r.n do
+		local v = r[i]
+		if v ~= nil and v ~= skip then
+			list.n = list.n + 1
+			list[list.n] = v
+		end
+	end
+	return list
+end
+
+function M.getListeners(type)
+	local r = registry[type]
+	if not r then
+		return empty
+	end
+	for i = 1, r.n do
+		if r[i] == nil then
+			r = compact(r)
+			registry[type] = r
+			break
+		end
+	end
+	return r
+end
+
+function M.hasFrameListener()
+	return M.getListeners("enter-frame").n > 0
+end
 
 function M:init()
 	self._elms = {}
@@ -67,6 +101,15 @@ function M:addEventListener(type, listener, data)
 	local elm = self._elms[type]
 	local el = {type = type, listener = listener, data = data}
 	table.insert(elm, el)
+	if #elm == 1 then
+		local r = registry[type]
+		if not r then
+			r = setmetatable({n = 0}, weak)
+			registry[type] = r
+		end
+		r.n = r.n + 1
+		r[r.n] = self
+	end
 
 	return self
 end
@@ -82,6 +125,9 @@ function M:removeEventListener(type, listener, data)
 	for i, v in ipairs(elm) do
 		if v.type == type and v.listener == listener and v.data == data then
 			table.remove(elm, i)
+			if #elm == 0 then
+				registry[type] = compact(registry[type], self)
+			end
 			break
 		end
 	end
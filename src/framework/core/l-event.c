@@ -292,15 +292,54 @@ static int l_event_pump(lua_State * L)
 		lua_setfield(L, -2, "time");
 		return 1;
 
+	case EVENT_TYPE_SYSTEM_WORKER:
+		lua_newtable(L);
+		lua_pushstring(L, ((struct input_t *)e.device)->name);
+		lua_setfield(L, -2, "device");
+		lua_pushstring(L, "system-worker");
+		lua_setfield(L, -2, "type");
+		lua_pushnumber(L, ktime_to_ns(e.timestamp));
+		lua_setfield(L, -2, "time");
+		return 1;
+
+	case EVENT_TYPE_SYSTEM_IMAGE:
+		lua_newtable(L);
+		lua_pushstring(L, ((struct input_t *)e.device)->name);
+		lua_setfield(L, -2, "device");
+		lua_pushstring(L, "system-image");
+		lua_setfield(L, -2, "type");
+		lua_pushnumber(L, ktime_to_ns(e.timestamp));
+		lua_setfield(L, -2, "time");
+		return 1;
+
 	default:
 		break;
 	}
 	return 0;
 }
 
+/*
+ * Event.wait([timeout]) blocks the vm task until an event can be pumped or timeout
+ * seconds have passed, a missing or negative timeout waits for the next event
+ */
+static int l_event_wait(lua_State * L)
+{
+	struct window_t * w = ((struct vmctx_t *)luahelper_vmctx(L))->w;
+	double timeout = luaL_optnumber(L, 1, -1);
+	ktime_t deadline;
+
+	if(timeout < 0)
+		deadline = ns_to_ktime(KTIME_MAX);
+	else
+		deadline = ktime_add_us(ktime_get(), (u64_t)(timeout * 1000000.0));
+	lua_pushboolean(L, window_wait_event(w, deadline));
+	return 1;
+}
+
 static const luaL_Reg l_event[] = {
 	{"new",		l_event_new},
 	{"pump",	l_event_pump},
+	{"wait",	l_event_wait},
 	{NULL,		NULL}
 };
 
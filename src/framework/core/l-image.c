@@ -27,6 +27,8 @@
  */
 
 #include <xboot.h>
+#include <input/input.h>
+#include <graphic/imgcache.h>
 #include <core/l-color.h>
 #include <core/l-matrix.h>
 #include <core/l-text.h>
@@ -77,15 +79,265 @@ static int l_image_new(lua_State * L)
 	return 0;
 }
 
+static int l_image_load(lua_State * L)
+{
+	const char * filename = luaL_checkstring(L, 1);
+	int width = luaL_optinteger(L, 2, 0);
+	int height = luaL_optinteger(L, 3, 0);
+	struct surface_t * s = imgcache_get(((struct vmctx_t *)luahelper_vmctx(L))->xfs, filename, width, height);
+	if(s)
+	{
+		struct limage_t * image = lua_newuserdata(L, sizeof(struct limage_t));
+		image->s = s;
+		luaL_setmetatable(L, MT_IMAGE);
+		return 1;
+	}
+	return 0;
+}
+
+static const char __image_jobs_key = 0;
+static struct input_t __image_input = { .name = "image" };
+
+/*
+ * The decode task posts a system image event to the vm window when done, the
+ * lua side may have collected the job by then and leaves the free to it.
+ */
+struct limage_job_t {
+	struct vmctx_t * ctx;
+	struct surface_t * s;
+	int done;
+	int detached;
+	spinlock_t lock;
+};
+
+static void limage_job_callback(struct surface_t * s, void * data)
+{
+	struct limage_job_t * job = (struct limage_job_t *)data;
+	struct vmctx_t * ctx = job->ctx;
+	struct event_t e;
+	irq_flags_t flags;
+	int detached;
+
+	spin_lock_irqsave(&job->lock, flags);
+	job->s = s;
+	job->done = 1;
+	detached = job->detached;
+	spin_unlock_irqrestore(&job->lock, flags);
+	if(detached)
+	{
+		if(s)
+			imgcache_put(s);
+		free(job);
+	}
+	else
+	{
+		e.device = &__image_input;
+		e.type = EVENT_TYPE_SYSTEM_IMAGE;
+		window_push_event(ctx->w, &e);
+	}
+	vmctx_job_put(ctx);
+}
+
+static int l_image_load_async(lua_State * L)
+{
+	const char * filename = luaL_checkstring(L, 1);
+	int width = luaL_optinteger(L, 2, 0);
+	int height = luaL_optinteger(L, 3, 0);
+	struct vmctx_t * ctx = (struct vmctx_t *)luahelper_vmctx(L);
+	struct limage_job_t ** pjob;
+	struct limage_job_t * job;
+
+	if(!lua_isnoneornil(L, 4))
+		luaL_checktype(L, 4, LUA_TFUNCTION);
+	pjob = lua_newuserdata(L, sizeof(struct limage_job_t *));
+	*pjob = NULL;
+	luaL_setmetatable(L, MT_IMAGE_JOB);
+	job = malloc(sizeof(struct limage_job_t));
+	if(!job)
+		return 0;
+	job->ctx = ctx;
+	job->s = NULL;
+	job->done = 0;
+	job->detached = 0;
+	spin_lock_init(&job->lock);
+	vmctx_job_get(ctx);
+	if(!imgcache_get_async(ctx->xfs, filename, width, height, limage_job_callback, job))
+	{
+		vmctx_job_put(ctx);
+		free(job);
+		return 0;
+	}
+	*pjob = job;
+	if(!lua_isnoneornil(L, 4))
+	{
+		lua_rawgetp(L, LUA_REGISTRYINDEX, &__image_jobs_key);
+		lua_pushvalue(L, -2);
+		lua_pushvalue(L, 4);
+		lua_rawset(L, -3);
+		lua_pop(L, 1);
+	}
+	return 1;
+}
+
+static int limage_job_wait(struct limage_job_t * job)
+{
+	irq_flags_t flags;
+	int done;
+
+	spin_lock_irqsave(&job->lock, flags);
+	done = job->done;
+	spin_unlock_irqrestore(&job->lock, flags);
+	return done;
+}
+
+/*
+ * Push the decoded image of a finished job or nil, the surface moves to the image
+ */
+static void limage_job_push(lua_State * L, struct limage_job_t * job)
+{
+	struct limage_t * image;
+
+	if(job && job->s)
+	{
+		image = lua_newuserdata(L, sizeof(struct limage_t));
+		image->s = job->s;
+		luaL_setmetatable(L, MT_IMAGE);
+		job->s = NULL;
+	}
+	else
+	{
+		lua_pushnil(L);
+	}
+}
+
+/*
+ * Image.schedule() calls the function of every finished job, driven by the
+ * system image events. Finished jobs are collected first as callbacks may
+ * start new ones.
+ */
+static int l_image_schedule(lua_State * L)
+{
+	struct limage_job_t ** pjob;
+	int top, n = 0, i;
+
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__image_jobs_key);
+	top = lua_gettop(L);
+	lua_newtable(L);
+	lua_pushnil(L);
+	while(lua_next(L, top))
+	{
+		pjob = lua_touserdata(L, -2);
+		if(!*pjob || limage_job_wait(*pjob))
+		{
+			lua_rawseti(L, top + 1, ++n);
+			lua_pushvalue(L, -1);
+			lua_rawseti(L, top + 1, ++n);
+		}
+		else
+		{
+			lua_pop(L, 1);
+		}
+	}
+	for(i = 2; i <= n; i += 2)
+	{
+		lua_rawgeti(L, top + 1, i);
+		lua_pushnil(L);
+		lua_rawset(L, top);
+	}
+	for(i = 2; i <= n; i += 2)
+	{
+		lua_rawgeti(L, top + 1, i - 1);
+		lua_rawgeti(L, top + 1, i);
+		pjob = lua_touserdata(L, -1);
+		lua_pop(L, 1);
+		limage_job_push(L, *pjob);
+		lua_call(L, 1, 0);
+	}
+	return 0;
+}
+
 static const luaL_Reg l_image[] = {
-	{"new",	l_image_new},
-	{NULL,	NULL}
+	{"new",			l_image_new},
+	{"load",		l_image_load},
+	{"loadAsync",	l_image_load_async},
+	{"schedule",	l_image_schedule},
+	{NULL,			NULL}
+};
+
+/*
+ * Collecting a pending job only detaches it, the decode task frees it when done.
+ */
+static int m_image_job_gc(lua_State * L)
+{
+	struct limage_job_t ** pjob = luaL_checkudata(L, 1, MT_IMAGE_JOB);
+	struct limage_job_t * job = *pjob;
+	irq_flags_t flags;
+	int done;
+
+	if(job)
+	{
+		spin_lock_irqsave(&job->lock, flags);
+		done = job->done;
+		job->detached = 1;
+		spin_unlock_irqrestore(&job->lock, flags);
+		if(done)
+		{
+			if(job->s)
+				imgcache_put(job->s);
+			free(job);
+		}
+		*pjob = NULL;
+	}
+	return 0;
+}
+
+static int m_image_job_poll(lua_State * L)
+{
+	struct limage_job_t ** pjob = luaL_checkudata(L, 1, MT_IMAGE_JOB);
+	struct limage_job_t * job = *pjob;
+
+	if(job && limage_job_wait(job))
+	{
+		lua_pushboolean(L, 1);
+		limage_job_push(L, job);
+		return 2;
+	}
+	lua_pushboolean(L, job ? 0 : 1);
+	return 1;
+}
+
+static const luaL_Reg m_image_job[] = {
+	{"__gc",	m_image_job_gc},
+	{"poll",	m_image_job_poll},
+	{NULL,		NULL}
 };
 
+/*
+ * Images from the cache share their surface, the first change makes a private copy.
+ */
+static struct limage_t * limage_checkwritable(lua_State * L, int idx)
+{
+	struct limage_t * img = luaL_checkudata(L, idx, MT_IMAGE);
+	struct surface_t * s;
+
+	if(imgcache_owned(img->s))
+	{
+		s = surface_clone(img->s, 0, 0, 0, 0, 0);
+		if(!s)
+			luaL_error(L, "out of memory");
+		imgcache_put(img->s);
+		img->s = s;
+	}
+	return img;
+}
+
 static int m_image_gc(lua_State * L)
 {
 	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
-	surface_free(img->s);
+	if(imgcache_owned(img->s))
+		imgcache_put(img->s);
+	else
+		surface_free(img->s);
 	return 0;
 }
 
@@ -178,7 +430,7 @@ static int m_image_extend(lua_State * L)
 
 static int m_image_apply(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct lvision_t * vison = luaL_checkudata(L, 2, MT_VISION);
 	surface_apply_vision(img->s, vison->v);
 	lua_settop(L, 1);
@@ -187,7 +439,7 @@ static int m_image_apply(lua_State * L)
 
 static int m_image_clear(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct color_t * c = luaL_checkudata(L, 2, MT_COLOR);
 	int x = luaL_optinteger(L, 3, 0);
 	int y = luaL_optinteger(L, 4, 0);
@@ -200,7 +452,7 @@ static int m_image_clear(lua_State * L)
 
 static int m_image_blit(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct matrix_t * m = luaL_checkudata(L, 2, MT_MATRIX);
 	struct limage_t * o = luaL_checkudata(L, 3, MT_IMAGE);
 	surface_blit(img->s, NULL, m, o->s, RENDER_TYPE_GOOD);
@@ -210,7 +462,7 @@ static int m_image_blit(lua_State * L)
 
 static int m_image_fill(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct matrix_t * m = luaL_checkudata(L, 2, MT_MATRIX);
 	int w = luaL_checkinteger(L, 3);
 	int h = luaL_checkinteger(L, 4);
@@ -223,7 +475,7 @@ static int m_image_fill(lua_State * L)
 
 static int m_image_text(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct matrix_t * m = luaL_checkudata(L, 2, MT_MATRIX);
 	struct ltext_t * text = luaL_checkudata(L, 3, MT_TEXT);
 	surface_text(img->s, NULL, m, &text->txt);
@@ -233,7 +485,7 @@ static int m_image_text(lua_State * L)
 
 static int m_image_icon(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct matrix_t * m = luaL_checkudata(L, 2, MT_MATRIX);
 	struct licon_t * icon = luaL_checkudata(L, 3, MT_ICON);
 	surface_icon(img->s, NULL, m, &icon->ico);
@@ -243,7 +495,7 @@ static int m_image_icon(lua_State * L)
 
 static int m_image_line(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct point_t p0, p1;
 	p0.x = luaL_checknumber(L, 2);
 	p0.y = luaL_checknumber(L, 3);
@@ -258,7 +510,7 @@ static int m_image_line(lua_State * L)
 
 static int m_image_polyline(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct point_t pts[128], * p;
 	int n, i;
 	if(lua_istable(L, 2) && ((n = lua_rawlen(L, 2) >> 1) > 0))
@@ -287,7 +539,7 @@ static int m_image_polyline(lua_State * L)
 
 static int m_image_curve(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct point_t pts[128], * p;
 	int n, i;
 	if(lua_istable(L, 2) && ((n = lua_rawlen(L, 2) >> 1) > 0))
@@ -316,7 +568,7 @@ static int m_image_curve(lua_State * L)
 
 static int m_image_triangle(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct point_t p0, p1, p2;
 	p0.x = luaL_checknumber(L, 2);
 	p0.y = luaL_checknumber(L, 3);
@@ -333,7 +585,7 @@ static int m_image_triangle(lua_State * L)
 
 static int m_image_rectangle(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int x = luaL_checknumber(L, 2);
 	int y = luaL_checknumber(L, 3);
 	int w = luaL_checknumber(L, 4);
@@ -348,7 +600,7 @@ static int m_image_rectangle(lua_State * L)
 
 static int m_image_polygon(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct point_t pts[128], * p;
 	int n, i;
 	if(lua_istable(L, 2) && ((n = lua_rawlen(L, 2) >> 1) > 0))
@@ -377,7 +629,7 @@ static int m_image_polygon(lua_State * L)
 
 static int m_image_circle(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int x = luaL_checknumber(L, 2);
 	int y = luaL_checknumber(L, 3);
 	int radius = luaL_checknumber(L, 4);
@@ -390,7 +642,7 @@ static int m_image_circle(lua_State * L)
 
 static int m_image_ellipse(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int x = luaL_checknumber(L, 2);
 	int y = luaL_checknumber(L, 3);
 	int w = luaL_checknumber(L, 4);
@@ -404,7 +656,7 @@ static int m_image_ellipse(lua_State * L)
 
 static int m_image_arc(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int x = luaL_checknumber(L, 2);
 	int y = luaL_checknumber(L, 3);
 	int radius = luaL_checknumber(L, 4);
@@ -419,7 +671,7 @@ static int m_image_arc(lua_State * L)
 
 static int m_image_gradient(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int x = luaL_checknumber(L, 2);
 	int y = luaL_checknumber(L, 3);
 	int w = luaL_checknumber(L, 4);
@@ -435,7 +687,7 @@ static int m_image_gradient(lua_State * L)
 
 static int m_image_checkerboard(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int x = luaL_optinteger(L, 2, 0);
 	int y = luaL_optinteger(L, 3, 0);
 	int w = luaL_optinteger(L, 4, 0);
@@ -447,7 +699,7 @@ static int m_image_checkerboard(lua_State * L)
 
 static int m_image_gray(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	surface_filter_gray(img->s);
 	lua_settop(L, 1);
 	return 1;
@@ -455,7 +707,7 @@ static int m_image_gray(lua_State * L)
 
 static int m_image_sepia(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	surface_filter_sepia(img->s);
 	lua_settop(L, 1);
 	return 1;
@@ -463,7 +715,7 @@ static int m_image_sepia(lua_State * L)
 
 static int m_image_invert(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	surface_filter_invert(img->s);
 	lua_settop(L, 1);
 	return 1;
@@ -471,7 +723,7 @@ static int m_image_invert(lua_State * L)
 
 static int m_image_coloring(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct color_t * c = luaL_checkudata(L, 2, MT_COLOR);
 	surface_filter_coloring(img->s, c);
 	lua_settop(L, 1);
@@ -480,7 +732,7 @@ static int m_image_coloring(lua_State * L)
 
 static int m_image_hue(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int angle = luaL_optinteger(L, 2, 0);
 	surface_filter_hue(img->s, angle);
 	lua_settop(L, 1);
@@ -489,7 +741,7 @@ static int m_image_hue(lua_State * L)
 
 static int m_image_saturate(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int saturate = luaL_optinteger(L, 2, 0);
 	surface_filter_saturate(img->s, saturate);
 	lua_settop(L, 1);
@@ -498,7 +750,7 @@ static int m_image_saturate(lua_State * L)
 
 static int m_image_brightness(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int brightness = luaL_optinteger(L, 2, 0);
 	surface_filter_brightness(img->s, brightness);
 	lua_settop(L, 1);
@@ -507,7 +759,7 @@ static int m_image_brightness(lua_State * L)
 
 static int m_image_contrast(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int contrast = luaL_optinteger(L, 2, 0);
 	surface_filter_contrast(img->s, contrast);
 	lua_settop(L, 1);
@@ -516,7 +768,7 @@ static int m_image_contrast(lua_State * L)
 
 static int m_image_opacity(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int alpha = luaL_optinteger(L, 2, 100);
 	surface_filter_opacity(img->s, alpha);
 	lua_settop(L, 1);
@@ -525,7 +777,7 @@ static int m_image_opacity(lua_State * L)
 
 static int m_image_haldclut(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	struct limage_t * clut = luaL_checkudata(L, 2, MT_IMAGE);
 	const char * type = luaL_optstring(L, 3, "nearest");
 	surface_filter_haldclut(img->s, clut->s, type);
@@ -535,13 +787,90 @@ static int m_image_haldclut(lua_State * L)
 
 static int m_image_blur(lua_State * L)
 {
-	struct limage_t * img = luaL_checkudata(L, 1, MT_IMAGE);
+	struct limage_t * img = limage_checkwritable(L, 1);
 	int radius = luaL_optinteger(L, 2, 0);
 	surface_filter_blur(img->s, radius);
 	lua_settop(L, 1);
 	return 1;
 }
 
+static int m_image_filters(lua_State * L)
+{
+	struct limage_t * img = limage_checkwritable(L, 1);
+	struct surface_filter_t * f;
+	struct color_t * c;
+	const char * type;
+	int len, n, i;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	len = lua_rawlen(L, 2);
+	f = lua_newuserdata(L, sizeof(struct surface_filter_t) * (len + 1));
+	for(i = 1, n = 0; i <= len; i++)
+	{
+		lua_rawgeti(L, 2, i);
+		if(lua_istable(L, -1))
+		{
+			lua_rawgeti(L, -1, 1);
+			lua_rawgeti(L, -2, 2);
+			type = luaL_checkstring(L, -2);
+		}
+		else
+		{
+			lua_pushvalue(L, -1);
+			lua_pushnil(L);
+			type = luaL_checkstring(L, -2);
+		}
+		f[n].value = 0;
+		switch(shash(type))
+		{
+		case 0x7c977c78: /* "gray" */
+			f[n++].type = SURFACE_FILTER_GRAY;
+			break;
+		case 0x10594eb7: /* "sepia" */
+			f[n++].type = SURFACE_FILTER_SEPIA;
+			break;
+		case 0x04d5a7bd: /* "invert" */
+			f[n++].type = SURFACE_FILTER_INVERT;
+			break;
+		case 0x3daf0902: /* "coloring" */
+			c = luaL_checkudata(L, -1, MT_COLOR);
+			memcpy(&f[n].color, c, sizeof(struct color_t));
+			f[n++].type = SURFACE_FILTER_COLORING;
+			break;
+		case 0x0b887cc7: /* "hue" */
+			f[n].value = luaL_optinteger(L, -1, 0);
+			f[n++].type = SURFACE_FILTER_HUE;
+			break;
+		case 0xdf32bb4e: /* "saturate" */
+			f[n].value = luaL_optinteger(L, -1, 0);
+			f[n++].type = SURFACE_FILTER_SATURATE;
+			break;
+		case 0x7bdc2cbe: /* "brightness" */
+			f[n].value = luaL_optinteger(L, -1, 0);
+			f[n++].type = SURFACE_FILTER_BRIGHTNESS;
+			break;
+		case 0x42b3b373: /* "contrast" */
+			f[n].value = luaL_optinteger(L, -1, 0);
+			f[n++].type = SURFACE_FILTER_CONTRAST;
+			break;
+		case 0x70951bfe: /* "opacity" */
+			f[n].value = luaL_optinteger(L, -1, 100);
+			f[n++].type = SURFACE_FILTER_OPACITY;
+			break;
+		case 0x7c94a79a: /* "blur" */
+			f[n].value = luaL_optinteger(L, -1, 0);
+			f[n++].type = SURFACE_FILTER_BLUR;
+			break;
+		default:
+			return luaL_argerror(L, 2, lua_pushfstring(L, "unknown filter '%s'", type));
+		}
+		lua_pop(L, 3);
+	}
+	surface_filter_chain(img->s, f, n);
+	lua_settop(L, 1);
+	return 1;
+}
+
 static const luaL_Reg m_image[] = {
 	{"__gc",			m_image_gc},
 	{"__tostring",		m_image_tostring},
@@ -582,6 +911,7 @@ static const luaL_Reg m_image[] = {
 	{"opacity",			m_image_opacity},
 	{"haldclut",		m_image_haldclut},
 	{"blur",			m_image_blur},
+	{"filters",		m_image_filters},
 
 	{NULL, NULL}
 };
@@ -590,5 +920,8 @@ int luaopen_image(lua_State * L)
 {
 	luaL_newlib(L, l_image);
 	luahelper_create_metatable(L, MT_IMAGE, m_image);
+	luahelper_create_metatable(L, MT_IMAGE_JOB, m_image_job);
+	lua_newtable(L);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &__image_jobs_key);
 	return 1;
 }
@@ -7,7 +7,8 @@ extern "C" {
 
 #include <luahelper.h>
 
-#define MT_IMAGE	"__mt_image__"
+#define MT_IMAGE		"__mt_image__"
+#define MT_IMAGE_JOB	"__mt_image_job__"
 
 struct limage_t {
 	struct surface_t * s;
@@ -42,6 +42,98 @@ void ninepatch_stretch(struct lninepatch_t * ninepatch, double width, double hei
 	ninepatch->__h = height;
 	ninepatch->__sx = (ninepatch->__w - lr) / (ninepatch->width - lr);
 	ninepatch->__sy = (ninepatch->__h - tb) / (ninepatch->height - tb);
+	if(ninepatch->cache && ((surface_get_width(ninepatch->cache) != (int)(width + 0.5)) || (surface_get_height(ninepatch->cache) != (int)(height + 0.5))))
+	{
+		surface_free(ninepatch->cache);
+		ninepatch->cache = NULL;
+	}
+}
+
+static inline uint32_t * ninepatch_row(struct surface_t * s, int y)
+{
+	return (uint32_t *)((unsigned char *)surface_get_pixels(s) + y * surface_get_stride(s));
+}
+
+/*
+ * One destination row out of the three patches of a band, the middle one is
+ * stretched by nearest column replication through map
+ */
+static void ninepatch_compose_row(uint32_t * d, struct surface_t * l, struct surface_t * m, struct surface_t * r, int sy, int * map, int dw)
+{
+	uint32_t * s;
+	int x;
+
+	if(l)
+	{
+		memcpy(d, ninepatch_row(l, sy), surface_get_width(l) << 2);
+		d += surface_get_width(l);
+	}
+	if(m)
+	{
+		s = ninepatch_row(m, sy);
+		for(x = 0; x < dw; x++)
+			d[x] = s[map[x]];
+	}
+	d += dw;
+	if(r)
+		memcpy(d, ninepatch_row(r, sy), surface_get_width(r) << 2);
+}
+
+/*
+ * Compose the whole ninepatch at its current size once, stretched rows which map to
+ * the same source row are copied from the previous one. The surface is kept until
+ * the size changes.
+ */
+struct surface_t * ninepatch_surface(struct lninepatch_t * ninepatch)
+{
+	struct surface_t * s;
+	int w = (int)(ninepatch->__w + 0.5);
+	int h = (int)(ninepatch->__h + 0.5);
+	int mw = ninepatch->width - ninepatch->left - ninepatch->right;
+	int mh = ninepatch->height - ninepatch->top - ninepatch->bottom;
+	int dw = w - ninepatch->left - ninepatch->right;
+	int dh = h - ninepatch->top - ninepatch->bottom;
+	int * map = NULL;
+	int x, y, sy, last;
+
+	if(ninepatch->cache)
+		return ninepatch->cache;
+	if((w <= 0) || (h <= 0))
+		return NULL;
+	s = surface_alloc(w, h, NULL);
+	if(!s)
+		return NULL;
+	if((mw > 0) && (dw > 0))
+	{
+		map = malloc(dw * sizeof(int));
+		if(!map)
+		{
+			surface_free(s);
+			return NULL;
+		}
+		for(x = 0; x < dw; x++)
+			map[x] = (int)((long long)x * mw / dw);
+	}
+	for(y = 0; y < ninepatch->top; y++)
+		ninepatch_compose_row(ninepatch_row(s, y), ninepatch->lt, map ? ninepatch->mt : NULL, ninepatch->rt, y, map, dw);
+	if((mh > 0) && (dh > 0))
+	{
+		for(y = 0, last = -1; y < dh; y++)
+		{
+			sy = (int)((long long)y * mh / dh);
+			if(sy == last)
+				memcpy(ninepatch_row(s, ninepatch->top + y), ninepatch_row(s, ninepatch->top + y - 1), w << 2);
+			else
+				ninepatch_compose_row(ninepatch_row(s, ninepatch->top + y), ninepatch->lm, map ? ninepatch->mm : NULL, ninepatch->rm, sy, map, dw);
+			last = sy;
+		}
+	}
+	for(y = 0; y < ninepatch->bottom; y++)
+		ninepatch_compose_row(ninepatch_row(s, h - ninepatch->bottom + y), ninepatch->lb, map ? ninepatch->mb : NULL, ninepatch->rb, y, map, dw);
+	if(map)
+		free(map);
+	ninepatch->cache = s;
+	return s;
 }
 
 static inline int detect_black_pixel(unsigned char * p)
@@ -80,6 +172,7 @@ static inline int to_ninepatch(struct surface_t * s, struct lninepatch_t * ninep
 	ninepatch->right = 0;
 	ninepatch->top = 0;
 	ninepatch->right = 0;
+	ninepatch->cache = NULL;
 
 	for(i = 0; i < width; i++)
 	{
@@ -231,6 +324,8 @@ static int m_ninepatch_gc(lua_State * L)
 		surface_free(ninepatch->mb);
 	if(ninepatch->rb)
 		surface_free(ninepatch->rb);
+	if(ninepatch->cache)
+		surface_free(ninepatch->cache);
 	return 0;
 }
 
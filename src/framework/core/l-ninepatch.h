@@ -23,9 +23,11 @@ struct lninepatch_t {
 	struct surface_t * rb;
 	double __w, __h;
 	double __sx, __sy;
+	struct surface_t * cache;
 };
 
 void ninepatch_stretch(struct lninepatch_t * ninepatch, double width, double height);
+struct surface_t * ninepatch_surface(struct lninepatch_t * ninepatch);
 int luaopen_ninepatch(lua_State * L);
 
 #ifdef __cplusplus
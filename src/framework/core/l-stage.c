@@ -33,7 +33,8 @@ local M = Class(DisplayObject)
 
 function M:init()
 	self._running = true
-	self._timerlist = {}
+	self._stopwatch = Stopwatch.new()
+	self._stat = { time = 0, frames = 0, idle = 0, jitter = 0, jmax = 0, jcount = 0, matrices = 0, layouts = 0, animations = 0, gc = 0, gcmax = 0, heap = 0 }
 	self._window = Window.new()
 	self.super:init(self._window:getSize())
 	self:markDirty()
@@ -45,65 +46,50 @@ function M:exit()
 end
 
 function M:hasTimer(timer)
-	local tl = self._timerlist
-
-	if not tl or #tl == 0 then
-		return false
-	end
-
-	for i, v in ipairs(tl) do
-		if v == timer then
-			return true
-		end
-	end
-
-	return false
+	return Timer.has(timer)
 end
 
 function M:addTimer(timer)
-	if self:hasTimer(timer) then
-		return false
-	end
-
-	timer:start()
-	table.insert(self._timerlist, timer)
-	return true
+	return Timer.add(timer)
 end
 
 function M:removeTimer(timer)
-	local tl = self._timerlist
-
-	if not tl or #tl == 0 then
-		return false
-	end
-
-	for i, v in ipairs(tl) do
-		if v == timer then
-			v:pause()
-			table.remove(tl, i)
-			return true
-		end
-	end
-
-	return false
+	return Timer.remove(timer)
 end
 
-function M:schedTimer(dt)
-	for i, v in ipairs(self._timerlist) do
-		if v._running then
-			v._runtime = v._runtime + dt
-
-			if v._runtime >= v._delay then
-				v._runcount = v._runcount + 1
-				v._listener(v)
-				v._runtime = 0
+function M:schedTimer()
+	return Timer.schedule()
+end
 
-				if v._iteration ~= 0 and v._runcount >= v._iteration then
-					self:removeTimer(v)
-				end
-			end
-		end
-	end
+function M:getStat()
+	local s = self._stat
+	local now = self._stopwatch:elapsed()
+	local span = now - s.time
+	local stat = {
+		fps = span > 0 and s.frames / span or 0,
+		idle = span > 0 and s.idle / span or 0,
+		jitter = s.jcount > 0 and s.jitter / s.jcount or 0,
+		jitterMax = s.jmax,
+		matrices = s.frames > 0 and s.matrices / s.frames or 0,
+		layouts = s.frames > 0 and s.layouts / s.frames or 0,
+		animations = s.frames > 0 and s.animations / s.frames or 0,
+		gc = s.frames > 0 and s.gc / s.frames or s.gc,
+		gcMax = s.gcmax,
+		heap = s.heap,
+	}
+
+	s.time = now
+	s.frames = 0
+	s.idle = 0
+	s.jitter = 0
+	s.jmax = 0
+	s.jcount = 0
+	s.matrices = 0
+	s.layouts = 0
+	s.animations = 0
+	s.gc = 0
+	s.gcmax = 0
+	return stat
 end
 
 function M:getDotsPerInch()
@@ -130,29 +116,85 @@ end
 
 function M:loop()
 	local Event = Event
+	local EventDispatcher = EventDispatcher
+	local Timer = Timer
+	local Worker = Worker
+	local Image = Image
 	local window = self._window
-	local stopwatch = Stopwatch.new()
-
-	self:addTimer(Timer.new(1 / 60, 0, function(t)
-		self:dispatch(Event.new("enter-frame"))
-		self:render(window)
-		collectgarbage("step")
-	end))
+	local stopwatch = self._stopwatch
+	local stat = self._stat
+	local interval = 1 / 60
+	local frame, now = 0, 0
+	local paced = false
+	local animating = 0
+	local due, timeout, t, m, l, pause
 
 	while self._running do
 		local e = Event.pump()
-		if e ~= nil then
+		while e ~= nil do
 			if e.type == "system-exit" then
 				self:exit()
+			elseif e.type == "system-worker" then
+				Worker.schedule()
+			elseif e.type == "system-image" then
+				Image.schedule()
 			end
 			self:dispatch(e)
+			e = Event.pump()
 		end
 
-		local elapsed = stopwatch:elapsed()
-		if elapsed > 0 then
-			stopwatch:reset()
-			self:schedTimer(elapsed)
+		now = stopwatch:elapsed()
+		if now >= frame then
+			if paced then
+				t = now - frame
+				stat.jitter = stat.jitter + t
+				stat.jcount = stat.jcount + 1
+				if t > stat.jmax then
+					stat.jmax = t
+				end
+			end
+			self:dispatch(Event.new("enter-frame"))
+			if animating > 0 or self:isDirty() or window:isDirty() then
+				m, l, animating = self:render(window)
+				stat.matrices = stat.matrices + m
+				stat.layouts = stat.layouts + l
+				stat.animations = stat.animations + animating
+				stat.frames = stat.frames + 1
+			end
+			frame = frame + interval
+			if frame <= now then
+				frame = now + interval
+			end
 		end
+
+		due = Timer.schedule()
+
+		if animating > 0 or EventDispatcher.hasFrameListener() or self:isDirty() or window:isDirty() then
+			timeout = frame - stopwatch:elapsed()
+			paced = true
+		else
+			timeout = nil
+			paced = false
+		end
+		if due and (not timeout or due < timeout) then
+			timeout = due
+		end
+		if timeout and timeout < 0 then
+			timeout = 0
+		end
+
+		pause, stat.heap = xboot.gc(timeout or interval)
+		stat.gc = stat.gc + pause
+		if pause > stat.gcmax then
+			stat.gcmax = pause
+		end
+		if timeout then
+			timeout = timeout > pause and timeout - pause or 0
+		end
+
+		t = stopwatch:elapsed()
+		Event.wait(timeout)
+		stat.idle = stat.idle + stopwatch:elapsed() - t
 	end
 end
 
@@ -26,38 +26,320 @@
  *
  */
 
+#include <xboot.h>
 #include <core/l-timer.h>
 
-static const char timer_lua[] = X(
-local M = Class()
+#define	MT_TIMER		"__mt_timer__"
+#define	MT_TIMER_HEAP	"__mt_timer_heap__"
 
-function M:init(delay, iteration, listener)
-	self._delay = delay or 1
-	self._iteration = iteration or 1
-	self._listener = listener
-	self._running = false
-	self._runtime = 0
-	self._runcount = 0
-end
+struct ltimer_t {
+	ktime_t deadline;
+	s64_t period;
+	s64_t remain;
+	int iteration;
+	int runcount;
+	int running;
+	int attached;
+	int index;
+	int ref;
+};
 
-function M:start()
-	self._running = true
-end
+/*
+ * Attached and running timers, a binary min heap on the absolute deadline
+ */
+struct ltimer_heap_t {
+	struct ltimer_t ** t;
+	int count;
+	int size;
+};
+
+static const char __timer_heap_key = 0;
+
+static struct ltimer_heap_t * timer_heap(lua_State * L)
+{
+	struct ltimer_heap_t * h;
+
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__timer_heap_key);
+	h = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return h;
+}
+
+static inline void heap_set(struct ltimer_heap_t * h, int i, struct ltimer_t * t)
+{
+	h->t[i] = t;
+	t->index = i;
+}
+
+static void heap_sift_up(struct ltimer_heap_t * h, int i)
+{
+	struct ltimer_t * t = h->t[i];
+	int p;
+
+	while(i > 0)
+	{
+		p = (i - 1) >> 1;
+		if(!ktime_before(t->deadline, h->t[p]->deadline))
+			break;
+		heap_set(h, i, h->t[p]);
+		i = p;
+	}
+	heap_set(h, i, t);
+}
+
+static void heap_sift_down(struct ltimer_heap_t * h, int i)
+{
+	struct ltimer_t * t = h->t[i];
+	int c;
+
+	while((c = (i << 1) + 1) < h->count)
+	{
+		if((c + 1 < h->count) && ktime_before(h->t[c + 1]->deadline, h->t[c]->deadline))
+			c++;
+		if(!ktime_before(h->t[c]->deadline, t->deadline))
+			break;
+		heap_set(h, i, h->t[c]);
+		i = c;
+	}
+	heap_set(h, i, t);
+}
+
+/*
+ * Insert the timer at stack index idx, the heap holds a registry reference so
+ * a scheduled timer is never collected
+ */
+static int heap_push(lua_State * L, struct ltimer_heap_t * h, struct ltimer_t * t, int idx)
+{
+	struct ltimer_t ** n;
+
+	if(t->index >= 0)
+		return 1;
+	if(h->count >= h->size)
+	{
+		n = realloc(h->t, sizeof(struct ltimer_t *) * (h->size > 0 ? h->size << 1 : 16));
+		if(!n)
+			return 0;
+		h->t = n;
+		h->size = h->size > 0 ? h->size << 1 : 16;
+	}
+	lua_pushvalue(L, idx);
+	t->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	heap_set(h, h->count++, t);
+	heap_sift_up(h, t->index);
+	return 1;
+}
+
+static void heap_remove(lua_State * L, struct ltimer_heap_t * h, struct ltimer_t * t)
+{
+	int i = t->index;
+
+	if(i < 0)
+		return;
+	if(--h->count > i)
+	{
+		heap_set(h, i, h->t[h->count]);
+		heap_sift_down(h, i);
+		heap_sift_up(h, h->t[i]->index);
+	}
+	t->index = -1;
+	luaL_unref(L, LUA_REGISTRYINDEX, t->ref);
+	t->ref = LUA_NOREF;
+}
+
+static void timer_schedule(lua_State * L, struct ltimer_t * t, int idx)
+{
+	if(t->attached && t->running && (t->index < 0))
+	{
+		t->deadline = ktime_add_ns(ktime_get(), t->remain);
+		heap_push(L, timer_heap(L), t, idx);
+	}
+}
+
+static void timer_unschedule(lua_State * L, struct ltimer_t * t)
+{
+	s64_t remain;
+
+	if(t->index >= 0)
+	{
+		remain = ktime_to_ns(ktime_sub(t->deadline, ktime_get()));
+		t->remain = remain > 0 ? remain : 0;
+		heap_remove(L, timer_heap(L), t);
+	}
+}
+
+static int l_timer_new(lua_State * L)
+{
+	double delay = luaL_optnumber(L, 1, 1);
+	int iteration = luaL_optinteger(L, 2, 1);
+	struct ltimer_t * t;
 
-function M:pause()
-	self._running = false
-end
+	luaL_checktype(L, 3, LUA_TFUNCTION);
+	t = lua_newuserdatauv(L, sizeof(struct ltimer_t), 1);
+	t->period = (s64_t)((delay > 0 ? delay : 0) * 1000000000.0);
+	t->remain = t->period;
+	t->iteration = iteration;
+	t->runcount = 0;
+	t->running = 0;
+	t->attached = 0;
+	t->index = -1;
+	t->ref = LUA_NOREF;
+	lua_pushvalue(L, 3);
+	lua_setiuservalue(L, -2, 1);
+	luaL_setmetatable(L, MT_TIMER);
+	return 1;
+}
 
-function M:status()
-	return self._running
-end
+static int l_timer_add(lua_State * L)
+{
+	struct ltimer_t * t = luaL_checkudata(L, 1, MT_TIMER);
+	if(t->attached)
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	t->attached = 1;
+	t->running = 1;
+	timer_schedule(L, t, 1);
+	lua_pushboolean(L, 1);
+	return 1;
+}
 
-return M
-);
+static int l_timer_remove(lua_State * L)
+{
+	struct ltimer_t * t = luaL_checkudata(L, 1, MT_TIMER);
+	if(!t->attached)
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	timer_unschedule(L, t);
+	t->attached = 0;
+	t->running = 0;
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static int l_timer_has(lua_State * L)
+{
+	struct ltimer_t * t = luaL_checkudata(L, 1, MT_TIMER);
+	lua_pushboolean(L, t->attached);
+	return 1;
+}
+
+/*
+ * Fire every timer whose deadline has passed and return the seconds until the next
+ * one, or nil. Periodic timers advance by whole periods from their last deadline so
+ * they do not drift, missed periods are skipped rather than fired in a burst.
+ */
+static int l_timer_schedule(lua_State * L)
+{
+	struct ltimer_heap_t * h = timer_heap(L);
+	struct ltimer_t * t;
+	ktime_t now = ktime_get();
+	s64_t late, next;
+
+	while((h->count > 0) && !ktime_after(h->t[0]->deadline, now))
+	{
+		t = h->t[0];
+		lua_rawgeti(L, LUA_REGISTRYINDEX, t->ref);
+		t->runcount++;
+		if((t->iteration != 0) && (t->runcount >= t->iteration))
+		{
+			heap_remove(L, h, t);
+			t->attached = 0;
+			t->running = 0;
+			t->remain = t->period;
+		}
+		else
+		{
+			next = t->period;
+			late = ktime_to_ns(ktime_sub(now, t->deadline));
+			if(late >= next)
+				next = (next > 0) ? (late / next + 1) * next : late + 1;
+			t->deadline = ktime_add_ns(t->deadline, next);
+			heap_sift_down(h, 0);
+		}
+		lua_getiuservalue(L, -1, 1);
+		lua_pushvalue(L, -2);
+		lua_call(L, 1, 0);
+		lua_pop(L, 1);
+	}
+	if(h->count > 0)
+		lua_pushnumber(L, (lua_Number)ktime_to_ns(ktime_sub(h->t[0]->deadline, ktime_get())) / (lua_Number)1000000000.0);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+static const luaL_Reg l_timer[] = {
+	{"new",			l_timer_new},
+	{"add",			l_timer_add},
+	{"remove",		l_timer_remove},
+	{"has",			l_timer_has},
+	{"schedule",	l_timer_schedule},
+	{NULL,			NULL}
+};
+
+static int m_timer_start(lua_State * L)
+{
+	struct ltimer_t * t = luaL_checkudata(L, 1, MT_TIMER);
+	t->running = 1;
+	timer_schedule(L, t, 1);
+	return 0;
+}
+
+static int m_timer_pause(lua_State * L)
+{
+	struct ltimer_t * t = luaL_checkudata(L, 1, MT_TIMER);
+	timer_unschedule(L, t);
+	t->running = 0;
+	return 0;
+}
+
+static int m_timer_status(lua_State * L)
+{
+	struct ltimer_t * t = luaL_checkudata(L, 1, MT_TIMER);
+	lua_pushboolean(L, t->running);
+	return 1;
+}
+
+static const luaL_Reg m_timer[] = {
+	{"start",		m_timer_start},
+	{"pause",		m_timer_pause},
+	{"status",		m_timer_status},
+	{NULL,			NULL}
+};
+
+static int m_timer_heap_gc(lua_State * L)
+{
+	struct ltimer_heap_t * h = luaL_checkudata(L, 1, MT_TIMER_HEAP);
+	if(h->t)
+		free(h->t);
+	return 0;
+}
+
+static const luaL_Reg m_timer_heap[] = {
+	{"__gc",		m_timer_heap_gc},
+	{NULL,			NULL}
+};
 
 int luaopen_timer(lua_State * L)
 {
-	if(luaL_loadbuffer(L, timer_lua, sizeof(timer_lua) - 1, "Timer.lua") == LUA_OK)
-		lua_call(L, 0, 1);
+	struct ltimer_heap_t * h;
+
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__timer_heap_key);
+	if(lua_isnil(L, -1))
+	{
+		h = lua_newuserdatauv(L, sizeof(struct ltimer_heap_t), 0);
+		h->t = NULL;
+		h->count = 0;
+		h->size = 0;
+		luahelper_create_metatable(L, MT_TIMER_HEAP, m_timer_heap);
+		luaL_setmetatable(L, MT_TIMER_HEAP);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &__timer_heap_key);
+	}
+	lua_pop(L, 1);
+	luaL_newlib(L, l_timer);
+	luahelper_create_metatable(L, MT_TIMER, m_timer);
 	return 1;
 }
@@ -28,6 +28,7 @@
 
 #include <xboot.h>
 #include <vision/vision.h>
+#include <vision/pipeline.h>
 #include <core/l-image.h>
 #include <core/l-vision.h>
 
@@ -69,6 +70,7 @@ static int l_vision_new(lua_State * L)
 	{
 		struct lvision_t * vision = lua_newuserdata(L, sizeof(struct lvision_t));
 		vision->v = v;
+		vision->pipeline = NULL;
 		luaL_setmetatable(L, MT_VISION);
 		return 1;
 	}
@@ -84,6 +86,7 @@ static int m_vision_gc(lua_State * L)
 {
 	struct lvision_t * vison = luaL_checkudata(L, 1, MT_VISION);
 	vision_free(vison->v);
+	vision_pipeline_free(vison->pipeline);
 	return 0;
 }
 
@@ -184,6 +187,7 @@ static int m_vision_clone(lua_State * L)
 		return 0;
 	struct lvision_t * subvision = lua_newuserdata(L, sizeof(struct lvision_t));
 	subvision->v = o;
+	subvision->pipeline = NULL;
 	luaL_setmetatable(L, MT_VISION);
 	return 1;
 }
@@ -207,6 +211,7 @@ static int m_vision_inrange(lua_State * L)
 			{
 				struct lvision_t * mask = lua_newuserdata(L, sizeof(struct lvision_t));
 				mask->v = o;
+				mask->pipeline = NULL;
 				luaL_setmetatable(L, MT_VISION);
 				return 1;
 			}
@@ -316,6 +321,84 @@ static int m_vision_dilate(lua_State * L)
 	return 1;
 }
 
+/*
+ * vision:pipeline({ {"threshold", 128, "binary"}, "invert", {"erode", 2}, {"dilate", 2, 1} })
+ * runs the chain on a gray vision in as few passes as possible, the compiled steps and
+ * the scratch image are kept with the vision and reused by the next call.
+ */
+static int m_vision_pipeline(lua_State * L)
+{
+	struct lvision_t * vision = luaL_checkudata(L, 1, MT_VISION);
+	const char * type;
+	int len, i, x, y;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	if(!vision->pipeline)
+	{
+		vision->pipeline = vision_pipeline_alloc();
+		if(!vision->pipeline)
+			return 0;
+	}
+	vision_pipeline_clear(vision->pipeline);
+	len = lua_rawlen(L, 2);
+	for(i = 1; i <= len; i++)
+	{
+		lua_rawgeti(L, 2, i);
+		if(lua_istable(L, -1))
+		{
+			lua_rawgeti(L, -1, 1);
+			lua_rawgeti(L, -2, 2);
+			lua_rawgeti(L, -3, 3);
+			type = luaL_checkstring(L, -3);
+		}
+		else
+		{
+			lua_pushvalue(L, -1);
+			lua_pushnil(L);
+			lua_pushnil(L);
+			type = luaL_checkstring(L, -3);
+		}
+		switch(shash(type))
+		{
+		case 0x04d5a7bd: /* "invert" */
+			vision_pipeline_invert(vision->pipeline);
+			break;
+		case 0xf0a23fd2: /* "threshold" */
+			vision_pipeline_threshold(vision->pipeline, luaL_optinteger(L, -2, -1), luaL_optstring(L, -1, "binary"));
+			break;
+		case 0x0f6313b4: /* "erode" */
+			x = luaL_optinteger(L, -2, 1);
+			y = luaL_optinteger(L, -1, x);
+			vision_pipeline_erode(vision->pipeline, x, y);
+			break;
+		case 0xf8cbd578: /* "dilate" */
+			x = luaL_optinteger(L, -2, 1);
+			y = luaL_optinteger(L, -1, x);
+			vision_pipeline_dilate(vision->pipeline, x, y);
+			break;
+		case 0x7c9bd777: /* "open" */
+			x = luaL_optinteger(L, -2, 1);
+			y = luaL_optinteger(L, -1, x);
+			vision_pipeline_erode(vision->pipeline, x, y);
+			vision_pipeline_dilate(vision->pipeline, x, y);
+			break;
+		case 0x0f3b9a5b: /* "close" */
+			x = luaL_optinteger(L, -2, 1);
+			y = luaL_optinteger(L, -1, x);
+			vision_pipeline_dilate(vision->pipeline, x, y);
+			vision_pipeline_erode(vision->pipeline, x, y);
+			break;
+		default:
+			vision_pipeline_clear(vision->pipeline);
+			return luaL_argerror(L, 2, lua_pushfstring(L, "unknown operation '%s'", type));
+		}
+		lua_pop(L, 4);
+	}
+	vision_pipeline_run(vision->pipeline, vision->v);
+	lua_settop(L, 1);
+	return 1;
+}
+
 static const luaL_Reg m_vision[] = {
 	{"__gc",			m_vision_gc},
 	{"__tostring",		m_vision_tostring},
@@ -340,6 +423,7 @@ static const luaL_Reg m_vision[] = {
 	{"colormap",		m_vision_colormap},
 	{"erode",			m_vision_erode},
 	{"dilate",			m_vision_dilate},
+	{"pipeline",		m_vision_pipeline},
 
 	{NULL, NULL}
 };
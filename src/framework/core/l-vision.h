@@ -11,6 +11,7 @@ extern "C" {
 
 struct lvision_t {
 	struct vision_t * v;
+	struct vision_pipeline_t * pipeline;
 };
 
 int luaopen_vision(lua_State * L);
@@ -105,6 +105,13 @@ static int m_window_to_back(lua_State * L)
 	return 0;
 }
 
+static int m_window_is_dirty(lua_State * L)
+{
+	struct window_t * w = luaL_checkudata(L, 1, MT_WINDOW);
+	lua_pushboolean(L, window_is_active(w) && window_is_dirty(w));
+	return 1;
+}
+
 static int m_window_snapshot(lua_State * L)
 {
 	struct window_t * w = luaL_checkudata(L, 1, MT_WINDOW);
@@ -133,6 +140,7 @@ static const luaL_Reg m_window[] = {
 	{"getBacklight",		m_window_get_backlight},
 	{"toFront",				m_window_to_front},
 	{"toBack",				m_window_to_back},
+	{"isDirty",				m_window_is_dirty},
 	{"snapshot",			m_window_snapshot},
 	{"addFont",				m_window_add_font},
 	{NULL, NULL}
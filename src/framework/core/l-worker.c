@@ -0,0 +1,810 @@
+/*
+ * framework/core/l-worker.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <input/input.h>
+#include <graphic/imgcache.h>
+#include <core/l-image.h>
+#include <core/l-vision.h>
+#include <core/l-worker.h>
+
+#define MT_WORKER		"__mt_worker__"
+#define WORKER_QUEUE	(64)
+#define WORKER_DEPTH	(32)
+
+enum {
+	WORKER_TAG_NIL		= 0,
+	WORKER_TAG_FALSE	= 1,
+	WORKER_TAG_TRUE		= 2,
+	WORKER_TAG_INTEGER	= 3,
+	WORKER_TAG_NUMBER	= 4,
+	WORKER_TAG_STRING	= 5,
+	WORKER_TAG_TABLE	= 6,
+	WORKER_TAG_END		= 7,
+	WORKER_TAG_IMAGE	= 8,
+	WORKER_TAG_VISION	= 9,
+};
+
+/*
+ * Shared by the host vm and the worker vm, the last one to let go frees it.
+ * The host never blocks on a worker, what does not fit into the in channel
+ * waits on the backlog, which only the host touches.
+ */
+struct lworker_t {
+	struct channel_t * in;
+	struct channel_t * out;
+	struct list_head backlog;
+	struct window_t * w;
+	char * path;
+	char * name;
+	spinlock_t lock;
+	int ref;
+	int notified;
+	int stalled;
+	int closed;
+	int done;
+};
+
+/*
+ * Surfaces and visions ride along as pointers, a message owns them until
+ * they are pushed on the receiving side. Moved ones are still owned by the
+ * sender until the message is committed.
+ */
+struct lworker_obj_t {
+	int tag;
+	void * ptr;
+	void * src;
+	int moved;
+};
+
+struct lworker_msg_t {
+	struct list_head entry;
+	unsigned char * data;
+	size_t len;
+	size_t size;
+	struct lworker_obj_t * objs;
+	int nobj;
+	int sobj;
+};
+
+static const char __worker_list_key = 0;
+static const char __worker_self_key = 0;
+static struct input_t __worker_input = { .name = "worker" };
+
+static struct lworker_msg_t * msg_alloc(void)
+{
+	struct lworker_msg_t * m;
+
+	m = malloc(sizeof(struct lworker_msg_t));
+	if(!m)
+		return NULL;
+	memset(m, 0, sizeof(struct lworker_msg_t));
+	init_list_head(&m->entry);
+	return m;
+}
+
+static void msg_free(struct lworker_msg_t * m)
+{
+	struct lworker_obj_t * o;
+	int i;
+
+	if(!m)
+		return;
+	for(i = 0; i < m->nobj; i++)
+	{
+		o = &m->objs[i];
+		if(o->ptr && !o->moved)
+		{
+			if(o->tag == WORKER_TAG_IMAGE)
+				surface_free(o->ptr);
+			else if(o->tag == WORKER_TAG_VISION)
+				vision_free(o->ptr);
+		}
+	}
+	free(m->objs);
+	free(m->data);
+	free(m);
+}
+
+static int msg_write(struct lworker_msg_t * m, const void * p, size_t len)
+{
+	unsigned char * data;
+	size_t size;
+
+	if(m->len + len > m->size)
+	{
+		size = max(m->size * 2, m->len + len + 64);
+		data = realloc(m->data, size);
+		if(!data)
+			return 0;
+		m->data = data;
+		m->size = size;
+	}
+	memcpy(m->data + m->len, p, len);
+	m->len += len;
+	return 1;
+}
+
+static int msg_write_tag(struct lworker_msg_t * m, int tag)
+{
+	unsigned char c = tag;
+	return msg_write(m, &c, 1);
+}
+
+static int msg_write_obj(struct lworker_msg_t * m, int tag, void * src, void * ptr, int moved)
+{
+	struct lworker_obj_t * objs;
+	int i;
+
+	for(i = 0; i < m->nobj; i++)
+	{
+		if(m->objs[i].src == src)
+			break;
+	}
+	if(i == m->nobj)
+	{
+		if(!ptr)
+			return 0;
+		if(m->nobj >= m->sobj)
+		{
+			objs = realloc(m->objs, sizeof(struct lworker_obj_t) * (m->sobj + 4));
+			if(!objs)
+				return 0;
+			m->objs = objs;
+			m->sobj += 4;
+		}
+		m->objs[i].tag = tag;
+		m->objs[i].ptr = ptr;
+		m->objs[i].src = src;
+		m->objs[i].moved = moved;
+		m->nobj++;
+	}
+	else if(ptr && !moved)
+	{
+		if(tag == WORKER_TAG_IMAGE)
+			surface_free(ptr);
+		else
+			vision_free(ptr);
+	}
+	return msg_write_tag(m, tag) && msg_write(m, &i, sizeof(int));
+}
+
+static const char * msg_encode(lua_State * L, struct lworker_msg_t * m, int idx, int transfer, int depth)
+{
+	const char * err;
+	const char * s;
+	lua_Integer i;
+	lua_Number n;
+	size_t l;
+
+	idx = lua_absindex(L, idx);
+	switch(lua_type(L, idx))
+	{
+	case LUA_TNIL:
+		if(!msg_write_tag(m, WORKER_TAG_NIL))
+			return "out of memory";
+		break;
+
+	case LUA_TBOOLEAN:
+		if(!msg_write_tag(m, lua_toboolean(L, idx) ? WORKER_TAG_TRUE : WORKER_TAG_FALSE))
+			return "out of memory";
+		break;
+
+	case LUA_TNUMBER:
+		if(lua_isinteger(L, idx))
+		{
+			i = lua_tointeger(L, idx);
+			if(!msg_write_tag(m, WORKER_TAG_INTEGER) || !msg_write(m, &i, sizeof(lua_Integer)))
+				return "out of memory";
+		}
+		else
+		{
+			n = lua_tonumber(L, idx);
+			if(!msg_write_tag(m, WORKER_TAG_NUMBER) || !msg_write(m, &n, sizeof(lua_Number)))
+				return "out of memory";
+		}
+		break;
+
+	case LUA_TSTRING:
+		s = lua_tolstring(L, idx, &l);
+		if(!msg_write_tag(m, WORKER_TAG_STRING) || !msg_write(m, &l, sizeof(size_t)) || !msg_write(m, s, l))
+			return "out of memory";
+		break;
+
+	case LUA_TTABLE:
+		if(depth >= WORKER_DEPTH)
+			return "table nested too deep";
+		luaL_checkstack(L, 3, NULL);
+		if(!msg_write_tag(m, WORKER_TAG_TABLE))
+			return "out of memory";
+		lua_pushnil(L);
+		while(lua_next(L, idx))
+		{
+			if((err = msg_encode(L, m, -2, transfer, depth + 1)) || (err = msg_encode(L, m, -1, transfer, depth + 1)))
+			{
+				lua_pop(L, 2);
+				return err;
+			}
+			lua_pop(L, 1);
+		}
+		if(!msg_write_tag(m, WORKER_TAG_END))
+			return "out of memory";
+		break;
+
+	case LUA_TUSERDATA:
+		if(luaL_testudata(L, idx, MT_IMAGE))
+		{
+			struct limage_t * img = lua_touserdata(L, idx);
+			if(transfer && !imgcache_owned(img->s))
+			{
+				if(!msg_write_obj(m, WORKER_TAG_IMAGE, img, img->s, 1))
+					return "out of memory";
+			}
+			else if(!msg_write_obj(m, WORKER_TAG_IMAGE, img, surface_clone(img->s, 0, 0, 0, 0, 0), 0))
+				return "out of memory";
+		}
+		else if(luaL_testudata(L, idx, MT_VISION))
+		{
+			struct lvision_t * vision = lua_touserdata(L, idx);
+			if(!msg_write_obj(m, WORKER_TAG_VISION, vision, transfer ? vision->v : vision_clone(vision->v, 0, 0, 0, 0), transfer))
+				return "out of memory";
+		}
+		else
+			return "userdata can not be posted";
+		break;
+
+	default:
+		return "value can not be posted";
+	}
+	return NULL;
+}
+
+/*
+ * The sender gives up moved buffers for tiny placeholders, so its handles stay usable
+ */
+static void msg_commit(struct lworker_msg_t * m)
+{
+	struct lworker_obj_t * o;
+	int i;
+
+	for(i = 0; i < m->nobj; i++)
+	{
+		o = &m->objs[i];
+		if(o->moved)
+		{
+			if(o->tag == WORKER_TAG_IMAGE)
+				((struct limage_t *)o->src)->s = surface_alloc(1, 1, NULL);
+			else if(o->tag == WORKER_TAG_VISION)
+				((struct lvision_t *)o->src)->v = vision_alloc(((struct vision_t *)o->ptr)->type, 1, 1);
+			o->moved = 0;
+		}
+		o->src = NULL;
+	}
+}
+
+static void msg_decode(lua_State * L, struct lworker_msg_t * m, size_t * pos, int cache)
+{
+	struct lworker_obj_t * o;
+	lua_Integer i;
+	lua_Number n;
+	size_t l;
+	int idx;
+
+	luaL_checkstack(L, 3, NULL);
+	switch(m->data[(*pos)++])
+	{
+	case WORKER_TAG_FALSE:
+		lua_pushboolean(L, 0);
+		break;
+	case WORKER_TAG_TRUE:
+		lua_pushboolean(L, 1);
+		break;
+	case WORKER_TAG_INTEGER:
+		memcpy(&i, m->data + *pos, sizeof(lua_Integer));
+		*pos += sizeof(lua_Integer);
+		lua_pushinteger(L, i);
+		break;
+	case WORKER_TAG_NUMBER:
+		memcpy(&n, m->data + *pos, sizeof(lua_Number));
+		*pos += sizeof(lua_Number);
+		lua_pushnumber(L, n);
+		break;
+	case WORKER_TAG_STRING:
+		memcpy(&l, m->data + *pos, sizeof(size_t));
+		*pos += sizeof(size_t);
+		lua_pushlstring(L, (const char *)m->data + *pos, l);
+		*pos += l;
+		break;
+	case WORKER_TAG_TABLE:
+		lua_newtable(L);
+		while(m->data[*pos] != WORKER_TAG_END)
+		{
+			msg_decode(L, m, pos, cache);
+			msg_decode(L, m, pos, cache);
+			lua_rawset(L, -3);
+		}
+		(*pos)++;
+		break;
+	case WORKER_TAG_IMAGE:
+	case WORKER_TAG_VISION:
+		memcpy(&idx, m->data + *pos, sizeof(int));
+		*pos += sizeof(int);
+		if(lua_rawgeti(L, cache, idx + 1) != LUA_TNIL)
+			break;
+		lua_pop(L, 1);
+		o = &m->objs[idx];
+		if(o->tag == WORKER_TAG_IMAGE)
+		{
+			struct limage_t * img = lua_newuserdatauv(L, sizeof(struct limage_t), 0);
+			img->s = o->ptr;
+			luaL_setmetatable(L, MT_IMAGE);
+		}
+		else
+		{
+			struct lvision_t * vision = lua_newuserdatauv(L, sizeof(struct lvision_t), 0);
+			vision->v = o->ptr;
+			vision->pipeline = NULL;
+			luaL_setmetatable(L, MT_VISION);
+		}
+		o->ptr = NULL;
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, cache, idx + 1);
+		break;
+	default:
+		lua_pushnil(L);
+		break;
+	}
+}
+
+static struct lworker_msg_t * msg_pack(lua_State * L, int idx, int transfer)
+{
+	struct lworker_msg_t * m;
+	const char * err;
+
+	m = msg_alloc();
+	if(!m)
+		luaL_error(L, "out of memory");
+	if((err = msg_encode(L, m, idx, transfer, 0)))
+	{
+		msg_free(m);
+		luaL_error(L, "%s", err);
+	}
+	msg_commit(m);
+	return m;
+}
+
+static void msg_push(lua_State * L, struct lworker_msg_t * m)
+{
+	size_t pos = 0;
+
+	lua_newtable(L);
+	if(m->len > 0)
+		msg_decode(L, m, &pos, lua_gettop(L));
+	else
+		lua_pushnil(L);
+	lua_remove(L, -2);
+	msg_free(m);
+}
+
+static void worker_drain(struct channel_t * c)
+{
+	struct lworker_msg_t * m;
+
+	while(channel_tryrecv(c, (unsigned char *)&m, sizeof(struct lworker_msg_t *)))
+		msg_free(m);
+}
+
+/*
+ * Post a system worker event to the host window, called with the lock held. The flag
+ * only stays set when the event was queued, otherwise the next post tries again.
+ */
+static void worker_notify(struct lworker_t * wk)
+{
+	struct event_t e;
+
+	if(!wk->closed && !wk->notified && wk->w)
+	{
+		e.device = &__worker_input;
+		e.type = EVENT_TYPE_SYSTEM_WORKER;
+		wk->notified = window_push_event(wk->w, &e);
+	}
+}
+
+/*
+ * Host side, move the backlog into the in channel as far as it fits. The worker is
+ * told to notify the host once it makes room, marked before the retry so that a
+ * recv racing the full channel is not missed.
+ */
+static void worker_flush(struct lworker_t * wk)
+{
+	struct lworker_msg_t * m, * n;
+
+	list_for_each_entry_safe(m, n, &wk->backlog, entry)
+	{
+		if(!channel_trysend(wk->in, (unsigned char *)&m, sizeof(struct lworker_msg_t *)))
+		{
+			spin_lock(&wk->lock);
+			wk->stalled = 1;
+			spin_unlock(&wk->lock);
+			if(!channel_trysend(wk->in, (unsigned char *)&m, sizeof(struct lworker_msg_t *)))
+				break;
+		}
+		list_del_init(&m->entry);
+	}
+}
+
+static void worker_put(struct lworker_t * wk)
+{
+	int ref;
+
+	spin_lock(&wk->lock);
+	ref = --wk->ref;
+	spin_unlock(&wk->lock);
+	if(ref == 0)
+	{
+		worker_drain(wk->in);
+		worker_drain(wk->out);
+		channel_free(wk->in);
+		channel_free(wk->out);
+		free(wk->path);
+		free(wk->name);
+		free(wk);
+	}
+}
+
+/*
+ * Host side, drop whatever is still queued both ways and wake the worker with a nil
+ * message. Only the host sends on the in channel, so once drained the nil fits.
+ */
+static void worker_close(struct lworker_t * wk)
+{
+	struct lworker_msg_t * m, * n;
+	int done;
+
+	spin_lock(&wk->lock);
+	wk->closed = 1;
+	wk->w = NULL;
+	done = wk->done;
+	spin_unlock(&wk->lock);
+	list_for_each_entry_safe(m, n, &wk->backlog, entry)
+	{
+		list_del(&m->entry);
+		msg_free(m);
+	}
+	worker_drain(wk->out);
+	if(!done)
+	{
+		worker_drain(wk->in);
+		m = NULL;
+		channel_trysend(wk->in, (unsigned char *)&m, sizeof(struct lworker_msg_t *));
+	}
+	worker_put(wk);
+}
+
+/*
+ * Round robin over the other online cpus, the current one if none is running
+ */
+static int worker_next_cpu(void)
+{
+	static int next = 0;
+	int self = smp_processor_id();
+	int i, cpu;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		cpu = (unsigned int)(next++) % CONFIG_MAX_SMP_CPUS;
+		if((cpu != self) && scheduler_is_online(cpu))
+			return cpu;
+	}
+	return self;
+}
+
+static struct lworker_t * worker_self(lua_State * L)
+{
+	struct lworker_t * wk;
+
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__worker_self_key);
+	wk = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	if(!wk)
+		luaL_error(L, "not running in a worker");
+	return wk;
+}
+
+const char * lworker_get_path(struct lworker_t * wk)
+{
+	return wk->path;
+}
+
+const char * lworker_get_name(struct lworker_t * wk)
+{
+	return wk->name;
+}
+
+void lworker_attach(lua_State * L, struct lworker_t * wk)
+{
+	lua_pushlightuserdata(L, wk);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &__worker_self_key);
+}
+
+void lworker_exit(struct lworker_t * wk)
+{
+	spin_lock(&wk->lock);
+	wk->done = 1;
+	worker_notify(wk);
+	spin_unlock(&wk->lock);
+	worker_drain(wk->in);
+	worker_put(wk);
+}
+
+/*
+ * Worker.new(name, func [, cpu]) runs require(name) in a new vm on another cpu,
+ * func(worker, value) is called on the host vm for every value the worker posts
+ */
+static int l_worker_new(lua_State * L)
+{
+	struct vmctx_t * ctx = luahelper_vmctx(L);
+	const char * name = luaL_checkstring(L, 1);
+	int cpu = luaL_optinteger(L, 3, -1);
+	struct lworker_t ** p;
+	struct lworker_t * wk;
+	struct task_t * task;
+
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+	if(!scheduler_is_online(cpu))
+		cpu = worker_next_cpu();
+
+	wk = malloc(sizeof(struct lworker_t));
+	if(!wk)
+		return 0;
+	wk->in = channel_alloc(sizeof(struct lworker_msg_t *) * WORKER_QUEUE);
+	wk->out = channel_alloc(sizeof(struct lworker_msg_t *) * WORKER_QUEUE);
+	init_list_head(&wk->backlog);
+	wk->w = ctx->w;
+	wk->path = strdup(ctx->path);
+	wk->name = strdup(name);
+	spin_lock_init(&wk->lock);
+	wk->ref = 2;
+	wk->notified = 0;
+	wk->stalled = 0;
+	wk->closed = 0;
+	wk->done = 0;
+	task = (wk->in && wk->out && wk->path && wk->name) ? vmworker(&__sched[cpu], wk->name, wk) : NULL;
+	if(!task)
+	{
+		if(wk->in)
+			channel_free(wk->in);
+		if(wk->out)
+			channel_free(wk->out);
+		if(wk->path)
+			free(wk->path);
+		if(wk->name)
+			free(wk->name);
+		free(wk);
+		return 0;
+	}
+
+	p = lua_newuserdatauv(L, sizeof(struct lworker_t *), 1);
+	*p = wk;
+	lua_pushvalue(L, 2);
+	lua_setiuservalue(L, -2, 1);
+	luaL_setmetatable(L, MT_WORKER);
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__worker_list_key);
+	lua_pushvalue(L, -2);
+	lua_rawsetp(L, -2, wk);
+	lua_pop(L, 1);
+	if(cpu == smp_processor_id())
+		task_resume(task);
+	else
+		task_wakeup(task);
+	return 1;
+}
+
+/*
+ * Worker.recv() blocks the worker until the host posts, nil once the host is gone
+ */
+static int l_worker_recv(lua_State * L)
+{
+	struct lworker_t * wk = worker_self(L);
+	struct lworker_msg_t * m;
+
+	channel_recv(wk->in, (unsigned char *)&m, sizeof(struct lworker_msg_t *));
+	spin_lock(&wk->lock);
+	if(wk->stalled)
+	{
+		wk->stalled = 0;
+		worker_notify(wk);
+	}
+	spin_unlock(&wk->lock);
+	if(!m)
+		return 0;
+	msg_push(L, m);
+	return 1;
+}
+
+/*
+ * Worker.post(value [, transfer]) sends a value back to the host, with transfer
+ * set the images and visions in it are moved instead of copied
+ */
+static int l_worker_post(lua_State * L)
+{
+	struct lworker_t * wk = worker_self(L);
+	struct lworker_msg_t * m;
+	int closed;
+
+	if(wk->closed)
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	m = msg_pack(L, 1, lua_toboolean(L, 2));
+	if(!channel_trysend(wk->out, (unsigned char *)&m, sizeof(struct lworker_msg_t *)))
+	{
+		/* Full, make sure the host knows before blocking on it */
+		spin_lock(&wk->lock);
+		worker_notify(wk);
+		spin_unlock(&wk->lock);
+		channel_send(wk->out, (unsigned char *)&m, sizeof(struct lworker_msg_t *));
+	}
+	spin_lock(&wk->lock);
+	closed = wk->closed;
+	worker_notify(wk);
+	spin_unlock(&wk->lock);
+	lua_pushboolean(L, !closed);
+	return 1;
+}
+
+/*
+ * Worker.schedule() hands everything the workers of this vm posted to their callbacks,
+ * feeds them their backlog and forgets the ones that have exited
+ */
+static int l_worker_schedule(lua_State * L)
+{
+	struct lworker_t * wk;
+	struct lworker_msg_t * m;
+	int i, n = 0;
+	int done;
+
+	lua_newtable(L);
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__worker_list_key);
+	lua_pushnil(L);
+	while(lua_next(L, -2))
+		lua_rawseti(L, -4, ++n);
+	lua_pop(L, 1);
+	for(i = 1; i <= n; i++)
+	{
+		lua_rawgeti(L, -1, i);
+		wk = *((struct lworker_t **)lua_touserdata(L, -1));
+		if(wk)
+		{
+			spin_lock(&wk->lock);
+			wk->notified = 0;
+			done = wk->done;
+			spin_unlock(&wk->lock);
+			worker_flush(wk);
+			while(*((struct lworker_t **)lua_touserdata(L, -1)) && channel_tryrecv(wk->out, (unsigned char *)&m, sizeof(struct lworker_msg_t *)))
+			{
+				lua_getiuservalue(L, -1, 1);
+				lua_pushvalue(L, -2);
+				msg_push(L, m);
+				lua_call(L, 2, 0);
+			}
+			if(done && *((struct lworker_t **)lua_touserdata(L, -1)))
+			{
+				lua_rawgetp(L, LUA_REGISTRYINDEX, &__worker_list_key);
+				lua_pushnil(L);
+				lua_rawsetp(L, -2, wk);
+				lua_pop(L, 1);
+			}
+		}
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+	return 0;
+}
+
+static const luaL_Reg l_worker[] = {
+	{"new",			l_worker_new},
+	{"recv",		l_worker_recv},
+	{"post",		l_worker_post},
+	{"schedule",	l_worker_schedule},
+	{NULL,			NULL}
+};
+
+static int m_worker_gc(lua_State * L)
+{
+	struct lworker_t ** p = luaL_checkudata(L, 1, MT_WORKER);
+	if(*p)
+	{
+		worker_close(*p);
+		*p = NULL;
+	}
+	return 0;
+}
+
+static int m_worker_post(lua_State * L)
+{
+	struct lworker_t ** p = luaL_checkudata(L, 1, MT_WORKER);
+	struct lworker_msg_t * m;
+
+	if(!*p || (*p)->done)
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	m = msg_pack(L, 2, lua_toboolean(L, 3));
+	list_add_tail(&m->entry, &(*p)->backlog);
+	worker_flush(*p);
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+static int m_worker_terminate(lua_State * L)
+{
+	struct lworker_t ** p = luaL_checkudata(L, 1, MT_WORKER);
+	if(*p)
+	{
+		lua_rawgetp(L, LUA_REGISTRYINDEX, &__worker_list_key);
+		lua_pushnil(L);
+		lua_rawsetp(L, -2, *p);
+		lua_pop(L, 1);
+		worker_close(*p);
+		*p = NULL;
+	}
+	return 0;
+}
+
+static int m_worker_status(lua_State * L)
+{
+	struct lworker_t ** p = luaL_checkudata(L, 1, MT_WORKER);
+	lua_pushboolean(L, *p && !(*p)->done);
+	return 1;
+}
+
+static const luaL_Reg m_worker[] = {
+	{"__gc",		m_worker_gc},
+	{"post",		m_worker_post},
+	{"terminate",	m_worker_terminate},
+	{"status",		m_worker_status},
+	{NULL,			NULL}
+};
+
+int luaopen_worker(lua_State * L)
+{
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__worker_list_key);
+	if(lua_isnil(L, -1))
+	{
+		/* Strong, a running worker stays alive until it exits or is terminated */
+		lua_newtable(L);
+		lua_rawsetp(L, LUA_REGISTRYINDEX, &__worker_list_key);
+	}
+	lua_pop(L, 1);
+	luaL_newlib(L, l_worker);
+	luahelper_create_metatable(L, MT_WORKER, m_worker);
+	return 1;
+}
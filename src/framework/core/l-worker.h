@@ -0,0 +1,22 @@
+#ifndef __FRAMEWORK_CORE_L_WORKER_H__
+#define __FRAMEWORK_CORE_L_WORKER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <luahelper.h>
+
+struct lworker_t;
+
+const char * lworker_get_path(struct lworker_t * wk);
+const char * lworker_get_name(struct lworker_t * wk);
+void lworker_attach(lua_State * L, struct lworker_t * wk);
+void lworker_exit(struct lworker_t * wk);
+int luaopen_worker(lua_State * L);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FRAMEWORK_CORE_L_WORKER_H__ */
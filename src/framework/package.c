@@ -44,7 +44,7 @@ static struct package_t * package_alloc(const char * path, const char * lang)
 	int i, j;
 
 	ctx = xfs_alloc(path, 0);
-	if(ctx && xfs_isfile(ctx, "main.lua"))
+	if(ctx && (xfs_isfile(ctx, "main.lua") || xfs_isfile(ctx, "main.luac")))
 	{
 		pkg = malloc(sizeof(struct package_t));
 		if(pkg)
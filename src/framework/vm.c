@@ -28,6 +28,7 @@
 
 #include <xfs/xfs.h>
 #include <luahelper.h>
+#include <lgc.h>
 #include <core/l-application.h>
 #include <core/l-assets.h>
 #include <core/l-class.h>
@@ -57,6 +58,7 @@
 #include <core/l-timer.h>
 #include <core/l-vision.h>
 #include <core/l-window.h>
+#include <core/l-worker.h>
 #include <core/l-xfs.h>
 #include <codec/l-codec.h>
 #include <hardware/l-hardware.h>
@@ -91,6 +93,7 @@ static void luaopen_glblibs(lua_State * L)
 		{ "DisplayText",			luaopen_display_text },
 		{ "DisplayIcon",			luaopen_display_icon },
 		{ "Timer",					luaopen_timer },
+		{ "Worker",					luaopen_worker },
 		{ "Vision",					luaopen_vision },
 		{ "Stage",					luaopen_stage },
 		{ "Assets",					luaopen_assets },
@@ -154,6 +157,11 @@ static const char boot_lua[] = X(
 	assets = Assets.new()
 	T = I18n.new(Setting.get("language", "en-US"))
 	if require("main") then
+		if Setting.get("vm-report", "0") ~= "0" then
+			for i, v in ipairs(xboot.modules()) do
+				print(string.format("%-40s %-8s parse %8.3fms exec %8.3fms", v.name, v.kind, v.parse * 1000, v.exec * 1000))
+			end
+		end
 		stage:loop()
 	end
 );
@@ -187,39 +195,260 @@ static const char * reader(lua_State * L, void * data, size_t * size)
 	return rd->buffer;
 }
 
-static int l_loadfile(lua_State * L)
+struct writer_data_t
+{
+	char * buf;
+	size_t len;
+	size_t size;
+};
+
+static int writer(lua_State * L, const void * p, size_t size, void * data)
+{
+	struct writer_data_t * wd = (struct writer_data_t *)data;
+	size_t sz;
+	char * buf;
+
+	if(wd->len + size > wd->size)
+	{
+		sz = max(wd->size << 1, max(wd->len + size, (size_t)SZ_4K));
+		buf = realloc(wd->buf, sz);
+		if(!buf)
+			return 1;
+		wd->buf = buf;
+		wd->size = sz;
+	}
+	memcpy(wd->buf + wd->len, p, size);
+	wd->len += size;
+	return 0;
+}
+
+static int vm_load(lua_State * L, struct xfs_file_t * file, const char * chunkname, const char * mode)
 {
-	struct xfs_context_t * ctx = ((struct vmctx_t *)luahelper_vmctx(L))->xfs;
-	const char * filename = luaL_optstring(L, 1, NULL);
 	struct reader_data_t * rd;
+	int status;
 
 	rd = malloc(sizeof(struct reader_data_t));
 	if(!rd)
 	{
-		lua_pushnil(L);
-		lua_pushfstring(L, "cannot malloc memory", filename);
-		return 2;
+		lua_pushliteral(L, "cannot malloc memory");
+		return LUA_ERRMEM;
+	}
+	rd->file = file;
+	status = lua_load(L, reader, rd, chunkname, mode);
+	free(rd);
+	return status;
+}
+
+/*
+ * Lua does not verify binary chunks, they are only trusted from read-only
+ * mounts such as the romdisk and never from application writable storage.
+ */
+static int vm_trusted(struct xfs_file_t * file)
+{
+	struct vfs_mount_t * m, * best = NULL;
+	const char * path = file->path->path;
+	size_t len, l = 0;
+	int i;
+
+	if(file->path->writable)
+		return 0;
+	for(i = 0; (m = vfs_mount_get(i)) != NULL; i++)
+	{
+		len = strlen(m->m_path);
+		if((len >= l) && (strncmp(path, m->m_path, len) == 0) && ((len == 1) || (path[len] == '/') || (path[len] == '\0')))
+		{
+			best = m;
+			l = len;
+		}
+	}
+	return (best && (best->m_flags & MOUNT_RO)) ? 1 : 0;
+}
+
+/*
+ * Compiled chunks are cached in kernel memory and never on a writable mount,
+ * keyed by the full source path and tagged with its mtime and length. The
+ * cache is shared by all vms, the coldest dumps go first beyond the budget.
+ */
+#define VM_CACHE_BUDGET		(SZ_1M)
+
+struct vm_cache_entry_t {
+	struct list_head entry;
+	char * name;
+	u64_t mtime;
+	s64_t length;
+	char * buf;
+	size_t len;
+};
+
+static struct {
+	struct list_head lru;
+	size_t bytes;
+	spinlock_t lock;
+} __vm_cache = {
+	.lru = {
+		.next = &__vm_cache.lru,
+		.prev = &__vm_cache.lru,
+	},
+	.bytes = 0,
+	.lock = SPIN_LOCK_INIT(),
+};
+
+static void vm_cache_entry_free(struct vm_cache_entry_t * e)
+{
+	if(e)
+	{
+		free(e->name);
+		free(e->buf);
+		free(e);
 	}
+}
 
-	rd->file = xfs_open_read(ctx, filename);
-	if(!rd->file)
+static struct vm_cache_entry_t * vm_cache_search(const char * name)
+{
+	struct vm_cache_entry_t * pos;
+
+	list_for_each_entry(pos, &__vm_cache.lru, entry)
+	{
+		if(strcmp(pos->name, name) == 0)
+			return pos;
+	}
+	return NULL;
+}
+
+static void vm_cache_store(struct vm_cache_entry_t * e)
+{
+	struct vm_cache_entry_t * pos, * n;
+	struct list_head victims;
+	irq_flags_t flags;
+
+	init_list_head(&victims);
+	spin_lock_irqsave(&__vm_cache.lock, flags);
+	pos = vm_cache_search(e->name);
+	if(pos)
+	{
+		list_move(&pos->entry, &victims);
+		__vm_cache.bytes -= pos->len;
+	}
+	list_add(&e->entry, &__vm_cache.lru);
+	__vm_cache.bytes += e->len;
+	list_for_each_entry_safe_reverse(pos, n, &__vm_cache.lru, entry)
+	{
+		if((__vm_cache.bytes <= VM_CACHE_BUDGET) || (pos == e))
+			break;
+		list_move(&pos->entry, &victims);
+		__vm_cache.bytes -= pos->len;
+	}
+	spin_unlock_irqrestore(&__vm_cache.lock, flags);
+	list_for_each_entry_safe(pos, n, &victims, entry)
+	{
+		list_del(&pos->entry);
+		vm_cache_entry_free(pos);
+	}
+}
+
+/*
+ * The dump is copied out under the lock, another vm may evict the entry
+ * while this one is still undumping it.
+ */
+static char * vm_cache_fetch(const char * name, u64_t mtime, s64_t length, size_t * len)
+{
+	struct vm_cache_entry_t * e;
+	irq_flags_t flags;
+	char * buf = NULL;
+
+	spin_lock_irqsave(&__vm_cache.lock, flags);
+	e = vm_cache_search(name);
+	if(e && (e->mtime == mtime) && (e->length == length))
+	{
+		buf = malloc(e->len);
+		if(buf)
+		{
+			memcpy(buf, e->buf, e->len);
+			*len = e->len;
+			list_move(&e->entry, &__vm_cache.lru);
+		}
+	}
+	spin_unlock_irqrestore(&__vm_cache.lock, flags);
+	return buf;
+}
+
+static int vm_load_cached(lua_State * L, const char * filename, struct xfs_file_t * src, int * hit)
+{
+	struct writer_data_t wd;
+	struct vm_cache_entry_t * e;
+	u64_t mtime = xfs_mtime(src);
+	s64_t length = xfs_length(src);
+	char * name, * buf;
+	size_t len;
+	int status;
+
+	*hit = 0;
+	name = malloc(strlen(src->path->path) + strlen(filename) + 2);
+	if(!name)
+		return vm_load(L, src, filename, "t");
+	sprintf(name, "%s/%s", src->path->path, filename);
+	buf = vm_cache_fetch(name, mtime, length, &len);
+	if(buf)
+	{
+		status = luaL_loadbufferx(L, buf, len, filename, "b");
+		free(buf);
+		if(status == LUA_OK)
+		{
+			free(name);
+			*hit = 1;
+			return LUA_OK;
+		}
+		lua_pop(L, 1);
+	}
+
+	status = vm_load(L, src, filename, "t");
+	if(status == LUA_OK)
+	{
+		wd.buf = NULL;
+		wd.len = 0;
+		wd.size = 0;
+		e = malloc(sizeof(struct vm_cache_entry_t));
+		if(e && (lua_dump(L, writer, &wd, 1) == 0) && (wd.len <= VM_CACHE_BUDGET / 4))
+		{
+			init_list_head(&e->entry);
+			e->name = name;
+			e->mtime = mtime;
+			e->length = length;
+			e->buf = wd.buf;
+			e->len = wd.len;
+			vm_cache_store(e);
+			return LUA_OK;
+		}
+		free(wd.buf);
+		free(e);
+	}
+	free(name);
+	return status;
+}
+
+static int l_loadfile(lua_State * L)
+{
+	struct xfs_context_t * ctx = ((struct vmctx_t *)luahelper_vmctx(L))->xfs;
+	const char * filename = luaL_optstring(L, 1, NULL);
+	struct xfs_file_t * file;
+
+	file = xfs_open_read(ctx, filename);
+	if(!file)
 	{
-		free(rd);
 		lua_pushnil(L);
 		lua_pushfstring(L, "cannot open %s", filename);
 		return 2;
 	}
 
-	if(lua_load(L, reader, rd, filename, NULL))
+	if(vm_load(L, file, filename, vm_trusted(file) ? NULL : "t") != LUA_OK)
 	{
-		free(rd);
+		xfs_close(file);
 		lua_pushnil(L);
 		lua_pushfstring(L, "cannot read %s", filename);
 		return 2;
 	}
 
-	xfs_close(rd->file);
-	free(rd);
+	xfs_close(file);
 	return 1;
 }
 
@@ -237,12 +466,31 @@ static int l_dofile(lua_State * L)
 	return dofilecont(L, 0, 0);
 }
 
+static const char __vm_modules_key = 0;
+
+static int l_module_run(lua_State * L)
+{
+	ktime_t t = ktime_get();
+	int n = lua_gettop(L);
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, n, LUA_MULTRET);
+	lua_pushnumber(L, ktime_us_delta(ktime_get(), t) / 1000000.0);
+	lua_setfield(L, lua_upvalueindex(2), "exec");
+	return lua_gettop(L);
+}
+
 static int l_search_package_lua(lua_State * L)
 {
 	struct xfs_context_t * ctx = ((struct vmctx_t *)luahelper_vmctx(L))->xfs;
 	const char * filename = lua_tostring(L, -1);
+	const char * kind = NULL;
+	struct xfs_file_t * file;
+	ktime_t t;
 	char * buf;
 	size_t len, i;
+	int status, hit = 0;
 
 	len = strlen(filename);
 	buf = malloc(len + 16);
@@ -257,26 +505,159 @@ static int l_search_package_lua(lua_State * L)
 	}
 
 	if(xfs_isdir(ctx, buf))
-		strcat(buf, "/init.lua");
+		strcat(buf, "/init.luac");
 	else
-		strcat(buf, ".lua");
+		strcat(buf, ".luac");
 
-	if(xfs_isfile(ctx, buf))
+	t = ktime_get();
+	file = xfs_open_read(ctx, buf);
+	len = strlen(buf) - 1;
+	buf[len] = 0;
+	if(file)
 	{
-		lua_pop(L, 1);
-		lua_pushcfunction(L, l_loadfile);
-		lua_pushstring(L, buf);
-		lua_call(L, 1, 1);
+		if(vm_trusted(file))
+		{
+			if(vm_load(L, file, buf, "b") == LUA_OK)
+				kind = "bytecode";
+			else
+				lua_pop(L, 1);
+		}
+		xfs_close(file);
 	}
-	else
+
+	if(!kind)
 	{
-		lua_pushfstring(L, "\r\n\tno file '%s' in application directories", buf);
+		file = xfs_open_read(ctx, buf);
+		if(!file)
+		{
+			lua_pushfstring(L, "\r\n\tno file '%s' in application directories", buf);
+			free(buf);
+			return 1;
+		}
+		if(strtol(setting_get("vm-cache", "0"), NULL, 0))
+		{
+			status = vm_load_cached(L, buf, file, &hit);
+			kind = hit ? "cache" : "source";
+		}
+		else
+		{
+			status = vm_load(L, file, buf, vm_trusted(file) ? NULL : "t");
+			kind = "source";
+		}
+		xfs_close(file);
+		if(status != LUA_OK)
+		{
+			lua_pushfstring(L, "error loading module '%s' from file '%s':\r\n\t%s", filename, buf, lua_tostring(L, -1));
+			free(buf);
+			return lua_error(L);
+		}
 	}
 
+	lua_createtable(L, 0, 4);
+	lua_pushstring(L, buf);
+	lua_setfield(L, -2, "name");
+	lua_pushstring(L, kind);
+	lua_setfield(L, -2, "kind");
+	lua_pushnumber(L, ktime_us_delta(ktime_get(), t) / 1000000.0);
+	lua_setfield(L, -2, "parse");
+	lua_pushnumber(L, 0);
+	lua_setfield(L, -2, "exec");
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__vm_modules_key);
+	lua_pushvalue(L, -2);
+	lua_rawseti(L, -2, lua_rawlen(L, -2) + 1);
+	lua_pop(L, 1);
+	lua_pushcclosure(L, l_module_run, 2);
+
 	free(buf);
 	return 1;
 }
 
+/*
+ * Incremental gc steps bounded by a time budget, the work follows twice the
+ * allocation since the previous call and the step size adapts to keep each
+ * step well inside the budget. A generational step is a whole minor or major
+ * collection, so that mode runs at most one basic step and only once due.
+ */
+static int l_xboot_gc(lua_State * L)
+{
+	struct vmctx_t * ctx = (struct vmctx_t *)luahelper_vmctx(L);
+	double budget = luaL_optnumber(L, 1, 0);
+	ktime_t start, deadline, t;
+	size_t heap, work;
+	s64_t us;
+
+	heap = ((size_t)lua_gc(L, LUA_GCCOUNT) << 10) + lua_gc(L, LUA_GCCOUNTB);
+	start = ktime_get();
+	if(isdecGCmodegen(G(L)))
+	{
+		if((budget > 0) && (G(L)->GCdebt > 0))
+		{
+			lua_gc(L, LUA_GCSTEP, 0);
+			heap = ((size_t)lua_gc(L, LUA_GCCOUNT) << 10) + lua_gc(L, LUA_GCCOUNTB);
+		}
+	}
+	else if((budget > 0) && (heap > ctx->gc.heap))
+	{
+		deadline = ktime_add_us(start, budget * 1000000);
+		work = (heap - ctx->gc.heap) * 2;
+		do {
+			t = ktime_get();
+			if(lua_gc(L, LUA_GCSTEP, ctx->gc.step))
+				break;
+			us = ktime_us_delta(ktime_get(), t);
+			if((us > budget * 250000) && (ctx->gc.step > 1))
+				ctx->gc.step >>= 1;
+			else if((us < budget * 62500) && (ctx->gc.step < 1024))
+				ctx->gc.step <<= 1;
+			if(work > ((size_t)ctx->gc.step << 10))
+				work -= (size_t)ctx->gc.step << 10;
+			else
+				work = 0;
+		} while((work > 0) && ktime_before(ktime_get(), deadline));
+		heap = ((size_t)lua_gc(L, LUA_GCCOUNT) << 10) + lua_gc(L, LUA_GCCOUNTB);
+	}
+	ctx->gc.heap = heap;
+	lua_pushnumber(L, ktime_us_delta(ktime_get(), start) / 1000000.0);
+	lua_pushinteger(L, heap);
+	return 2;
+}
+
+static int l_xboot_modules(lua_State * L)
+{
+	lua_rawgetp(L, LUA_REGISTRYINDEX, &__vm_modules_key);
+	return 1;
+}
+
+static int l_xboot_font(lua_State * L)
+{
+	struct vmctx_t * ctx = (struct vmctx_t *)luahelper_vmctx(L);
+	struct font_stats_t stats;
+
+	font_context_stats(ctx->f, &stats);
+	lua_newtable(L);
+	lua_pushinteger(L, stats.atlas_pages);
+	lua_setfield(L, -2, "pages");
+	lua_pushinteger(L, stats.atlas_glyphs);
+	lua_setfield(L, -2, "glyphs");
+	lua_pushinteger(L, stats.atlas_bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushinteger(L, stats.atlas_used);
+	lua_setfield(L, -2, "used");
+	lua_pushinteger(L, stats.glyph_hit);
+	lua_setfield(L, -2, "hit");
+	lua_pushinteger(L, stats.glyph_miss);
+	lua_setfield(L, -2, "miss");
+	lua_pushinteger(L, stats.runs);
+	lua_setfield(L, -2, "runs");
+	lua_pushinteger(L, stats.run_bytes);
+	lua_setfield(L, -2, "runbytes");
+	lua_pushinteger(L, stats.run_hit);
+	lua_setfield(L, -2, "runhit");
+	lua_pushinteger(L, stats.run_miss);
+	lua_setfield(L, -2, "runmiss");
+	return 1;
+}
+
 static int l_xboot_version(lua_State * L)
 {
 	lua_pushstring(L, xboot_version_string());
@@ -325,8 +706,10 @@ static int l_xboot_keygen(lua_State * L)
 	return 1;
 }
 
-static int pmain(lua_State * L)
+static void luaopen_vm(lua_State * L)
 {
+	if(strcmp(setting_get("vm-gc", "incremental"), "generational") == 0)
+		lua_gc(L, LUA_GCGEN, 0, 0);
 	luaL_openlibs(L);
 	luaopen_glblibs(L);
 	luaopen_prelibs(L);
@@ -339,6 +722,8 @@ static int pmain(lua_State * L)
 	lua_pushvalue(L, -1);
 	lua_setglobal(L, "dofile");
 
+	lua_newtable(L);
+	lua_rawsetp(L, LUA_REGISTRYINDEX, &__vm_modules_key);
 	luahelper_package_searcher(L, l_search_package_lua, 2);
 	luahelper_package_path(L, "./?/init.lua;./?.lua");
 	luahelper_package_cpath(L, "./?.so");
@@ -365,22 +750,42 @@ static int pmain(lua_State * L)
 	lua_setfield(L, -2, "uniqueid");
 	lua_pushcfunction(L, l_xboot_keygen);
 	lua_setfield(L, -2, "keygen");
+	lua_pushcfunction(L, l_xboot_modules);
+	lua_setfield(L, -2, "modules");
+	lua_pushcfunction(L, l_xboot_gc);
+	lua_setfield(L, -2, "gc");
+	lua_pushcfunction(L, l_xboot_font);
+	lua_setfield(L, -2, "font");
+	lua_pop(L, 1);
+}
 
+static int pmain(lua_State * L)
+{
+	luaopen_vm(L);
 	luaopen_boot(L);
 	return 0;
 }
 
+static int wmain(lua_State * L)
+{
+	struct lworker_t * wk = lua_touserdata(L, 1);
+
+	luaopen_vm(L);
+	lworker_attach(L, wk);
+	lua_getglobal(L, "require");
+	lua_pushstring(L, lworker_get_name(wk));
+	lua_call(L, 1, 0);
+	return 0;
+}
+
 static void * l_alloc(void * ud, void * ptr, size_t osize, size_t nsize)
 {
-	if(nsize == 0)
-	{
-		free(ptr);
-		return NULL;
-	}
-	else
-	{
-		return realloc(ptr, nsize);
-	}
+	struct vmctx_t * ctx = (struct vmctx_t *)ud;
+	void * p;
+
+	p = vmalloc_realloc(ctx->m, ptr, osize, nsize);
+	ctx->task->mused = ctx->m->used;
+	return p;
 }
 
 static int l_panic(lua_State *L)
@@ -397,30 +802,87 @@ static lua_State * l_newstate(void * ud)
 	return L;
 }
 
-static struct vmctx_t * vmctx_alloc(const char * path, const char * fb, const char * input, void * data)
+static struct vmctx_t * vmctx_alloc(const char * path, struct window_t * w, void * data)
 {
 	struct vmctx_t * ctx;
 
 	ctx = malloc(sizeof(struct vmctx_t));
 	if(!ctx)
+	{
+		window_free(w);
 		return NULL;
+	}
 
+	ctx->m = vmalloc_alloc(strtoull(setting_get("vm-memory", "0"), NULL, 0));
+	if(!ctx->m)
+	{
+		window_free(w);
+		free(ctx);
+		return NULL;
+	}
+	ctx->task = task_self();
+	ctx->task->mlimit = ctx->m->limit;
+	ctx->path = strdup(path);
 	ctx->xfs = xfs_alloc(path, 1);
 	ctx->f = font_context_alloc();
-	ctx->w = window_alloc(fb, input);
+	ctx->w = w;
+	ctx->gc.heap = 0;
+	ctx->gc.step = 8;
+	spin_lock_init(&ctx->job.lock);
+	ctx->job.pending = 0;
+	ctx->job.waiter = NULL;
 	ctx->priv = data;
 
 	return ctx;
 }
 
+/*
+ * Background jobs borrowing the xfs context or the window of a vm hold it, the
+ * last put may come from any task and wakes the vm waiting to be freed.
+ */
+void vmctx_job_get(struct vmctx_t * ctx)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&ctx->job.lock, flags);
+	ctx->job.pending++;
+	spin_unlock_irqrestore(&ctx->job.lock, flags);
+}
+
+void vmctx_job_put(struct vmctx_t * ctx)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&ctx->job.lock, flags);
+	if((--ctx->job.pending == 0) && ctx->job.waiter)
+		task_wakeup(ctx->job.waiter);
+	spin_unlock_irqrestore(&ctx->job.lock, flags);
+}
+
 static void vmctx_free(struct vmctx_t * ctx)
 {
+	irq_flags_t flags;
+
 	if(!ctx)
 		return;
 
+	spin_lock_irqsave(&ctx->job.lock, flags);
+	while(ctx->job.pending > 0)
+	{
+		ctx->job.waiter = task_self();
+		spin_unlock_irqrestore(&ctx->job.lock, flags);
+		task_suspend(task_self());
+		spin_lock_irqsave(&ctx->job.lock, flags);
+	}
+	ctx->job.waiter = NULL;
+	spin_unlock_irqrestore(&ctx->job.lock, flags);
 	xfs_free(ctx->xfs);
 	font_context_free(ctx->f);
 	window_free(ctx->w);
+	vmalloc_free(ctx->m);
+	ctx->task->mused = 0;
+	ctx->task->mlimit = 0;
+	free(ctx->path);
 	free(ctx);
 }
 
@@ -432,7 +894,7 @@ static void vm_task(struct task_t * task, void * data)
 
 	if(td)
 	{
-		ctx = vmctx_alloc(task->name, td->fb, td->input, td);
+		ctx = vmctx_alloc(task->name, window_alloc(td->fb, td->input), td);
 		if(ctx)
 		{
 			L = l_newstate(ctx);
@@ -453,6 +915,38 @@ static void vm_task(struct task_t * task, void * data)
 	}
 }
 
+static void vm_worker_task(struct task_t * task, void * data)
+{
+	struct lworker_t * wk = (struct lworker_t *)data;
+	struct vmctx_t * ctx;
+	lua_State * L;
+
+	ctx = vmctx_alloc(lworker_get_path(wk), NULL, NULL);
+	if(ctx)
+	{
+		L = l_newstate(ctx);
+		if(L)
+		{
+			lua_pushcfunction(L, &wmain);
+			lua_pushlightuserdata(L, wk);
+			if(luahelper_pcall(L, 1, 0) != LUA_OK)
+			{
+				lua_writestringerror("%s: ", task->name);
+				lua_writestringerror("%s\r\n", lua_tostring(L, -1));
+				lua_pop(L, 1);
+			}
+			lua_close(L);
+		}
+		vmctx_free(ctx);
+	}
+	lworker_exit(wk);
+}
+
+struct task_t * vmworker(struct scheduler_t * sched, const char * name, void * data)
+{
+	return task_create(sched, name, vm_worker_task, data, 0, 0);
+}
+
 int vmexec(const char * path, const char * fb, const char * input)
 {
 	if(!is_absolute_path(path))
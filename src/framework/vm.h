@@ -5,18 +5,36 @@
 extern "C" {
 #endif
 
+#include <xboot/task.h>
 #include <xfs/xfs.h>
 #include <graphic/font.h>
 #include <xboot/window.h>
+#include <vmalloc.h>
 
 struct vmctx_t
 {
+	char * path;
 	struct xfs_context_t * xfs;
 	struct font_context_t * f;
 	struct window_t * w;
+	struct vmalloc_t * m;
+	struct task_t * task;
+	struct {
+		size_t heap;
+		int step;
+	} gc;
+	struct {
+		spinlock_t lock;
+		int pending;
+		struct task_t * waiter;
+	} job;
 	void * priv;
 };
 
+void vmctx_job_get(struct vmctx_t * ctx);
+void vmctx_job_put(struct vmctx_t * ctx);
+struct task_t * vmworker(struct scheduler_t * sched, const char * name, void * data);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,217 @@
+/*
+ * framework/vmalloc.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <vmalloc.h>
+
+#define VMALLOC_ARENA_SIZE		(SZ_256K)
+#define VMALLOC_SLAB_SIZE		(SZ_4K)
+#define VMALLOC_CLASS(n)		(((n) - 1) >> VMALLOC_CLASS_SHIFT)
+
+/*
+ * Arenas are taken from the system heap and only given back when the
+ * allocator is destroyed. Large blocks live in a private tlsf heap over
+ * the arenas, small ones are carved from slabs of that heap and recycled
+ * through per class free lists, lua always tells us the old size.
+ */
+struct vmalloc_arena_t {
+	struct list_head entry;
+	size_t size;
+};
+
+static void * vmalloc_arena_add(struct vmalloc_t * m, size_t size)
+{
+	struct vmalloc_arena_t * a;
+	size_t offset = (sizeof(struct vmalloc_arena_t) + 15) & ~15;
+
+	a = malloc(offset + size);
+	if(!a)
+	{
+		/* Out of system heap, let the kernel caches give memory back and retry */
+		shrinker_run();
+		a = malloc(offset + size);
+		if(!a)
+			return NULL;
+	}
+	a->size = offset + size;
+	list_add(&a->entry, &m->arenas);
+	m->footprint += a->size;
+	return (char *)a + offset;
+}
+
+static void * vmalloc_large(struct vmalloc_t * m, void * ptr, size_t size)
+{
+	void * p, * mem;
+	size_t sz;
+
+	p = ptr ? mm_realloc(m->mm, ptr, size) : mm_malloc(m->mm, size);
+	if(!p)
+	{
+		sz = max((size_t)VMALLOC_ARENA_SIZE, (size + SZ_4K) & ~(SZ_4K - 1));
+		mem = vmalloc_arena_add(m, sz);
+		if(!mem || !mm_add_pool(m->mm, mem, sz))
+			return NULL;
+		p = ptr ? mm_realloc(m->mm, ptr, size) : mm_malloc(m->mm, size);
+	}
+	return p;
+}
+
+static void * vmalloc_small(struct vmalloc_t * m, int idx)
+{
+	size_t size = (idx + 1) << VMALLOC_CLASS_SHIFT;
+	void * p = m->slots[idx];
+	char * slab;
+
+	if(p)
+	{
+		m->slots[idx] = *(void **)p;
+		return p;
+	}
+	if(m->left < size)
+	{
+		slab = vmalloc_large(m, NULL, VMALLOC_SLAB_SIZE);
+		if(!slab)
+			return NULL;
+		if(m->left > 0)
+		{
+			p = m->slab;
+			*(void **)p = m->slots[VMALLOC_CLASS(m->left)];
+			m->slots[VMALLOC_CLASS(m->left)] = p;
+		}
+		m->slab = slab;
+		m->left = VMALLOC_SLAB_SIZE;
+	}
+	p = m->slab;
+	m->slab += size;
+	m->left -= size;
+	return p;
+}
+
+static void vmalloc_release(struct vmalloc_t * m, void * ptr, size_t size)
+{
+	int idx;
+
+	if(size <= VMALLOC_CLASS_MAX)
+	{
+		idx = VMALLOC_CLASS(size);
+		*(void **)ptr = m->slots[idx];
+		m->slots[idx] = ptr;
+	}
+	else
+	{
+		mm_free(m->mm, ptr);
+	}
+}
+
+struct vmalloc_t * vmalloc_alloc(size_t limit)
+{
+	struct vmalloc_arena_t * a;
+	struct vmalloc_t * m;
+	void * mem;
+
+	m = malloc(sizeof(struct vmalloc_t));
+	if(!m)
+		return NULL;
+
+	memset(m, 0, sizeof(struct vmalloc_t));
+	init_list_head(&m->arenas);
+	mem = vmalloc_arena_add(m, VMALLOC_ARENA_SIZE);
+	if(!mem)
+	{
+		free(m);
+		return NULL;
+	}
+	m->mm = mm_create(mem, VMALLOC_ARENA_SIZE);
+	if(!m->mm)
+	{
+		a = list_first_entry(&m->arenas, struct vmalloc_arena_t, entry);
+		list_del(&a->entry);
+		free(a);
+		free(m);
+		return NULL;
+	}
+	m->limit = limit;
+
+	return m;
+}
+
+void vmalloc_free(struct vmalloc_t * m)
+{
+	struct vmalloc_arena_t * pos, * n;
+
+	if(!m)
+		return;
+
+	mm_destroy(m->mm);
+	list_for_each_entry_safe(pos, n, &m->arenas, entry)
+	{
+		list_del(&pos->entry);
+		free(pos);
+	}
+	free(m);
+}
+
+void * vmalloc_realloc(struct vmalloc_t * m, void * ptr, size_t osize, size_t nsize)
+{
+	void * p;
+
+	if(!ptr)
+		osize = 0;
+	if(nsize == 0)
+	{
+		if(ptr)
+		{
+			vmalloc_release(m, ptr, osize);
+			m->used -= osize;
+		}
+		return NULL;
+	}
+	if(m->limit && (nsize > osize) && (m->used - osize + nsize > m->limit))
+		return NULL;
+
+	if(ptr && (osize <= VMALLOC_CLASS_MAX) && (nsize <= VMALLOC_CLASS_MAX) && (VMALLOC_CLASS(osize) == VMALLOC_CLASS(nsize)))
+	{
+		p = ptr;
+	}
+	else if(ptr && (osize > VMALLOC_CLASS_MAX) && (nsize > VMALLOC_CLASS_MAX))
+	{
+		p = vmalloc_large(m, ptr, nsize);
+	}
+	else
+	{
+		p = (nsize <= VMALLOC_CLASS_MAX) ? vmalloc_small(m, VMALLOC_CLASS(nsize)) : vmalloc_large(m, NULL, nsize);
+		if(p && ptr)
+		{
+			memcpy(p, ptr, min(osize, nsize));
+			vmalloc_release(m, ptr, osize);
+		}
+	}
+	if(p)
+		m->used = m->used - osize + nsize;
+	return p;
+}
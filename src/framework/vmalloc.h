@@ -0,0 +1,34 @@
+#ifndef __FRAMEWORK_VMALLOC_H__
+#define __FRAMEWORK_VMALLOC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+
+#define VMALLOC_CLASS_SHIFT		(4)
+#define VMALLOC_CLASS_MAX		(256)
+#define VMALLOC_CLASSES			(VMALLOC_CLASS_MAX >> VMALLOC_CLASS_SHIFT)
+
+struct vmalloc_t {
+	struct list_head arenas;
+	void * mm;
+	void * slots[VMALLOC_CLASSES];
+	char * slab;
+	size_t left;
+	size_t used;
+	size_t limit;
+	size_t footprint;
+};
+
+struct vmalloc_t * vmalloc_alloc(size_t limit);
+void vmalloc_free(struct vmalloc_t * m);
+void * vmalloc_realloc(struct vmalloc_t * m, void * ptr, size_t osize, size_t nsize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FRAMEWORK_VMALLOC_H__ */
@@ -8,6 +8,47 @@ extern "C" {
 #include <xboot.h>
 #include <camera/video.h>
 
+#define CAMERA_BUFFER_MAX		(8)
+
+struct camera_buffer_t
+{
+	struct list_head entry;
+	int index;
+	size_t size;
+	void * mem;
+
+	struct video_frame_t frame;
+	ktime_t timestamp;
+	uint64_t sequence;
+};
+
+struct camera_queue_t
+{
+	struct camera_buffer_t * bufs;
+	int count;
+	size_t size;
+
+	struct list_head idle;
+	struct list_head done;
+	struct list_head wait;
+	struct task_t * task;
+	int exit;
+	int ref;
+
+	uint64_t sequence;
+	uint64_t frames;
+	uint64_t dropped;
+	spinlock_t lock;
+};
+
+struct camera_stat_t
+{
+	uint64_t frames;
+	uint64_t dropped;
+	int queued;
+	int count;
+};
+
 struct camera_t
 {
 	char * name;
@@ -17,6 +58,7 @@ struct camera_t
 	int (*capture)(struct camera_t * cam, struct video_frame_t * frame);
 	int (*ioctl)(struct camera_t * cam, const char * cmd, void * arg);
 
+	struct camera_queue_t * queue;
 	void * priv;
 };
 
@@ -30,6 +72,16 @@ int camera_stop(struct camera_t * cam);
 int camera_capture(struct camera_t * cam, struct video_frame_t * frame, int timeout);
 int camera_ioctl(struct camera_t * cam, const char * cmd, void * arg);
 
+int camera_stream_on(struct camera_t * cam, enum video_format_t fmt, int width, int height, int count);
+void camera_stream_off(struct camera_t * cam);
+struct camera_buffer_t * camera_dequeue(struct camera_t * cam, int timeout);
+void camera_enqueue(struct camera_t * cam, struct camera_buffer_t * buf);
+void camera_get_stat(struct camera_t * cam, struct camera_stat_t * stat);
+
+int camera_queue_setup(struct camera_t * cam, size_t size);
+struct camera_buffer_t * camera_buffer_get(struct camera_t * cam);
+void camera_buffer_done(struct camera_t * cam, struct camera_buffer_t * buf);
+
 #ifdef __cplusplus
 }
 #endif
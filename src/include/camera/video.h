@@ -24,7 +24,9 @@ struct video_frame_t {
 	void * buf;
 };
 
+int video_frame_size(enum video_format_t fmt, int width, int height);
 void video_frame_to_argb(struct video_frame_t * frame, void * pixels);
+void video_frame_to_gray(struct video_frame_t * frame, void * gray);
 
 #ifdef __cplusplus
 }
@@ -7,8 +7,38 @@ extern "C" {
 
 #include <xboot/device.h>
 #include <xboot/driver.h>
+#include <xboot/channel.h>
 #include <graphic/surface.h>
 
+#define FRAMEBUFFER_BUFFER_MAX	(3)
+
+/*
+ * Background presentation queue, used when more than one buffer is requested.
+ * At most one frame is pending, a newer frame supersedes it and inherits its damage.
+ * Once created it lives as long as the framebuffer, a single buffer request only
+ * makes the present path drain it and present synchronously.
+ */
+struct framebuffer_swap_t
+{
+	struct task_t * task;
+	struct channel_t * wake;
+	struct list_head wait;
+	spinlock_t lock;
+	int buffers;
+	int exit;
+
+	struct {
+		struct surface_t * s;
+		struct region_list_t * rl;
+		uint64_t stamp;
+	} pending, busy;
+
+	uint64_t frames;
+	uint64_t dropped;
+	uint64_t latency;
+	uint64_t latency_max;
+};
+
 struct framebuffer_t
 {
 	/* Framebuffer name */
@@ -37,22 +67,29 @@ struct framebuffer_t
 
 	/* Private data */
 	void * priv;
+
+	/* Presentation queue, owned by framebuffer core */
+	struct framebuffer_swap_t * swap;
 };
 
+/*
+ * Copy damaged regions into a video memory with the same layout and format as the surface
+ */
 static inline void present_surface(void * vram, struct surface_t * s, struct region_list_t * rl)
 {
 	struct region_t * r;
 	unsigned char * p, * q;
 	int count = rl->count;
 	int stride = s->stride;
+	int bytes = surface_format_bytes(s->format);
 	int offset, line, height;
 	int i, j;
 
 	for(i = 0; i < count; i++)
 	{
 		r = &rl->region[i];
-		offset = r->y * stride + (r->x << 2);
-		line = r->w << 2;
+		offset = r->y * stride + r->x * bytes;
+		line = r->w * bytes;
 		height = r->h;
 
 		p = (unsigned char *)vram + offset;
@@ -104,6 +141,10 @@ void unregister_framebuffer(struct framebuffer_t * fb);
 
 void framebuffer_set_backlight(struct framebuffer_t * fb, int brightness);
 int framebuffer_get_backlight(struct framebuffer_t * fb);
+void framebuffer_set_buffers(struct framebuffer_t * fb, int buffers);
+int framebuffer_get_buffers(struct framebuffer_t * fb);
+void framebuffer_present_async(struct framebuffer_t * fb, struct surface_t * s, struct region_list_t * rl);
+void framebuffer_present_wait(struct framebuffer_t * fb, struct surface_t * s);
 
 #ifdef __cplusplus
 }
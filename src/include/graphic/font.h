@@ -7,8 +7,85 @@ extern "C" {
 
 #include <types.h>
 #include <list.h>
+#include <sizes.h>
 #include <xfs/xfs.h>
 
+#define FONT_ATLAS_PAGE_SIZE	(256)
+#define FONT_ATLAS_PAGE_MAX		(8)
+#define FONT_ATLAS_SHELF_MAX	(64)
+#define FONT_ATLAS_HASH_SIZE	(256)
+#define FONT_RUN_HASH_SIZE		(64)
+#define FONT_RUN_CACHE_BYTES	(SZ_128K)
+
+/*
+ * A8 glyph atlas page, packed with a best fit shelf allocator.
+ */
+struct font_atlas_page_t {
+	struct list_head list;
+	uint8_t * pixels;
+	int width;
+	int height;
+	int used;
+	int nshelf;
+	struct {
+		int y, h;
+		int x;
+	} shelf[FONT_ATLAS_SHELF_MAX];
+};
+
+struct font_glyph_t {
+	struct hlist_node node;
+	uint32_t key;
+	char * family;
+	int size;
+	uint32_t code;
+	int valid;
+	struct font_atlas_page_t * page;
+	int x, y;
+	int w, h;
+	int left, top;
+	int xadvance, yadvance;
+};
+
+/*
+ * Laid out text run, glyph positions are relative to the metrics origin.
+ */
+struct font_run_t {
+	struct hlist_node node;
+	struct list_head list;
+	uint32_t hash;
+	unsigned int generation;
+	int bytes;
+	char * utf8;
+	char * family;
+	int size;
+	int wrap;
+	struct {
+		int ox;
+		int oy;
+		int width;
+		int height;
+	} metrics;
+	int nglyph;
+	struct {
+		struct font_glyph_t * g;
+		int x, y;
+	} glyph[];
+};
+
+struct font_stats_t {
+	int atlas_pages;
+	int atlas_glyphs;
+	size_t atlas_bytes;
+	size_t atlas_used;
+	uint64_t glyph_hit;
+	uint64_t glyph_miss;
+	int runs;
+	size_t run_bytes;
+	uint64_t run_hit;
+	uint64_t run_miss;
+};
+
 struct font_context_t {
 	void * library;
 	void * manager;
@@ -16,12 +93,33 @@ struct font_context_t {
 	void * sbit;
 	void * image;
 	struct list_head list;
+
+	struct {
+		struct list_head page;
+		struct hlist_head hash[FONT_ATLAS_HASH_SIZE];
+		unsigned int generation;
+	} atlas;
+
+	struct {
+		struct list_head lru;
+		struct hlist_head hash[FONT_RUN_HASH_SIZE];
+	} run;
+
+	struct font_stats_t stats;
 };
 
 struct font_context_t * font_context_alloc(void);
 void font_context_free(struct font_context_t * ctx);
 void * font_lookup_bitmap(struct font_context_t * ctx, const char * family, int size, uint32_t code);
 void * font_lookup_glyph(struct font_context_t * ctx, const char * family, int size, uint32_t code);
+struct font_glyph_t * font_atlas_lookup(struct font_context_t * ctx, const char * family, int size, uint32_t code);
+void font_atlas_reset(struct font_context_t * ctx);
+uint32_t font_run_hash(const char * utf8, const char * family, int size, int wrap);
+struct font_run_t * font_run_search(struct font_context_t * ctx, const char * utf8, const char * family, int size, int wrap);
+struct font_run_t * font_run_alloc(struct font_context_t * ctx, const char * utf8, const char * family, int size, int wrap, int nglyph);
+void font_run_cache(struct font_context_t * ctx, struct font_run_t * run);
+void font_run_free(struct font_run_t * run);
+void font_context_stats(struct font_context_t * ctx, struct font_stats_t * stats);
 void font_add(struct font_context_t * ctx, struct xfs_context_t * xfs, const char * family, const char * path);
 
 #ifdef __cplusplus
@@ -0,0 +1,35 @@
+#ifndef __GRAPHIC_IMGCACHE_H__
+#define __GRAPHIC_IMGCACHE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <graphic/surface.h>
+#include <xfs/xfs.h>
+
+struct imgcache_stat_t {
+	size_t bytes;
+	size_t budget;
+	int entries;
+	int busy;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+};
+
+typedef void (*imgcache_callback_t)(struct surface_t * s, void * data);
+
+struct surface_t * imgcache_get(struct xfs_context_t * ctx, const char * filename, int width, int height);
+int imgcache_get_async(struct xfs_context_t * ctx, const char * filename, int width, int height, imgcache_callback_t cb, void * data);
+void imgcache_put(struct surface_t * s);
+int imgcache_owned(struct surface_t * s);
+void imgcache_set_budget(size_t budget);
+void imgcache_get_stat(struct imgcache_stat_t * stat);
+void imgcache_shrink(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GRAPHIC_IMGCACHE_H__ */
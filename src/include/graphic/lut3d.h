@@ -0,0 +1,91 @@
+#ifndef __GRAPHIC_LUT3D_H__
+#define __GRAPHIC_LUT3D_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <xboot/kref.h>
+#include <graphic/surface.h>
+
+/*
+ * A 3D colour lookup table, size grid points on each axis. Entries are stored
+ * with 16-bits per channel in r, g, b, pad order, blue is the slowest axis.
+ * Lookups use tetrahedral interpolation, the fraction is in 1/256 steps.
+ */
+struct lut3d_t {
+	struct kref_t ref;
+	int size;
+	uint16_t * table;
+	uint16_t index[256];
+	uint16_t frac[256];
+};
+
+struct lut3d_t * lut3d_alloc(int size);
+struct lut3d_t * lut3d_alloc_from_haldclut(struct surface_t * clut, int size);
+void lut3d_free(struct lut3d_t * lut);
+void lut3d_set(struct lut3d_t * lut, int ri, int gi, int bi, int r, int g, int b);
+void lut3d_apply(struct lut3d_t * lut, struct surface_t * s, int nearest);
+
+struct lut3d_t * lut3d_cache_get(struct surface_t * clut);
+void lut3d_cache_put(struct lut3d_t * lut);
+void lut3d_cache_remove(struct surface_t * clut);
+
+static inline __attribute__((always_inline)) void lut3d_lookup(struct lut3d_t * lut, int * r, int * g, int * b)
+{
+	int fr = lut->frac[*r], fg = lut->frac[*g], fb = lut->frac[*b];
+	int sr = 4, sg = lut->size << 2, sb = (lut->size * lut->size) << 2;
+	uint16_t * c0 = lut->table + lut->index[*b] * sb + lut->index[*g] * sg + lut->index[*r] * sr;
+	uint16_t * c1, * c2, * c3 = c0 + sr + sg + sb;
+	int w0, w1, w2;
+	int v;
+
+	if(fr >= fg)
+	{
+		if(fg >= fb)
+		{
+			c1 = c0 + sr; c2 = c1 + sg;
+			w0 = fr; w1 = fg; w2 = fb;
+		}
+		else if(fr >= fb)
+		{
+			c1 = c0 + sr; c2 = c1 + sb;
+			w0 = fr; w1 = fb; w2 = fg;
+		}
+		else
+		{
+			c1 = c0 + sb; c2 = c1 + sr;
+			w0 = fb; w1 = fr; w2 = fg;
+		}
+	}
+	else
+	{
+		if(fb >= fg)
+		{
+			c1 = c0 + sb; c2 = c1 + sg;
+			w0 = fb; w1 = fg; w2 = fr;
+		}
+		else if(fb >= fr)
+		{
+			c1 = c0 + sg; c2 = c1 + sb;
+			w0 = fg; w1 = fb; w2 = fr;
+		}
+		else
+		{
+			c1 = c0 + sg; c2 = c1 + sr;
+			w0 = fg; w1 = fr; w2 = fb;
+		}
+	}
+	v = ((c0[0] << 8) + (c1[0] - c0[0]) * w0 + (c2[0] - c1[0]) * w1 + (c3[0] - c2[0]) * w2 + 128) >> 8;
+	*r = (v - (v >> 8) + 128) >> 8;
+	v = ((c0[1] << 8) + (c1[1] - c0[1]) * w0 + (c2[1] - c1[1]) * w1 + (c3[1] - c2[1]) * w2 + 128) >> 8;
+	*g = (v - (v >> 8) + 128) >> 8;
+	v = ((c0[2] << 8) + (c1[2] - c0[2]) * w0 + (c2[2] - c1[2]) * w1 + (c3[2] - c2[2]) * w2 + 128) >> 8;
+	*b = (v - (v >> 8) + 128) >> 8;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GRAPHIC_LUT3D_H__ */
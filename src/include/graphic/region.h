@@ -101,6 +101,8 @@ static inline int region_union(struct region_t * r, struct region_t * a, struct
 	return 1;
 }
 
+#define REGION_LIST_SIMPLIFY_COUNT	(64)
+
 struct region_list_t {
 	struct region_t * region;
 	unsigned int size;
@@ -111,8 +113,12 @@ struct region_list_t * region_list_alloc(unsigned int size);
 void region_list_free(struct region_list_t * rl);
 void region_list_clone(struct region_list_t * rl, struct region_list_t * o);
 void region_list_merge(struct region_list_t * rl, struct region_list_t * o);
+void region_list_intersect(struct region_list_t * rl, struct region_list_t * o);
+void region_list_subtract(struct region_list_t * rl, struct region_list_t * o);
 void region_list_add(struct region_list_t * rl, struct region_t * r);
 void region_list_clear(struct region_list_t * rl);
+int region_list_extents(struct region_list_t * rl, struct region_t * r);
+void region_list_simplify(struct region_list_t * rl, unsigned int max);
 
 #ifdef __cplusplus
 }
@@ -23,19 +23,53 @@ struct render_t;
  * Each pixel is a 32-bits, with alpha in the upper 8 bits, then red green and blue.
  * The 32-bit quantities are stored native-endian, Pre-multiplied alpha is used.
  * That is, 50% transparent red is 0x80800000 not 0x80ff0000.
+ *
+ * RGB565 surfaces are opaque 16-bits native-endian, A8 surfaces hold coverage
+ * only and read back as pre-multiplied black.
  */
+enum surface_format_t {
+	SURFACE_FORMAT_ARGB32	= 0,
+	SURFACE_FORMAT_RGB565	= 1,
+	SURFACE_FORMAT_A8		= 2,
+};
+
 struct surface_t
 {
 	int width;
 	int height;
 	int stride;
 	int pixlen;
+	enum surface_format_t format;
 	void * pixels;
 	struct render_t * r;
 	void * rctx;
 	void * priv;
 };
 
+/*
+ * Colour filters which can be chained, consecutive linear steps are composed
+ * into one colour matrix and the whole chain is applied in a single pass.
+ */
+enum surface_filter_type_t {
+	SURFACE_FILTER_GRAY			= 0,
+	SURFACE_FILTER_SEPIA		= 1,
+	SURFACE_FILTER_INVERT		= 2,
+	SURFACE_FILTER_COLORING		= 3,
+	SURFACE_FILTER_HUE			= 4,
+	SURFACE_FILTER_SATURATE		= 5,
+	SURFACE_FILTER_BRIGHTNESS	= 6,
+	SURFACE_FILTER_CONTRAST		= 7,
+	SURFACE_FILTER_OPACITY		= 8,
+	SURFACE_FILTER_BLUR			= 9,
+};
+
+struct surface_filter_t
+{
+	enum surface_filter_type_t type;
+	int value;
+	struct color_t color;
+};
+
 enum render_type_t {
 	RENDER_TYPE_FAST	= 0,
 	RENDER_TYPE_GOOD	= 1,
@@ -79,6 +113,7 @@ struct render_t
 	void (*filter_opacity)(struct surface_t * s, int alpha);
 	void (*filter_haldclut)(struct surface_t * s, struct surface_t * clut, const char * type);
 	void (*filter_blur)(struct surface_t * s, int radius);
+	void (*filter_chain)(struct surface_t * s, struct surface_filter_t * f, int n);
 };
 
 static inline int surface_get_width(struct surface_t * s)
@@ -101,6 +136,99 @@ static inline void * surface_get_pixels(struct surface_t * s)
 	return s->pixels;
 }
 
+static inline enum surface_format_t surface_get_format(struct surface_t * s)
+{
+	return s->format;
+}
+
+static inline int surface_format_bytes(enum surface_format_t format)
+{
+	switch(format)
+	{
+	case SURFACE_FORMAT_RGB565:
+		return 2;
+	case SURFACE_FORMAT_A8:
+		return 1;
+	default:
+		break;
+	}
+	return 4;
+}
+
+static inline uint16_t pixel_argb_to_rgb565(uint32_t v)
+{
+	return ((v >> 8) & 0xf800) | ((v >> 5) & 0x07e0) | ((v >> 3) & 0x001f);
+}
+
+static inline uint32_t pixel_rgb565_to_argb(uint16_t v)
+{
+	uint32_t r = (v >> 11) & 0x1f;
+	uint32_t g = (v >> 5) & 0x3f;
+	uint32_t b = (v >> 0) & 0x1f;
+
+	return (0xff << 24) | (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+}
+
+/*
+ * Pre-multiplied source over destination, all values are 32-bits argb
+ */
+static inline uint32_t pixel_over(uint32_t d, uint32_t s)
+{
+	int sa = (s >> 24) & 0xff;
+	int t, a, r, g, b;
+
+	if(sa == 255)
+		return s;
+	if(sa == 0)
+		return d;
+	t = sa + (sa >> 8);
+	a = ((((s >> 24) & 0xff) + ((d >> 24) & 0xff)) << 8) - ((d >> 24) & 0xff) * t;
+	r = ((((s >> 16) & 0xff) + ((d >> 16) & 0xff)) << 8) - ((d >> 16) & 0xff) * t;
+	g = ((((s >> 8) & 0xff) + ((d >> 8) & 0xff)) << 8) - ((d >> 8) & 0xff) * t;
+	b = ((((s >> 0) & 0xff) + ((d >> 0) & 0xff)) << 8) - ((d >> 0) & 0xff) * t;
+	return ((a >> 8) << 24) | ((r >> 8) << 16) | ((g >> 8) << 8) | ((b >> 8) << 0);
+}
+
+static inline uint32_t pixel_load(enum surface_format_t format, const void * p)
+{
+	switch(format)
+	{
+	case SURFACE_FORMAT_RGB565:
+		return pixel_rgb565_to_argb(*(const uint16_t *)p);
+	case SURFACE_FORMAT_A8:
+		return (uint32_t)(*(const uint8_t *)p) << 24;
+	default:
+		break;
+	}
+	return *(const uint32_t *)p;
+}
+
+static inline void pixel_store(enum surface_format_t format, void * p, uint32_t v)
+{
+	switch(format)
+	{
+	case SURFACE_FORMAT_RGB565:
+		*(uint16_t *)p = pixel_argb_to_rgb565(v);
+		break;
+	case SURFACE_FORMAT_A8:
+		*(uint8_t *)p = (v >> 24) & 0xff;
+		break;
+	default:
+		*(uint32_t *)p = v;
+		break;
+	}
+}
+
+static inline void pixel_blend(enum surface_format_t format, void * p, uint32_t v)
+{
+	int sa = (v >> 24) & 0xff;
+
+	if(sa == 255)
+		pixel_store(format, p, v);
+	else if(sa != 0)
+		pixel_store(format, p, pixel_over(pixel_load(format, p), v));
+}
+
 static inline void surface_blit(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct surface_t * src, enum render_type_t type)
 {
 	s->r->blit(s, clip, m, src, type);
@@ -181,59 +309,143 @@ static inline void surface_shape_raster(struct surface_t * s, struct svg_t * svg
 	s->r->shape_raster(s, svg, tx, ty, sx, sy);
 }
 
+/*
+ * Filters work on argb32, other formats are filtered through an argb32 copy
+ */
+struct surface_t * surface_filter_begin(struct surface_t * s);
+void surface_filter_end(struct surface_t * s, struct surface_t * t);
+
 static inline void surface_filter_gray(struct surface_t * s)
 {
-	s->r->filter_gray(s);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_gray(t);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_sepia(struct surface_t * s)
 {
-	s->r->filter_sepia(s);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_sepia(t);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_invert(struct surface_t * s)
 {
-	s->r->filter_invert(s);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_invert(t);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_coloring(struct surface_t * s, struct color_t * c)
 {
-	s->r->filter_coloring(s, c);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_coloring(t, c);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_hue(struct surface_t * s, int angle)
 {
-	s->r->filter_hue(s, angle);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_hue(t, angle);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_saturate(struct surface_t * s, int saturate)
 {
-	s->r->filter_saturate(s, saturate);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_saturate(t, saturate);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_brightness(struct surface_t * s, int brightness)
 {
-	s->r->filter_brightness(s, brightness);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_brightness(t, brightness);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_contrast(struct surface_t * s, int contrast)
 {
-	s->r->filter_contrast(s, contrast);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_contrast(t, contrast);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_opacity(struct surface_t * s, int alpha)
 {
-	s->r->filter_opacity(s, alpha);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_opacity(t, alpha);
+		surface_filter_end(s, t);
+	}
 }
 
 static inline void surface_filter_haldclut(struct surface_t * s, struct surface_t * clut, const char * type)
 {
-	s->r->filter_haldclut(s, clut, type);
+	struct surface_t * t = surface_filter_begin(s);
+	struct surface_t * c = surface_filter_begin(clut);
+
+	if(t && c)
+		t->r->filter_haldclut(t, c, type);
+	if(c != clut)
+		surface_filter_end(NULL, c);
+	surface_filter_end(s, t);
 }
 
 static inline void surface_filter_blur(struct surface_t * s, int radius)
 {
-	s->r->filter_blur(s, radius);
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_blur(t, radius);
+		surface_filter_end(s, t);
+	}
+}
+
+static inline void surface_filter_chain(struct surface_t * s, struct surface_filter_t * f, int n)
+{
+	struct surface_t * t = surface_filter_begin(s);
+
+	if(t)
+	{
+		t->r->filter_chain(t, f, n);
+		surface_filter_end(s, t);
+	}
 }
 
 void * render_default_create(struct surface_t * s);
@@ -242,6 +454,7 @@ void render_default_blit(struct surface_t * s, struct region_t * clip, struct ma
 void render_default_fill(struct surface_t * s, struct region_t * clip, struct matrix_t * m, int w, int h, struct color_t * c, enum render_type_t type);
 void render_default_text(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct text_t * txt);
 void render_default_icon(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct icon_t * ico);
+void render_default_mask(struct surface_t * s, struct region_t * r, struct color_t * c, uint8_t * mask, int pitch);
 void render_default_shape_line(struct surface_t * s, struct region_t * clip, struct point_t * p0, struct point_t * p1, int thickness, struct color_t * c);
 void render_default_shape_polyline(struct surface_t * s, struct region_t * clip, struct point_t * p, int n, int thickness, struct color_t * c);
 void render_default_shape_curve(struct surface_t * s, struct region_t * clip, struct point_t * p, int n, int thickness, struct color_t * c);
@@ -265,16 +478,21 @@ void render_default_filter_contrast(struct surface_t * s, int contrast);
 void render_default_filter_opacity(struct surface_t * s, int alpha);
 void render_default_filter_haldclut(struct surface_t * s, struct surface_t * clut, const char * type);
 void render_default_filter_blur(struct surface_t * s, int radius);
+void render_default_filter_chain(struct surface_t * s, struct surface_filter_t * f, int n);
 
 struct render_t * search_render(void);
 bool_t register_render(struct render_t * r);
 bool_t unregister_render(struct render_t * r);
 struct surface_t * surface_alloc(int width, int height, void * priv);
+struct surface_t * surface_alloc_format(int width, int height, enum surface_format_t format, void * priv);
 struct surface_t * surface_alloc_from_xfs(struct xfs_context_t * ctx, const char * filename);
+struct surface_t * surface_alloc_from_xfs_format(struct xfs_context_t * ctx, const char * filename, enum surface_format_t format);
+struct surface_t * surface_alloc_from_xfs_scaled(struct xfs_context_t * ctx, const char * filename, enum surface_format_t format, int width, int height);
 struct surface_t * surface_alloc_qrcode(const char * txt, int pixsz);
 void surface_free(struct surface_t * s);
 struct surface_t * surface_clone(struct surface_t * s, int x, int y, int w, int h, int r);
 struct surface_t * surface_extend(struct surface_t * s, int width, int height, const char * type);
+struct surface_t * surface_convert(struct surface_t * s, enum surface_format_t format);
 void surface_clear(struct surface_t * s, struct color_t * c, int x, int y, int w, int h);
 void surface_set_pixel(struct surface_t * s, int x, int y, struct color_t * c);
 void surface_get_pixel(struct surface_t * s, int x, int y, struct color_t * c);
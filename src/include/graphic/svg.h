@@ -90,11 +90,21 @@ struct svg_t {
 	float width;
 	float height;
 	struct svg_shape_t * shapes;
+	int compiled;
 };
 
+struct surface_t;
+
 struct svg_t * svg_alloc(char * svgstr);
+struct svg_t * svg_alloc_from_compiled(const void * buf, size_t len);
 struct svg_t * svg_alloc_from_xfs(struct xfs_context_t * ctx, const char * filename);
 void svg_free(struct svg_t * svg);
+size_t svg_compile(struct svg_t * svg, void * buf, size_t size);
+
+struct surface_t * svg_raster_cache_get(struct svg_t * svg, float tx, float ty, float sx, float sy, struct color_t * tint, int * x, int * y);
+void svg_raster_cache_put(struct surface_t * s);
+void svg_raster_cache_remove(struct svg_t * svg);
+void svg_raster_cache_shrink(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,23 @@
+#ifndef __VISION_MORPHOLOGY_H__
+#define __VISION_MORPHOLOGY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <vision/vision.h>
+
+enum vision_morphology_t {
+	VISION_MORPHOLOGY_ERODE		= 0,
+	VISION_MORPHOLOGY_DILATE	= 1,
+};
+
+void vision_morphology_rows(unsigned char * datas, unsigned char * scratch, int width, int height, int radius, const unsigned char * lut, enum vision_morphology_t type);
+void vision_morphology_cols(unsigned char * datas, unsigned char * scratch, int width, int height, int radius, const unsigned char * lut, enum vision_morphology_t type);
+void vision_morphology(struct vision_t * v, int rx, int ry, enum vision_morphology_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VISION_MORPHOLOGY_H__ */
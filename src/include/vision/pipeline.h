@@ -0,0 +1,50 @@
+#ifndef __VISION_PIPELINE_H__
+#define __VISION_PIPELINE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <vision/vision.h>
+
+#define VISION_PIPELINE_MAX_STEPS	(32)
+
+enum vision_pipeline_op_t {
+	VISION_PIPELINE_INVERT		= 0,
+	VISION_PIPELINE_THRESHOLD	= 1,
+	VISION_PIPELINE_ERODE		= 2,
+	VISION_PIPELINE_DILATE		= 3,
+};
+
+struct vision_pipeline_step_t {
+	enum vision_pipeline_op_t op;
+	int x, y;
+	char type[16];
+};
+
+/*
+ * A chain of gray operators run in as few passes as possible. Pixel wise steps are
+ * folded into one lookup table which rides along the next morphology pass, and the
+ * scratch image is kept between runs.
+ */
+struct vision_pipeline_t {
+	struct vision_pipeline_step_t steps[VISION_PIPELINE_MAX_STEPS];
+	int nstep;
+	unsigned char * scratch;
+	int nscratch;
+};
+
+struct vision_pipeline_t * vision_pipeline_alloc(void);
+void vision_pipeline_free(struct vision_pipeline_t * p);
+void vision_pipeline_clear(struct vision_pipeline_t * p);
+bool_t vision_pipeline_invert(struct vision_pipeline_t * p);
+bool_t vision_pipeline_threshold(struct vision_pipeline_t * p, int threshold, const char * type);
+bool_t vision_pipeline_erode(struct vision_pipeline_t * p, int rx, int ry);
+bool_t vision_pipeline_dilate(struct vision_pipeline_t * p, int rx, int ry);
+void vision_pipeline_run(struct vision_pipeline_t * p, struct vision_t * v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __VISION_PIPELINE_H__ */
@@ -7,6 +7,8 @@ extern "C" {
 
 #include <vision/vision.h>
 
+int vision_threshold_otsu(const int * histogram, int npixel);
+void vision_threshold_table(unsigned char * table, int threshold, const char * type);
 void vision_threshold(struct vision_t * v, int threshold, const char * type);
 
 #ifdef __cplusplus
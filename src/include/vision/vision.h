@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <graphic/surface.h>
+#include <camera/video.h>
 
 enum vision_type_t {
 	VISION_TYPE_GRAY	= 0x0110,	/* unsigned char (0 ~ 255) */
@@ -71,6 +72,7 @@ void vision_clear(struct vision_t * v);
 
 void vision_apply_surface(struct vision_t * v, struct surface_t * s);
 void surface_apply_vision(struct surface_t * s, struct vision_t * v);
+void vision_apply_video_frame(struct vision_t * v, struct video_frame_t * frame);
 
 #ifdef __cplusplus
 }
@@ -63,6 +63,8 @@ extern "C" {
 #include <xboot/task.h>
 #include <xboot/mutex.h>
 #include <xboot/channel.h>
+#include <xboot/parallel.h>
+#include <xboot/shrinker.h>
 #include <xboot/window.h>
 #include <xboot/module.h>
 #include <xboot/setting.h>
@@ -86,6 +88,8 @@ extern "C" {
 #include <vision/gray.h>
 #include <vision/inrange.h>
 #include <vision/invert.h>
+#include <vision/morphology.h>
+#include <vision/pipeline.h>
 #include <vision/sepia.h>
 #include <vision/threshold.h>
 #include <xui/xui.h>
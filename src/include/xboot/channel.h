@@ -23,6 +23,8 @@ struct channel_t * channel_alloc(unsigned int size);
 void channel_free(struct channel_t * c);
 void channel_send(struct channel_t * c, unsigned char * buf, unsigned int len);
 void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len);
+int channel_trysend(struct channel_t * c, unsigned char * buf, unsigned int len);
+int channel_tryrecv(struct channel_t * c, unsigned char * buf, unsigned int len);
 
 #ifdef __cplusplus
 }
@@ -33,6 +33,8 @@ enum event_type_t {
 	EVENT_TYPE_JOYSTICK_BUTTONUP		= 0x0505,
 
 	EVENT_TYPE_SYSTEM_EXIT				= 0x1000,
+	EVENT_TYPE_SYSTEM_WORKER			= 0x1001,
+	EVENT_TYPE_SYSTEM_IMAGE				= 0x1002,
 };
 
 enum {
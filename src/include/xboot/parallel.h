@@ -0,0 +1,22 @@
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+
+/*
+ * Called with a sub range [start, end) of the whole work, possibly on another cpu
+ */
+typedef void (*parallel_func_t)(int start, int end, void * data);
+
+int parallel_get_workers(void);
+void parallel_for(int count, int grain, parallel_func_t func, void * data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PARALLEL_H__ */
@@ -0,0 +1,30 @@
+#ifndef __SHRINKER_H__
+#define __SHRINKER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <types.h>
+#include <list.h>
+
+/*
+ * Caches holding memory that can be rebuilt on demand, dropped when an
+ * allocation cannot be satisfied before it is retried
+ */
+struct shrinker_t {
+	struct list_head entry;
+	const char * name;
+	void (*shrink)(struct shrinker_t * s);
+	void * priv;
+};
+
+bool_t register_shrinker(struct shrinker_t * s);
+bool_t unregister_shrinker(struct shrinker_t * s);
+void shrinker_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SHRINKER_H__ */
@@ -50,6 +50,9 @@ struct task_t {
 	uint32_t inv_weight;
 	task_func_t func;
 	void * data;
+	size_t mused;
+	size_t mlimit;
+	volatile int wakeup;
 	int __errno;
 };
 
@@ -59,6 +62,8 @@ struct scheduler_t {
 	struct task_t * running;
 	uint64_t min_vtime;
 	uint64_t weight;
+	volatile int wakeup;
+	volatile int online;
 	spinlock_t lock;
 };
 
@@ -69,6 +74,14 @@ static inline struct scheduler_t * scheduler_self(void)
 	return &__sched[smp_processor_id()];
 }
 
+/*
+ * Only schedulers entered through scheduler_loop ever run their tasks
+ */
+static inline int scheduler_is_online(int cpu)
+{
+	return ((cpu >= 0) && (cpu < CONFIG_MAX_SMP_CPUS)) ? __sched[cpu].online : 0;
+}
+
 static inline struct task_t * task_self(void)
 {
 	return __sched[smp_processor_id()].running;
@@ -79,11 +92,13 @@ void task_destroy(struct task_t * task);
 void task_renice(struct task_t * task, int nice);
 void task_suspend(struct task_t * task);
 void task_resume(struct task_t * task);
+void task_wakeup(struct task_t * task);
 void task_yield(void);
 
 struct task_data_t * task_data_alloc(const char * fb, const char * input, void * data);
 void task_data_free(struct task_data_t * td);
 
+int scheduler_online_count(void);
 void scheduler_loop(void);
 void do_init_sched(void);
 
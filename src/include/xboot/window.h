@@ -36,7 +36,15 @@ struct window_t {
 	struct window_manager_t * wm;
 	struct surface_t * s;
 	struct region_list_t * rl;
+	struct {
+		struct surface_t * s[FRAMEBUFFER_BUFFER_MAX];
+		struct region_list_t * rl[FRAMEBUFFER_BUFFER_MAX];
+		int valid[FRAMEBUFFER_BUFFER_MAX];
+		int count;
+		int index;
+	} swap;
 	struct fifo_t * event;
+	struct task_t * wait;
 	struct hmap_t * map;
 	int launcher;
 };
@@ -97,7 +105,10 @@ void window_region_list_add(struct window_t * w, struct region_t * r);
 void window_region_list_clear(struct window_t * w);
 void window_present(struct window_t * w, void * o, void (*draw)(struct window_t *, void *));
 void window_exit(struct window_t * w);
+int window_is_dirty(struct window_t * w);
 int window_pump_event(struct window_t * w, struct event_t * e);
+int window_wait_event(struct window_t * w, ktime_t deadline);
+int window_push_event(struct window_t * w, struct event_t * e);
 void push_event(struct event_t * e);
 
 #ifdef __cplusplus
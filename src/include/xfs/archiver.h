@@ -45,6 +45,7 @@ struct xfs_archiver_t
 	s64_t (*seek)(void * f, s64_t offset);
 	s64_t (*tell)(void * f);
 	s64_t (*length)(void * f);
+	u64_t (*mtime)(void * f);
 	void (*close)(void * f);
 };
 
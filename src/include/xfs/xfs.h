@@ -41,6 +41,7 @@ s64_t xfs_write(struct xfs_file_t * file, void * buf, s64_t size);
 s64_t xfs_seek(struct xfs_file_t * file, s64_t offset);
 s64_t xfs_tell(struct xfs_file_t * file);
 s64_t xfs_length(struct xfs_file_t * file);
+u64_t xfs_mtime(struct xfs_file_t * file);
 void xfs_close(struct xfs_file_t * file);
 
 struct xfs_context_t * xfs_alloc(const char * path, int userdata);
@@ -56,6 +56,7 @@ static int do_ps(int argc, char ** argv)
 	struct scheduler_t * sched;
 	struct task_t * pos, * n;
 	struct slist_t * sl, * e;
+	char mused[32], mlimit[32];
 	int i;
 
 	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
@@ -82,7 +83,17 @@ static int do_ps(int argc, char ** argv)
 		slist_for_each_entry(e, sl)
 		{
 			pos = (struct task_t *)e->priv;
-			printf(" %p %-8s %3d %20lld %s\r\n", pos->func, task_status_tostring(pos), pos->nice, pos->time, e->key);
+			if(pos->mused > 0)
+			{
+				ssize(mused, pos->mused);
+				if(pos->mlimit > 0)
+					ssize(mlimit, pos->mlimit);
+				else
+					strcpy(mlimit, "-");
+				printf(" %p %-8s %3d %20lld %s (%s/%s)\r\n", pos->func, task_status_tostring(pos), pos->nice, pos->time, e->key, mused, mlimit);
+			}
+			else
+				printf(" %p %-8s %3d %20lld %s\r\n", pos->func, task_status_tostring(pos), pos->nice, pos->time, e->key);
 		}
 		slist_free(sl);
 	}
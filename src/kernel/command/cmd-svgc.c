@@ -0,0 +1,147 @@
+/*
+ * kernel/command/cmd-svgc.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <graphic/svg.h>
+#include <command/command.h>
+
+static void usage(void)
+{
+	printf("usage:\r\n");
+	printf("    svgc <input.svg> <output.svgc>\r\n");
+}
+
+static void * read_file(const char * filename, size_t * len)
+{
+	struct vfs_stat_t st;
+	char * buf;
+	int fd;
+
+	if((vfs_stat(filename, &st) < 0) || S_ISDIR(st.st_mode))
+		return NULL;
+	fd = vfs_open(filename, O_RDONLY, 0);
+	if(fd < 0)
+		return NULL;
+	buf = malloc(st.st_size + 1);
+	if(buf)
+	{
+		if(vfs_read(fd, buf, st.st_size) != st.st_size)
+		{
+			free(buf);
+			buf = NULL;
+		}
+		else
+		{
+			buf[st.st_size] = '\0';
+			*len = st.st_size;
+		}
+	}
+	vfs_close(fd);
+	return buf;
+}
+
+static int do_svgc(int argc, char ** argv)
+{
+	char ipath[VFS_MAX_PATH];
+	char opath[VFS_MAX_PATH];
+	struct svg_t * svg;
+	void * buf;
+	size_t len;
+	int fd;
+
+	if(argc != 3)
+	{
+		usage();
+		return -1;
+	}
+	if((shell_realpath(argv[1], ipath) < 0) || (shell_realpath(argv[2], opath) < 0))
+	{
+		printf("svgc: Can not convert to realpath\r\n");
+		return -1;
+	}
+	buf = read_file(ipath, &len);
+	if(!buf)
+	{
+		printf("svgc: %s: Can not read\r\n", ipath);
+		return -1;
+	}
+	svg = svg_alloc(buf);
+	free(buf);
+	if(!svg)
+	{
+		printf("svgc: %s: Can not parse\r\n", ipath);
+		return -1;
+	}
+	len = svg_compile(svg, NULL, 0);
+	buf = malloc(len);
+	if(!buf)
+	{
+		printf("svgc: Can not alloc memory\r\n");
+		svg_free(svg);
+		return -1;
+	}
+	svg_compile(svg, buf, len);
+	svg_free(svg);
+	fd = vfs_open(opath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0)
+	{
+		printf("svgc: %s: Can not open\r\n", opath);
+		free(buf);
+		return -1;
+	}
+	if(vfs_write(fd, buf, len) != len)
+	{
+		printf("svgc: %s: Can not write\r\n", opath);
+		vfs_close(fd);
+		free(buf);
+		return -1;
+	}
+	vfs_close(fd);
+	free(buf);
+	return 0;
+}
+
+static struct command_t cmd_svgc = {
+	.name	= "svgc",
+	.desc	= "compile svg into binary form",
+	.usage	= usage,
+	.exec	= do_svgc,
+};
+
+static __init void svgc_cmd_init(void)
+{
+	register_command(&cmd_svgc);
+}
+
+static __exit void svgc_cmd_exit(void)
+{
+	unregister_command(&cmd_svgc);
+}
+
+command_initcall(svgc_cmd_init);
+command_exitcall(svgc_cmd_exit);
@@ -276,3 +276,61 @@ void channel_recv(struct channel_t * c, unsigned char * buf, unsigned int len)
 		} while(l < len);
 	}
 }
+
+/*
+ * Non blocking variants, either the whole buffer moves or nothing does
+ */
+int channel_trysend(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	struct task_t * pos, * n;
+	unsigned int l;
+
+	if(!c || !buf)
+		return 0;
+	spin_lock(&c->lock);
+	if(c->size - (c->in - c->out) < len)
+	{
+		spin_unlock(&c->lock);
+		return 0;
+	}
+	l = min(len, c->size - (c->in & (c->size - 1)));
+	memcpy(c->buffer + (c->in & (c->size - 1)), buf, l);
+	memcpy(c->buffer, buf + l, len - l);
+	smp_wmb();
+	c->in += len;
+	list_for_each_entry_safe(pos, n, &c->rwait, rlist)
+	{
+		list_del_init(&pos->rlist);
+		task_resume(pos);
+	}
+	spin_unlock(&c->lock);
+	return 1;
+}
+
+int channel_tryrecv(struct channel_t * c, unsigned char * buf, unsigned int len)
+{
+	struct task_t * pos, * n;
+	unsigned int l;
+
+	if(!c || !buf)
+		return 0;
+	spin_lock(&c->lock);
+	if(c->in - c->out < len)
+	{
+		spin_unlock(&c->lock);
+		return 0;
+	}
+	smp_rmb();
+	l = min(len, c->size - (c->out & (c->size - 1)));
+	memcpy(buf, c->buffer + (c->out & (c->size - 1)), l);
+	memcpy(buf + l, c->buffer, len - l);
+	smp_mb();
+	c->out += len;
+	list_for_each_entry_safe(pos, n, &c->swait, slist)
+	{
+		list_del_init(&pos->slist);
+		task_resume(pos);
+	}
+	spin_unlock(&c->lock);
+	return 1;
+}
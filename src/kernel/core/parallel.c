@@ -0,0 +1,184 @@
+/*
+ * kernel/core/parallel.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/parallel.h>
+
+struct parallel_job_t {
+	parallel_func_t func;
+	void * data;
+	int count;
+	int grain;
+	atomic_t next;
+	atomic_t done;
+	struct kref_t ref;
+};
+
+static void parallel_job_release(struct kref_t * kref)
+{
+	free(container_of(kref, struct parallel_job_t, ref));
+}
+
+static void parallel_job_run(struct parallel_job_t * job)
+{
+	int start, end;
+
+	while((start = atomic_add_return(&job->next, job->grain) - job->grain) < job->count)
+	{
+		end = min(start + job->grain, job->count);
+		job->func(start, end, job->data);
+		atomic_add(&job->done, end - start);
+	}
+}
+
+/*
+ * One persistent helper per online cpu, it sleeps until a job is handed over and
+ * drops its reference once no chunk is left. A newer job replaces a stale one.
+ */
+struct parallel_worker_t {
+	struct task_t * task;
+	struct parallel_job_t * job;
+	spinlock_t lock;
+};
+
+static struct parallel_worker_t __parallel_worker[CONFIG_MAX_SMP_CPUS];
+static spinlock_t __parallel_lock = SPIN_LOCK_INIT();
+
+static void parallel_task(struct task_t * task, void * data)
+{
+	struct parallel_worker_t * w = (struct parallel_worker_t *)data;
+	struct parallel_job_t * job;
+
+	while(1)
+	{
+		spin_lock(&w->lock);
+		job = w->job;
+		w->job = NULL;
+		spin_unlock(&w->lock);
+		if(job)
+		{
+			parallel_job_run(job);
+			kref_put(&job->ref, parallel_job_release);
+		}
+		else
+		{
+			task_suspend(task);
+		}
+	}
+}
+
+static struct parallel_worker_t * parallel_worker_get(int cpu)
+{
+	struct parallel_worker_t * w = &__parallel_worker[cpu];
+	struct task_t * task;
+
+	if(!scheduler_is_online(cpu))
+		return NULL;
+	if(!w->task)
+	{
+		spin_lock(&__parallel_lock);
+		if(!w->task)
+		{
+			spin_lock_init(&w->lock);
+			w->job = NULL;
+			task = task_create(&__sched[cpu], "parallel", parallel_task, w, 0, 0);
+			if(task)
+			{
+				smp_wmb();
+				w->task = task;
+				task_wakeup(task);
+			}
+		}
+		spin_unlock(&__parallel_lock);
+	}
+	return w->task ? w : NULL;
+}
+
+int parallel_get_workers(void)
+{
+	int n = scheduler_online_count();
+	return (n > 0) ? n : 1;
+}
+
+/*
+ * Split [0, count) into chunks of grain and run them on every online scheduler. The
+ * caller works on chunks too, and only waits for chunks already taken by other cpus,
+ * so a helper that never gets scheduled can not stall it.
+ */
+void parallel_for(int count, int grain, parallel_func_t func, void * data)
+{
+	struct parallel_worker_t * w;
+	struct parallel_job_t * job, * old;
+	int self = smp_processor_id();
+	int chunks, workers;
+	int i, n;
+
+	if(!func || (count <= 0))
+		return;
+	if(grain <= 0)
+		grain = 1;
+	chunks = (count + grain - 1) / grain;
+	workers = min(parallel_get_workers(), chunks);
+	if(workers <= 1)
+	{
+		func(0, count, data);
+		return;
+	}
+	job = malloc(sizeof(struct parallel_job_t));
+	if(!job)
+	{
+		func(0, count, data);
+		return;
+	}
+	job->func = func;
+	job->data = data;
+	job->count = count;
+	job->grain = grain;
+	atomic_set(&job->next, 0);
+	atomic_set(&job->done, 0);
+	kref_init(&job->ref);
+
+	for(i = 0, n = 1; (i < CONFIG_MAX_SMP_CPUS) && (n < workers); i++)
+	{
+		if((i == self) || !(w = parallel_worker_get(i)))
+			continue;
+		kref_get(&job->ref);
+		spin_lock(&w->lock);
+		old = w->job;
+		w->job = job;
+		spin_unlock(&w->lock);
+		if(old)
+			kref_put(&old->ref, parallel_job_release);
+		task_wakeup(w->task);
+		n++;
+	}
+	parallel_job_run(job);
+	while(atomic_get(&job->done) < count)
+		task_yield();
+	kref_put(&job->ref, parallel_job_release);
+}
@@ -0,0 +1,133 @@
+/*
+ * kernel/core/shrinker.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <xboot/shrinker.h>
+
+static struct list_head __shrinker_list = {
+	.next = &__shrinker_list,
+	.prev = &__shrinker_list,
+};
+static spinlock_t __shrinker_lock = SPIN_LOCK_INIT();
+
+static struct shrinker_t * search_shrinker(const char * name)
+{
+	struct shrinker_t * pos;
+
+	list_for_each_entry(pos, &__shrinker_list, entry)
+	{
+		if(strcmp(pos->name, name) == 0)
+			return pos;
+	}
+	return NULL;
+}
+
+bool_t register_shrinker(struct shrinker_t * s)
+{
+	irq_flags_t flags;
+
+	if(!s || !s->name || !s->shrink)
+		return FALSE;
+
+	spin_lock_irqsave(&__shrinker_lock, flags);
+	if(search_shrinker(s->name))
+	{
+		spin_unlock_irqrestore(&__shrinker_lock, flags);
+		return FALSE;
+	}
+	init_list_head(&s->entry);
+	list_add_tail(&s->entry, &__shrinker_list);
+	spin_unlock_irqrestore(&__shrinker_lock, flags);
+
+	return TRUE;
+}
+
+bool_t unregister_shrinker(struct shrinker_t * s)
+{
+	irq_flags_t flags;
+
+	if(!s || !s->name)
+		return FALSE;
+
+	spin_lock_irqsave(&__shrinker_lock, flags);
+	list_del(&s->entry);
+	spin_unlock_irqrestore(&__shrinker_lock, flags);
+
+	return TRUE;
+}
+
+/*
+ * Shrinkers run under the registry lock and must not unregister themselves
+ */
+void shrinker_run(void)
+{
+	struct shrinker_t * pos;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__shrinker_lock, flags);
+	list_for_each_entry(pos, &__shrinker_list, entry)
+		pos->shrink(pos);
+	spin_unlock_irqrestore(&__shrinker_lock, flags);
+}
+
+static ssize_t shrinker_read_list(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct shrinker_t * pos;
+	irq_flags_t flags;
+	int len = 0;
+
+	spin_lock_irqsave(&__shrinker_lock, flags);
+	list_for_each_entry(pos, &__shrinker_list, entry)
+	{
+		if(len + strlen(pos->name) + 2 >= size)
+			break;
+		len += sprintf((char *)buf + len, "%s\r\n", pos->name);
+	}
+	spin_unlock_irqrestore(&__shrinker_lock, flags);
+	return len;
+}
+
+static ssize_t shrinker_write_shrink(struct kobj_t * kobj, void * buf, size_t size)
+{
+	shrinker_run();
+	return size;
+}
+
+static __init void shrinker_init(void)
+{
+	struct kobj_t * kobj;
+
+	kobj = kobj_alloc_directory("shrinker");
+	if(kobj)
+	{
+		kobj_add_regular(kobj, "list", shrinker_read_list, NULL, NULL);
+		kobj_add_regular(kobj, "shrink", NULL, shrinker_write_shrink, NULL);
+		kobj_add(kobj_search_directory_with_create(kobj_get_root(), "kernel"), kobj);
+	}
+}
+core_initcall(shrinker_init);
@@ -112,6 +112,18 @@ static inline uint64_t calc_delta_fair(struct task_t * task, uint64_t delta)
 	return delta;
 }
 
+int scheduler_online_count(void)
+{
+	int i, n = 0;
+
+	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
+	{
+		if(__sched[i].online)
+			n++;
+	}
+	return n;
+}
+
 static inline struct task_t * scheduler_next_ready_task(struct scheduler_t * sched)
 {
 	struct rb_node * leftmost = rb_first_cached(&sched->ready);
@@ -177,14 +189,20 @@ static inline void scheduler_switch_task(struct scheduler_t * sched, struct task
 	t->fctx = from.fctx;
 }
 
+/*
+ * Lightest online scheduler, before any is running all of them are candidates
+ */
 static inline struct scheduler_t * scheduler_load_balance_choice(void)
 {
 	struct scheduler_t * sched = &__sched[0];
 	uint64_t weight = ~0ULL;
+	int online = scheduler_online_count();
 	int i;
 
 	for(i = 0; i < CONFIG_MAX_SMP_CPUS; i++)
 	{
+		if(online && !__sched[i].online)
+			continue;
 		if(__sched[i].weight < weight)
 		{
 			sched = &__sched[i];
@@ -268,6 +286,9 @@ struct task_t * task_create(struct scheduler_t * sched, const char * name, task_
 	task->fctx = make_fcontext(task->stack + stksz, task->stksz, fcontext_entry_func);
 	task->func = func;
 	task->data = data;
+	task->mused = 0;
+	task->mlimit = 0;
+	task->wakeup = 0;
 	task->__errno = 0;
 
 	return task;
@@ -325,6 +346,11 @@ void task_suspend(struct task_t * task)
 		}
 		else if(task->status == TASK_STATUS_RUNNING)
 		{
+			if(task->wakeup)
+			{
+				task->wakeup = 0;
+				return;
+			}
 			now = ktime_to_ns(ktime_get());
 			detla = now - task->start;
 
@@ -360,12 +386,56 @@ void task_resume(struct task_t * task)
 	}
 }
 
+/*
+ * Ask for a task to be resumed, safe from interrupt context and from any cpu. Only
+ * two flags are set, the scheduler owning the task resumes it on its next yield, and
+ * a task woken while still running returns from its next suspend at once.
+ */
+void task_wakeup(struct task_t * task)
+{
+	if(task)
+	{
+		task->wakeup = 1;
+		smp_wmb();
+		task->sched->wakeup = 1;
+	}
+}
+
+static void scheduler_wakeup(struct scheduler_t * sched)
+{
+	struct task_t * pos, * task;
+
+	while(sched->wakeup)
+	{
+		sched->wakeup = 0;
+		smp_mb();
+		do {
+			task = NULL;
+			spin_lock(&sched->lock);
+			list_for_each_entry(pos, &sched->suspend, list)
+			{
+				if(pos->wakeup)
+				{
+					pos->wakeup = 0;
+					task = pos;
+					break;
+				}
+			}
+			spin_unlock(&sched->lock);
+			task_resume(task);
+		} while(task);
+	}
+}
+
 void task_yield(void)
 {
 	struct scheduler_t * sched = scheduler_self();
 	struct task_t * next, * self = task_self();
-	uint64_t now = ktime_to_ns(ktime_get());
-	uint64_t detla = now - self->start;
+	uint64_t now, detla;
+
+	scheduler_wakeup(sched);
+	now = ktime_to_ns(ktime_get());
+	detla = now - self->start;
 
 	self->time += detla;
 	self->vtime += calc_delta_fair(self, detla);
@@ -434,6 +504,8 @@ static void smpboot_entry_func(void)
 	sched->weight += task->weight;
 	spin_unlock(&sched->lock);
 	task_resume(task);
+	sched->online = 1;
+	smp_wmb();
 
 	struct task_t * next = scheduler_next_ready_task(sched);
 	if(next)
@@ -460,6 +532,8 @@ void scheduler_loop(void)
 	sched->weight += task->weight;
 	spin_unlock(&sched->lock);
 	task_resume(task);
+	sched->online = 1;
+	smp_wmb();
 
 	struct task_t * next = scheduler_next_ready_task(sched);
 	if(next)
@@ -488,6 +562,8 @@ void do_init_sched(void)
 		sched->running = NULL;
 		sched->min_vtime = 0;
 		sched->weight = 0;
+		sched->wakeup = 0;
+		sched->online = 0;
 		spin_unlock(&sched->lock);
 	}
 }
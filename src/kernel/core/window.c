@@ -197,6 +197,113 @@ static void window_manager_free(struct window_manager_t * wm)
 	}
 }
 
+static void window_swap_resize(struct window_t * w, int count)
+{
+	struct framebuffer_t * fb = w->wm->fb;
+	int i;
+
+	if(count < 1)
+		count = 1;
+	else if(count > FRAMEBUFFER_BUFFER_MAX)
+		count = FRAMEBUFFER_BUFFER_MAX;
+	if(count == w->swap.count)
+		return;
+	for(i = 0; i < w->swap.count; i++)
+		framebuffer_present_wait(fb, w->swap.s[i]);
+	for(i = 1; i < w->swap.count; i++)
+	{
+		if(w->swap.s[i] == w->s)
+		{
+			w->swap.s[i] = w->swap.s[0];
+			w->swap.s[0] = w->s;
+		}
+	}
+	for(i = 1; i < FRAMEBUFFER_BUFFER_MAX; i++)
+	{
+		if((i >= count) && w->swap.s[i] && (w->swap.s[i] != w->s))
+		{
+			framebuffer_destroy_surface(fb, w->swap.s[i]);
+			w->swap.s[i] = NULL;
+		}
+		if((i >= count) && w->swap.rl[i])
+		{
+			region_list_free(w->swap.rl[i]);
+			w->swap.rl[i] = NULL;
+		}
+	}
+	for(i = 0; i < count; i++)
+	{
+		if(!w->swap.s[i])
+		{
+			w->swap.s[i] = framebuffer_create_surface(fb);
+			if(!w->swap.s[i])
+				break;
+		}
+		if(!w->swap.rl[i])
+		{
+			w->swap.rl[i] = region_list_alloc(0);
+			if(!w->swap.rl[i])
+				break;
+		}
+		w->swap.valid[i] = 0;
+	}
+	w->swap.count = (i > 0) ? i : 1;
+	if(w->swap.count == 1)
+	{
+		if(w->swap.rl[0])
+		{
+			region_list_free(w->swap.rl[0]);
+			w->swap.rl[0] = NULL;
+		}
+	}
+	w->swap.index = 0;
+	w->s = w->swap.s[0];
+}
+
+/*
+ * With more than one buffer, pick the next back buffer and extend the damage by
+ * what changed since this buffer was last drawn, according to its buffer age.
+ */
+static void window_swap_acquire(struct window_t * w)
+{
+	struct region_t region;
+	int index = w->swap.index;
+	int i;
+
+	w->s = w->swap.s[index];
+	framebuffer_present_wait(w->wm->fb, w->s);
+	region_list_clone(w->swap.rl[index], w->rl);
+	if(!w->swap.valid[index])
+	{
+		region_init(&region, 0, 0, framebuffer_get_width(w->wm->fb), framebuffer_get_height(w->wm->fb));
+		region_list_clear(w->rl);
+		region_list_add(w->rl, &region);
+		w->swap.valid[index] = 1;
+	}
+	else
+	{
+		for(i = 0; i < w->swap.count; i++)
+		{
+			if(i != index)
+				region_list_merge(w->rl, w->swap.rl[i]);
+		}
+	}
+}
+
+/*
+ * Pairs with window_wait_event, the event is queued before the waiter is read,
+ * the waiter is published before the fifo is checked
+ */
+static inline void window_wakeup(struct window_t * w)
+{
+	struct task_t * task;
+
+	smp_mb();
+	task = w->wait;
+	if(task)
+		task_wakeup(task);
+}
+
 struct window_t * window_alloc(const char * fb, const char * input)
 {
 	struct window_manager_t * wm = window_manager_alloc(fb);
@@ -217,7 +324,11 @@ struct window_t * window_alloc(const char * fb, const char * input)
 	w->wm = wm;
 	w->s = framebuffer_create_surface(w->wm->fb);
 	w->rl = region_list_alloc(0);
+	memset(&w->swap, 0, sizeof(w->swap));
+	w->swap.s[0] = w->s;
+	w->swap.count = 1;
 	w->event = fifo_alloc(sizeof(struct event_t) * CONFIG_EVENT_FIFO_SIZE);
+	w->wait = NULL;
 	w->launcher = 0;
 	if(p)
 	{
@@ -261,21 +372,28 @@ struct window_t * window_alloc(const char * fb, const char * input)
 
 void window_free(struct window_t * w)
 {
+	struct window_manager_t * wm;
+	int last;
+
 	if(!w || !w->wm)
 		return;
 
-	spin_lock(&w->wm->lock);
+	wm = w->wm;
+	spin_lock(&wm->lock);
 	list_del(&w->list);
-	w->wm->wcount--;
-	w->wm->refresh = 1;
-	spin_unlock(&w->wm->lock);
-	if(w->wm->wcount <= 0)
-		window_manager_free(w->wm);
+	wm->wcount--;
+	wm->refresh = 1;
+	last = (wm->wcount <= 0) ? 1 : 0;
+	spin_unlock(&wm->lock);
 	fifo_free(w->event);
 	hmap_free(w->map, NULL);
-	framebuffer_destroy_surface(w->wm->fb, w->s);
+	window_swap_resize(w, 1);
+	framebuffer_present_wait(wm->fb, w->s);
+	framebuffer_destroy_surface(wm->fb, w->s);
 	region_list_free(w->rl);
 	free(w);
+	if(last)
+		window_manager_free(wm);
 }
 
 void window_to_front(struct window_t * w)
@@ -286,6 +404,7 @@ void window_to_front(struct window_t * w)
 		list_move(&w->list, &w->wm->window);
 		w->wm->refresh = 1;
 		spin_unlock(&w->wm->lock);
+		window_wakeup(w);
 	}
 }
 
@@ -323,11 +442,14 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 	struct surface_t * s = w->s;
 	struct region_t * r, region;
 	struct matrix_t m;
-	uint32_t * p, * q;
-	int x1, y1, x2, y2;
-	int l, x, y;
 	int n, i;
 
+	if(w->swap.count != framebuffer_get_buffers(w->wm->fb))
+	{
+		window_swap_resize(w, framebuffer_get_buffers(w->wm->fb));
+		s = w->s;
+		w->wm->refresh = 1;
+	}
 	if(w->wm->refresh)
 	{
 		region_init(&region, 0, 0, framebuffer_get_width(w->wm->fb), framebuffer_get_height(w->wm->fb));
@@ -335,6 +457,8 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 		region_list_add(w->rl, &region);
 		w->wm->refresh = 0;
 		w->wm->cursor.dirty = 0;
+		for(i = 0; i < w->swap.count; i++)
+			w->swap.valid[i] = 0;
 	}
 	else if(w->wm->cursor.show && w->wm->cursor.dirty)
 	{
@@ -344,27 +468,17 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 		window_region_list_add(w, &(struct region_t){ r->x - 2, r->y - 2, r->w, r->h });
 		w->wm->cursor.dirty = 0;
 	}
+	if(w->swap.count > 1)
+	{
+		window_swap_acquire(w);
+		s = w->s;
+	}
 	if((n = w->rl->count) > 0)
 	{
-		l = s->stride >> 2;
 		for(i = 0; i < n; i++)
 		{
 			r = &w->rl->region[i];
-			x1 = r->x;
-			y1 = r->y;
-			x2 = r->x + r->w;
-			y2 = r->y + r->h;
-			q = (uint32_t *)s->pixels + y1 * l + x1;
-			for(y = y1; y < y2; y++, q += l)
-			{
-				for(x = x1, p = q; x < x2; x++, p++)
-				{
-					if((x ^ y) & (1 << 3))
-						*p = 0xffabb9bd;
-					else
-						*p = 0xff899598;
-				}
-			}
+			surface_shape_checkerboard(s, NULL, r->x, r->y, r->w, r->h);
 		}
 		if(draw)
 			draw(w, o);
@@ -375,7 +489,15 @@ void window_present(struct window_t * w, void * o, void (*draw)(struct window_t
 			surface_blit(s, NULL, &m, w->wm->cursor.s, RENDER_TYPE_FAST);
 		}
 	}
-	framebuffer_present_surface(w->wm->fb, w->s, w->rl);
+	if(w->swap.count > 1)
+	{
+		framebuffer_present_async(w->wm->fb, w->s, w->swap.rl[w->swap.index]);
+		w->swap.index = (w->swap.index + 1) % w->swap.count;
+	}
+	else
+	{
+		framebuffer_present_surface(w->wm->fb, w->s, w->rl);
+	}
 }
 
 void window_exit(struct window_t * w)
@@ -388,7 +510,23 @@ void window_exit(struct window_t * w)
 		e.type = EVENT_TYPE_SYSTEM_EXIT;
 		e.timestamp = ktime_get();
 		fifo_put(w->event, (unsigned char *)&e, sizeof(struct event_t));
+		window_wakeup(w);
+	}
+}
+
+/*
+ * Whether the next present has work of its own, regardless of the content
+ */
+int window_is_dirty(struct window_t * w)
+{
+	if(w)
+	{
+		if(w->wm->refresh || (w->swap.count != framebuffer_get_buffers(w->wm->fb)))
+			return 1;
+		if(w->wm->cursor.show && w->wm->cursor.dirty)
+			return 1;
 	}
+	return 0;
 }
 
 int window_pump_event(struct window_t * w, struct event_t * e)
@@ -398,6 +536,69 @@ int window_pump_event(struct window_t * w, struct event_t * e)
 	return 0;
 }
 
+/*
+ * Queue an event for this window only, whatever window is in front. Returns
+ * zero and queues nothing when the event fifo is full.
+ */
+int window_push_event(struct window_t * w, struct event_t * e)
+{
+	irq_flags_t flags;
+	int ret = 0;
+
+	if(w && e)
+	{
+		e->timestamp = ktime_get();
+		spin_lock_irqsave(&w->event->lock, flags);
+		if(w->event->size - __fifo_len(w->event) >= sizeof(struct event_t))
+			ret = (__fifo_put(w->event, (unsigned char *)e, sizeof(struct event_t)) == sizeof(struct event_t));
+		spin_unlock_irqrestore(&w->event->lock, flags);
+		if(ret)
+			window_wakeup(w);
+	}
+	return ret;
+}
+
+static int window_wakeup_timer(struct timer_t * timer, void * data)
+{
+	task_wakeup((struct task_t *)data);
+	return 0;
+}
+
+/*
+ * Suspend the calling task until an event is queued or the deadline passes, returns
+ * whether there is an event to pump. Wakeups only flag the task, one arriving between
+ * the fifo check and the suspend makes the suspend return at once.
+ */
+int window_wait_event(struct window_t * w, ktime_t deadline)
+{
+	struct task_t * self = task_self();
+	struct timer_t timer;
+	ktime_t now;
+	int armed = 0;
+
+	if(!w)
+		return 0;
+	w->wait = self;
+	smp_mb();
+	timer_init(&timer, window_wakeup_timer, self);
+	while(fifo_len(w->event) < sizeof(struct event_t))
+	{
+		now = ktime_get();
+		if(!ktime_before(now, deadline))
+			break;
+		if(!armed && (ktime_to_ns(deadline) != KTIME_MAX))
+		{
+			timer_start_now(&timer, ktime_sub(deadline, now));
+			armed = 1;
+		}
+		task_suspend(self);
+	}
+	if(armed)
+		timer_cancel(&timer);
+	w->wait = NULL;
+	return (fifo_len(w->event) >= sizeof(struct event_t)) ? 1 : 0;
+}
+
 void push_event(struct event_t * e)
 {
 	struct window_manager_t * pos, * n;
@@ -412,6 +613,7 @@ void push_event(struct event_t * e)
 			if(w && (!w->map || hmap_search(w->map, ((struct input_t *)e->device)->name)))
 			{
 				fifo_put(w->event, (unsigned char *)e, sizeof(struct event_t));
+				window_wakeup(w);
 				switch(e->type)
 				{
 				case EVENT_TYPE_KEY_DOWN:
@@ -27,6 +27,7 @@
  */
 
 #include <ctype.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
@@ -175,6 +176,7 @@ static FT_Error ftcface_requester(FTC_FaceID id, FT_Library lib, FT_Pointer data
 struct font_context_t * font_context_alloc(void)
 {
 	struct font_context_t * ctx;
+	int i;
 
 	ctx = malloc(sizeof(struct font_context_t));
 	if(!ctx)
@@ -185,6 +187,14 @@ struct font_context_t * font_context_alloc(void)
 	FTC_SBitCache_New((FTC_Manager)ctx->manager, (FTC_SBitCache *)&ctx->sbit);
 	FTC_ImageCache_New((FTC_Manager)ctx->manager, (FTC_ImageCache *)&ctx->image);
 	init_list_head(&ctx->list);
+	init_list_head(&ctx->atlas.page);
+	for(i = 0; i < FONT_ATLAS_HASH_SIZE; i++)
+		init_hlist_head(&ctx->atlas.hash[i]);
+	ctx->atlas.generation = 0;
+	init_list_head(&ctx->run.lru);
+	for(i = 0; i < FONT_RUN_HASH_SIZE; i++)
+		init_hlist_head(&ctx->run.hash[i]);
+	memset(&ctx->stats, 0, sizeof(struct font_stats_t));
 
 	font_add(ctx, NULL, "roboto-thin",			"/framework/assets/fonts/Roboto-Thin.ttf");
 	font_add(ctx, NULL, "roboto-Thin-italic",	"/framework/assets/fonts/Roboto-ThinItalic.ttf");
@@ -207,9 +217,22 @@ struct font_context_t * font_context_alloc(void)
 void font_context_free(struct font_context_t * ctx)
 {
 	struct font_t * pos, * n;
+	struct font_atlas_page_t * page, * pn;
+	struct font_run_t * run, * rn;
 
 	if(ctx)
 	{
+		list_for_each_entry_safe(run, rn, &ctx->run.lru, list)
+		{
+			font_run_free(run);
+		}
+		font_atlas_reset(ctx);
+		list_for_each_entry_safe(page, pn, &ctx->atlas.page, list)
+		{
+			list_del(&page->list);
+			free(page->pixels);
+			free(page);
+		}
 		list_for_each_entry_safe(pos, n, &ctx->list, list)
 		{
 			if(pos->family)
@@ -326,6 +349,309 @@ void * font_lookup_glyph(struct font_context_t * ctx, const char * family, int s
 	return NULL;
 }
 
+static inline uint32_t string_hash(uint32_t v, const char * s)
+{
+	char c;
+
+	if(s)
+	{
+		while((c = *s++))
+			v = (v << 5) + v + c;
+	}
+	return v;
+}
+
+static inline uint32_t glyph_hash(uint32_t key, int size, uint32_t code)
+{
+	uint32_t v = key ^ (size * 0x9e3779b1) ^ (code * 0x85ebca6b);
+	return (v ^ (v >> 16)) & (FONT_ATLAS_HASH_SIZE - 1);
+}
+
+static struct font_atlas_page_t * font_atlas_page_alloc(int width, int height)
+{
+	struct font_atlas_page_t * page;
+
+	page = malloc(sizeof(struct font_atlas_page_t));
+	if(!page)
+		return NULL;
+	page->pixels = malloc(width * height);
+	if(!page->pixels)
+	{
+		free(page);
+		return NULL;
+	}
+	page->width = width;
+	page->height = height;
+	page->used = 0;
+	page->nshelf = 0;
+	return page;
+}
+
+static int font_atlas_page_pack(struct font_atlas_page_t * page, int w, int h, int * x, int * y)
+{
+	int best = -1, waste = INT_MAX;
+	int sy, sh, i;
+
+	for(i = 0; i < page->nshelf; i++)
+	{
+		if((page->shelf[i].h >= h) && (page->shelf[i].x + w <= page->width))
+		{
+			if(page->shelf[i].h - h < waste)
+			{
+				waste = page->shelf[i].h - h;
+				best = i;
+			}
+		}
+	}
+	if((best < 0) || (waste > (h >> 1)))
+	{
+		sy = (page->nshelf > 0) ? page->shelf[page->nshelf - 1].y + page->shelf[page->nshelf - 1].h : 0;
+		sh = (h + 3) & ~0x3;
+		if((page->nshelf < FONT_ATLAS_SHELF_MAX) && (w <= page->width) && (sy + sh <= page->height))
+		{
+			best = page->nshelf++;
+			page->shelf[best].y = sy;
+			page->shelf[best].h = sh;
+			page->shelf[best].x = 0;
+		}
+	}
+	if(best < 0)
+		return 0;
+	*x = page->shelf[best].x;
+	*y = page->shelf[best].y;
+	page->shelf[best].x += w;
+	page->used += w * h;
+	return 1;
+}
+
+static struct font_atlas_page_t * font_atlas_pack(struct font_context_t * ctx, int w, int h, int * x, int * y)
+{
+	struct font_atlas_page_t * page;
+
+	list_for_each_entry(page, &ctx->atlas.page, list)
+	{
+		if(font_atlas_page_pack(page, w, h, x, y))
+			return page;
+	}
+	if(ctx->stats.atlas_pages < FONT_ATLAS_PAGE_MAX)
+	{
+		page = font_atlas_page_alloc(FONT_ATLAS_PAGE_SIZE, FONT_ATLAS_PAGE_SIZE);
+		if(page)
+		{
+			list_add_tail(&page->list, &ctx->atlas.page);
+			ctx->stats.atlas_pages++;
+			ctx->stats.atlas_bytes += page->width * page->height;
+			if(font_atlas_page_pack(page, w, h, x, y))
+				return page;
+		}
+	}
+	return NULL;
+}
+
+void font_atlas_reset(struct font_context_t * ctx)
+{
+	struct font_atlas_page_t * page;
+	struct font_glyph_t * g;
+	struct hlist_node * n;
+	int i;
+
+	if(ctx)
+	{
+		for(i = 0; i < FONT_ATLAS_HASH_SIZE; i++)
+		{
+			hlist_for_each_entry_safe(g, n, &ctx->atlas.hash[i], node)
+			{
+				hlist_del(&g->node);
+				free(g);
+			}
+		}
+		list_for_each_entry(page, &ctx->atlas.page, list)
+		{
+			page->used = 0;
+			page->nshelf = 0;
+		}
+		ctx->atlas.generation++;
+		ctx->stats.atlas_glyphs = 0;
+		ctx->stats.atlas_used = 0;
+	}
+}
+
+struct font_glyph_t * font_atlas_lookup(struct font_context_t * ctx, const char * family, int size, uint32_t code)
+{
+	struct font_atlas_page_t * page;
+	struct hlist_head * head;
+	struct font_glyph_t * g;
+	FTC_SBit sbit;
+	uint8_t * sp, * dp;
+	const char * name = family ? family : "";
+	uint32_t key;
+	int x, y, j, len;
+
+	key = string_hash(5381, name);
+	head = &ctx->atlas.hash[glyph_hash(key, size, code)];
+	hlist_for_each_entry(g, head, node)
+	{
+		if((g->key == key) && (g->size == size) && (g->code == code) && (strcmp(g->family, name) == 0))
+		{
+			ctx->stats.glyph_hit++;
+			return g->valid ? g : NULL;
+		}
+	}
+	ctx->stats.glyph_miss++;
+
+	len = strlen(name) + 1;
+	g = malloc(sizeof(struct font_glyph_t) + len);
+	if(!g)
+		return NULL;
+	memset(g, 0, sizeof(struct font_glyph_t));
+	g->family = (char *)(g + 1);
+	memcpy(g->family, name, len);
+	g->key = key;
+	g->size = size;
+	g->code = code;
+	sbit = (FTC_SBit)font_lookup_bitmap(ctx, family, size, code);
+	if(sbit)
+	{
+		/*
+		 * Glyphs larger than a page can never be packed, keep them
+		 * without a page and let the renderer draw them directly
+		 */
+		if((sbit->width > 0) && (sbit->height > 0) && sbit->buffer && (sbit->width <= FONT_ATLAS_PAGE_SIZE) && (sbit->height <= FONT_ATLAS_PAGE_SIZE))
+		{
+			page = font_atlas_pack(ctx, sbit->width, sbit->height, &x, &y);
+			if(!page)
+			{
+				font_atlas_reset(ctx);
+				page = font_atlas_pack(ctx, sbit->width, sbit->height, &x, &y);
+				head = &ctx->atlas.hash[glyph_hash(key, size, code)];
+			}
+			if(page)
+			{
+				sp = (uint8_t *)sbit->buffer;
+				dp = page->pixels + y * page->width + x;
+				for(j = 0; j < sbit->height; j++, sp += sbit->pitch, dp += page->width)
+					memcpy(dp, sp, sbit->width);
+				g->page = page;
+				g->x = x;
+				g->y = y;
+				ctx->stats.atlas_used += sbit->width * sbit->height;
+			}
+		}
+		g->w = sbit->width;
+		g->h = sbit->height;
+		g->left = sbit->left;
+		g->top = sbit->top;
+		g->xadvance = sbit->xadvance;
+		g->yadvance = sbit->yadvance;
+		g->valid = 1;
+	}
+	hlist_add_head(&g->node, head);
+	ctx->stats.atlas_glyphs++;
+	return g->valid ? g : NULL;
+}
+
+uint32_t font_run_hash(const char * utf8, const char * family, int size, int wrap)
+{
+	uint32_t v = string_hash(5381, utf8);
+
+	v = string_hash(v, family);
+	return v ^ (size * 0x9e3779b1) ^ (wrap * 0x85ebca6b);
+}
+
+struct font_run_t * font_run_search(struct font_context_t * ctx, const char * utf8, const char * family, int size, int wrap)
+{
+	struct font_run_t * run;
+	struct hlist_node * n;
+	uint32_t hash = font_run_hash(utf8, family, size, wrap);
+
+	hlist_for_each_entry_safe(run, n, &ctx->run.hash[hash & (FONT_RUN_HASH_SIZE - 1)], node)
+	{
+		if((run->hash == hash) && (run->size == size) && (run->wrap == wrap) && (strcmp(run->utf8, utf8) == 0) && (strcmp(run->family, family ? family : "") == 0))
+		{
+			if(run->generation != ctx->atlas.generation)
+			{
+				ctx->stats.runs--;
+				ctx->stats.run_bytes -= run->bytes;
+				font_run_free(run);
+				break;
+			}
+			list_move(&run->list, &ctx->run.lru);
+			ctx->stats.run_hit++;
+			return run;
+		}
+	}
+	ctx->stats.run_miss++;
+	return NULL;
+}
+
+struct font_run_t * font_run_alloc(struct font_context_t * ctx, const char * utf8, const char * family, int size, int wrap, int nglyph)
+{
+	struct font_run_t * run;
+	int lutf8 = strlen(utf8) + 1;
+	int lfamily = (family ? strlen(family) : 0) + 1;
+	int bytes;
+
+	if(nglyph < 0)
+		nglyph = 0;
+	bytes = sizeof(struct font_run_t) + nglyph * sizeof(run->glyph[0]) + lutf8 + lfamily;
+	run = malloc(bytes);
+	if(!run)
+		return NULL;
+	init_hlist_node(&run->node);
+	init_list_head(&run->list);
+	run->hash = font_run_hash(utf8, family, size, wrap);
+	run->generation = ctx->atlas.generation;
+	run->bytes = bytes;
+	run->utf8 = (char *)&run->glyph[nglyph];
+	run->family = run->utf8 + lutf8;
+	memcpy(run->utf8, utf8, lutf8);
+	if(family)
+		memcpy(run->family, family, lfamily);
+	else
+		run->family[0] = 0;
+	run->size = size;
+	run->wrap = wrap;
+	run->nglyph = 0;
+	return run;
+}
+
+void font_run_cache(struct font_context_t * ctx, struct font_run_t * run)
+{
+	struct font_run_t * last;
+
+	if(ctx && run)
+	{
+		while((ctx->stats.run_bytes + run->bytes > FONT_RUN_CACHE_BYTES) && !list_empty(&ctx->run.lru))
+		{
+			last = list_last_entry(&ctx->run.lru, struct font_run_t, list);
+			ctx->stats.runs--;
+			ctx->stats.run_bytes -= last->bytes;
+			font_run_free(last);
+		}
+		hlist_add_head(&run->node, &ctx->run.hash[run->hash & (FONT_RUN_HASH_SIZE - 1)]);
+		list_add(&run->list, &ctx->run.lru);
+		ctx->stats.runs++;
+		ctx->stats.run_bytes += run->bytes;
+	}
+}
+
+void font_run_free(struct font_run_t * run)
+{
+	if(run)
+	{
+		if(!hlist_unhashed(&run->node))
+			hlist_del(&run->node);
+		list_del(&run->list);
+		free(run);
+	}
+}
+
+void font_context_stats(struct font_context_t * ctx, struct font_stats_t * stats)
+{
+	if(ctx && stats)
+		memcpy(stats, &ctx->stats, sizeof(struct font_stats_t));
+}
+
 void font_add(struct font_context_t * ctx, struct xfs_context_t * xfs, const char * family, const char * path)
 {
 	struct vfs_stat_t st;
@@ -356,6 +682,7 @@ void font_add(struct font_context_t * ctx, struct xfs_context_t * xfs, const cha
 			f->family = strdup(family);
 			f->path = strdup(path);
 			list_add_tail(&f->list, &ctx->list);
+			font_atlas_reset(ctx);
 		}
 	}
 }
@@ -137,6 +137,11 @@ static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip
 	sy = r.y - y;
 	dskip = s->width - dw;
 	sskip = sbit->pitch - dw;
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		render_default_mask(s, &r, c, (uint8_t *)sbit->buffer + sy * sbit->pitch + sx, sbit->pitch);
+		return;
+	}
 	dp = (uint32_t *)s->pixels + dy * s->width + dx;
 	sp = (uint8_t *)sbit->buffer + sy * sbit->pitch + sx;
 	color = color_get_premult(c);
@@ -211,6 +216,11 @@ static inline void draw_font_glyph(struct surface_t * s, struct region_t * clip,
 	sy = r.y - y;
 	dskip = s->width - dw;
 	sskip = bitmap->pitch - dw;
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		render_default_mask(s, &r, c, (uint8_t *)bitmap->buffer + sy * bitmap->pitch + sx, bitmap->pitch);
+		return;
+	}
 	dp = (uint32_t *)s->pixels + dy * s->width + dx;
 	sp = (uint8_t *)bitmap->buffer + sy * bitmap->pitch + sx;
 	color = (c->a << 24) | (c->r << 16) | (c->g << 8) | (c->b << 0);
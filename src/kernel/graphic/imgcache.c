@@ -0,0 +1,480 @@
+/*
+ * kernel/graphic/imgcache.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <graphic/imgcache.h>
+
+#define IMGCACHE_BUDGET		(SZ_16M)
+#define IMGCACHE_HASH_SIZE	(64)
+
+enum imgcache_state_t {
+	IMGCACHE_STATE_LOADING	= 0,
+	IMGCACHE_STATE_READY	= 1,
+	IMGCACHE_STATE_FAILED	= 2,
+};
+
+/*
+ * Decoded images, keyed by the mount which provides the file, its path, mtime,
+ * length and the decode size. Unreferenced entries stay on the lru list until
+ * the byte budget needs their memory.
+ */
+struct imgcache_entry_t {
+	struct list_head entry;
+	struct hlist_node node;
+	struct hlist_node snode;
+	uint32_t hash;
+	int ref;
+	enum imgcache_state_t state;
+	char * mount;
+	char * path;
+	u64_t mtime;
+	s64_t length;
+	int width;
+	int height;
+	size_t size;
+	struct surface_t * s;
+};
+
+static struct {
+	struct list_head lru;
+	struct hlist_head hash[IMGCACHE_HASH_SIZE];
+	struct hlist_head shash[IMGCACHE_HASH_SIZE];
+	size_t bytes;
+	size_t budget;
+	int entries;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	spinlock_t lock;
+} __imgcache = {
+	.lru = {
+		.next = &__imgcache.lru,
+		.prev = &__imgcache.lru,
+	},
+	.bytes = 0,
+	.budget = IMGCACHE_BUDGET,
+	.lock = SPIN_LOCK_INIT(),
+};
+
+static inline struct hlist_head * imgcache_surface_hash(struct surface_t * s)
+{
+	return &__imgcache.shash[((unsigned long)s >> 4) & (IMGCACHE_HASH_SIZE - 1)];
+}
+
+static void imgcache_entry_free(struct imgcache_entry_t * e)
+{
+	if(e)
+	{
+		if(e->s)
+			surface_free(e->s);
+		free(e->mount);
+		free(e->path);
+		free(e);
+	}
+}
+
+/*
+ * Drop unreferenced entries from the cold end until the cache fits the budget,
+ * the victims are moved to the list and freed after the lock is released.
+ */
+static void imgcache_evict(size_t budget, struct list_head * victims)
+{
+	struct imgcache_entry_t * pos, * n;
+
+	list_for_each_entry_safe_reverse(pos, n, &__imgcache.lru, entry)
+	{
+		if(__imgcache.bytes <= budget)
+			break;
+		if((pos->ref == 0) && (pos->state == IMGCACHE_STATE_READY))
+		{
+			hlist_del(&pos->node);
+			hlist_del(&pos->snode);
+			list_move(&pos->entry, victims);
+			__imgcache.bytes -= pos->size;
+			__imgcache.entries--;
+			__imgcache.evictions++;
+		}
+	}
+}
+
+static void imgcache_free_victims(struct list_head * victims)
+{
+	struct imgcache_entry_t * pos, * n;
+
+	list_for_each_entry_safe(pos, n, victims, entry)
+	{
+		list_del(&pos->entry);
+		imgcache_entry_free(pos);
+	}
+}
+
+static struct surface_t * imgcache_decode(struct xfs_context_t * ctx, const char * filename, int width, int height)
+{
+	return surface_alloc_from_xfs_scaled(ctx, filename, SURFACE_FORMAT_ARGB32, width, height);
+}
+
+struct surface_t * imgcache_get(struct xfs_context_t * ctx, const char * filename, int width, int height)
+{
+	struct imgcache_entry_t * e, * pos;
+	struct hlist_node * n;
+	struct xfs_file_t * file;
+	struct list_head victims;
+	struct surface_t * s;
+	irq_flags_t flags;
+	uint32_t hash;
+	u64_t mtime;
+	s64_t length;
+	char * mount;
+
+	if(!ctx || !filename)
+		return NULL;
+	if((width <= 0) || (height <= 0))
+		width = height = 0;
+
+	file = xfs_open_read(ctx, filename);
+	if(!file)
+		return NULL;
+	mount = strdup(file->path->path);
+	mtime = xfs_mtime(file);
+	length = xfs_length(file);
+	xfs_close(file);
+	if(!mount)
+		return NULL;
+	hash = shash(mount) ^ shash(filename) ^ (uint32_t)mtime ^ (uint32_t)length ^ (width << 16) ^ height;
+
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	e = NULL;
+	hlist_for_each_entry_safe(pos, n, &__imgcache.hash[hash & (IMGCACHE_HASH_SIZE - 1)], node)
+	{
+		if((pos->hash == hash) && (pos->mtime == mtime) && (pos->length == length) && (pos->width == width) && (pos->height == height)
+			&& (strcmp(pos->path, filename) == 0) && (strcmp(pos->mount, mount) == 0))
+		{
+			e = pos;
+			break;
+		}
+	}
+	if(e)
+	{
+		e->ref++;
+		__imgcache.hits++;
+		list_move(&e->entry, &__imgcache.lru);
+		while(e->state == IMGCACHE_STATE_LOADING)
+		{
+			spin_unlock_irqrestore(&__imgcache.lock, flags);
+			task_yield();
+			spin_lock_irqsave(&__imgcache.lock, flags);
+		}
+		s = (e->state == IMGCACHE_STATE_READY) ? e->s : NULL;
+		if(!s && (--e->ref == 0))
+		{
+			spin_unlock_irqrestore(&__imgcache.lock, flags);
+			imgcache_entry_free(e);
+		}
+		else
+		{
+			spin_unlock_irqrestore(&__imgcache.lock, flags);
+		}
+		free(mount);
+		return s;
+	}
+	__imgcache.misses++;
+	spin_unlock_irqrestore(&__imgcache.lock, flags);
+
+	e = malloc(sizeof(struct imgcache_entry_t));
+	if(!e)
+	{
+		free(mount);
+		return imgcache_decode(ctx, filename, width, height);
+	}
+	memset(e, 0, sizeof(struct imgcache_entry_t));
+	init_list_head(&e->entry);
+	init_hlist_node(&e->node);
+	init_hlist_node(&e->snode);
+	e->hash = hash;
+	e->ref = 1;
+	e->state = IMGCACHE_STATE_LOADING;
+	e->mount = mount;
+	e->path = strdup(filename);
+	e->mtime = mtime;
+	e->length = length;
+	e->width = width;
+	e->height = height;
+	if(!e->path)
+	{
+		imgcache_entry_free(e);
+		return imgcache_decode(ctx, filename, width, height);
+	}
+
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	hlist_add_head(&e->node, &__imgcache.hash[hash & (IMGCACHE_HASH_SIZE - 1)]);
+	list_add(&e->entry, &__imgcache.lru);
+	__imgcache.entries++;
+	spin_unlock_irqrestore(&__imgcache.lock, flags);
+
+	s = imgcache_decode(ctx, filename, width, height);
+
+	init_list_head(&victims);
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	if(s)
+	{
+		e->s = s;
+		e->size = sizeof(struct surface_t) + s->pixlen;
+		e->state = IMGCACHE_STATE_READY;
+		hlist_add_head(&e->snode, imgcache_surface_hash(s));
+		__imgcache.bytes += e->size;
+		imgcache_evict(__imgcache.budget, &victims);
+	}
+	else
+	{
+		e->state = IMGCACHE_STATE_FAILED;
+		hlist_del(&e->node);
+		list_del_init(&e->entry);
+		__imgcache.entries--;
+		if(--e->ref > 0)
+			e = NULL;
+	}
+	spin_unlock_irqrestore(&__imgcache.lock, flags);
+	imgcache_free_victims(&victims);
+	if(!s)
+		imgcache_entry_free(e);
+	return s;
+}
+
+struct imgcache_async_t {
+	struct xfs_context_t * ctx;
+	char * filename;
+	int width;
+	int height;
+	imgcache_callback_t cb;
+	void * data;
+};
+
+static void imgcache_async_task(struct task_t * task, void * data)
+{
+	struct imgcache_async_t * job = (struct imgcache_async_t *)data;
+
+	job->cb(imgcache_get(job->ctx, job->filename, job->width, job->height), job->data);
+	free(job->filename);
+	free(job);
+}
+
+/*
+ * Decode on a background task, the callback runs on that task with a referenced
+ * surface or NULL. The xfs context must stay alive until the callback is called.
+ */
+int imgcache_get_async(struct xfs_context_t * ctx, const char * filename, int width, int height, imgcache_callback_t cb, void * data)
+{
+	struct imgcache_async_t * job;
+	struct task_t * task;
+
+	if(!ctx || !filename || !cb)
+		return 0;
+	job = malloc(sizeof(struct imgcache_async_t));
+	if(!job)
+		return 0;
+	job->ctx = ctx;
+	job->filename = strdup(filename);
+	job->width = width;
+	job->height = height;
+	job->cb = cb;
+	job->data = data;
+	if(!job->filename)
+	{
+		free(job);
+		return 0;
+	}
+	task = task_create(NULL, "imgcache", imgcache_async_task, job, 0, 5);
+	if(!task)
+	{
+		free(job->filename);
+		free(job);
+		return 0;
+	}
+	task_resume(task);
+	return 1;
+}
+
+static struct imgcache_entry_t * imgcache_search_surface(struct surface_t * s)
+{
+	struct imgcache_entry_t * pos;
+	struct hlist_node * n;
+
+	hlist_for_each_entry_safe(pos, n, imgcache_surface_hash(s), snode)
+	{
+		if(pos->s == s)
+			return pos;
+	}
+	return NULL;
+}
+
+void imgcache_put(struct surface_t * s)
+{
+	struct imgcache_entry_t * e;
+	struct list_head victims;
+	irq_flags_t flags;
+
+	if(!s)
+		return;
+	init_list_head(&victims);
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	e = imgcache_search_surface(s);
+	if(e)
+	{
+		if(--e->ref == 0)
+			imgcache_evict(__imgcache.budget, &victims);
+		spin_unlock_irqrestore(&__imgcache.lock, flags);
+		imgcache_free_victims(&victims);
+	}
+	else
+	{
+		spin_unlock_irqrestore(&__imgcache.lock, flags);
+		surface_free(s);
+	}
+}
+
+int imgcache_owned(struct surface_t * s)
+{
+	irq_flags_t flags;
+	int ret;
+
+	if(!s)
+		return 0;
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	ret = imgcache_search_surface(s) ? 1 : 0;
+	spin_unlock_irqrestore(&__imgcache.lock, flags);
+	return ret;
+}
+
+void imgcache_set_budget(size_t budget)
+{
+	struct list_head victims;
+	irq_flags_t flags;
+
+	init_list_head(&victims);
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	__imgcache.budget = budget;
+	imgcache_evict(budget, &victims);
+	spin_unlock_irqrestore(&__imgcache.lock, flags);
+	imgcache_free_victims(&victims);
+}
+
+void imgcache_get_stat(struct imgcache_stat_t * stat)
+{
+	struct imgcache_entry_t * pos;
+	irq_flags_t flags;
+
+	if(!stat)
+		return;
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	stat->bytes = __imgcache.bytes;
+	stat->budget = __imgcache.budget;
+	stat->entries = __imgcache.entries;
+	stat->busy = 0;
+	list_for_each_entry(pos, &__imgcache.lru, entry)
+	{
+		if(pos->ref > 0)
+			stat->busy++;
+	}
+	stat->hits = __imgcache.hits;
+	stat->misses = __imgcache.misses;
+	stat->evictions = __imgcache.evictions;
+	spin_unlock_irqrestore(&__imgcache.lock, flags);
+}
+
+void imgcache_shrink(void)
+{
+	struct list_head victims;
+	irq_flags_t flags;
+
+	init_list_head(&victims);
+	spin_lock_irqsave(&__imgcache.lock, flags);
+	imgcache_evict(0, &victims);
+	spin_unlock_irqrestore(&__imgcache.lock, flags);
+	imgcache_free_victims(&victims);
+}
+
+static ssize_t imgcache_read_stat(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct imgcache_stat_t stat;
+
+	imgcache_get_stat(&stat);
+	return sprintf(buf, "bytes: %ld\r\nbudget: %ld\r\nentries: %d\r\nbusy: %d\r\nhits: %lu\r\nmisses: %lu\r\nevictions: %lu\r\n",
+		(long)stat.bytes, (long)stat.budget, stat.entries, stat.busy, stat.hits, stat.misses, stat.evictions);
+}
+
+static ssize_t imgcache_read_budget(struct kobj_t * kobj, void * buf, size_t size)
+{
+	struct imgcache_stat_t stat;
+
+	imgcache_get_stat(&stat);
+	return sprintf(buf, "%ld", (long)stat.budget);
+}
+
+static ssize_t imgcache_write_budget(struct kobj_t * kobj, void * buf, size_t size)
+{
+	imgcache_set_budget(strtoul(buf, NULL, 0));
+	return size;
+}
+
+static ssize_t imgcache_write_shrink(struct kobj_t * kobj, void * buf, size_t size)
+{
+	imgcache_shrink();
+	return size;
+}
+
+static void imgcache_shrinker_shrink(struct shrinker_t * s)
+{
+	imgcache_shrink();
+}
+
+static struct shrinker_t __imgcache_shrinker = {
+	.name = "imgcache",
+	.shrink = imgcache_shrinker_shrink,
+};
+
+static __init void imgcache_init(void)
+{
+	struct kobj_t * kobj;
+	int i;
+
+	for(i = 0; i < IMGCACHE_HASH_SIZE; i++)
+	{
+		init_hlist_head(&__imgcache.hash[i]);
+		init_hlist_head(&__imgcache.shash[i]);
+	}
+	kobj = kobj_alloc_directory("imgcache");
+	if(kobj)
+	{
+		kobj_add_regular(kobj, "stat", imgcache_read_stat, NULL, NULL);
+		kobj_add_regular(kobj, "budget", imgcache_read_budget, imgcache_write_budget, NULL);
+		kobj_add_regular(kobj, "shrink", NULL, imgcache_write_shrink, NULL);
+		kobj_add(kobj_search_directory_with_create(kobj_get_root(), "kernel"), kobj);
+	}
+	register_shrinker(&__imgcache_shrinker);
+}
+core_initcall(imgcache_init);
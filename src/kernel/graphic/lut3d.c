@@ -0,0 +1,358 @@
+/*
+ * kernel/graphic/lut3d.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <xboot.h>
+#include <graphic/lut3d.h>
+
+#define LUT3D_SIZE_MIN		(2)
+#define LUT3D_SIZE_MAX		(65)
+#define LUT3D_SIZE_DEFAULT	(33)
+#define LUT3D_ROW_GRAIN		(16)
+#define LUT3D_CACHE_MAX		(4)
+
+struct lut3d_cache_entry_t {
+	struct list_head entry;
+	struct surface_t * clut;
+	void * pixels;
+	int width;
+	int height;
+	struct lut3d_t * lut;
+};
+
+static struct {
+	struct list_head lru;
+	int count;
+	spinlock_t lock;
+} __lut3d_cache = {
+	.lru = {
+		.next = &__lut3d_cache.lru,
+		.prev = &__lut3d_cache.lru,
+	},
+	.count = 0,
+	.lock = SPIN_LOCK_INIT(),
+};
+
+struct lut3d_t * lut3d_alloc(int size)
+{
+	struct lut3d_t * lut;
+	int ri, gi, bi;
+	int pos, i;
+
+	if((size < LUT3D_SIZE_MIN) || (size > LUT3D_SIZE_MAX))
+		return NULL;
+
+	lut = malloc(sizeof(struct lut3d_t));
+	if(!lut)
+		return NULL;
+	lut->table = malloc(size * size * size * 4 * sizeof(uint16_t));
+	if(!lut->table)
+	{
+		free(lut);
+		return NULL;
+	}
+	kref_init(&lut->ref);
+	lut->size = size;
+	for(i = 0; i < 256; i++)
+	{
+		pos = (i * (size - 1) * 256 + 127) / 255;
+		lut->index[i] = min(pos >> 8, size - 2);
+		lut->frac[i] = pos - (lut->index[i] << 8);
+	}
+	for(bi = 0; bi < size; bi++)
+	{
+		for(gi = 0; gi < size; gi++)
+		{
+			for(ri = 0; ri < size; ri++)
+				lut3d_set(lut, ri, gi, bi, ri * 65535 / (size - 1), gi * 65535 / (size - 1), bi * 65535 / (size - 1));
+		}
+	}
+	return lut;
+}
+
+static inline float haldclut_sample(unsigned char * cq, int level, int c, int i0, int i1, int i2, float f0, float f1, float f2)
+{
+	int level2 = level * level;
+	unsigned char * t = cq + ((i2 * level2 + i1 * level + i0) << 2) + c;
+	float v00, v01, v10, v11;
+
+	v00 = t[0] + (t[4] - t[0]) * f0;
+	v01 = t[level << 2] + (t[(level << 2) + 4] - t[level << 2]) * f0;
+	v10 = t[level2 << 2] + (t[(level2 << 2) + 4] - t[level2 << 2]) * f0;
+	v11 = t[(level2 + level) << 2] + (t[((level2 + level) << 2) + 4] - t[(level2 + level) << 2]) * f0;
+	v00 = v00 + (v01 - v00) * f1;
+	v10 = v10 + (v11 - v10) * f1;
+	return v00 + (v10 - v00) * f2;
+}
+
+struct lut3d_t * lut3d_alloc_from_haldclut(struct surface_t * clut, int size)
+{
+	struct lut3d_t * lut;
+	unsigned char * cq;
+	float fr, fg, fb;
+	int cw, ch, level, n;
+	int ri, gi, bi;
+	int ir, ig, ib;
+
+	if(!clut || (clut->format != SURFACE_FORMAT_ARGB32))
+		return NULL;
+	cw = surface_get_width(clut);
+	ch = surface_get_height(clut);
+	if(cw != ch)
+		return NULL;
+	for(n = 2; n * n * n < cw; n++);
+	if((n > 16) || (n * n * n != cw))
+		return NULL;
+	level = n * n;
+	if(size <= 0)
+		size = min(level, LUT3D_SIZE_DEFAULT);
+
+	lut = lut3d_alloc(size);
+	if(!lut)
+		return NULL;
+	cq = surface_get_pixels(clut);
+	for(bi = 0; bi < size; bi++)
+	{
+		fb = (float)bi * (level - 1) / (size - 1);
+		ib = min((int)fb, level - 2);
+		fb -= ib;
+		for(gi = 0; gi < size; gi++)
+		{
+			fg = (float)gi * (level - 1) / (size - 1);
+			ig = min((int)fg, level - 2);
+			fg -= ig;
+			for(ri = 0; ri < size; ri++)
+			{
+				fr = (float)ri * (level - 1) / (size - 1);
+				ir = min((int)fr, level - 2);
+				fr -= ir;
+				lut3d_set(lut, ri, gi, bi,
+					haldclut_sample(cq, level, 2, ir, ig, ib, fr, fg, fb) * 257.0f + 0.5f,
+					haldclut_sample(cq, level, 1, ir, ig, ib, fr, fg, fb) * 257.0f + 0.5f,
+					haldclut_sample(cq, level, 0, ir, ig, ib, fr, fg, fb) * 257.0f + 0.5f);
+			}
+		}
+	}
+	return lut;
+}
+
+static void lut3d_release(struct kref_t * ref)
+{
+	struct lut3d_t * lut = container_of(ref, struct lut3d_t, ref);
+
+	free(lut->table);
+	free(lut);
+}
+
+void lut3d_free(struct lut3d_t * lut)
+{
+	if(lut)
+		kref_put(&lut->ref, lut3d_release);
+}
+
+void lut3d_set(struct lut3d_t * lut, int ri, int gi, int bi, int r, int g, int b)
+{
+	uint16_t * t;
+
+	if(lut && (ri >= 0) && (ri < lut->size) && (gi >= 0) && (gi < lut->size) && (bi >= 0) && (bi < lut->size))
+	{
+		t = lut->table + (((bi * lut->size + gi) * lut->size + ri) << 2);
+		t[0] = clamp(r, 0, 65535);
+		t[1] = clamp(g, 0, 65535);
+		t[2] = clamp(b, 0, 65535);
+		t[3] = 0;
+	}
+}
+
+struct lut3d_job_t {
+	struct lut3d_t * lut;
+	struct surface_t * s;
+	int nearest;
+};
+
+static void lut3d_apply_band(int start, int end, void * data)
+{
+	struct lut3d_job_t * job = (struct lut3d_job_t *)data;
+	struct lut3d_t * lut = job->lut;
+	int width = surface_get_width(job->s);
+	int stride = surface_get_stride(job->s);
+	unsigned char * pixels = surface_get_pixels(job->s);
+	unsigned char * p;
+	uint16_t * t;
+	int r, g, b, a;
+	int x, y;
+
+	for(y = start; y < end; y++)
+	{
+		p = pixels + y * stride;
+		for(x = 0; x < width; x++, p += 4)
+		{
+			a = p[3];
+			if(a == 0)
+				continue;
+			if(a == 255)
+			{
+				b = p[0];
+				g = p[1];
+				r = p[2];
+			}
+			else
+			{
+				b = min(p[0] * 255 / a, 255);
+				g = min(p[1] * 255 / a, 255);
+				r = min(p[2] * 255 / a, 255);
+			}
+			if(job->nearest)
+			{
+				b = lut->index[b] + (lut->frac[b] >= 128 ? 1 : 0);
+				g = lut->index[g] + (lut->frac[g] >= 128 ? 1 : 0);
+				r = lut->index[r] + (lut->frac[r] >= 128 ? 1 : 0);
+				t = lut->table + (((b * lut->size + g) * lut->size + r) << 2);
+				r = t[0] >> 8;
+				g = t[1] >> 8;
+				b = t[2] >> 8;
+			}
+			else
+			{
+				lut3d_lookup(lut, &r, &g, &b);
+			}
+			if(a == 255)
+			{
+				p[0] = b;
+				p[1] = g;
+				p[2] = r;
+			}
+			else
+			{
+				p[0] = idiv255(b * a);
+				p[1] = idiv255(g * a);
+				p[2] = idiv255(r * a);
+			}
+		}
+	}
+}
+
+void lut3d_apply(struct lut3d_t * lut, struct surface_t * s, int nearest)
+{
+	struct lut3d_job_t job;
+
+	if(!lut || !s || (s->format != SURFACE_FORMAT_ARGB32))
+		return;
+	job.lut = lut;
+	job.s = s;
+	job.nearest = nearest;
+	parallel_for(surface_get_height(s), LUT3D_ROW_GRAIN, lut3d_apply_band, &job);
+}
+
+/*
+ * The table built from a hald clut is kept until the surface is freed, pixels
+ * of a clut surface should not be changed in place after its first use.
+ */
+struct lut3d_t * lut3d_cache_get(struct surface_t * clut)
+{
+	struct lut3d_cache_entry_t * e, * n;
+	struct lut3d_t * lut;
+	irq_flags_t flags;
+
+	if(!clut)
+		return NULL;
+
+	spin_lock_irqsave(&__lut3d_cache.lock, flags);
+	list_for_each_entry(e, &__lut3d_cache.lru, entry)
+	{
+		if((e->clut == clut) && (e->pixels == clut->pixels) && (e->width == clut->width) && (e->height == clut->height))
+		{
+			list_move(&e->entry, &__lut3d_cache.lru);
+			kref_get(&e->lut->ref);
+			spin_unlock_irqrestore(&__lut3d_cache.lock, flags);
+			return e->lut;
+		}
+	}
+	spin_unlock_irqrestore(&__lut3d_cache.lock, flags);
+
+	lut = lut3d_alloc_from_haldclut(clut, 0);
+	if(!lut)
+		return NULL;
+	e = malloc(sizeof(struct lut3d_cache_entry_t));
+	if(!e)
+		return lut;
+	e->clut = clut;
+	e->pixels = clut->pixels;
+	e->width = clut->width;
+	e->height = clut->height;
+	e->lut = lut;
+	kref_get(&lut->ref);
+
+	spin_lock_irqsave(&__lut3d_cache.lock, flags);
+	list_add(&e->entry, &__lut3d_cache.lru);
+	if(++__lut3d_cache.count > LUT3D_CACHE_MAX)
+	{
+		n = list_last_entry(&__lut3d_cache.lru, struct lut3d_cache_entry_t, entry);
+		list_del(&n->entry);
+		__lut3d_cache.count--;
+	}
+	else
+	{
+		n = NULL;
+	}
+	spin_unlock_irqrestore(&__lut3d_cache.lock, flags);
+	if(n)
+	{
+		lut3d_free(n->lut);
+		free(n);
+	}
+	return lut;
+}
+
+void lut3d_cache_put(struct lut3d_t * lut)
+{
+	lut3d_free(lut);
+}
+
+void lut3d_cache_remove(struct surface_t * clut)
+{
+	struct lut3d_cache_entry_t * e, * n;
+	struct list_head head;
+	irq_flags_t flags;
+
+	init_list_head(&head);
+	spin_lock_irqsave(&__lut3d_cache.lock, flags);
+	list_for_each_entry_safe(e, n, &__lut3d_cache.lru, entry)
+	{
+		if(e->clut == clut)
+		{
+			list_move(&e->entry, &head);
+			__lut3d_cache.count--;
+		}
+	}
+	spin_unlock_irqrestore(&__lut3d_cache.lock, flags);
+	list_for_each_entry_safe(e, n, &head, entry)
+	{
+		lut3d_free(e->lut);
+		free(e);
+	}
+}
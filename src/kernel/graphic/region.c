@@ -32,6 +32,18 @@
 #include <malloc.h>
 #include <graphic/region.h>
 
+/*
+ * The region list is kept as a y-x banded set of rectangles, like pixman and X11.
+ * Rectangles never overlap, are sorted by y and then by x, rectangles of the same
+ * band share the same y and h, and vertically adjacent bands with identical spans
+ * are coalesced into a single band.
+ */
+enum {
+	REGION_OP_UNION		= 0,
+	REGION_OP_INTERSECT	= 1,
+	REGION_OP_SUBTRACT	= 2,
+};
+
 struct region_list_t * region_list_alloc(unsigned int size)
 {
 	struct region_list_t * rl;
@@ -66,15 +78,283 @@ void region_list_free(struct region_list_t * rl)
 	}
 }
 
-static inline void region_list_resize(struct region_list_t * rl, unsigned int size)
+static inline int region_list_resize(struct region_list_t * rl, unsigned int size)
 {
+	struct region_t * r;
+
 	if(rl && (rl->size != size))
 	{
 		if(size < 16)
 			size = 16;
+		r = realloc(rl->region, size * sizeof(struct region_t));
+		if(!r)
+			return 0;
+		rl->region = r;
 		rl->size = size;
-		rl->region = realloc(rl->region, rl->size * sizeof(struct region_t));
 	}
+	return 1;
+}
+
+static inline int region_list_reserve(struct region_list_t * rl, unsigned int count)
+{
+	unsigned int size = rl->size;
+
+	if(size >= count)
+		return 1;
+	while(size < count)
+		size <<= 1;
+	return region_list_resize(rl, size);
+}
+
+static inline unsigned int band_end(struct region_list_t * rl, unsigned int i)
+{
+	int y = rl->region[i].y;
+
+	while((++i < rl->count) && (rl->region[i].y == y));
+	return i;
+}
+
+static inline int band_equal(struct region_t * a, struct region_t * b, unsigned int n)
+{
+	unsigned int i;
+
+	for(i = 0; i < n; i++)
+	{
+		if((a[i].x != b[i].x) || (a[i].w != b[i].w))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Append a band to the list, coalescing it with the previous band when possible.
+ * Returns zero if the list could not grow.
+ */
+static int region_list_append_band(struct region_list_t * rl, unsigned int * prev, struct region_t * band, unsigned int n)
+{
+	struct region_t * p;
+	unsigned int pn, i;
+
+	if(n == 0)
+		return 1;
+	if(*prev < rl->count)
+	{
+		p = &rl->region[*prev];
+		pn = rl->count - *prev;
+		if((pn == n) && (p->y + p->h == band->y) && band_equal(p, band, n))
+		{
+			for(i = 0; i < pn; i++)
+				p[i].h += band->h;
+			return 1;
+		}
+	}
+	if(!region_list_reserve(rl, rl->count + n))
+		return 0;
+	*prev = rl->count;
+	memcpy(&rl->region[rl->count], band, n * sizeof(struct region_t));
+	rl->count += n;
+	return 1;
+}
+
+/*
+ * Coalesce the last band into the previous one after it has been extended in place.
+ */
+static void region_list_coalesce_tail(struct region_list_t * rl)
+{
+	unsigned int last, prev, n, i;
+
+	if(rl->count < 2)
+		return;
+	for(last = rl->count - 1; (last > 0) && (rl->region[last - 1].y == rl->region[rl->count - 1].y); last--);
+	if(last == 0)
+		return;
+	for(prev = last - 1; (prev > 0) && (rl->region[prev - 1].y == rl->region[last - 1].y); prev--);
+	n = rl->count - last;
+	if((last - prev == n) && (rl->region[prev].y + rl->region[prev].h == rl->region[last].y) && band_equal(&rl->region[prev], &rl->region[last], n))
+	{
+		for(i = prev; i < last; i++)
+			rl->region[i].h += rl->region[last].h;
+		rl->count = last;
+	}
+}
+
+/*
+ * Combine two sorted, disjoint span lists of one band according to the operator.
+ */
+static unsigned int band_op(struct region_t * out, int y, int h, struct region_t * a, unsigned int na, struct region_t * b, unsigned int nb, int op)
+{
+	unsigned int i = 0, j = 0, n = 0;
+	int ina = 0, inb = 0, in = 0, now;
+	int x, start = 0;
+
+	while((i < na * 2) || (j < nb * 2))
+	{
+		int xa = (i < na * 2) ? ((i & 1) ? a[i >> 1].x + a[i >> 1].w : a[i >> 1].x) : INT_MAX;
+		int xb = (j < nb * 2) ? ((j & 1) ? b[j >> 1].x + b[j >> 1].w : b[j >> 1].x) : INT_MAX;
+
+		x = min(xa, xb);
+		if(xa == x)
+		{
+			ina = !(i & 1);
+			i++;
+		}
+		if(xb == x)
+		{
+			inb = !(j & 1);
+			j++;
+		}
+		switch(op)
+		{
+		case REGION_OP_UNION:
+			now = ina || inb;
+			break;
+		case REGION_OP_INTERSECT:
+			now = ina && inb;
+			break;
+		case REGION_OP_SUBTRACT:
+			now = ina && !inb;
+			break;
+		default:
+			now = 0;
+			break;
+		}
+		if(now && !in)
+		{
+			start = x;
+		}
+		else if(!now && in)
+		{
+			if((n > 0) && (out[n - 1].x + out[n - 1].w == start))
+				out[n - 1].w = x - out[n - 1].x;
+			else if(x > start)
+				region_init(&out[n++], start, y, x - start, h);
+		}
+		in = now;
+	}
+	return n;
+}
+
+/*
+ * Without memory for the exact result, damage must still cover it, so the
+ * list degenerates to the bounding box the operation can reach.
+ */
+static void region_list_op_fallback(struct region_list_t * rl, struct region_list_t * a, struct region_list_t * b, int op)
+{
+	struct region_t ra, rb;
+
+	if(!region_list_extents(a, &ra))
+	{
+		if((op != REGION_OP_UNION) || !region_list_extents(b, &ra))
+		{
+			rl->count = 0;
+			return;
+		}
+	}
+	else if((op != REGION_OP_SUBTRACT) && region_list_extents(b, &rb))
+	{
+		if(op == REGION_OP_UNION)
+			region_union(&ra, &ra, &rb);
+		else if(!region_intersect(&ra, &ra, &rb))
+		{
+			rl->count = 0;
+			return;
+		}
+	}
+	if(region_list_reserve(rl, 1))
+	{
+		region_clone(&rl->region[0], &ra);
+		rl->count = 1;
+	}
+}
+
+static void region_list_op(struct region_list_t * rl, struct region_list_t * a, struct region_list_t * b, int op)
+{
+	struct region_list_t tmp;
+	struct region_t * band;
+	unsigned int ia = 0, ib = 0, ea, eb;
+	unsigned int na, nb, nys = 0, i, j, n;
+	unsigned int prev = 0;
+	int * ys, y0, y1;
+
+	ys = malloc(sizeof(int) * (2 * (a->count + b->count) + 1));
+	band = malloc(sizeof(struct region_t) * (a->count + b->count + 1));
+	if(!ys || !band)
+	{
+		if(ys)
+			free(ys);
+		if(band)
+			free(band);
+		region_list_op_fallback(rl, a, b, op);
+		return;
+	}
+	for(i = 0, j = 0; (i < a->count) || (j < b->count);)
+	{
+		if((j >= b->count) || ((i < a->count) && (a->region[i].y <= b->region[j].y)))
+		{
+			y0 = a->region[i].y;
+			y1 = y0 + a->region[i].h;
+			i = band_end(a, i);
+		}
+		else
+		{
+			y0 = b->region[j].y;
+			y1 = y0 + b->region[j].h;
+			j = band_end(b, j);
+		}
+		ys[nys++] = y0;
+		ys[nys++] = y1;
+	}
+	for(i = 1; i < nys; i++)
+	{
+		y0 = ys[i];
+		for(j = i; (j > 0) && (ys[j - 1] > y0); j--)
+			ys[j] = ys[j - 1];
+		ys[j] = y0;
+	}
+
+	tmp.region = NULL;
+	tmp.size = 0;
+	tmp.count = 0;
+	if(!region_list_resize(&tmp, a->count + b->count))
+	{
+		free(ys);
+		free(band);
+		region_list_op_fallback(rl, a, b, op);
+		return;
+	}
+	for(i = 0; i + 1 < nys; i++)
+	{
+		y0 = ys[i];
+		y1 = ys[i + 1];
+		if(y0 >= y1)
+			continue;
+		while((ia < a->count) && (a->region[ia].y + a->region[ia].h <= y0))
+			ia = band_end(a, ia);
+		while((ib < b->count) && (b->region[ib].y + b->region[ib].h <= y0))
+			ib = band_end(b, ib);
+		ea = (ia < a->count) ? band_end(a, ia) : ia;
+		eb = (ib < b->count) ? band_end(b, ib) : ib;
+		na = ((ia < a->count) && (a->region[ia].y <= y0)) ? ea - ia : 0;
+		nb = ((ib < b->count) && (b->region[ib].y <= y0)) ? eb - ib : 0;
+		n = band_op(band, y0, y1 - y0, &a->region[ia], na, &b->region[ib], nb, op);
+		if(!region_list_append_band(&tmp, &prev, band, n))
+			break;
+	}
+	free(ys);
+	free(band);
+
+	if((i + 1 < nys) || !region_list_reserve(rl, tmp.count))
+	{
+		free(tmp.region);
+		region_list_op_fallback(rl, a, b, op);
+		return;
+	}
+	if(tmp.count > 0)
+		memcpy(rl->region, tmp.region, sizeof(struct region_t) * tmp.count);
+	rl->count = tmp.count;
+	free(tmp.region);
+	if(rl->count > REGION_LIST_SIMPLIFY_COUNT)
+		region_list_simplify(rl, REGION_LIST_SIMPLIFY_COUNT);
 }
 
 void region_list_clone(struct region_list_t * rl, struct region_list_t * o)
@@ -87,8 +367,8 @@ void region_list_clone(struct region_list_t * rl, struct region_list_t * o)
 			rl->count = 0;
 		else
 		{
-			if(rl->size < o->size)
-				region_list_resize(rl, o->size);
+			if(!region_list_reserve(rl, o->count))
+				return;
 			if((count = o->count) > 0)
 				memcpy(rl->region, o->region, sizeof(struct region_t) * count);
 			rl->count = count;
@@ -98,46 +378,73 @@ void region_list_clone(struct region_list_t * rl, struct region_list_t * o)
 
 void region_list_merge(struct region_list_t * rl, struct region_list_t * o)
 {
-	int count;
-	int i;
+	if(rl && o && (o->count > 0))
+	{
+		if(rl->count == 0)
+			region_list_clone(rl, o);
+		else
+			region_list_op(rl, rl, o, REGION_OP_UNION);
+	}
+}
 
-	if(rl && o && ((count = o->count) > 0))
+void region_list_intersect(struct region_list_t * rl, struct region_list_t * o)
+{
+	if(rl && (rl->count > 0))
 	{
-		for(i = 0; i < count; i++)
-			region_list_add(rl, &o->region[i]);
+		if(!o || (o->count == 0))
+			rl->count = 0;
+		else
+			region_list_op(rl, rl, o, REGION_OP_INTERSECT);
 	}
 }
 
+void region_list_subtract(struct region_list_t * rl, struct region_list_t * o)
+{
+	if(rl && (rl->count > 0) && o && (o->count > 0))
+		region_list_op(rl, rl, o, REGION_OP_SUBTRACT);
+}
+
 void region_list_add(struct region_list_t * rl, struct region_t * r)
 {
-	struct region_t * p;
-	int index = -1;
-	int i;
+	struct region_list_t o;
+	struct region_t * l;
+	unsigned int prev;
 
-	if(!rl || !r)
+	if(!rl || !r || region_isempty(r))
 		return;
 
-	for(i = 0; i < rl->count; i++)
+	if(rl->count > 0)
 	{
-		if(region_overlap(&rl->region[i], r))
+		l = &rl->region[rl->count - 1];
+		if(r->y >= l->y + l->h)
 		{
-			index = i;
-			break;
+			for(prev = rl->count - 1; (prev > 0) && (rl->region[prev - 1].y == l->y); prev--);
+			region_list_append_band(rl, &prev, r, 1);
+			return;
+		}
+		if((r->y == l->y) && (r->h == l->h) && (r->x >= l->x + l->w))
+		{
+			if(r->x == l->x + l->w)
+				l->w += r->w;
+			else if(region_list_reserve(rl, rl->count + 1))
+				region_clone(&rl->region[rl->count++], r);
+			region_list_coalesce_tail(rl);
+			return;
 		}
-	}
-
-	if(index >= 0)
-	{
-		p = &rl->region[index];
-		region_union(p, p, r);
 	}
 	else
 	{
-		if(rl->size <= rl->count)
-			region_list_resize(rl, rl->size << 1);
-		region_clone(&rl->region[rl->count], r);
-		rl->count++;
+		if(region_list_reserve(rl, 1))
+		{
+			region_clone(&rl->region[0], r);
+			rl->count = 1;
+		}
+		return;
 	}
+	o.region = r;
+	o.size = 1;
+	o.count = 1;
+	region_list_op(rl, rl, &o, REGION_OP_UNION);
 }
 
 void region_list_clear(struct region_list_t * rl)
@@ -145,3 +452,48 @@ void region_list_clear(struct region_list_t * rl)
 	if(rl)
 		rl->count = 0;
 }
+
+int region_list_extents(struct region_list_t * rl, struct region_t * r)
+{
+	unsigned int i;
+
+	if(!rl || !r || (rl->count == 0))
+		return 0;
+	region_clone(r, &rl->region[0]);
+	for(i = 1; i < rl->count; i++)
+		region_union(r, r, &rl->region[i]);
+	return 1;
+}
+
+/*
+ * Cap the rectangle count, trading some overdraw for fewer rectangles. Each band
+ * is first collapsed to its horizontal extent, and when that is still not enough
+ * the whole list degenerates to its bounding box.
+ */
+void region_list_simplify(struct region_list_t * rl, unsigned int max)
+{
+	struct region_t band, r;
+	unsigned int count, prev;
+	unsigned int i, e;
+
+	if(!rl || (rl->count <= max))
+		return;
+	count = rl->count;
+	rl->count = 0;
+	prev = 0;
+	for(i = 0; i < count; i = e)
+	{
+		for(e = i + 1; (e < count) && (rl->region[e].y == rl->region[i].y); e++);
+		band.x = rl->region[i].x;
+		band.y = rl->region[i].y;
+		band.w = rl->region[e - 1].x + rl->region[e - 1].w - band.x;
+		band.h = rl->region[i].h;
+		region_list_append_band(rl, &prev, &band, 1);
+	}
+	if(rl->count > max)
+	{
+		region_list_extents(rl, &r);
+		region_clone(&rl->region[0], &r);
+		rl->count = 1;
+	}
+}
@@ -28,6 +28,7 @@
 
 #include <xboot.h>
 #include <graphic/surface.h>
+#include <graphic/lut3d.h>
 
 void * render_default_create(struct surface_t * s)
 {
@@ -70,6 +71,34 @@ static inline void blend(uint32_t * d, uint32_t * s)
 	}
 }
 
+static inline __attribute__((always_inline)) void blit_format(struct surface_t * s, struct region_t * r, struct matrix_t * t, double fx, double fy, struct surface_t * src, enum surface_format_t df, enum surface_format_t sf)
+{
+	unsigned char * p, * q;
+	unsigned char * sp = surface_get_pixels(src);
+	int db = surface_format_bytes(df);
+	int sb = surface_format_bytes(sf);
+	int ds = surface_get_stride(s);
+	int ss = surface_get_stride(src);
+	int sw = surface_get_width(src);
+	int sh = surface_get_height(src);
+	int x, y, ox, oy;
+	double ofx, ofy;
+
+	q = (unsigned char *)surface_get_pixels(s) + r->y * ds + r->x * db;
+	for(y = 0; y < r->h; ++y, q += ds, fx += t->c, fy += t->d)
+	{
+		ofx = fx;
+		ofy = fy;
+		for(x = 0, p = q; x < r->w; ++x, p += db, ofx += t->a, ofy += t->b)
+		{
+			ox = (int)ofx;
+			oy = (int)ofy;
+			if(ox >= 0 && ox < sw && oy >= 0 && oy < sh)
+				pixel_blend(df, p, pixel_load(sf, sp + oy * ss + ox * sb));
+		}
+	}
+}
+
 void render_default_blit(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct surface_t * src, enum render_type_t type)
 {
 	struct region_t r, region;
@@ -95,6 +124,26 @@ void render_default_blit(struct surface_t * s, struct region_t * clip, struct ma
 	if(!region_intersect(&r, &r, &region))
 		return;
 
+	if((s->format == SURFACE_FORMAT_RGB565) && (src->format == SURFACE_FORMAT_RGB565) && (m->a == 1) && (m->b == 0) && (m->c == 0) && (m->d == 1) && (m->tx == (int)m->tx) && (m->ty == (int)m->ty))
+	{
+		unsigned char * q = (unsigned char *)surface_get_pixels(s) + r.y * surface_get_stride(s) + (r.x << 1);
+		unsigned char * o = (unsigned char *)surface_get_pixels(src) + (r.y - (int)m->ty) * surface_get_stride(src) + ((r.x - (int)m->tx) << 1);
+		for(y = 0; y < r.h; y++, q += surface_get_stride(s), o += surface_get_stride(src))
+			memcpy(q, o, r.w << 1);
+		return;
+	}
+	if((s->format == SURFACE_FORMAT_ARGB32) && (src->format == SURFACE_FORMAT_ARGB32) && (m->a == 1) && (m->b == 0) && (m->c == 0) && (m->d == 1) && (m->tx == (int)m->tx) && (m->ty == (int)m->ty))
+	{
+		uint32_t * q = dp + r.y * ds + r.x;
+		uint32_t * o = sp + (r.y - (int)m->ty) * ss + (r.x - (int)m->tx);
+		for(y = 0; y < r.h; y++, q += ds, o += ss)
+		{
+			for(x = 0; x < r.w; x++)
+				blend(&q[x], &o[x]);
+		}
+		return;
+	}
+
 	x1 = r.x;
 	y1 = r.y;
 	x2 = r.x + r.w;
@@ -107,6 +156,40 @@ void render_default_blit(struct surface_t * s, struct region_t * clip, struct ma
 	matrix_invert(&t);
 	matrix_transform_point(&t, &fx, &fy);
 
+	if((s->format != SURFACE_FORMAT_ARGB32) || (src->format != SURFACE_FORMAT_ARGB32))
+	{
+		switch((s->format << 4) | src->format)
+		{
+		case (SURFACE_FORMAT_ARGB32 << 4) | SURFACE_FORMAT_RGB565:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_ARGB32, SURFACE_FORMAT_RGB565);
+			break;
+		case (SURFACE_FORMAT_ARGB32 << 4) | SURFACE_FORMAT_A8:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_ARGB32, SURFACE_FORMAT_A8);
+			break;
+		case (SURFACE_FORMAT_RGB565 << 4) | SURFACE_FORMAT_ARGB32:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_RGB565, SURFACE_FORMAT_ARGB32);
+			break;
+		case (SURFACE_FORMAT_RGB565 << 4) | SURFACE_FORMAT_RGB565:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_RGB565, SURFACE_FORMAT_RGB565);
+			break;
+		case (SURFACE_FORMAT_RGB565 << 4) | SURFACE_FORMAT_A8:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_RGB565, SURFACE_FORMAT_A8);
+			break;
+		case (SURFACE_FORMAT_A8 << 4) | SURFACE_FORMAT_ARGB32:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_A8, SURFACE_FORMAT_ARGB32);
+			break;
+		case (SURFACE_FORMAT_A8 << 4) | SURFACE_FORMAT_RGB565:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_A8, SURFACE_FORMAT_RGB565);
+			break;
+		case (SURFACE_FORMAT_A8 << 4) | SURFACE_FORMAT_A8:
+			blit_format(s, &r, &t, fx, fy, src, SURFACE_FORMAT_A8, SURFACE_FORMAT_A8);
+			break;
+		default:
+			break;
+		}
+		return;
+	}
+
 	for(y = y1; y < y2; ++y, fx += t.c, fy += t.d)
 	{
 		ofx = fx;
@@ -130,8 +213,9 @@ void render_default_fill(struct surface_t * s, struct region_t * clip, struct ma
 	struct region_t r, region;
 	struct matrix_t t;
 	uint32_t * p, v;
+	unsigned char * bp, * bq;
 	int ds = surface_get_stride(s) >> 2;
-	int x1, y1, x2, y2, stride;
+	int x1, y1, x2, y2, stride, b;
 	int x, y, ox, oy;
 	double fx, fy, ofx, ofy;
 
@@ -158,6 +242,25 @@ void render_default_fill(struct surface_t * s, struct region_t * clip, struct ma
 	matrix_invert(&t);
 	matrix_transform_point(&t, &fx, &fy);
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		b = surface_format_bytes(s->format);
+		bq = (unsigned char *)surface_get_pixels(s) + y1 * surface_get_stride(s) + x1 * b;
+		for(y = y1; y < y2; ++y, bq += surface_get_stride(s), fx += t.c, fy += t.d)
+		{
+			ofx = fx;
+			ofy = fy;
+			for(x = x1, bp = bq; x < x2; ++x, bp += b, ofx += t.a, ofy += t.b)
+			{
+				ox = (int)ofx;
+				oy = (int)ofy;
+				if(ox >= 0 && ox < w && oy >= 0 && oy < h)
+					pixel_store(s->format, bp, v);
+			}
+		}
+		return;
+	}
+
 	for(y = y1; y < y2; ++y, fx += t.c, fy += t.d)
 	{
 		ofx = fx;
@@ -174,12 +277,41 @@ void render_default_fill(struct surface_t * s, struct region_t * clip, struct ma
 	}
 }
 
+/*
+ * Coverage mask with solid color, for non argb32 destinations. The region is already clipped.
+ */
+void render_default_mask(struct surface_t * s, struct region_t * r, struct color_t * c, uint8_t * mask, int pitch)
+{
+	enum surface_format_t format = s->format;
+	unsigned char * p, * q;
+	uint8_t * m;
+	int b = surface_format_bytes(format);
+	int i, j, a;
+
+	q = (unsigned char *)s->pixels + r->y * s->stride + r->x * b;
+	for(j = 0; j < r->h; j++, q += s->stride, mask += pitch)
+	{
+		for(i = 0, p = q, m = mask; i < r->w; i++, p += b, m++)
+		{
+			if(*m != 0)
+			{
+				a = idiv255(c->a * *m);
+				pixel_blend(format, p, (a << 24) | (idiv255(c->r * a) << 16) | (idiv255(c->g * a) << 8) | (idiv255(c->b * a) << 0));
+			}
+		}
+	}
+}
+
 #define XVG_SUBSAMPLES		(5)
 #define XVG_FIXSHIFT		(14)
 #define XVG_FIX				(1 << XVG_FIXSHIFT)
 #define XVG_FIXMASK			(XVG_FIX - 1)
 #define XVG_MPAGE_SIZE		(4096)
 #define XVG_KAPPA90			(0.5522847493f)
+#define XVG_CACHE_BYTES		(SZ_1M)
+#define XVG_CACHE_ENTRY_MAX	(SZ_64K)
+#define XVG_CACHE_HASH_SIZE	(256)
+#define XVG_CACHE_QUANT		(256.0f)
 
 enum xvg_line_join_t {
 	XVG_JOIN_MITER			= 0,
@@ -245,6 +377,7 @@ struct xvg_context_t {
 	struct xvg_mem_page_t * cpage;
 	unsigned char * bitmap;
 	int width, height, stride;
+	enum surface_format_t format;
 	unsigned char * scanline;
 	int cscanline;
 	float * pts;
@@ -259,6 +392,46 @@ struct xvg_context_t {
 	enum xvg_fill_rule_t rule;
 };
 
+/*
+ * Coverage masks of recently drawn paths, keyed by the path relative to its integer
+ * origin. The fraction part is part of the key, so sub-pixel placement is exact.
+ */
+struct xvg_cache_key_t {
+	int stroke;
+	int thickness;
+	int miter;
+	int join;
+	int cap;
+	int rule;
+	int npts;
+};
+
+struct xvg_cache_entry_t {
+	struct list_head entry;
+	struct hlist_node node;
+	uint32_t hash;
+	int ref;
+	int x, y, w, h;
+	size_t size;
+	struct xvg_cache_key_t key;
+	int32_t * pts;
+	unsigned char * mask;
+};
+
+static struct {
+	struct list_head lru;
+	struct hlist_head hash[XVG_CACHE_HASH_SIZE];
+	size_t bytes;
+	spinlock_t lock;
+} __xvg_cache = {
+	.lru = {
+		.next = &__xvg_cache.lru,
+		.prev = &__xvg_cache.lru,
+	},
+	.bytes = 0,
+	.lock = SPIN_LOCK_INIT(),
+};
+
 static struct xvg_mem_page_t * xvg_next_page(struct xvg_context_t * ctx, struct xvg_mem_page_t * cur)
 {
 	struct xvg_mem_page_t * page;
@@ -876,6 +1049,21 @@ static void xvg_fill_active_edges(unsigned char * scanline, int len, struct xvg_
 	}
 }
 
+static void xvg_scanline_format(unsigned char * dst, int count, unsigned char * cover, enum surface_format_t format, struct color_t * c)
+{
+	int bytes = surface_format_bytes(format);
+	int i, a;
+
+	for(i = 0; i < count; i++)
+	{
+		a = idiv255((int)cover[0] * c->a);
+		if(a != 0)
+			pixel_blend(format, dst, (a << 24) | (idiv255(c->r * a) << 16) | (idiv255(c->g * a) << 8) | (idiv255(c->b * a) << 0));
+		cover++;
+		dst += bytes;
+	}
+}
+
 static void xvg_scanline_solid(unsigned char * dst, int count, unsigned char * cover, int x, int y, struct color_t * c)
 {
 	int cb = c->b;
@@ -998,7 +1186,12 @@ static void xvg_rasterize_sorted_edges(struct xvg_context_t * ctx, struct color_
 		if(xmax > x1)
 			xmax = x1;
 		if(xmin <= xmax)
-			xvg_scanline_solid(&ctx->bitmap[y * ctx->stride] + xmin * 4, xmax - xmin + 1, &ctx->scanline[xmin], xmin, y, c);
+		{
+			if(ctx->format == SURFACE_FORMAT_ARGB32)
+				xvg_scanline_solid(&ctx->bitmap[y * ctx->stride] + xmin * 4, xmax - xmin + 1, &ctx->scanline[xmin], xmin, y, c);
+			else
+				xvg_scanline_format(&ctx->bitmap[y * ctx->stride] + xmin * surface_format_bytes(ctx->format), xmax - xmin + 1, &ctx->scanline[xmin], ctx->format, c);
+		}
 	}
 }
 
@@ -1056,7 +1249,7 @@ static void xvg_cubic_bezto(struct xvg_context_t * ctx, float cpx1, float cpy1,
 	xvg_add_point(ctx, x, y);
 }
 
-static void xvg_fill(struct xvg_context_t * ctx)
+static int xvg_fill_edges(struct xvg_context_t * ctx)
 {
 	struct xvg_edge_t * e;
 	float * p;
@@ -1082,10 +1275,10 @@ static void xvg_fill(struct xvg_context_t * ctx)
 		e->y1 = e->y1 * XVG_SUBSAMPLES;
 	}
 	qsort(ctx->edges, ctx->nedges, sizeof(struct xvg_edge_t), xvg_cmp_edge);
-	xvg_rasterize_sorted_edges(ctx, &ctx->color, ctx->rule);
+	return ctx->nedges;
 }
 
-static void xvg_stroke(struct xvg_context_t * ctx)
+static int xvg_stroke_edges(struct xvg_context_t * ctx)
 {
 	struct xvg_edge_t * e;
 	struct xvg_point_t * p0, * p1;
@@ -1103,7 +1296,7 @@ static void xvg_stroke(struct xvg_context_t * ctx)
 		xvg_flatten_cubic_bez(ctx, p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7], 0, XVG_POINT_CORNER);
 	}
 	if(ctx->npoints < 2)
-		return;
+		return 0;
 	closed = 0;
 	p0 = &ctx->points[ctx->npoints - 1];
 	p1 = &ctx->points[0];
@@ -1122,7 +1315,234 @@ static void xvg_stroke(struct xvg_context_t * ctx)
 		e->y1 = e->y1 * XVG_SUBSAMPLES;
 	}
 	qsort(ctx->edges, ctx->nedges, sizeof(struct xvg_edge_t), xvg_cmp_edge);
-	xvg_rasterize_sorted_edges(ctx, &ctx->color, ctx->rule);
+	return ctx->nedges;
+}
+
+static void xvg_cache_put(struct xvg_cache_entry_t * e)
+{
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__xvg_cache.lock, flags);
+	e->ref--;
+	spin_unlock_irqrestore(&__xvg_cache.lock, flags);
+}
+
+static struct xvg_cache_entry_t * xvg_cache_get(uint32_t hash, struct xvg_cache_key_t * key, int32_t * pts)
+{
+	struct xvg_cache_entry_t * e;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__xvg_cache.lock, flags);
+	hlist_for_each_entry(e, &__xvg_cache.hash[hash & (XVG_CACHE_HASH_SIZE - 1)], node)
+	{
+		if((e->hash == hash) && (memcmp(&e->key, key, sizeof(struct xvg_cache_key_t)) == 0) && (memcmp(e->pts, pts, key->npts * 2 * sizeof(int32_t)) == 0))
+		{
+			list_move(&e->entry, &__xvg_cache.lru);
+			e->ref++;
+			spin_unlock_irqrestore(&__xvg_cache.lock, flags);
+			return e;
+		}
+	}
+	spin_unlock_irqrestore(&__xvg_cache.lock, flags);
+	return NULL;
+}
+
+static void xvg_cache_add(struct xvg_cache_entry_t * e)
+{
+	struct xvg_cache_entry_t * pos, * n;
+	irq_flags_t flags;
+
+	spin_lock_irqsave(&__xvg_cache.lock, flags);
+	list_for_each_entry_safe_reverse(pos, n, &__xvg_cache.lru, entry)
+	{
+		if(__xvg_cache.bytes + e->size <= XVG_CACHE_BYTES)
+			break;
+		if(pos->ref == 0)
+		{
+			list_del(&pos->entry);
+			hlist_del(&pos->node);
+			__xvg_cache.bytes -= pos->size;
+			free(pos);
+		}
+	}
+	list_add(&e->entry, &__xvg_cache.lru);
+	hlist_add_head(&e->node, &__xvg_cache.hash[e->hash & (XVG_CACHE_HASH_SIZE - 1)]);
+	__xvg_cache.bytes += e->size;
+	spin_unlock_irqrestore(&__xvg_cache.lock, flags);
+}
+
+static void xvg_cache_composite(struct xvg_context_t * ctx, struct xvg_cache_entry_t * e, int x, int y)
+{
+	struct region_t r;
+	int j;
+
+	region_init(&r, x, y, e->w, e->h);
+	if(!region_intersect(&r, &r, &ctx->clip))
+		return;
+	for(j = r.y; j < r.y + r.h; j++)
+	{
+		if(ctx->format == SURFACE_FORMAT_ARGB32)
+			xvg_scanline_solid(&ctx->bitmap[j * ctx->stride] + r.x * 4, r.w, &e->mask[(j - y) * e->w + (r.x - x)], r.x, j, &ctx->color);
+		else
+			xvg_scanline_format(&ctx->bitmap[j * ctx->stride] + r.x * surface_format_bytes(ctx->format), r.w, &e->mask[(j - y) * e->w + (r.x - x)], ctx->format, &ctx->color);
+	}
+}
+
+/*
+ * Rasterize the sorted edges into a new a8 mask, the edges are shifted to the mask origin
+ */
+static struct xvg_cache_entry_t * xvg_cache_build(struct xvg_context_t * ctx, uint32_t hash, struct xvg_cache_key_t * key, int32_t * pts, int ox, int oy)
+{
+	struct xvg_cache_entry_t * e;
+	struct xvg_context_t mctx;
+	struct xvg_edge_t * edge;
+	float minx, miny, maxx, maxy;
+	int x, y, w, h, i;
+	size_t size;
+
+	minx = miny = 1e30f;
+	maxx = maxy = -1e30f;
+	for(i = 0; i < ctx->nedges; i++)
+	{
+		edge = &ctx->edges[i];
+		minx = min(minx, min(edge->x0, edge->x1));
+		maxx = max(maxx, max(edge->x0, edge->x1));
+		miny = min(miny, edge->y0);
+		maxy = max(maxy, edge->y1);
+	}
+	x = (int)floorf(minx);
+	y = (int)floorf(miny / XVG_SUBSAMPLES);
+	w = (int)ceilf(maxx) - x + 1;
+	h = (int)ceilf(maxy / XVG_SUBSAMPLES) - y + 1;
+	size = sizeof(struct xvg_cache_entry_t) + key->npts * 2 * sizeof(int32_t) + w * h;
+	if((w <= 0) || (h <= 0) || (size > XVG_CACHE_ENTRY_MAX))
+		return NULL;
+	if(w > ctx->cscanline)
+	{
+		unsigned char * scanline = realloc(ctx->scanline, w);
+		if(!scanline)
+			return NULL;
+		ctx->scanline = scanline;
+		ctx->cscanline = w;
+	}
+	e = malloc(size);
+	if(!e)
+		return NULL;
+	e->hash = hash;
+	e->ref = 1;
+	e->x = x - ox;
+	e->y = y - oy;
+	e->w = w;
+	e->h = h;
+	e->size = size;
+	memcpy(&e->key, key, sizeof(struct xvg_cache_key_t));
+	e->pts = (int32_t *)(e + 1);
+	memcpy(e->pts, pts, key->npts * 2 * sizeof(int32_t));
+	e->mask = (unsigned char *)(e->pts + key->npts * 2);
+	memset(e->mask, 0, w * h);
+
+	for(i = 0; i < ctx->nedges; i++)
+	{
+		edge = &ctx->edges[i];
+		edge->x0 -= x;
+		edge->x1 -= x;
+		edge->y0 -= y * XVG_SUBSAMPLES;
+		edge->y1 -= y * XVG_SUBSAMPLES;
+	}
+	memcpy(&mctx, ctx, sizeof(struct xvg_context_t));
+	mctx.bitmap = e->mask;
+	mctx.width = w;
+	mctx.height = h;
+	mctx.stride = w;
+	mctx.format = SURFACE_FORMAT_A8;
+	region_init(&mctx.clip, 0, 0, w, h);
+	xvg_rasterize_sorted_edges(&mctx, &(struct color_t){ 0, 0, 0, 255 }, mctx.rule);
+	ctx->freelist = mctx.freelist;
+	ctx->pages = mctx.pages;
+	ctx->cpage = mctx.cpage;
+	return e;
+}
+
+static void xvg_draw(struct xvg_context_t * ctx, int stroke)
+{
+	struct xvg_cache_entry_t * e;
+	struct xvg_cache_key_t key;
+	int32_t * pts;
+	float minx, miny, maxx, maxy, margin;
+	uint32_t hash;
+	int ox, oy, i;
+
+	if(ctx->npts <= 0)
+		return;
+	minx = maxx = ctx->pts[0];
+	miny = maxy = ctx->pts[1];
+	for(i = 1; i < ctx->npts; i++)
+	{
+		minx = min(minx, ctx->pts[i * 2 + 0]);
+		maxx = max(maxx, ctx->pts[i * 2 + 0]);
+		miny = min(miny, ctx->pts[i * 2 + 1]);
+		maxy = max(maxy, ctx->pts[i * 2 + 1]);
+	}
+	margin = stroke ? ctx->thickness * ctx->miter * 0.5f + 2 : 2;
+	if((maxx - minx + margin * 2) * (maxy - miny + margin * 2) + ctx->npts * 2 * sizeof(int32_t) > XVG_CACHE_ENTRY_MAX)
+	{
+		if(stroke ? xvg_stroke_edges(ctx) : xvg_fill_edges(ctx))
+			xvg_rasterize_sorted_edges(ctx, &ctx->color, ctx->rule);
+		return;
+	}
+
+	pts = malloc(ctx->npts * 2 * sizeof(int32_t));
+	if(!pts)
+		return;
+	ox = (int)floorf(minx);
+	oy = (int)floorf(miny);
+	memset(&key, 0, sizeof(struct xvg_cache_key_t));
+	key.stroke = stroke;
+	key.thickness = stroke ? (int)(ctx->thickness * XVG_CACHE_QUANT) : 0;
+	key.miter = stroke ? (int)(ctx->miter * XVG_CACHE_QUANT) : 0;
+	key.join = stroke ? ctx->join : 0;
+	key.cap = stroke ? ctx->cap : 0;
+	key.rule = ctx->rule;
+	key.npts = ctx->npts;
+	hash = 5381;
+	for(i = 0; i < sizeof(struct xvg_cache_key_t) / sizeof(int); i++)
+		hash = ((hash << 5) + hash) ^ ((int *)&key)[i];
+	for(i = 0; i < ctx->npts; i++)
+	{
+		pts[i * 2 + 0] = (int32_t)roundf((ctx->pts[i * 2 + 0] - ox) * XVG_CACHE_QUANT);
+		pts[i * 2 + 1] = (int32_t)roundf((ctx->pts[i * 2 + 1] - oy) * XVG_CACHE_QUANT);
+		hash = ((hash << 5) + hash) ^ pts[i * 2 + 0];
+		hash = ((hash << 5) + hash) ^ pts[i * 2 + 1];
+	}
+
+	e = xvg_cache_get(hash, &key, pts);
+	if(!e)
+	{
+		if(stroke ? xvg_stroke_edges(ctx) : xvg_fill_edges(ctx))
+		{
+			e = xvg_cache_build(ctx, hash, &key, pts, ox, oy);
+			if(e)
+				xvg_cache_add(e);
+			else
+				xvg_rasterize_sorted_edges(ctx, &ctx->color, ctx->rule);
+		}
+	}
+	if(e)
+	{
+		xvg_cache_composite(ctx, e, ox + e->x, oy + e->y);
+		xvg_cache_put(e);
+	}
+	free(pts);
+}
+
+static void xvg_fill(struct xvg_context_t * ctx)
+{
+	xvg_draw(ctx, 0);
+}
+
+static void xvg_stroke(struct xvg_context_t * ctx)
+{
+	xvg_draw(ctx, 1);
 }
 
 static void xvg_init(struct xvg_context_t * ctx, struct surface_t * s, struct region_t * clip, int thickness, struct color_t * c)
@@ -1142,6 +1562,7 @@ static void xvg_init(struct xvg_context_t * ctx, struct surface_t * s, struct re
 	ctx->width = s->width;
 	ctx->height = s->height;
 	ctx->stride = s->stride;
+	ctx->format = s->format;
 	ctx->cscanline = ctx->width;
 	ctx->scanline = malloc(ctx->cscanline);
 	ctx->pts = NULL;
@@ -1529,6 +1950,39 @@ void render_default_shape_gradient(struct surface_t * s, struct region_t * clip,
 	region_init(&region, x, y, w, h);
 	if(!region_intersect(&r, &r, &region))
 		return;
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		int b = surface_format_bytes(s->format);
+		stride = surface_get_stride(s);
+		q = (unsigned char *)surface_get_pixels(s) + r.y * stride + r.x * b;
+		for(j = r.y - y; j < r.y - y + r.h; j++, q += stride)
+		{
+			u = (h > 1) ? (j << 8) / (h - 1) : 0;
+			v = 256 - u;
+			cl.b = (lt->b * v + lb->b * u) >> 8;
+			cl.g = (lt->g * v + lb->g * u) >> 8;
+			cl.r = (lt->r * v + lb->r * u) >> 8;
+			cl.a = (lt->a * v + lb->a * u) >> 8;
+			cr.b = (rt->b * v + rb->b * u) >> 8;
+			cr.g = (rt->g * v + rb->g * u) >> 8;
+			cr.r = (rt->r * v + rb->r * u) >> 8;
+			cr.a = (rt->a * v + rb->a * u) >> 8;
+			for(i = r.x - x, p = q; i < r.x - x + r.w; i++, p += b)
+			{
+				u = (w > 1) ? (i << 8) / (w - 1) : 0;
+				v = 256 - u;
+				sa = (cl.a * v + cr.a * u) >> 8;
+				if(sa != 0)
+				{
+					sr = idiv255(((cl.r * v + cr.r * u) >> 8) * sa);
+					sg = idiv255(((cl.g * v + cr.g * u) >> 8) * sa);
+					sb = idiv255(((cl.b * v + cr.b * u) >> 8) * sa);
+					pixel_blend(s->format, p, (sa << 24) | (sr << 16) | (sg << 8) | (sb << 0));
+				}
+			}
+		}
+		return;
+	}
 	stride = surface_get_stride(s);
 	q = (unsigned char *)surface_get_pixels(s) + y * stride + (x << 2);
 	x0 = r.x - x;
@@ -1614,6 +2068,17 @@ void render_default_shape_checkerboard(struct surface_t * s, struct region_t * c
 	y1 = r.y;
 	x2 = r.x + r.w;
 	y2 = r.y + r.h;
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		unsigned char * bq = (unsigned char *)s->pixels + y1 * s->stride + x1 * surface_format_bytes(s->format);
+		unsigned char * bp;
+		for(j = y1; j < y2; j++, bq += s->stride)
+		{
+			for(i = x1, bp = bq; i < x2; i++, bp += surface_format_bytes(s->format))
+				pixel_store(s->format, bp, ((i ^ j) & (1 << 3)) ? 0xffabb9bd : 0xff899598);
+		}
+		return;
+	}
 	l = s->stride >> 2;
 	q = (uint32_t *)s->pixels + y1 * l + x1;
 
@@ -1635,6 +2100,9 @@ void render_default_filter_gray(struct surface_t * s)
 	unsigned char * p = surface_get_pixels(s);
 	unsigned char gray;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	for(i = 0; i < len; i++, p += 4)
 	{
 		if(p[3] != 0)
@@ -1653,6 +2121,9 @@ void render_default_filter_sepia(struct surface_t * s)
 	unsigned char * p = surface_get_pixels(s);
 	int r, g, b;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	for(i = 0; i < len; i++, p += 4)
 	{
 		if(p[3] != 0)
@@ -1672,6 +2143,9 @@ void render_default_filter_invert(struct surface_t * s)
 	int i, len = surface_get_width(s) * surface_get_height(s);
 	unsigned char * p = surface_get_pixels(s);
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	for(i = 0; i < len; i++, p += 4)
 	{
 		if(p[3] != 0)
@@ -1691,6 +2165,9 @@ void render_default_filter_coloring(struct surface_t * s, struct color_t * c)
 	unsigned char g = c->g;
 	unsigned char b = c->b;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	for(i = 0; i < len; i++, p += 4)
 	{
 		if(p[3] == 255)
@@ -1719,6 +2196,9 @@ void render_default_filter_hue(struct surface_t * s, int angle)
 	int tr, tg, tb;
 	int m[9];
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	m[0] = (0.213 + cv * 0.787 - sv * 0.213) * 65536;
 	m[1] = (0.715 - cv * 0.715 - sv * 0.715) * 65536;
 	m[2] = (0.072 - cv * 0.072 + sv * 0.928) * 65536;
@@ -1768,6 +2248,9 @@ void render_default_filter_saturate(struct surface_t * s, int saturate)
 	int r, g, b, vmin, vmax;
 	int alpha, delta, value, lv, sv;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	for(i = 0; i < len; i++, p += 4)
 	{
 		if(p[3] != 0)
@@ -1842,6 +2325,9 @@ void render_default_filter_brightness(struct surface_t * s, int brightness)
 	unsigned char * p = surface_get_pixels(s);
 	int t, v = clamp(brightness, -100, 100) * 255 / 100;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	for(i = 0; i < len; i++, p += 4)
 	{
 		if(p[3] != 0)
@@ -1871,6 +2357,9 @@ void render_default_filter_contrast(struct surface_t * s, int contrast)
 	int r, g, b;
 	int tr, tg, tb;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	for(i = 0; i < len; i++, p += 4)
 	{
 		if(p[3] != 0)
@@ -1909,6 +2398,9 @@ void render_default_filter_opacity(struct surface_t * s, int alpha)
 	unsigned char * p = surface_get_pixels(s);
 	int v = clamp(alpha, 0, 100) * 256 / 100;
 
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
 	switch(v)
 	{
 	case 0:
@@ -1933,229 +2425,26 @@ void render_default_filter_opacity(struct surface_t * s, int alpha)
 
 void render_default_filter_haldclut(struct surface_t * s, struct surface_t * clut, const char * type)
 {
-	int width = surface_get_width(s);
-	int height = surface_get_height(s);
-	int stride = surface_get_stride(s);
-	unsigned char * p, * q = surface_get_pixels(s);
-	int cw = surface_get_width(clut);
-	int ch = surface_get_height(clut);
-	unsigned char * t, * cp, * cq = surface_get_pixels(clut);
-	double sum[9];
-	double dr, dg, db, xdr, xdg, xdb;
-	int ri, gi, bi;
-	int x, y, v;
-	int level, level2, level_1, level_2;
-
-	if(cw == ch)
-	{
-		switch(cw)
-		{
-		case 8:    level =  2 *  2; break;
-		case 27:   level =  3 *  3; break;
-		case 64:   level =  4 *  4; break;
-		case 125:  level =  5 *  5; break;
-		case 216:  level =  6 *  6; break;
-		case 343:  level =  7 *  7; break;
-		case 512:  level =  8 *  8; break;
-		case 729:  level =  9 *  9; break;
-		case 1000: level = 10 * 10; break;
-		case 1331: level = 11 * 11; break;
-		case 1728: level = 12 * 12; break;
-		case 2197: level = 13 * 13; break;
-		case 2744: level = 14 * 14; break;
-		case 3375: level = 15 * 15; break;
-		case 4096: level = 16 * 16; break;
-		default:
-			return;
-		}
-		level2 = level * level;
-		level_1 = level - 1;
-		level_2 = level - 2;
+	struct lut3d_t * lut;
+
+	if((s->format != SURFACE_FORMAT_ARGB32) || (clut->format != SURFACE_FORMAT_ARGB32))
+		return;
+
+	lut = lut3d_cache_get(clut);
+	if(lut)
+	{
 		switch(shash(type))
 		{
 		case 0x09fa48d7: /* "nearest" */
-			for(y = 0; y < height; y++, q += stride)
-			{
-				for(x = 0, p = q; x < width; x++, p += 4)
-				{
-					if(p[3] != 0)
-					{
-						if(p[3] == 255)
-						{
-							bi = idiv255(p[0] * level_1);
-							if(bi > level_2)
-								bi = level_2;
-							gi = idiv255(p[1] * level_1);
-							if(gi > level_2)
-								gi = level_2;
-							ri = idiv255(p[2] * level_1);
-							if(ri > level_2)
-								ri = level_2;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							p[0] = cp[0];
-							p[1] = cp[1];
-							p[2] = cp[2];
-						}
-						else
-						{
-							bi = p[0] * level_1 / p[3];
-							if(bi > level_2)
-								bi = level_2;
-							gi = p[1] * level_1 / p[3];
-							if(gi > level_2)
-								gi = level_2;
-							ri = p[2] * level_1 / p[3];
-							if(ri > level_2)
-								ri = level_2;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							p[0] = idiv255(cp[0] * p[3]);
-							p[1] = idiv255(cp[1] * p[3]);
-							p[2] = idiv255(cp[2] * p[3]);
-						}
-					}
-				}
-			}
+			lut3d_apply(lut, s, 1);
 			break;
 		case 0x860ab38f: /* "trilinear" */
-			for(y = 0; y < height; y++, q += stride)
-			{
-				for(x = 0, p = q; x < width; x++, p += 4)
-				{
-					if(p[3] != 0)
-					{
-						if(p[3] == 255)
-						{
-							bi = idiv255(p[0] * level_1);
-							if(bi > level_2)
-								bi = level_2;
-							gi = idiv255(p[1] * level_1);
-							if(gi > level_2)
-								gi = level_2;
-							ri = idiv255(p[2] * level_1);
-							if(ri > level_2)
-								ri = level_2;
-							db = (double)p[0] * level_1 / 255 - bi;
-							dg = (double)p[1] * level_1 / 255 - gi;
-							dr = (double)p[2] * level_1 / 255 - ri;
-							xdb = 1 - db;
-							xdg = 1 - dg;
-							xdr = 1 - dr;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							t = cp;
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + (level << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[6] = sum[0] * xdg + sum[3] * dg;
-							sum[7] = sum[1] * xdg + sum[4] * dg;
-							sum[8] = sum[2] * xdg + sum[5] * dg;
-							t = cp + (level2 << 2);
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + ((level2 + level) << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[0] = sum[0] * xdg + sum[3] * dg;
-							sum[1] = sum[1] * xdg + sum[4] * dg;
-							sum[2] = sum[2] * xdg + sum[5] * dg;
-							v = sum[6] * xdb + sum[0] * db;
-							p[0] = clamp(v, 0, 255);
-							v = sum[7] * xdb + sum[1] * db;
-							p[1] = clamp(v, 0, 255);
-							v = sum[8] * xdb + sum[2] * db;
-							p[2] = clamp(v, 0, 255);
-						}
-						else
-						{
-							bi = p[0] * level_1 / p[3];
-							if(bi > level_2)
-								bi = level_2;
-							gi = p[1] * level_1 / p[3];
-							if(gi > level_2)
-								gi = level_2;
-							ri = p[2] * level_1 / p[3];
-							if(ri > level_2)
-								ri = level_2;
-							db = (double)p[0] * level_1 / p[3] - bi;
-							dg = (double)p[1] * level_1 / p[3] - gi;
-							dr = (double)p[2] * level_1 / p[3] - ri;
-							xdb = 1 - db;
-							xdg = 1 - dg;
-							xdr = 1 - dr;
-							cp = cq + ((bi * level2 + gi * level + ri) << 2);
-							t = cp;
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + (level << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[6] = sum[0] * xdg + sum[3] * dg;
-							sum[7] = sum[1] * xdg + sum[4] * dg;
-							sum[8] = sum[2] * xdg + sum[5] * dg;
-							t = cp + (level2 << 2);
-							sum[0] = (double)t[0] * xdr;
-							sum[1] = (double)t[1] * xdr;
-							sum[2] = (double)t[2] * xdr;
-							t += 4;
-							sum[0] += (double)t[0] * dr;
-							sum[1] += (double)t[1] * dr;
-							sum[2] += (double)t[2] * dr;
-							t = cp + ((level2 + level) << 2);
-							sum[3] = (double)t[0] * xdr;
-							sum[4] = (double)t[1] * xdr;
-							sum[5] = (double)t[2] * xdr;
-							t += 4;
-							sum[3] += (double)t[0] * dr;
-							sum[4] += (double)t[1] * dr;
-							sum[5] += (double)t[2] * dr;
-							sum[0] = sum[0] * xdg + sum[3] * dg;
-							sum[1] = sum[1] * xdg + sum[4] * dg;
-							sum[2] = sum[2] * xdg + sum[5] * dg;
-							v = (sum[6] * xdb + sum[0] * db) * p[3] / 255;
-							p[0] = clamp(v, 0, 255);
-							v = (sum[7] * xdb + sum[1] * db) * p[3] / 255;
-							p[1] = clamp(v, 0, 255);
-							v = (sum[8] * xdb + sum[2] * db) * p[3] / 255;
-							p[2] = clamp(v, 0, 255);
-						}
-					}
-				}
-			}
+			lut3d_apply(lut, s, 0);
 			break;
 		default:
 			break;
 		}
+		lut3d_cache_put(lut);
 	}
 }
 
@@ -2197,33 +2486,82 @@ static inline void blurrow(unsigned char * pixel, int width, int height, int cha
 		blurinner(&p[i * channel], &zr, &zg, &zb, &za, alpha);
 }
 
-static inline void blurcol(unsigned char * pixel, int width, int height, int channel, int x, int alpha)
+/*
+ * The column pass walks a tile of BLUR_TILE_COLS adjacent columns row by row, so every
+ * step touches one contiguous span instead of striding a whole line per pixel
+ */
+#define BLUR_TILE_COLS		(16)
+#define BLUR_ROW_GRAIN		(16)
+
+struct blur_job_t {
+	unsigned char * pixel;
+	int width;
+	int height;
+	int channel;
+	int alpha;
+};
+
+static inline void blurcol(unsigned char * pixel, int width, int height, int channel, int x, int n, int alpha)
 {
-	unsigned char * p = pixel;
-	int zr, zg, zb, za;
-	int i;
+	unsigned char * p;
+	int zr[BLUR_TILE_COLS], zg[BLUR_TILE_COLS], zb[BLUR_TILE_COLS], za[BLUR_TILE_COLS];
+	int stride = width * channel;
+	int i, j;
 
-	p += x * channel;
-	zb = p[0] << 7;
-	zg = p[1] << 7;
-	zr = p[2] << 7;
-	za = p[3] << 7;
+	p = pixel + x * channel;
+	for(j = 0; j < n; j++)
+	{
+		zb[j] = p[j * channel + 0] << 7;
+		zg[j] = p[j * channel + 1] << 7;
+		zr[j] = p[j * channel + 2] << 7;
+		za[j] = p[j * channel + 3] << 7;
+	}
+	for(i = 1; i < height - 1; i++)
+	{
+		p = pixel + i * stride + x * channel;
+		for(j = 0; j < n; j++)
+			blurinner(&p[j * channel], &zr[j], &zg[j], &zb[j], &za[j], alpha);
+	}
+	for(i = height - 2; i >= 0; i--)
+	{
+		p = pixel + i * stride + x * channel;
+		for(j = 0; j < n; j++)
+			blurinner(&p[j * channel], &zr[j], &zg[j], &zb[j], &za[j], alpha);
+	}
+}
 
-	for(i = width; i < (height - 1) * width; i += width)
-		blurinner(&p[i * channel], &zr, &zg, &zb, &za, alpha);
-	for(i = (height - 2) * width; i >= 0; i -= width)
-		blurinner(&p[i * channel], &zr, &zg, &zb, &za, alpha);
+static void blurrow_band(int start, int end, void * data)
+{
+	struct blur_job_t * job = (struct blur_job_t *)data;
+	int row;
+
+	for(row = start; row < end; row++)
+		blurrow(job->pixel, job->width, job->height, job->channel, row, job->alpha);
+}
+
+static void blurcol_band(int start, int end, void * data)
+{
+	struct blur_job_t * job = (struct blur_job_t *)data;
+	int tile, x;
+
+	for(tile = start; tile < end; tile++)
+	{
+		x = tile * BLUR_TILE_COLS;
+		blurcol(job->pixel, job->width, job->height, job->channel, x, min(BLUR_TILE_COLS, job->width - x), job->alpha);
+	}
 }
 
 static inline void expblur(unsigned char * pixel, int width, int height, int channel, int radius)
 {
-	int alpha = (int)((1 << 16) * (1.0 - expf(-2.3 / (radius + 1.0))));
-	int row, col;
+	struct blur_job_t job;
 
-	for(row = 0; row < height; row++)
-		blurrow(pixel, width, height, channel, row, alpha);
-	for(col = 0; col < width; col++)
-		blurcol(pixel, width, height, channel, col, alpha);
+	job.pixel = pixel;
+	job.width = width;
+	job.height = height;
+	job.channel = channel;
+	job.alpha = (int)((1 << 16) * (1.0 - expf(-2.3 / (radius + 1.0))));
+	parallel_for(height, BLUR_ROW_GRAIN, blurrow_band, &job);
+	parallel_for((width + BLUR_TILE_COLS - 1) / BLUR_TILE_COLS, 1, blurcol_band, &job);
 }
 
 void render_default_filter_blur(struct surface_t * s, int radius)
@@ -2232,6 +2570,337 @@ void render_default_filter_blur(struct surface_t * s, int radius)
 	int height = surface_get_height(s);
 	unsigned char * pixels = surface_get_pixels(s);
 
-	if(radius > 0)
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+
+	if((radius > 0) && (width > 0) && (height > 0))
 		expblur(pixels, width, height, 4, radius);
 }
+
+/*
+ * Filter chain, works on unpremultiplied pixels, linear steps are composed into
+ * a 4x5 matrix, applied in fixed point with the non-linear steps in one pass.
+ */
+#define FILTER_CHAIN_STAGES		(8)
+#define FILTER_ROW_GRAIN		(16)
+#define FILTER_MATRIX_SHIFT		(12)
+#define FILTER_MATRIX_LIMIT		(64 << FILTER_MATRIX_SHIFT)
+
+struct filter_stage_t {
+	int saturate;
+	int v;
+	int m[20];
+};
+
+struct filter_chain_job_t {
+	struct surface_t * s;
+	struct filter_stage_t stage[FILTER_CHAIN_STAGES];
+	int nstage;
+};
+
+static void filter_matrix_identity(float * m)
+{
+	memset(m, 0, sizeof(float) * 20);
+	m[0] = m[6] = m[12] = m[18] = 1.0f;
+}
+
+static void filter_matrix_concat(float * m, float * f)
+{
+	float t[20];
+	int i, j;
+
+	for(i = 0; i < 4; i++)
+	{
+		for(j = 0; j < 5; j++)
+		{
+			t[i * 5 + j] = f[i * 5 + 0] * m[0 * 5 + j] + f[i * 5 + 1] * m[1 * 5 + j] + f[i * 5 + 2] * m[2 * 5 + j] + f[i * 5 + 3] * m[3 * 5 + j];
+			if(j == 4)
+				t[i * 5 + j] += f[i * 5 + 4];
+		}
+	}
+	memcpy(m, t, sizeof(t));
+}
+
+static void filter_matrix_rgb(float * m, float * rgb)
+{
+	int i;
+
+	filter_matrix_identity(m);
+	for(i = 0; i < 3; i++)
+	{
+		m[i * 5 + 0] = rgb[i * 3 + 0];
+		m[i * 5 + 1] = rgb[i * 3 + 1];
+		m[i * 5 + 2] = rgb[i * 3 + 2];
+	}
+}
+
+static int filter_matrix(struct surface_filter_t * f, float * m)
+{
+	float rgb[9];
+	float av, cv, sv, v;
+
+	switch(f->type)
+	{
+	case SURFACE_FILTER_GRAY:
+		rgb[0] = rgb[3] = rgb[6] = 0.299f;
+		rgb[1] = rgb[4] = rgb[7] = 0.587f;
+		rgb[2] = rgb[5] = rgb[8] = 0.114f;
+		filter_matrix_rgb(m, rgb);
+		return 1;
+
+	case SURFACE_FILTER_SEPIA:
+		rgb[0] = 0.393f; rgb[1] = 0.769f; rgb[2] = 0.189f;
+		rgb[3] = 0.349f; rgb[4] = 0.686f; rgb[5] = 0.168f;
+		rgb[6] = 0.272f; rgb[7] = 0.534f; rgb[8] = 0.131f;
+		filter_matrix_rgb(m, rgb);
+		return 1;
+
+	case SURFACE_FILTER_INVERT:
+		filter_matrix_identity(m);
+		m[0] = m[6] = m[12] = -1.0f;
+		m[4] = m[9] = m[14] = 255.0f;
+		return 1;
+
+	case SURFACE_FILTER_COLORING:
+		filter_matrix_identity(m);
+		m[0] = m[6] = m[12] = 0.0f;
+		m[4] = f->color.r;
+		m[9] = f->color.g;
+		m[14] = f->color.b;
+		return 1;
+
+	case SURFACE_FILTER_HUE:
+		av = f->value * M_PI / 180.0;
+		cv = cosf(av);
+		sv = sinf(av);
+		rgb[0] = 0.213 + cv * 0.787 - sv * 0.213;
+		rgb[1] = 0.715 - cv * 0.715 - sv * 0.715;
+		rgb[2] = 0.072 - cv * 0.072 + sv * 0.928;
+		rgb[3] = 0.213 - cv * 0.213 + sv * 0.143;
+		rgb[4] = 0.715 + cv * 0.285 + sv * 0.140;
+		rgb[5] = 0.072 - cv * 0.072 - sv * 0.283;
+		rgb[6] = 0.213 - cv * 0.213 - sv * 0.787;
+		rgb[7] = 0.715 - cv * 0.715 + sv * 0.715;
+		rgb[8] = 0.072 + cv * 0.928 + sv * 0.072;
+		filter_matrix_rgb(m, rgb);
+		return 1;
+
+	case SURFACE_FILTER_BRIGHTNESS:
+		v = clamp(f->value, -100, 100) * 255 / 100;
+		filter_matrix_identity(m);
+		m[4] = m[9] = m[14] = v;
+		return 1;
+
+	case SURFACE_FILTER_CONTRAST:
+		v = clamp(f->value, -100, 100) * 128 / 100;
+		filter_matrix_identity(m);
+		m[0] = m[6] = m[12] = (128.0f + v) / 128.0f;
+		m[4] = m[9] = m[14] = -v;
+		return 1;
+
+	case SURFACE_FILTER_OPACITY:
+		filter_matrix_identity(m);
+		m[18] = clamp(f->value, 0, 100) / 100.0f;
+		return 1;
+
+	default:
+		break;
+	}
+	return 0;
+}
+
+static inline void filter_saturate_pixel(int * r, int * g, int * b, int v)
+{
+	int vmin = min(min(*r, *g), *b);
+	int vmax = max(max(*r, *g), *b);
+	int delta = vmax - vmin;
+	int value = vmax + vmin;
+	int alpha, lv, sv;
+
+	if(delta == 0)
+		return;
+	lv = value >> 1;
+	sv = lv < 128 ? (delta << 7) / value : (delta << 7) / (510 - value);
+	if(v >= 0)
+	{
+		alpha = (v + sv >= 128) ? sv : 128 - v;
+		if(alpha != 0)
+			alpha = 128 * 128 / alpha - 128;
+	}
+	else
+	{
+		alpha = v;
+	}
+	*r = clamp(*r + ((*r - lv) * alpha >> 7), 0, 255);
+	*g = clamp(*g + ((*g - lv) * alpha >> 7), 0, 255);
+	*b = clamp(*b + ((*b - lv) * alpha >> 7), 0, 255);
+}
+
+static void filter_chain_band(int start, int end, void * data)
+{
+	struct filter_chain_job_t * job = (struct filter_chain_job_t *)data;
+	struct filter_stage_t * st;
+	int width = surface_get_width(job->s);
+	int stride = surface_get_stride(job->s);
+	unsigned char * pixels = surface_get_pixels(job->s);
+	unsigned char * p;
+	int r, g, b, a;
+	int tr, tg, tb;
+	int * m;
+	int x, y, i;
+
+	for(y = start; y < end; y++)
+	{
+		p = pixels + y * stride;
+		for(x = 0; x < width; x++, p += 4)
+		{
+			a = p[3];
+			if(a == 0)
+				continue;
+			if(a == 255)
+			{
+				b = p[0];
+				g = p[1];
+				r = p[2];
+			}
+			else
+			{
+				b = min(p[0] * 255 / a, 255);
+				g = min(p[1] * 255 / a, 255);
+				r = min(p[2] * 255 / a, 255);
+			}
+			for(i = 0, st = &job->stage[0]; i < job->nstage; i++, st++)
+			{
+				if(st->saturate)
+				{
+					filter_saturate_pixel(&r, &g, &b, st->v);
+				}
+				else
+				{
+					m = st->m;
+					tr = (m[0] * r + m[1] * g + m[2] * b + m[3] * a + m[4]) >> FILTER_MATRIX_SHIFT;
+					tg = (m[5] * r + m[6] * g + m[7] * b + m[8] * a + m[9]) >> FILTER_MATRIX_SHIFT;
+					tb = (m[10] * r + m[11] * g + m[12] * b + m[13] * a + m[14]) >> FILTER_MATRIX_SHIFT;
+					a = (m[15] * r + m[16] * g + m[17] * b + m[18] * a + m[19]) >> FILTER_MATRIX_SHIFT;
+					r = clamp(tr, 0, 255);
+					g = clamp(tg, 0, 255);
+					b = clamp(tb, 0, 255);
+					a = clamp(a, 0, 255);
+				}
+			}
+			if(a == 255)
+			{
+				p[0] = b;
+				p[1] = g;
+				p[2] = r;
+				p[3] = 255;
+			}
+			else
+			{
+				p[0] = idiv255(b * a);
+				p[1] = idiv255(g * a);
+				p[2] = idiv255(r * a);
+				p[3] = a;
+			}
+		}
+	}
+}
+
+static void filter_chain_flush(struct filter_chain_job_t * job)
+{
+	if(job->nstage > 0)
+	{
+		parallel_for(surface_get_height(job->s), FILTER_ROW_GRAIN, filter_chain_band, job);
+		job->nstage = 0;
+	}
+}
+
+static struct filter_stage_t * filter_chain_stage(struct filter_chain_job_t * job)
+{
+	if(job->nstage >= FILTER_CHAIN_STAGES)
+		filter_chain_flush(job);
+	return &job->stage[job->nstage++];
+}
+
+static void filter_chain_matrix(struct filter_chain_job_t * job, float * m)
+{
+	struct filter_stage_t * st;
+	float e = 0.0f;
+	int i, v;
+
+	for(i = 0; i < 20; i++)
+		e += fabsf(m[i] - (((i % 6) == 0) ? 1.0f : 0.0f));
+	if(e < 1e-4f)
+		return;
+	st = filter_chain_stage(job);
+	st->saturate = 0;
+	st->v = 0;
+	for(i = 0; i < 20; i++)
+	{
+		if((i % 5) == 4)
+			v = roundf(clamp(m[i], -65536.0f, 65536.0f) * (1 << FILTER_MATRIX_SHIFT)) + (1 << (FILTER_MATRIX_SHIFT - 1));
+		else
+			v = clamp((int)roundf(m[i] * (1 << FILTER_MATRIX_SHIFT)), -FILTER_MATRIX_LIMIT, FILTER_MATRIX_LIMIT);
+		st->m[i] = v;
+	}
+}
+
+void render_default_filter_chain(struct surface_t * s, struct surface_filter_t * f, int n)
+{
+	struct filter_chain_job_t * job;
+	struct filter_stage_t * st;
+	float m[20], t[20];
+	int linear = 0;
+	int i;
+
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		return;
+	if((n <= 0) || (surface_get_width(s) <= 0) || (surface_get_height(s) <= 0))
+		return;
+
+	job = malloc(sizeof(struct filter_chain_job_t));
+	if(!job)
+		return;
+	job->s = s;
+	job->nstage = 0;
+
+	for(i = 0; i < n; i++)
+	{
+		if(filter_matrix(&f[i], t))
+		{
+			if(!linear)
+			{
+				filter_matrix_identity(m);
+				linear = 1;
+			}
+			filter_matrix_concat(m, t);
+			continue;
+		}
+		if(linear)
+		{
+			filter_chain_matrix(job, m);
+			linear = 0;
+		}
+		switch(f[i].type)
+		{
+		case SURFACE_FILTER_SATURATE:
+			if(f[i].value != 0)
+			{
+				st = filter_chain_stage(job);
+				st->saturate = 1;
+				st->v = clamp(f[i].value, -100, 100) * 128 / 100;
+			}
+			break;
+		case SURFACE_FILTER_BLUR:
+			filter_chain_flush(job);
+			surface_filter_blur(s, f[i].value);
+			break;
+		default:
+			break;
+		}
+	}
+	if(linear)
+		filter_chain_matrix(job, m);
+	filter_chain_flush(job);
+	free(job);
+}
@@ -33,6 +33,7 @@
 #include <jerror.h>
 #include <qrcgen.h>
 #include <graphic/surface.h>
+#include <graphic/lut3d.h>
 
 static struct list_head __render_list = {
 	.next = &__render_list,
@@ -75,6 +76,7 @@ static struct render_t render_default = {
 	.filter_opacity		= render_default_filter_opacity,
 	.filter_haldclut	= render_default_filter_haldclut,
 	.filter_blur		= render_default_filter_blur,
+	.filter_chain		= render_default_filter_chain,
 };
 
 inline __attribute__((always_inline)) struct render_t * search_render(void)
@@ -115,6 +117,11 @@ bool_t unregister_render(struct render_t * r)
 }
 
 struct surface_t * surface_alloc(int width, int height, void * priv)
+{
+	return surface_alloc_format(width, height, SURFACE_FORMAT_ARGB32, priv);
+}
+
+struct surface_t * surface_alloc_format(int width, int height, enum surface_format_t format, void * priv)
 {
 	struct surface_t * s;
 	void * pixels;
@@ -127,7 +134,7 @@ struct surface_t * surface_alloc(int width, int height, void * priv)
 	if(!s)
 		return NULL;
 
-	stride = width << 2;
+	stride = width * surface_format_bytes(format);
 	pixlen = height * stride;
 	pixels = malloc(pixlen);
 	if(!pixels)
@@ -141,9 +148,16 @@ struct surface_t * surface_alloc(int width, int height, void * priv)
 	s->height = height;
 	s->stride = stride;
 	s->pixlen = pixlen;
+	s->format = format;
 	s->pixels = pixels;
 	s->r = search_render();
 	s->rctx = s->r->create(s);
+	if(!s->rctx && (s->r != &render_default))
+	{
+		/* The render can not wrap this format, fall back to the default one */
+		s->r = &render_default;
+		s->rctx = s->r->create(s);
+	}
 	s->priv = priv;
 	return s;
 }
@@ -152,6 +166,7 @@ void surface_free(struct surface_t * s)
 {
 	if(s)
 	{
+		lut3d_cache_remove(s);
 		if(s->r)
 			s->r->destroy(s->rctx);
 		free(s->pixels);
@@ -184,11 +199,14 @@ struct surface_t * surface_clone(struct surface_t * s, int x, int y, int w, int
 	int width, height, stride, pixlen;
 	int swidth, sstride;
 	int x1, y1, x2, y2;
-	int r2, n, l;
+	int r2, n, l, b;
 	int i, j;
 
 	if(!s)
 		return NULL;
+	b = surface_format_bytes(s->format);
+	if(s->format != SURFACE_FORMAT_ARGB32)
+		r = 0;
 
 	if((w <= 0) || (h <= 0))
 	{
@@ -220,7 +238,7 @@ struct surface_t * surface_clone(struct surface_t * s, int x, int y, int w, int
 			{
 				width = x2 - x1;
 				height = y2 - y1;
-				stride = width << 2;
+				stride = width * b;
 				pixlen = height * stride;
 
 				o = malloc(sizeof(struct surface_t));
@@ -236,7 +254,7 @@ struct surface_t * surface_clone(struct surface_t * s, int x, int y, int w, int
 				{
 					sstride = s->stride;
 					p = (unsigned char *)pixels;
-					q = (unsigned char *)s->pixels + y1 * sstride + (x1 << 2);
+					q = (unsigned char *)s->pixels + y1 * sstride + x1 * b;
 					for(i = 0; i < height; i++, p += stride, q += sstride)
 						memcpy(p, q, stride);
 				}
@@ -349,6 +367,7 @@ struct surface_t * surface_clone(struct surface_t * s, int x, int y, int w, int
 	o->height = height;
 	o->stride = stride;
 	o->pixlen = pixlen;
+	o->format = s->format;
 	o->pixels = pixels;
 	o->r = s->r;
 	o->rctx = o->r->create(o);
@@ -356,13 +375,29 @@ struct surface_t * surface_clone(struct surface_t * s, int x, int y, int w, int
 	return o;
 }
 
+static inline void pixel_copy(void * d, const void * s, int bytes)
+{
+	switch(bytes)
+	{
+	case 4:
+		*(uint32_t *)d = *(const uint32_t *)s;
+		break;
+	case 2:
+		*(uint16_t *)d = *(const uint16_t *)s;
+		break;
+	default:
+		*(uint8_t *)d = *(const uint8_t *)s;
+		break;
+	}
+}
+
 struct surface_t * surface_extend(struct surface_t * s, int width, int height, const char * type)
 {
 	struct surface_t * o;
-	uint32_t * dp, * sp;
+	unsigned char * dp, * sp;
 	void * pixels, * spixels;
 	int stride, pixlen;
-	int sw, sh, x, y;
+	int sw, sh, ss, x, y, b;
 
 	if(!s || (width <= 0) || (height <= 0))
 		return NULL;
@@ -371,64 +406,61 @@ struct surface_t * surface_extend(struct surface_t * s, int width, int height, c
 	if(!o)
 		return NULL;
 
-	stride = width << 2;
+	b = surface_format_bytes(s->format);
+	stride = width * b;
 	pixlen = height * stride;
 	pixels = malloc(pixlen);
 	if(!pixels)
 	{
-		free(s);
+		free(o);
 		return NULL;
 	}
 	spixels = s->pixels;
 	sw = s->width;
 	sh = s->height;
+	ss = s->stride;
 
 	switch(shash(type))
 	{
 	case 0x192dec66: /* "repeat" */
-		for(y = 0, dp = (uint32_t *)pixels; y < height; y++)
+		for(y = 0, dp = (unsigned char *)pixels; y < height; y++)
 		{
-			for(x = 0, sp = (uint32_t *)spixels + (y % sh) * sw; x < width; x++)
+			for(x = 0, sp = (unsigned char *)spixels + (y % sh) * ss; x < width; x++, dp += b)
 			{
-				*dp++ = *(sp + (x % sw));
+				pixel_copy(dp, sp + (x % sw) * b, b);
 			}
 		}
 		break;
 	case 0x3e3a6a0a: /* "reflect" */
-		for(y = 0, dp = (uint32_t *)pixels; y < height; y++)
+		for(y = 0, dp = (unsigned char *)pixels; y < height; y++)
 		{
-			for(x = 0, sp = (uint32_t *)spixels + (((y / sh) & 0x1) ? (sh - 1 - (y % sh)) : (y % sh)) * sw; x < width; x++)
+			for(x = 0, sp = (unsigned char *)spixels + (((y / sh) & 0x1) ? (sh - 1 - (y % sh)) : (y % sh)) * ss; x < width; x++, dp += b)
 			{
-				*dp++ = *(sp + (((x / sw) & 0x1) ? (sw - 1 - (x % sw)) : (x % sw)));
+				pixel_copy(dp, sp + (((x / sw) & 0x1) ? (sw - 1 - (x % sw)) : (x % sw)) * b, b);
 			}
 		}
 		break;
 	case 0x0b889c3a: /* "pad" */
-		for(y = 0, dp = (uint32_t *)pixels; y < height; y++)
+		for(y = 0, dp = (unsigned char *)pixels; y < height; y++)
 		{
-			for(x = 0, sp = (uint32_t *)spixels + ((y < sh) ? y : sh - 1) * sw; x < width; x++)
+			for(x = 0, sp = (unsigned char *)spixels + ((y < sh) ? y : sh - 1) * ss; x < width; x++, dp += b)
 			{
-				*dp++ = *(sp + ((x < sw) ? x : sw - 1));
+				pixel_copy(dp, sp + ((x < sw) ? x : sw - 1) * b, b);
 			}
 		}
 		break;
 	default:
-		for(y = 0, dp = (uint32_t *)pixels; y < height; y++)
+		for(y = 0, dp = (unsigned char *)pixels; y < height; y++, dp += stride)
 		{
 			if(y < sh)
 			{
-				for(x = 0, sp = (uint32_t *)spixels + y * sw; x < width; x++)
-				{
-					if(x < sw)
-						*dp++ = *(sp + x);
-					else
-						*dp++ = 0;
-				}
+				x = min(sw, width) * b;
+				memcpy(dp, (unsigned char *)spixels + y * ss, x);
+				memset(dp + x, 0, stride - x);
 			}
 			else
 			{
 				memset(dp, 0, stride);
-				dp += width;
 			}
 		}
 		break;
@@ -438,6 +470,7 @@ struct surface_t * surface_extend(struct surface_t * s, int width, int height, c
 	o->height = height;
 	o->stride = stride;
 	o->pixlen = pixlen;
+	o->format = s->format;
 	o->pixels = pixels;
 	o->r = s->r;
 	o->rctx = o->r->create(o);
@@ -445,16 +478,96 @@ struct surface_t * surface_extend(struct surface_t * s, int width, int height, c
 	return o;
 }
 
+struct surface_t * surface_convert(struct surface_t * s, enum surface_format_t format)
+{
+	struct surface_t * o;
+	unsigned char * p, * q;
+	int sb, db;
+	int x, y;
+
+	if(!s)
+		return NULL;
+	if(s->format == format)
+		return surface_clone(s, 0, 0, 0, 0, 0);
+	o = surface_alloc_format(s->width, s->height, format, NULL);
+	if(!o)
+		return NULL;
+	sb = surface_format_bytes(s->format);
+	db = surface_format_bytes(format);
+	for(y = 0; y < s->height; y++)
+	{
+		p = (unsigned char *)o->pixels + y * o->stride;
+		q = (unsigned char *)s->pixels + y * s->stride;
+		for(x = 0; x < s->width; x++, p += db, q += sb)
+			pixel_store(format, p, pixel_load(s->format, q));
+	}
+	return o;
+}
+
+struct surface_t * surface_filter_begin(struct surface_t * s)
+{
+	if(!s || (s->format == SURFACE_FORMAT_ARGB32))
+		return s;
+	return surface_convert(s, SURFACE_FORMAT_ARGB32);
+}
+
+/*
+ * Store the filtered copy back, rgb565 drops the alpha and a8 keeps only it.
+ * Without a surface the copy is just dropped.
+ */
+void surface_filter_end(struct surface_t * s, struct surface_t * t)
+{
+	unsigned char * p, * q;
+	int b, x, y;
+
+	if(t && (t != s))
+	{
+		if(s)
+		{
+			b = surface_format_bytes(s->format);
+			for(y = 0; y < s->height; y++)
+			{
+				p = (unsigned char *)s->pixels + y * s->stride;
+				q = (unsigned char *)t->pixels + y * t->stride;
+				for(x = 0; x < s->width; x++, p += b, q += 4)
+					pixel_store(s->format, p, *(uint32_t *)q);
+			}
+		}
+		surface_free(t);
+	}
+}
+
 void surface_clear(struct surface_t * s, struct color_t * c, int x, int y, int w, int h)
 {
 	uint32_t * q, * p, v;
+	unsigned char * bq, * bp;
 	int x1, y1, x2, y2;
-	int i, j, l;
+	int i, j, l, b;
 
 	if(s)
 	{
 		v = c ? color_get_premult(c) : 0;
-		if((w <= 0) || (h <= 0))
+		if(s->format != SURFACE_FORMAT_ARGB32)
+		{
+			b = surface_format_bytes(s->format);
+			if((w <= 0) || (h <= 0))
+			{
+				x = 0;
+				y = 0;
+				w = s->width;
+				h = s->height;
+			}
+			x1 = max(0, x);
+			x2 = min(s->width, x + w);
+			y1 = max(0, y);
+			y2 = min(s->height, y + h);
+			for(j = y1, bq = (unsigned char *)s->pixels + y1 * s->stride + x1 * b; j < y2; j++, bq += s->stride)
+			{
+				for(i = x1, bp = bq; i < x2; i++, bp += b)
+					pixel_store(s->format, bp, v);
+			}
+		}
+		else if((w <= 0) || (h <= 0))
 		{
 			if(v)
 			{
@@ -502,8 +615,8 @@ void surface_set_pixel(struct surface_t * s, int x, int y, struct color_t * c)
 {
 	if(c && s && (x < s->width) && (y < s->height))
 	{
-		uint32_t * p = (uint32_t *)s->pixels + y * (s->stride >> 2) + x;
-		*p = color_get_premult(c);
+		unsigned char * p = (unsigned char *)s->pixels + y * s->stride + x * surface_format_bytes(s->format);
+		pixel_store(s->format, p, color_get_premult(c));
 	}
 }
 
@@ -513,8 +626,8 @@ void surface_get_pixel(struct surface_t * s, int x, int y, struct color_t * c)
 	{
 		if(s && (x < s->width) && (y < s->height))
 		{
-			uint32_t * p = (uint32_t *)s->pixels + y * (s->stride >> 2) + x;
-			color_set_premult(c, *p);
+			unsigned char * p = (unsigned char *)s->pixels + y * s->stride + x * surface_format_bytes(s->format);
+			color_set_premult(c, pixel_load(s->format, p));
 		}
 		else
 		{
@@ -589,13 +702,136 @@ static void convert_bytes_to_data(png_structp png, png_row_infop row_info, png_b
 	}
 }
 
-static inline struct surface_t * surface_alloc_from_xfs_png(struct xfs_context_t * ctx, const char * filename)
+static inline void surface_store_row(struct surface_t * s, int y, uint32_t * row)
 {
+	unsigned char * p = (unsigned char *)s->pixels + y * s->stride;
+	int b = surface_format_bytes(s->format);
+	int x;
+
+	for(x = 0; x < s->width; x++, p += b)
+		pixel_store(s->format, p, row[x]);
+}
+
+/*
+ * Box filter for shrinking while decoding, source rows are pushed one by one and
+ * each destination row is stored as soon as its last source row arrives.
+ */
+struct surface_scaler_t {
 	struct surface_t * s;
+	int sw, sh;
+	int sy, dy;
+	int count;
+	int * xmap;
+	uint32_t * acc;
+	uint32_t * row;
+};
+
+static void surface_scaler_exit(struct surface_scaler_t * sc)
+{
+	free(sc->xmap);
+	free(sc->acc);
+	free(sc->row);
+	sc->xmap = NULL;
+	sc->acc = NULL;
+	sc->row = NULL;
+}
+
+static int surface_scaler_init(struct surface_scaler_t * sc, struct surface_t * s, int sw, int sh)
+{
+	int dw = surface_get_width(s);
+	int i;
+
+	sc->s = s;
+	sc->sw = sw;
+	sc->sh = sh;
+	sc->sy = 0;
+	sc->dy = 0;
+	sc->count = 0;
+	sc->xmap = malloc(sizeof(int) * (dw + 1));
+	sc->acc = calloc(dw * 4, sizeof(uint32_t));
+	sc->row = malloc(sizeof(uint32_t) * dw);
+	if(!sc->xmap || !sc->acc || !sc->row)
+	{
+		surface_scaler_exit(sc);
+		return 0;
+	}
+	for(i = 0; i <= dw; i++)
+		sc->xmap[i] = (int)((int64_t)i * sw / dw);
+	return 1;
+}
+
+static void surface_scaler_push(struct surface_scaler_t * sc, uint32_t * src)
+{
+	int dw = surface_get_width(sc->s);
+	int dh = surface_get_height(sc->s);
+	uint32_t * acc = sc->acc;
+	uint32_t c;
+	int x, dx, n;
+
+	if(sc->dy >= dh)
+		return;
+	for(dx = 0; dx < dw; dx++, acc += 4)
+	{
+		for(x = sc->xmap[dx]; x < sc->xmap[dx + 1]; x++)
+		{
+			c = src[x];
+			acc[0] += (c >> 24) & 0xff;
+			acc[1] += (c >> 16) & 0xff;
+			acc[2] += (c >> 8) & 0xff;
+			acc[3] += (c >> 0) & 0xff;
+		}
+	}
+	sc->count++;
+	sc->sy++;
+	if(sc->sy >= (int)((int64_t)(sc->dy + 1) * sc->sh / dh))
+	{
+		for(dx = 0, acc = sc->acc; dx < dw; dx++, acc += 4)
+		{
+			n = sc->count * (sc->xmap[dx + 1] - sc->xmap[dx]);
+			sc->row[dx] = ((acc[0] / n) << 24) | ((acc[1] / n) << 16) | ((acc[2] / n) << 8) | (acc[3] / n);
+		}
+		surface_store_row(sc->s, sc->dy, sc->row);
+		memset(sc->acc, 0, sizeof(uint32_t) * dw * 4);
+		sc->count = 0;
+		sc->dy++;
+	}
+}
+
+static struct surface_t * surface_scale(struct surface_t * s, int width, int height)
+{
+	struct surface_t * o, * t;
+	struct matrix_t m;
+
+	if(!s || (width <= 0) || (height <= 0) || ((width == surface_get_width(s)) && (height == surface_get_height(s))))
+		return s;
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		t = surface_scale(surface_convert(s, SURFACE_FORMAT_ARGB32), width, height);
+		o = t ? surface_convert(t, s->format) : NULL;
+		surface_free(t);
+		surface_free(s);
+		return o;
+	}
+	o = surface_alloc(width, height, NULL);
+	if(o)
+	{
+		matrix_init_scale(&m, (double)width / surface_get_width(s), (double)height / surface_get_height(s));
+		surface_blit(o, NULL, &m, s, RENDER_TYPE_GOOD);
+	}
+	surface_free(s);
+	return o;
+}
+
+static inline struct surface_t * surface_alloc_from_xfs_png(struct xfs_context_t * ctx, const char * filename, enum surface_format_t format, int width, int height)
+{
+	struct surface_scaler_t sc;
+	struct surface_t * volatile s = NULL;
+	struct surface_t * o;
 	png_struct * png;
 	png_info * info;
-	png_byte * data = NULL;
-	png_byte ** row_pointers = NULL;
+	png_byte * volatile data = NULL;
+	png_byte ** volatile row_pointers = NULL;
+	png_byte * p;
 	png_uint_32 png_width, png_height;
 	int depth, color_type, interlace, stride;
 	unsigned int i;
@@ -620,10 +856,18 @@ static inline struct surface_t * surface_alloc_from_xfs_png(struct xfs_context_t
 	}
 
 	png_set_read_fn(png, file, png_xfs_read_data);
+	memset(&sc, 0, sizeof(struct surface_scaler_t));
 
 #ifdef PNG_SETJMP_SUPPORTED
 	if(setjmp(png_jmpbuf(png)))
 	{
+		surface_scaler_exit(&sc);
+		if(row_pointers)
+			free(row_pointers);
+		if(data)
+			free(data);
+		if(s)
+			surface_free(s);
 		png_destroy_read_struct(&png, &info, NULL);
 		xfs_close(file);
 		return NULL;
@@ -677,14 +921,84 @@ static inline struct surface_t * surface_alloc_from_xfs_png(struct xfs_context_t
 		break;
 	}
 
-	s = surface_alloc(png_width, png_height, NULL);
-	data = surface_get_pixels(s);
+	if((width > 0) && (height > 0) && (width <= (int)png_width) && (height <= (int)png_height) && ((width != (int)png_width) || (height != (int)png_height)) && (interlace == PNG_INTERLACE_NONE))
+	{
+		/*
+		 * Shrink while decoding, only one source line and the target are in memory
+		 */
+		s = surface_alloc_format(width, height, format, NULL);
+		data = malloc(png_width * 4);
+		if(!s || !data || !surface_scaler_init(&sc, s, png_width, png_height))
+		{
+			if(s)
+				surface_free(s);
+			if(data)
+				free(data);
+			png_destroy_read_struct(&png, &info, NULL);
+			xfs_close(file);
+			return NULL;
+		}
+		for(i = 0; i < png_height; i++)
+		{
+			png_read_row(png, data, NULL);
+			surface_scaler_push(&sc, (uint32_t *)data);
+		}
+		surface_scaler_exit(&sc);
+		free(data);
+		data = NULL;
+		png_read_end(png, info);
+		png_destroy_read_struct(&png, &info, NULL);
+		xfs_close(file);
+		return s;
+	}
+
+	if((format != SURFACE_FORMAT_ARGB32) && (interlace == PNG_INTERLACE_NONE))
+	{
+		/*
+		 * Decode row by row through a single 32-bits line, the full argb image is never materialized
+		 */
+		s = surface_alloc_format(png_width, png_height, format, NULL);
+		data = malloc(png_width * 4);
+		if(!s || !data)
+		{
+			if(s)
+				surface_free(s);
+			if(data)
+				free(data);
+			png_destroy_read_struct(&png, &info, NULL);
+			xfs_close(file);
+			return NULL;
+		}
+		for(i = 0; i < png_height; i++)
+		{
+			png_read_row(png, data, NULL);
+			surface_store_row(s, i, (uint32_t *)data);
+		}
+		free(data);
+		data = NULL;
+		png_read_end(png, info);
+		png_destroy_read_struct(&png, &info, NULL);
+		xfs_close(file);
+		return surface_scale(s, width, height);
+	}
 
+	s = surface_alloc(png_width, png_height, NULL);
 	row_pointers = (png_byte **)malloc(png_height * sizeof(char *));
+	if(!s || !row_pointers)
+	{
+		if(s)
+			surface_free(s);
+		if(row_pointers)
+			free(row_pointers);
+		png_destroy_read_struct(&png, &info, NULL);
+		xfs_close(file);
+		return NULL;
+	}
+	p = surface_get_pixels(s);
 	stride = png_width * 4;
 
 	for(i = 0; i < png_height; i++)
-		row_pointers[i] = &data[i * stride];
+		row_pointers[i] = &p[i * stride];
 
 	png_read_image(png, row_pointers);
 	png_read_end(png, info);
@@ -692,7 +1006,16 @@ static inline struct surface_t * surface_alloc_from_xfs_png(struct xfs_context_t
 	png_destroy_read_struct(&png, &info, NULL);
 	xfs_close(file);
 
-	return s;
+	o = s;
+	if((width > 0) && (height > 0))
+		o = surface_scale(o, width, height);
+	if(o && (format != SURFACE_FORMAT_ARGB32))
+	{
+		s = o;
+		o = surface_convert(s, format);
+		surface_free(s);
+	}
+	return o;
 }
 
 struct x_error_mgr
@@ -792,13 +1115,15 @@ static void jpeg_xfs_src(j_decompress_ptr dinfo, struct xfs_file_t * file)
 	src->pub.next_input_byte = NULL;
 }
 
-static inline struct surface_t * surface_alloc_from_xfs_jpeg(struct xfs_context_t * ctx, const char * filename)
+static inline struct surface_t * surface_alloc_from_xfs_jpeg(struct xfs_context_t * ctx, const char * filename, enum surface_format_t format, int width, int height)
 {
 	struct jpeg_decompress_struct dinfo;
 	struct x_error_mgr jerr;
-	struct surface_t * s;
+	struct surface_scaler_t sc;
+	struct surface_t * volatile s = NULL;
 	struct xfs_file_t * file;
 	JSAMPARRAY buf;
+	uint32_t * volatile row = NULL;
 	unsigned char * p;
 	int scanline, offset, i;
 
@@ -807,8 +1132,14 @@ static inline struct surface_t * surface_alloc_from_xfs_jpeg(struct xfs_context_
 	dinfo.err = jpeg_std_error(&jerr.pub);
 	jerr.pub.error_exit = x_error_exit;
 	jerr.pub.emit_message = x_emit_message;
+	memset(&sc, 0, sizeof(struct surface_scaler_t));
 	if(setjmp(jerr.setjmp_buffer))
 	{
+		surface_scaler_exit(&sc);
+		if(row)
+			free(row);
+		if(s)
+			surface_free(s);
 		jpeg_destroy_decompress(&dinfo);
 		xfs_close(file);
 		return 0;
@@ -816,37 +1147,116 @@ static inline struct surface_t * surface_alloc_from_xfs_jpeg(struct xfs_context_
 	jpeg_create_decompress(&dinfo);
 	jpeg_xfs_src(&dinfo, file);
 	jpeg_read_header(&dinfo, 1);
+	if(dinfo.jpeg_color_space == JCS_GRAYSCALE)
+		dinfo.out_color_space = JCS_RGB;
+	if((width > 0) && (height > 0))
+	{
+		/*
+		 * Let the idct do the coarse scaling, the smallest m / 8 still covering the target
+		 */
+		for(i = 1; i < 8; i++)
+		{
+			if(((int)dinfo.image_width * i >= width * 8) && ((int)dinfo.image_height * i >= height * 8))
+				break;
+		}
+		dinfo.scale_num = i;
+		dinfo.scale_denom = 8;
+	}
 	jpeg_start_decompress(&dinfo);
 	buf = (*dinfo.mem->alloc_sarray)((j_common_ptr)&dinfo, JPOOL_IMAGE, dinfo.output_width * dinfo.output_components, 1);
-	s = surface_alloc(dinfo.image_width, dinfo.image_height, NULL);
+	if((width > 0) && (height > 0) && (width <= (int)dinfo.output_width) && (height <= (int)dinfo.output_height) && ((width != (int)dinfo.output_width) || (height != (int)dinfo.output_height)))
+	{
+		s = surface_alloc_format(width, height, format, NULL);
+		if(!s)
+		{
+			jpeg_destroy_decompress(&dinfo);
+			xfs_close(file);
+			return NULL;
+		}
+		row = malloc(sizeof(uint32_t) * dinfo.output_width);
+		if(!row || !surface_scaler_init(&sc, s, dinfo.output_width, dinfo.output_height))
+		{
+			free(row);
+			surface_free(s);
+			jpeg_destroy_decompress(&dinfo);
+			xfs_close(file);
+			return NULL;
+		}
+		while(dinfo.output_scanline < dinfo.output_height)
+		{
+			jpeg_read_scanlines(&dinfo, buf, 1);
+			for(i = 0; i < dinfo.output_width; i++)
+				row[i] = (0xff << 24) | (buf[0][(i * 3) + 0] << 16) | (buf[0][(i * 3) + 1] << 8) | (buf[0][(i * 3) + 2] << 0);
+			surface_scaler_push(&sc, row);
+		}
+		surface_scaler_exit(&sc);
+		free(row);
+		row = NULL;
+		jpeg_finish_decompress(&dinfo);
+		jpeg_destroy_decompress(&dinfo);
+		xfs_close(file);
+		return s;
+	}
+	s = surface_alloc_format(dinfo.output_width, dinfo.output_height, format, NULL);
+	if(!s)
+	{
+		jpeg_destroy_decompress(&dinfo);
+		xfs_close(file);
+		return NULL;
+	}
 	p = surface_get_pixels(s);
 	while(dinfo.output_scanline < dinfo.output_height)
 	{
 		scanline = dinfo.output_scanline * surface_get_stride(s);
 		jpeg_read_scanlines(&dinfo, buf, 1);
-		for(i = 0; i < dinfo.output_width; i++)
+		switch(format)
 		{
-			offset = scanline + (i * 4);
-			p[offset + 3] = 0xff;
-			p[offset + 2] = buf[0][(i * 3) + 0];
-			p[offset + 1] = buf[0][(i * 3) + 1];
-			p[offset + 0] = buf[0][(i * 3) + 2];
+		case SURFACE_FORMAT_RGB565:
+			for(i = 0; i < dinfo.output_width; i++)
+			{
+				offset = scanline + (i * 2);
+				*((uint16_t *)&p[offset]) = ((buf[0][(i * 3) + 0] & 0xf8) << 8) | ((buf[0][(i * 3) + 1] & 0xfc) << 3) | (buf[0][(i * 3) + 2] >> 3);
+			}
+			break;
+		case SURFACE_FORMAT_A8:
+			memset(&p[scanline], 0xff, dinfo.output_width);
+			break;
+		default:
+			for(i = 0; i < dinfo.output_width; i++)
+			{
+				offset = scanline + (i * 4);
+				p[offset + 3] = 0xff;
+				p[offset + 2] = buf[0][(i * 3) + 0];
+				p[offset + 1] = buf[0][(i * 3) + 1];
+				p[offset + 0] = buf[0][(i * 3) + 2];
+			}
+			break;
 		}
 	}
 	jpeg_finish_decompress(&dinfo);
 	jpeg_destroy_decompress(&dinfo);
 	xfs_close(file);
 
-	return s;
+	return surface_scale(s, width, height);
 }
 
 struct surface_t * surface_alloc_from_xfs(struct xfs_context_t * ctx, const char * filename)
+{
+	return surface_alloc_from_xfs_format(ctx, filename, SURFACE_FORMAT_ARGB32);
+}
+
+struct surface_t * surface_alloc_from_xfs_format(struct xfs_context_t * ctx, const char * filename, enum surface_format_t format)
+{
+	return surface_alloc_from_xfs_scaled(ctx, filename, format, 0, 0);
+}
+
+struct surface_t * surface_alloc_from_xfs_scaled(struct xfs_context_t * ctx, const char * filename, enum surface_format_t format, int width, int height)
 {
 	const char * ext = fileext(filename);
 	if(strcasecmp(ext, "png") == 0)
-		return surface_alloc_from_xfs_png(ctx, filename);
+		return surface_alloc_from_xfs_png(ctx, filename, format, width, height);
 	else if((strcasecmp(ext, "jpg") == 0) || (strcasecmp(ext, "jpeg") == 0))
-		return surface_alloc_from_xfs_jpeg(ctx, filename);
+		return surface_alloc_from_xfs_jpeg(ctx, filename, format, width, height);
 	return NULL;
 }
 
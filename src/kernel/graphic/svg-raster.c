@@ -35,6 +35,13 @@
 #define SVG_FIXMASK		(SVG_FIX - 1)
 #define SVG_MPAGE_SIZE	(4096)
 
+#define SVG_BAND_MIN_HEIGHT		(128)
+#define SVG_BAND_MIN_EDGES		(64)
+#define SVG_BAND_GRAIN			(32)
+#define SVG_RASTER_BUDGET		(SZ_4M)
+#define SVG_RASTER_HASH_SIZE	(64)
+#define SVG_RASTER_PHASES		(4)
+
 enum svg_point_flags_t {
 	SVG_POINT_CORNER	= (1 << 0),
 	SVG_POINT_BEVEL		= (1 << 1),
@@ -1019,7 +1026,7 @@ static void svg_scanline_solid(unsigned char * dst, int count, unsigned char * c
 	}
 }
 
-static void svg_rasterize_sorted_edges(struct svg_rasterizer_t * r, float tx, float ty, float sx, float sy, struct svg_cache_paint_t * cache, enum svg_fill_rule_t fill_rule)
+static void svg_rasterize_sorted_edges(struct svg_rasterizer_t * r, int ystart, int yend, float tx, float ty, float sx, float sy, struct svg_cache_paint_t * cache, enum svg_fill_rule_t fill_rule)
 {
 	struct svg_active_edge_t * active = NULL;
 	int y, s;
@@ -1027,7 +1034,7 @@ static void svg_rasterize_sorted_edges(struct svg_rasterizer_t * r, float tx, fl
 	int maxWeight = (255 / SVG_SUBSAMPLES);
 	int xmin, xmax;
 
-	for(y = 0; y < r->height; y++)
+	for(y = ystart; y < yend; y++)
 	{
 		memset(r->scanline, 0, r->width);
 		xmin = r->width;
@@ -1176,168 +1183,542 @@ static void svg_init_paint(struct svg_cache_paint_t * cache, struct svg_paint_t
 	}
 }
 
-static void svg_unpremultiply_alpha(unsigned char * img, int w, int h, int stride)
+struct svg_band_t {
+	struct svg_rasterizer_t * r;
+	float tx, ty;
+	float sx, sy;
+	struct svg_cache_paint_t * cache;
+	enum svg_fill_rule_t fill_rule;
+	int failed;
+};
+
+static void svg_free_pages(struct svg_mem_page_t * p)
 {
-	int x, y;
+	struct svg_mem_page_t * n;
 
-	for(y = 0; y < h; y++)
+	while(p)
 	{
-		unsigned char * row = &img[y * stride];
-		for(x = 0; x < w; x++)
-		{
-			int b = row[0], g = row[1], r = row[2], a = row[3];
-			if(a != 0)
-			{
-				row[0] = (unsigned char)(b * 255 / a);
-				row[1] = (unsigned char)(g * 255 / a);
-				row[2] = (unsigned char)(r * 255 / a);
-			}
-			row += 4;
-		}
+		n = p->next;
+		free(p);
+		p = n;
 	}
-	for(y = 0; y < h; y++)
+}
+
+/*
+ * Each band walks the shared sorted edges from the top with its own active
+ * edge pool and scanline, the bitmap rows it touches never overlap.
+ */
+static void svg_rasterize_band(int start, int end, void * data)
+{
+	struct svg_band_t * b = (struct svg_band_t *)data;
+	struct svg_rasterizer_t r;
+
+	memcpy(&r, b->r, sizeof(struct svg_rasterizer_t));
+	r.freelist = NULL;
+	r.pages = NULL;
+	r.curpage = NULL;
+	r.scanline = malloc(r.width);
+	if(!r.scanline)
 	{
-		unsigned char * row = &img[y * stride];
-		for(x = 0; x < w; x++)
-		{
-			int b = 0, g = 0, r = 0, a = row[3], n = 0;
-			if(a == 0)
-			{
-				if(x - 1 > 0 && row[-1] != 0)
-				{
-					b += row[-4];
-					g += row[-3];
-					r += row[-2];
-					n++;
-				}
-				if(x + 1 < w && row[7] != 0)
-				{
-					b += row[4];
-					g += row[5];
-					r += row[6];
-					n++;
-				}
-				if(y - 1 > 0 && row[-stride + 3] != 0)
-				{
-					b += row[-stride];
-					g += row[-stride + 1];
-					r += row[-stride + 2];
-					n++;
-				}
-				if(y + 1 < h && row[stride + 3] != 0)
-				{
-					b += row[stride];
-					g += row[stride + 1];
-					r += row[stride + 2];
-					n++;
-				}
-				if(n > 0)
-				{
-					row[0] = (unsigned char)(b / n);
-					row[1] = (unsigned char)(g / n);
-					row[2] = (unsigned char)(r / n);
-				}
-			}
-			row += 4;
-		}
+		b->failed = 1;
+		return;
 	}
+	svg_rasterize_sorted_edges(&r, start, end, b->tx, b->ty, b->sx, b->sy, b->cache, b->fill_rule);
+	svg_free_pages(r.pages);
+	free(r.scanline);
 }
 
-void render_default_shape_raster(struct surface_t * s, struct svg_t * svg, float tx, float ty, float sx, float sy)
+static int svg_rasterize(struct svg_rasterizer_t * r, float tx, float ty, float sx, float sy, struct svg_cache_paint_t * cache, enum svg_fill_rule_t fill_rule)
+{
+	struct svg_band_t band;
+	struct svg_edge_t * e;
+	int i;
+
+	for(i = 0; i < r->nedges; i++)
+	{
+		e = &r->edges[i];
+		e->x0 = tx + e->x0;
+		e->y0 = (ty + e->y0) * SVG_SUBSAMPLES;
+		e->x1 = tx + e->x1;
+		e->y1 = (ty + e->y1) * SVG_SUBSAMPLES;
+	}
+	qsort(r->edges, r->nedges, sizeof(struct svg_edge_t), svg_cmp_edge);
+	if((r->height >= SVG_BAND_MIN_HEIGHT) && (r->nedges >= SVG_BAND_MIN_EDGES) && (parallel_get_workers() > 1))
+	{
+		band.r = r;
+		band.tx = tx;
+		band.ty = ty;
+		band.sx = sx;
+		band.sy = sy;
+		band.cache = cache;
+		band.fill_rule = fill_rule;
+		band.failed = 0;
+		parallel_for(r->height, SVG_BAND_GRAIN, svg_rasterize_band, &band);
+		if(band.failed)
+			return 0;
+	}
+	else
+	{
+		svg_rasterize_sorted_edges(r, 0, r->height, tx, ty, sx, sy, cache, fill_rule);
+	}
+	return 1;
+}
+
+/*
+ * Composite all shapes into a premultiplied argb32 surface, with the svg origin
+ * placed at (tx, ty) in surface pixels. Returns zero if a shape could not be drawn.
+ */
+static int svg_raster_shapes(struct surface_t * s, struct svg_t * svg, float tx, float ty, float sx, float sy)
 {
 	struct svg_rasterizer_t r;
 	struct svg_cache_paint_t cache;
-	struct svg_mem_page_t * p, * n;
 	struct svg_shape_t * shape;
-	struct svg_edge_t * e;
 	float sw;
-	int i;
+	int ret = 1;
+
+	sw = (sx + sy) * 0.5f;
+	memset(&r, 0, sizeof(struct svg_rasterizer_t));
+	r.tesstol = 0.25;
+	r.disttol = 0.01;
+	r.bitmap = surface_get_pixels(s);
+	r.width = surface_get_width(s);
+	r.height = surface_get_height(s);
+	r.stride = surface_get_stride(s);
+	r.cscanline = r.width;
+	r.scanline = malloc(r.cscanline);
+	if(!r.scanline)
+		return 0;
+
+	for(shape = svg->shapes; (shape != NULL) && ret; shape = shape->next)
+	{
+		if(!shape->visible)
+			continue;
+		if(shape->fill.type != SVG_PAINT_NONE)
+		{
+			svg_reset_pool(&r);
+			r.freelist = NULL;
+			r.nedges = 0;
+			svg_flatten_shape(&r, shape, sx, sy);
+			svg_init_paint(&cache, &shape->fill, shape->opacity);
+			ret = svg_rasterize(&r, tx, ty, sx, sy, &cache, shape->fill_rule);
+		}
+		if(ret && (shape->stroke.type != SVG_PAINT_NONE) && (shape->stroke_width * sw > 0.01f))
+		{
+			svg_reset_pool(&r);
+			r.freelist = NULL;
+			r.nedges = 0;
+			svg_flatten_shape_stroke(&r, shape, sx, sy);
+			svg_init_paint(&cache, &shape->stroke, shape->opacity);
+			ret = svg_rasterize(&r, tx, ty, sx, sy, &cache, SVG_FILLRULE_NONZERO);
+		}
+	}
 
-	if(s)
-	{
-		sw = (sx + sy) * 0.5f;
-		r.px = 0;
-		r.py = 0;
-		r.tesstol = 0.25;
-		r.disttol = 0.01;
-		r.edges = NULL;
-		r.nedges = 0;
-		r.cedges = 0;
-		r.points = NULL;
-		r.npoints = 0;
-		r.cpoints = 0;
-		r.points2 = NULL;
-		r.npoints2 = 0;
-		r.cpoints2 = 0;
-		r.freelist = NULL;
-		r.pages = 0;
-		r.curpage = 0;
-		r.bitmap = surface_get_pixels(s);
-		r.width = surface_get_width(s);
-		r.height = surface_get_height(s);
-		r.stride = surface_get_stride(s);
-		r.cscanline = r.width;
-		r.scanline = malloc(r.cscanline);
-		if(!r.scanline)
-			return;
+	svg_free_pages(r.pages);
+	if(r.edges)
+		free(r.edges);
+	if(r.points)
+		free(r.points);
+	if(r.points2)
+		free(r.points2);
+	free(r.scanline);
+	return ret;
+}
+
+/*
+ * Pixel extent of the svg at the given scale, strokes and antialiasing included.
+ */
+static int svg_raster_bounds(struct svg_t * svg, float sx, float sy, struct region_t * region)
+{
+	struct svg_shape_t * shape;
+	float x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	float sw, hw;
+	int empty = 1;
 
-		for(shape = svg->shapes; shape != NULL; shape = shape->next)
+	sw = (sx + sy) * 0.5f;
+	for(shape = svg->shapes; shape != NULL; shape = shape->next)
+	{
+		if(!shape->visible)
+			continue;
+		if((shape->fill.type == SVG_PAINT_NONE) && (shape->stroke.type == SVG_PAINT_NONE))
+			continue;
+		hw = 0;
+		if(shape->stroke.type != SVG_PAINT_NONE)
 		{
-			if(!shape->visible)
-				continue;
-			if(shape->fill.type != SVG_PAINT_NONE)
-			{
-				svg_reset_pool(&r);
-				r.freelist = NULL;
-				r.nedges = 0;
-				svg_flatten_shape(&r, shape, sx, sy);
-				for(i = 0; i < r.nedges; i++)
-				{
-					e = &r.edges[i];
-					e->x0 = tx + e->x0;
-					e->y0 = (ty + e->y0) * SVG_SUBSAMPLES;
-					e->x1 = tx + e->x1;
-					e->y1 = (ty + e->y1) * SVG_SUBSAMPLES;
-				}
-				qsort(r.edges, r.nedges, sizeof(struct svg_edge_t), svg_cmp_edge);
-				svg_init_paint(&cache, &shape->fill, shape->opacity);
-				svg_rasterize_sorted_edges(&r, tx, ty, sx, sy, &cache, shape->fill_rule);
-			}
-			if((shape->stroke.type != SVG_PAINT_NONE) && (shape->stroke_width * sw > 0.01f))
+			hw = shape->stroke_width * sw * 0.5f;
+			if(shape->stroke_line_join == SVG_JOIN_MITER)
+				hw *= max(shape->miter_limit, 1.0f);
+			else if(shape->stroke_line_cap == SVG_CAP_SQUARE)
+				hw *= 1.4143f;
+		}
+		if(empty)
+		{
+			x0 = shape->bounds[0] * sx - hw;
+			y0 = shape->bounds[1] * sy - hw;
+			x1 = shape->bounds[2] * sx + hw;
+			y1 = shape->bounds[3] * sy + hw;
+			empty = 0;
+		}
+		else
+		{
+			x0 = min(x0, shape->bounds[0] * sx - hw);
+			y0 = min(y0, shape->bounds[1] * sy - hw);
+			x1 = max(x1, shape->bounds[2] * sx + hw);
+			y1 = max(y1, shape->bounds[3] * sy + hw);
+		}
+	}
+	if(empty)
+		return 0;
+	region_init(region, (int)floorf(x0) - 1, (int)floorf(y0) - 1, (int)ceilf(x1) - (int)floorf(x0) + 3, (int)ceilf(y1) - (int)floorf(y0) + 3);
+	return ((region->w > 0) && (region->h > 0)) ? 1 : 0;
+}
+
+static void svg_raster_tint(struct surface_t * s, uint32_t tint)
+{
+	int i, len = surface_get_width(s) * surface_get_height(s);
+	unsigned char * p = surface_get_pixels(s);
+	int r = (tint >> 16) & 0xff;
+	int g = (tint >> 8) & 0xff;
+	int b = (tint >> 0) & 0xff;
+	int a = (tint >> 24) & 0xff;
+	int o;
+
+	for(i = 0; i < len; i++, p += 4)
+	{
+		if(p[3] != 0)
+		{
+			o = idiv255(p[3] * a);
+			p[0] = idiv255(b * o);
+			p[1] = idiv255(g * o);
+			p[2] = idiv255(r * o);
+			p[3] = o;
+		}
+	}
+}
+
+/*
+ * Rasterize the region of the svg at the given transform into a new surface
+ */
+static struct surface_t * svg_raster_alloc(struct svg_t * svg, float tx, float ty, float sx, float sy, struct region_t * region, uint32_t tint)
+{
+	struct surface_t * s;
+
+	s = surface_alloc(region->w, region->h, NULL);
+	if(s && !svg_raster_shapes(s, svg, tx - region->x, ty - region->y, sx, sy))
+	{
+		surface_free(s);
+		return NULL;
+	}
+	if(s && (tint != 0xffffffff))
+		svg_raster_tint(s, tint);
+	return s;
+}
+
+/*
+ * Rasters are keyed by svg, scale, subpixel phase and tint. Unreferenced ones
+ * stay on the lru list until the byte budget needs their memory.
+ */
+struct svg_raster_entry_t {
+	struct list_head entry;
+	struct hlist_node node;
+	struct hlist_node snode;
+	struct svg_t * svg;
+	float sx, sy;
+	int px, py;
+	uint32_t tint;
+	int x, y;
+	int ref;
+	size_t size;
+	struct surface_t * s;
+};
+
+static struct {
+	struct list_head lru;
+	struct hlist_head hash[SVG_RASTER_HASH_SIZE];
+	struct hlist_head shash[SVG_RASTER_HASH_SIZE];
+	size_t bytes;
+	size_t budget;
+	spinlock_t lock;
+} __svg_raster = {
+	.lru = {
+		.next = &__svg_raster.lru,
+		.prev = &__svg_raster.lru,
+	},
+	.bytes = 0,
+	.budget = SVG_RASTER_BUDGET,
+	.lock = SPIN_LOCK_INIT(),
+};
+
+static inline struct hlist_head * svg_raster_hash(struct svg_t * svg)
+{
+	return &__svg_raster.hash[((unsigned long)svg >> 4) & (SVG_RASTER_HASH_SIZE - 1)];
+}
+
+static inline struct hlist_head * svg_raster_surface_hash(struct surface_t * s)
+{
+	return &__svg_raster.shash[((unsigned long)s >> 4) & (SVG_RASTER_HASH_SIZE - 1)];
+}
+
+static void svg_raster_entry_free(struct svg_raster_entry_t * e)
+{
+	if(e)
+	{
+		surface_free(e->s);
+		free(e);
+	}
+}
+
+/*
+ * Unlink an entry from the key hash, it keeps living until the last put
+ */
+static void svg_raster_unlink(struct svg_raster_entry_t * e, struct list_head * victims)
+{
+	hlist_del(&e->node);
+	list_del_init(&e->entry);
+	__svg_raster.bytes -= e->size;
+	e->svg = NULL;
+	if(e->ref == 0)
+	{
+		hlist_del(&e->snode);
+		list_add(&e->entry, victims);
+	}
+}
+
+static void svg_raster_evict(size_t budget, struct list_head * victims)
+{
+	struct svg_raster_entry_t * pos, * n;
+
+	list_for_each_entry_safe_reverse(pos, n, &__svg_raster.lru, entry)
+	{
+		if(__svg_raster.bytes <= budget)
+			break;
+		if(pos->ref == 0)
+			svg_raster_unlink(pos, victims);
+	}
+}
+
+static void svg_raster_free_victims(struct list_head * victims)
+{
+	struct svg_raster_entry_t * pos, * n;
+
+	list_for_each_entry_safe(pos, n, victims, entry)
+	{
+		list_del(&pos->entry);
+		svg_raster_entry_free(pos);
+	}
+}
+
+static struct svg_raster_entry_t * svg_raster_search(struct svg_t * svg, float sx, float sy, int px, int py, uint32_t tint)
+{
+	struct svg_raster_entry_t * pos;
+	struct hlist_node * n;
+
+	hlist_for_each_entry_safe(pos, n, svg_raster_hash(svg), node)
+	{
+		if((pos->svg == svg) && (pos->sx == sx) && (pos->sy == sy) && (pos->px == px) && (pos->py == py) && (pos->tint == tint))
+			return pos;
+	}
+	return NULL;
+}
+
+/*
+ * Get a referenced raster of the svg drawn at (tx, ty) with scale (sx, sy), the
+ * surface must be blitted at (x, y) and released with svg_raster_cache_put.
+ * Returns NULL if the svg is empty or too large to be cached.
+ */
+struct surface_t * svg_raster_cache_get(struct svg_t * svg, float tx, float ty, float sx, float sy, struct color_t * tint, int * x, int * y)
+{
+	struct svg_raster_entry_t * e, * o;
+	struct list_head victims;
+	struct region_t region;
+	struct surface_t * s;
+	irq_flags_t flags;
+	uint32_t t;
+	int ix, iy, px, py;
+
+	if(!svg || !x || !y)
+		return NULL;
+	ix = (int)floorf(tx);
+	iy = (int)floorf(ty);
+	px = (int)((tx - ix) * SVG_RASTER_PHASES) & (SVG_RASTER_PHASES - 1);
+	py = (int)((ty - iy) * SVG_RASTER_PHASES) & (SVG_RASTER_PHASES - 1);
+	t = tint ? (((uint32_t)tint->a << 24) | ((uint32_t)tint->r << 16) | ((uint32_t)tint->g << 8) | ((uint32_t)tint->b << 0)) : 0xffffffff;
+
+	spin_lock_irqsave(&__svg_raster.lock, flags);
+	e = svg_raster_search(svg, sx, sy, px, py, t);
+	if(e)
+	{
+		e->ref++;
+		list_move(&e->entry, &__svg_raster.lru);
+		spin_unlock_irqrestore(&__svg_raster.lock, flags);
+		*x = ix + e->x;
+		*y = iy + e->y;
+		return e->s;
+	}
+	spin_unlock_irqrestore(&__svg_raster.lock, flags);
+
+	if(!svg_raster_bounds(svg, sx, sy, &region))
+		return NULL;
+	if((size_t)region.w * region.h * 4 > __svg_raster.budget / 4)
+		return NULL;
+	e = malloc(sizeof(struct svg_raster_entry_t));
+	if(!e)
+		return NULL;
+	s = svg_raster_alloc(svg, (float)px / SVG_RASTER_PHASES, (float)py / SVG_RASTER_PHASES, sx, sy, &region, t);
+	if(!s)
+	{
+		free(e);
+		return NULL;
+	}
+	init_list_head(&e->entry);
+	init_hlist_node(&e->node);
+	init_hlist_node(&e->snode);
+	e->svg = svg;
+	e->sx = sx;
+	e->sy = sy;
+	e->px = px;
+	e->py = py;
+	e->tint = t;
+	e->x = region.x;
+	e->y = region.y;
+	e->ref = 1;
+	e->size = sizeof(struct surface_t) + s->pixlen;
+	e->s = s;
+
+	init_list_head(&victims);
+	spin_lock_irqsave(&__svg_raster.lock, flags);
+	o = svg_raster_search(svg, sx, sy, px, py, t);
+	if(o)
+	{
+		o->ref++;
+		list_move(&o->entry, &__svg_raster.lru);
+		list_add(&e->entry, &victims);
+		e = o;
+	}
+	else
+	{
+		hlist_add_head(&e->node, svg_raster_hash(svg));
+		hlist_add_head(&e->snode, svg_raster_surface_hash(s));
+		list_add(&e->entry, &__svg_raster.lru);
+		__svg_raster.bytes += e->size;
+		svg_raster_evict(__svg_raster.budget, &victims);
+	}
+	spin_unlock_irqrestore(&__svg_raster.lock, flags);
+	svg_raster_free_victims(&victims);
+	*x = ix + e->x;
+	*y = iy + e->y;
+	return e->s;
+}
+
+void svg_raster_cache_put(struct surface_t * s)
+{
+	struct svg_raster_entry_t * pos, * e = NULL;
+	struct hlist_node * n;
+	irq_flags_t flags;
+
+	if(!s)
+		return;
+	spin_lock_irqsave(&__svg_raster.lock, flags);
+	hlist_for_each_entry_safe(pos, n, svg_raster_surface_hash(s), snode)
+	{
+		if(pos->s == s)
+		{
+			if((--pos->ref == 0) && !pos->svg)
 			{
-				svg_reset_pool(&r);
-				r.freelist = NULL;
-				r.nedges = 0;
-				svg_flatten_shape_stroke(&r, shape, sx, sy);
-				for(i = 0; i < r.nedges; i++)
-				{
-					e = &r.edges[i];
-					e->x0 = tx + e->x0;
-					e->y0 = (ty + e->y0) * SVG_SUBSAMPLES;
-					e->x1 = tx + e->x1;
-					e->y1 = (ty + e->y1) * SVG_SUBSAMPLES;
-				}
-				qsort(r.edges, r.nedges, sizeof(struct svg_edge_t), svg_cmp_edge);
-				svg_init_paint(&cache, &shape->stroke, shape->opacity);
-				svg_rasterize_sorted_edges(&r, tx, ty, sx, sy, &cache, SVG_FILLRULE_NONZERO);
+				hlist_del(&pos->snode);
+				e = pos;
 			}
+			break;
 		}
-		svg_unpremultiply_alpha(r.bitmap, r.width, r.height, r.stride);
+	}
+	spin_unlock_irqrestore(&__svg_raster.lock, flags);
+	svg_raster_entry_free(e);
+}
+
+void svg_raster_cache_remove(struct svg_t * svg)
+{
+	struct svg_raster_entry_t * pos;
+	struct hlist_node * n;
+	struct list_head victims;
+	irq_flags_t flags;
+
+	if(!svg)
+		return;
+	init_list_head(&victims);
+	spin_lock_irqsave(&__svg_raster.lock, flags);
+	hlist_for_each_entry_safe(pos, n, svg_raster_hash(svg), node)
+	{
+		if(pos->svg == svg)
+			svg_raster_unlink(pos, &victims);
+	}
+	spin_unlock_irqrestore(&__svg_raster.lock, flags);
+	svg_raster_free_victims(&victims);
+}
 
-		p = r.pages;
-		while(p)
+void svg_raster_cache_shrink(void)
+{
+	struct list_head victims;
+	irq_flags_t flags;
+
+	init_list_head(&victims);
+	spin_lock_irqsave(&__svg_raster.lock, flags);
+	svg_raster_evict(0, &victims);
+	spin_unlock_irqrestore(&__svg_raster.lock, flags);
+	svg_raster_free_victims(&victims);
+}
+
+void render_default_shape_raster(struct surface_t * s, struct svg_t * svg, float tx, float ty, float sx, float sy)
+{
+	struct region_t region, clip;
+	struct surface_t * o;
+	struct matrix_t m;
+	int x, y;
+
+	if(!s || !svg)
+		return;
+	o = svg_raster_cache_get(svg, tx, ty, sx, sy, NULL, &x, &y);
+	if(o)
+	{
+		matrix_init_translate(&m, x, y);
+		render_default_blit(s, NULL, &m, o, RENDER_TYPE_FAST);
+		svg_raster_cache_put(o);
+	}
+	else if(svg_raster_bounds(svg, sx, sy, &region))
+	{
+		region.x += (int)floorf(tx);
+		region.y += (int)floorf(ty);
+		region_init(&clip, 0, 0, surface_get_width(s), surface_get_height(s));
+		if(region_intersect(&region, &region, &clip))
 		{
-			n = p->next;
-			free(p);
-			p = n;
+			o = svg_raster_alloc(svg, tx, ty, sx, sy, &region, 0xffffffff);
+			if(o)
+			{
+				matrix_init_translate(&m, region.x, region.y);
+				render_default_blit(s, NULL, &m, o, RENDER_TYPE_FAST);
+				surface_free(o);
+			}
 		}
-		if(r.edges)
-			free(r.edges);
-		if(r.points)
-			free(r.points);
-		if(r.points2)
-			free(r.points2);
-		if(r.scanline)
-			free(r.scanline);
 	}
 }
+
+static void svg_raster_shrink(struct shrinker_t * s)
+{
+	svg_raster_cache_shrink();
+}
+
+static struct shrinker_t __svg_raster_shrinker = {
+	.name = "svg-raster",
+	.shrink = svg_raster_shrink,
+};
+
+static __init void svg_raster_init(void)
+{
+	int i;
+
+	for(i = 0; i < SVG_RASTER_HASH_SIZE; i++)
+	{
+		init_hlist_head(&__svg_raster.hash[i]);
+		init_hlist_head(&__svg_raster.shash[i]);
+	}
+	register_shrinker(&__svg_raster_shrinker);
+}
+core_initcall(svg_raster_init);
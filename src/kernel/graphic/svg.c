@@ -2721,6 +2721,379 @@ static void svg_scale_to_viewbox(struct svg_parser_t * p, const char * units)
 	}
 }
 
+/*
+ * The compiled form is a flat image of the parsed tree, native endian and four
+ * bytes aligned, so it can be loaded straight from memory without any xml work.
+ * All links are stored as indexes into the record arrays following the header.
+ */
+#define SVG_COMPILED_MAGIC		(0x47565358)	/* "XSVG" */
+#define SVG_COMPILED_VERSION	(1)
+#define SVG_COMPILED_ENDIAN		(0x01020304)
+
+struct svg_compiled_header_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t endian;
+	uint32_t size;
+	float width;
+	float height;
+	uint32_t nshapes;
+	uint32_t npaths;
+	uint32_t ngradients;
+	uint32_t nstops;
+	uint32_t npts;
+};
+
+struct svg_compiled_paint_t {
+	uint32_t type;
+	uint32_t value;
+};
+
+struct svg_compiled_shape_t {
+	char id[64];
+	struct svg_compiled_paint_t fill;
+	struct svg_compiled_paint_t stroke;
+	float opacity;
+	float stroke_width;
+	float stroke_dash_offset;
+	float stroke_dash_array[SVG_MAX_DASHES];
+	uint32_t stroke_dash_count;
+	uint32_t stroke_line_join;
+	uint32_t stroke_line_cap;
+	float miter_limit;
+	uint32_t fill_rule;
+	uint32_t visible;
+	float bounds[4];
+	uint32_t path;
+	uint32_t npaths;
+};
+
+struct svg_compiled_path_t {
+	uint32_t pts;
+	uint32_t npts;
+	uint32_t closed;
+	float bounds[4];
+};
+
+struct svg_compiled_gradient_t {
+	float xform[6];
+	uint32_t spread;
+	float fx, fy;
+	uint32_t stop;
+	uint32_t nstops;
+};
+
+struct svg_compiled_stop_t {
+	uint32_t color;
+	float offset;
+};
+
+static inline uint32_t svg_color_pack(struct color_t * c)
+{
+	return (c->a << 24) | (c->b << 16) | (c->g << 8) | (c->r << 0);
+}
+
+static inline void svg_color_unpack(struct color_t * c, uint32_t v)
+{
+	c->r = (v >> 0) & 0xff;
+	c->g = (v >> 8) & 0xff;
+	c->b = (v >> 16) & 0xff;
+	c->a = (v >> 24) & 0xff;
+}
+
+static inline int svg_paint_is_gradient(struct svg_paint_t * paint)
+{
+	return ((paint->type == SVG_PAINT_LINEAR_GRADIENT) || (paint->type == SVG_PAINT_RADIAL_GRADIENT));
+}
+
+static void svg_compile_count(struct svg_t * svg, struct svg_compiled_header_t * h)
+{
+	struct svg_shape_t * shape;
+	struct svg_path_t * path;
+
+	memset(h, 0, sizeof(struct svg_compiled_header_t));
+	h->magic = SVG_COMPILED_MAGIC;
+	h->version = SVG_COMPILED_VERSION;
+	h->endian = SVG_COMPILED_ENDIAN;
+	h->width = svg->width;
+	h->height = svg->height;
+	for(shape = svg->shapes; shape != NULL; shape = shape->next)
+	{
+		h->nshapes++;
+		for(path = shape->paths; path != NULL; path = path->next)
+		{
+			h->npaths++;
+			h->npts += path->npts;
+		}
+		if(svg_paint_is_gradient(&shape->fill))
+		{
+			h->ngradients++;
+			h->nstops += shape->fill.gradient->nstops;
+		}
+		if(svg_paint_is_gradient(&shape->stroke))
+		{
+			h->ngradients++;
+			h->nstops += shape->stroke.gradient->nstops;
+		}
+	}
+	h->size = sizeof(struct svg_compiled_header_t)
+		+ h->nshapes * sizeof(struct svg_compiled_shape_t)
+		+ h->npaths * sizeof(struct svg_compiled_path_t)
+		+ h->ngradients * sizeof(struct svg_compiled_gradient_t)
+		+ h->nstops * sizeof(struct svg_compiled_stop_t)
+		+ h->npts * 2 * sizeof(float);
+}
+
+static void svg_compile_paint(struct svg_compiled_paint_t * cp, struct svg_paint_t * paint, struct svg_compiled_gradient_t * cg, struct svg_compiled_stop_t * cs, uint32_t * ngradients, uint32_t * nstops)
+{
+	struct svg_gradient_t * grad;
+	int i;
+
+	cp->type = paint->type;
+	if(svg_paint_is_gradient(paint))
+	{
+		grad = paint->gradient;
+		cg = &cg[*ngradients];
+		memcpy(cg->xform, grad->xform, sizeof(float) * 6);
+		cg->spread = grad->spread;
+		cg->fx = grad->fx;
+		cg->fy = grad->fy;
+		cg->stop = *nstops;
+		cg->nstops = grad->nstops;
+		for(i = 0; i < grad->nstops; i++)
+		{
+			cs[*nstops + i].color = svg_color_pack(&grad->stops[i].color);
+			cs[*nstops + i].offset = grad->stops[i].offset;
+		}
+		cp->value = (*ngradients)++;
+		*nstops += grad->nstops;
+	}
+	else if(paint->type == SVG_PAINT_COLOR)
+		cp->value = svg_color_pack(&paint->color);
+	else
+		cp->value = 0;
+}
+
+/*
+ * Serialize the svg into buf, with a null buf just return the size needed.
+ * Returns zero if the buffer is too small.
+ */
+size_t svg_compile(struct svg_t * svg, void * buf, size_t size)
+{
+	struct svg_compiled_header_t h;
+	struct svg_compiled_shape_t * cshape;
+	struct svg_compiled_path_t * cpath;
+	struct svg_compiled_gradient_t * cgrad;
+	struct svg_compiled_stop_t * cstop;
+	struct svg_shape_t * shape;
+	struct svg_path_t * path;
+	uint32_t npaths = 0, ngradients = 0, nstops = 0, npts = 0;
+	float * pts;
+
+	if(!svg)
+		return 0;
+	svg_compile_count(svg, &h);
+	if(!buf)
+		return h.size;
+	if(size < h.size)
+		return 0;
+
+	memset(buf, 0, h.size);
+	memcpy(buf, &h, sizeof(struct svg_compiled_header_t));
+	cshape = (struct svg_compiled_shape_t *)((char *)buf + sizeof(struct svg_compiled_header_t));
+	cpath = (struct svg_compiled_path_t *)(cshape + h.nshapes);
+	cgrad = (struct svg_compiled_gradient_t *)(cpath + h.npaths);
+	cstop = (struct svg_compiled_stop_t *)(cgrad + h.ngradients);
+	pts = (float *)(cstop + h.nstops);
+
+	for(shape = svg->shapes; shape != NULL; shape = shape->next, cshape++)
+	{
+		memcpy(cshape->id, shape->id, sizeof(cshape->id));
+		svg_compile_paint(&cshape->fill, &shape->fill, cgrad, cstop, &ngradients, &nstops);
+		svg_compile_paint(&cshape->stroke, &shape->stroke, cgrad, cstop, &ngradients, &nstops);
+		cshape->opacity = shape->opacity;
+		cshape->stroke_width = shape->stroke_width;
+		cshape->stroke_dash_offset = shape->stroke_dash_offset;
+		memcpy(cshape->stroke_dash_array, shape->stroke_dash_array, sizeof(cshape->stroke_dash_array));
+		cshape->stroke_dash_count = shape->stroke_dash_count;
+		cshape->stroke_line_join = shape->stroke_line_join;
+		cshape->stroke_line_cap = shape->stroke_line_cap;
+		cshape->miter_limit = shape->miter_limit;
+		cshape->fill_rule = shape->fill_rule;
+		cshape->visible = shape->visible;
+		memcpy(cshape->bounds, shape->bounds, sizeof(float) * 4);
+		cshape->path = npaths;
+		for(path = shape->paths; path != NULL; path = path->next, npaths++)
+		{
+			cpath[npaths].pts = npts;
+			cpath[npaths].npts = path->npts;
+			cpath[npaths].closed = path->closed;
+			memcpy(cpath[npaths].bounds, path->bounds, sizeof(float) * 4);
+			memcpy(&pts[npts * 2], path->pts, sizeof(float) * 2 * path->npts);
+			npts += path->npts;
+		}
+		cshape->npaths = npaths - cshape->path;
+	}
+	return h.size;
+}
+
+static int svg_compiled_check_paint(const struct svg_compiled_paint_t * cp, const struct svg_compiled_header_t * h)
+{
+	switch(cp->type)
+	{
+	case SVG_PAINT_NONE:
+	case SVG_PAINT_COLOR:
+		return 1;
+	case SVG_PAINT_LINEAR_GRADIENT:
+	case SVG_PAINT_RADIAL_GRADIENT:
+		return (cp->value < h->ngradients);
+	default:
+		break;
+	}
+	return 0;
+}
+
+static void svg_compiled_load_paint(struct svg_paint_t * paint, const struct svg_compiled_paint_t * cp, struct svg_gradient_t ** grads)
+{
+	paint->type = cp->type;
+	if(svg_paint_is_gradient(paint))
+		paint->gradient = grads[cp->value];
+	else if(paint->type == SVG_PAINT_COLOR)
+		svg_color_unpack(&paint->color, cp->value);
+}
+
+/*
+ * Build the svg from a compiled image, everything lives in a single allocation
+ * so the buffer may be released or unmapped right after this returns.
+ */
+struct svg_t * svg_alloc_from_compiled(const void * buf, size_t len)
+{
+	const struct svg_compiled_header_t * h = buf;
+	const struct svg_compiled_shape_t * cshape;
+	const struct svg_compiled_path_t * cpath;
+	const struct svg_compiled_gradient_t * cgrad;
+	const struct svg_compiled_stop_t * cstop;
+	const float * cpts;
+	struct svg_gradient_t ** grads;
+	struct svg_gradient_t * grad;
+	struct svg_shape_t * shapes;
+	struct svg_path_t * paths;
+	struct svg_t * svg;
+	float * pts;
+	size_t size, gsize;
+	char * p;
+	uint32_t i, j;
+
+	if(!buf || (len < sizeof(struct svg_compiled_header_t)))
+		return NULL;
+	if((h->magic != SVG_COMPILED_MAGIC) || (h->version != SVG_COMPILED_VERSION) || (h->endian != SVG_COMPILED_ENDIAN))
+		return NULL;
+	if((h->size > len) || (h->nshapes > len) || (h->npaths > len) || (h->ngradients > len) || (h->nstops > len) || (h->npts > len))
+		return NULL;
+	size = sizeof(struct svg_compiled_header_t)
+		+ (size_t)h->nshapes * sizeof(struct svg_compiled_shape_t)
+		+ (size_t)h->npaths * sizeof(struct svg_compiled_path_t)
+		+ (size_t)h->ngradients * sizeof(struct svg_compiled_gradient_t)
+		+ (size_t)h->nstops * sizeof(struct svg_compiled_stop_t)
+		+ (size_t)h->npts * 2 * sizeof(float);
+	if(size != h->size)
+		return NULL;
+
+	cshape = (const struct svg_compiled_shape_t *)(h + 1);
+	cpath = (const struct svg_compiled_path_t *)(cshape + h->nshapes);
+	cgrad = (const struct svg_compiled_gradient_t *)(cpath + h->npaths);
+	cstop = (const struct svg_compiled_stop_t *)(cgrad + h->ngradients);
+	cpts = (const float *)(cstop + h->nstops);
+
+	for(i = 0, gsize = 0; i < h->ngradients; i++)
+	{
+		if((cgrad[i].nstops < 1) || (cgrad[i].stop > h->nstops) || (cgrad[i].nstops > h->nstops - cgrad[i].stop))
+			return NULL;
+		gsize += sizeof(struct svg_gradient_t) + sizeof(struct svg_gradient_stop_t) * (cgrad[i].nstops - 1);
+	}
+	for(i = 0; i < h->npaths; i++)
+	{
+		if((cpath[i].npts < 1) || (cpath[i].pts > h->npts) || (cpath[i].npts > h->npts - cpath[i].pts))
+			return NULL;
+	}
+	for(i = 0; i < h->nshapes; i++)
+	{
+		if((cshape[i].npaths < 1) || (cshape[i].path > h->npaths) || (cshape[i].npaths > h->npaths - cshape[i].path))
+			return NULL;
+		if((cshape[i].stroke_dash_count > SVG_MAX_DASHES) || !svg_compiled_check_paint(&cshape[i].fill, h) || !svg_compiled_check_paint(&cshape[i].stroke, h))
+			return NULL;
+	}
+
+	p = malloc(sizeof(struct svg_t)
+		+ h->nshapes * sizeof(struct svg_shape_t)
+		+ h->npaths * sizeof(struct svg_path_t)
+		+ h->ngradients * sizeof(struct svg_gradient_t *)
+		+ h->npts * 2 * sizeof(float)
+		+ gsize);
+	if(!p)
+		return NULL;
+	svg = (struct svg_t *)p;
+	shapes = (struct svg_shape_t *)(svg + 1);
+	paths = (struct svg_path_t *)(shapes + h->nshapes);
+	grads = (struct svg_gradient_t **)(paths + h->npaths);
+	pts = (float *)(grads + h->ngradients);
+	p = (char *)(pts + h->npts * 2);
+
+	memcpy(pts, cpts, h->npts * 2 * sizeof(float));
+	for(i = 0; i < h->ngradients; i++)
+	{
+		grad = (struct svg_gradient_t *)p;
+		memcpy(grad->xform, cgrad[i].xform, sizeof(float) * 6);
+		grad->spread = cgrad[i].spread;
+		grad->fx = cgrad[i].fx;
+		grad->fy = cgrad[i].fy;
+		grad->nstops = cgrad[i].nstops;
+		for(j = 0; j < cgrad[i].nstops; j++)
+		{
+			svg_color_unpack(&grad->stops[j].color, cstop[cgrad[i].stop + j].color);
+			grad->stops[j].offset = cstop[cgrad[i].stop + j].offset;
+		}
+		grads[i] = grad;
+		p += sizeof(struct svg_gradient_t) + sizeof(struct svg_gradient_stop_t) * (cgrad[i].nstops - 1);
+	}
+	for(i = 0; i < h->npaths; i++)
+	{
+		paths[i].pts = &pts[cpath[i].pts * 2];
+		paths[i].npts = cpath[i].npts;
+		paths[i].closed = cpath[i].closed;
+		memcpy(paths[i].bounds, cpath[i].bounds, sizeof(float) * 4);
+		paths[i].next = NULL;
+	}
+	for(i = 0; i < h->nshapes; i++)
+	{
+		memcpy(shapes[i].id, cshape[i].id, sizeof(shapes[i].id));
+		shapes[i].id[sizeof(shapes[i].id) - 1] = '\0';
+		svg_compiled_load_paint(&shapes[i].fill, &cshape[i].fill, grads);
+		svg_compiled_load_paint(&shapes[i].stroke, &cshape[i].stroke, grads);
+		shapes[i].opacity = cshape[i].opacity;
+		shapes[i].stroke_width = cshape[i].stroke_width;
+		shapes[i].stroke_dash_offset = cshape[i].stroke_dash_offset;
+		memcpy(shapes[i].stroke_dash_array, cshape[i].stroke_dash_array, sizeof(shapes[i].stroke_dash_array));
+		shapes[i].stroke_dash_count = cshape[i].stroke_dash_count;
+		shapes[i].stroke_line_join = cshape[i].stroke_line_join;
+		shapes[i].stroke_line_cap = cshape[i].stroke_line_cap;
+		shapes[i].miter_limit = cshape[i].miter_limit;
+		shapes[i].fill_rule = cshape[i].fill_rule;
+		shapes[i].visible = cshape[i].visible;
+		memcpy(shapes[i].bounds, cshape[i].bounds, sizeof(float) * 4);
+		shapes[i].paths = &paths[cshape[i].path];
+		for(j = cshape[i].path; j < cshape[i].path + cshape[i].npaths - 1; j++)
+			paths[j].next = &paths[j + 1];
+		shapes[i].next = (i + 1 < h->nshapes) ? &shapes[i + 1] : NULL;
+	}
+	svg->width = h->width;
+	svg->height = h->height;
+	svg->shapes = (h->nshapes > 0) ? shapes : NULL;
+	svg->compiled = 1;
+
+	return svg;
+}
+
 struct svg_t * svg_alloc(char * svgstr)
 {
 	struct svg_parser_t * p;
@@ -2764,7 +3137,10 @@ struct svg_t * svg_alloc_from_xfs(struct xfs_context_t * ctx, const char * filen
 	xfs_read(file, buf, len);
 	buf[len] = '\0';
 	xfs_close(file);
-	svg = svg_alloc(buf);
+	if((len >= sizeof(struct svg_compiled_header_t)) && (((struct svg_compiled_header_t *)buf)->magic == SVG_COMPILED_MAGIC))
+		svg = svg_alloc_from_compiled(buf, len);
+	else
+		svg = svg_alloc(buf);
 	free(buf);
 
 	return svg;
@@ -2777,6 +3153,12 @@ void svg_free(struct svg_t * svg)
 
 	if(svg)
 	{
+		svg_raster_cache_remove(svg);
+		if(svg->compiled)
+		{
+			free(svg);
+			return;
+		}
 		shape = svg->shapes;
 		while(shape)
 		{
@@ -38,14 +38,21 @@
 #include FT_FREETYPE_H
 #include FT_CACHE_MANAGER_H
 
-static void text_metrics(struct text_t * txt)
+/*
+ * Line breaking shared by the cached layout and the uncached metrics, glyphs
+ * come from the atlas and are placed into the run when one is given.
+ */
+static void text_walk(struct text_t * txt, struct font_run_t * run)
 {
+	struct font_context_t * ctx = txt->fctx;
+	struct font_glyph_t * g, sg;
 	FTC_SBit sbit;
 	const char * p;
 	uint32_t code;
 	int col = 0, row = 0;
 	int tw = 0, th = 0, lh = 0;
 	int x = 0, y = 0, w = 0, h = 0;
+	int px = 0, py = 0, tx = 0, ty = 0;
 
 	p = txt->utf8;
 	while(*p)
@@ -55,11 +62,12 @@ static void text_metrics(struct text_t * txt)
 		{
 		case '\r':
 			tw = 0;
-			th += 0;
 			if(tw > w)
 				w = tw;
 			if(th > h)
 				h = th;
+			px = tx = 0;
+			py = ty;
 			col = 0;
 			break;
 
@@ -71,25 +79,47 @@ static void text_metrics(struct text_t * txt)
 				w = tw;
 			if(th > h)
 				h = th;
+			ty += txt->size;
+			px = tx = 0;
+			py = ty;
 			col = 0;
 			row++;
 			break;
 
 		case '\t':
+			tx += txt->size * 2;
 			tw += txt->size * 2;
-			th += 0;
 			if(tw > w)
 				w = tw;
 			if(th > h)
 				h = th;
+			px = tx;
+			py = ty;
 			col++;
 			break;
 
 		default:
-			sbit = (FTC_SBit)font_lookup_bitmap(txt->fctx, txt->family, txt->size, code);
-			if(sbit)
+			if(run)
 			{
-				if((txt->wrap > 0) && (tw + sbit->xadvance > txt->wrap))
+				g = font_atlas_lookup(ctx, txt->family, txt->size, code);
+			}
+			else if((sbit = (FTC_SBit)font_lookup_bitmap(ctx, txt->family, txt->size, code)))
+			{
+				sg.w = sbit->width;
+				sg.h = sbit->height;
+				sg.left = sbit->left;
+				sg.top = sbit->top;
+				sg.xadvance = sbit->xadvance;
+				sg.yadvance = sbit->yadvance;
+				g = &sg;
+			}
+			else
+			{
+				g = NULL;
+			}
+			if(g)
+			{
+				if((txt->wrap > 0) && (tw + g->xadvance > txt->wrap))
 				{
 					tw = 0;
 					th += txt->size;
@@ -98,26 +128,37 @@ static void text_metrics(struct text_t * txt)
 						w = tw;
 					if(th > h)
 						h = th;
+					ty += txt->size;
+					px = tx = 0;
+					py = ty;
 					col = 0;
 					row++;
 				}
-				tw += sbit->xadvance;
-				th += 0;
-				if(sbit->yadvance + sbit->height > lh)
-					lh = sbit->yadvance + sbit->height;
+				if(run && (g->w > 0) && (g->h > 0))
+				{
+					run->glyph[run->nglyph].g = g;
+					run->glyph[run->nglyph].x = px;
+					run->glyph[run->nglyph].y = py - g->top;
+					run->nglyph++;
+				}
+				px += g->xadvance;
+				py += g->yadvance;
+				tw += g->xadvance;
+				if(g->yadvance + g->h > lh)
+					lh = g->yadvance + g->h;
 				if(tw > w)
 					w = tw;
 				if(th > h)
 					h = th;
 				if(col == 0)
 				{
-					if(sbit->left > x)
-						x = sbit->left;
+					if(g->left > x)
+						x = g->left;
 				}
 				if(row == 0)
 				{
-					if(sbit->top > y)
-						y = sbit->top;
+					if(g->top > y)
+						y = g->top;
 				}
 			}
 			col++;
@@ -130,6 +171,57 @@ static void text_metrics(struct text_t * txt)
 	txt->metrics.height = h + lh;
 }
 
+static struct font_run_t * text_layout(struct text_t * txt)
+{
+	struct font_context_t * ctx = txt->fctx;
+	struct font_run_t * run;
+	const char * p;
+	uint32_t code;
+	int retry, n;
+
+	run = font_run_search(ctx, txt->utf8, txt->family, txt->size, txt->wrap);
+	if(run)
+		return run;
+
+	for(n = 0, p = txt->utf8; *p; n++)
+		p = utf8_to_code(p, &code);
+
+	for(retry = 0; retry < 2; retry++)
+	{
+		run = font_run_alloc(ctx, txt->utf8, txt->family, txt->size, txt->wrap, n);
+		if(!run)
+			return NULL;
+		text_walk(txt, run);
+		run->metrics.ox = txt->metrics.ox;
+		run->metrics.oy = txt->metrics.oy;
+		run->metrics.width = txt->metrics.width;
+		run->metrics.height = txt->metrics.height;
+
+		if(run->generation == ctx->atlas.generation)
+		{
+			font_run_cache(ctx, run);
+			return run;
+		}
+		font_run_free(run);
+	}
+	return NULL;
+}
+
+static void text_metrics(struct text_t * txt)
+{
+	struct font_run_t * run;
+
+	if((run = text_layout(txt)))
+	{
+		txt->metrics.ox = run->metrics.ox;
+		txt->metrics.oy = run->metrics.oy;
+		txt->metrics.width = run->metrics.width;
+		txt->metrics.height = run->metrics.height;
+		return;
+	}
+	text_walk(txt, NULL);
+}
+
 void text_init(struct text_t * txt, const char * utf8, struct color_t * c, int wrap, struct font_context_t * fctx, const char * family, int size)
 {
 	if(txt)
@@ -186,7 +278,7 @@ void text_set_size(struct text_t * txt, int size)
 	}
 }
 
-static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip, struct color_t * c, int x, int y, FTC_SBit sbit)
+static inline void draw_font_mask(struct surface_t * s, struct region_t * clip, struct color_t * c, int x, int y, uint8_t * mask, int width, int height, int pitch)
 {
 	struct region_t region, r;
 	uint32_t color;
@@ -206,7 +298,7 @@ static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip
 		if(!region_intersect(&r, &r, clip))
 			return;
 	}
-	region_init(&region, x, y, sbit->width, sbit->height);
+	region_init(&region, x, y, width, height);
 	if(!region_intersect(&r, &r, &region))
 		return;
 
@@ -217,9 +309,14 @@ static inline void draw_font_bitmap(struct surface_t * s, struct region_t * clip
 	sx = r.x - x;
 	sy = r.y - y;
 	dskip = s->width - dw;
-	sskip = sbit->pitch - dw;
+	sskip = pitch - dw;
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		render_default_mask(s, &r, c, mask + sy * pitch + sx, pitch);
+		return;
+	}
 	dp = (uint32_t *)s->pixels + dy * s->width + dx;
-	sp = (uint8_t *)sbit->buffer + sy * sbit->pitch + sx;
+	sp = mask + sy * pitch + sx;
 	color = (c->a << 24) | (c->r << 16) | (c->g << 8) | (c->b << 0);
 
 	for(j = 0; j < dh; j++)
@@ -292,6 +389,11 @@ static inline void draw_font_glyph(struct surface_t * s, struct region_t * clip,
 	sy = r.y - y;
 	dskip = s->width - dw;
 	sskip = bitmap->pitch - dw;
+	if(s->format != SURFACE_FORMAT_ARGB32)
+	{
+		render_default_mask(s, &r, c, (uint8_t *)bitmap->buffer + sy * bitmap->pitch + sx, bitmap->pitch);
+		return;
+	}
 	dp = (uint32_t *)s->pixels + dy * s->width + dx;
 	sp = (uint8_t *)bitmap->buffer + sy * bitmap->pitch + sx;
 	color = color_get_premult(c);
@@ -336,6 +438,8 @@ static inline void draw_font_glyph(struct surface_t * s, struct region_t * clip,
 
 void render_default_text(struct surface_t * s, struct region_t * clip, struct matrix_t * m, struct text_t * txt)
 {
+	struct font_run_t * run;
+	struct font_glyph_t * g;
 	FTC_SBit sbit;
 	FT_BitmapGlyph bitmap;
 	FT_Glyph glyph, gly;
@@ -344,8 +448,22 @@ void render_default_text(struct surface_t * s, struct region_t * clip, struct ma
 	const char * p;
 	uint32_t code;
 	int tx, ty, tw;
+	int i;
 
-	if((m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0))
+	if((m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0) && (run = text_layout(txt)))
+	{
+		tx = run->metrics.ox;
+		ty = run->metrics.oy;
+		for(i = 0; i < run->nglyph; i++)
+		{
+			g = run->glyph[i].g;
+			if(g->page)
+				draw_font_mask(s, clip, txt->c, (int)(m->tx + tx + run->glyph[i].x), (int)(m->ty + ty + run->glyph[i].y), g->page->pixels + g->y * g->page->width + g->x, g->w, g->h, g->page->width);
+			else if((sbit = (FTC_SBit)font_lookup_bitmap(txt->fctx, txt->family, txt->size, g->code)) && sbit->buffer)
+				draw_font_mask(s, clip, txt->c, (int)(m->tx + tx + run->glyph[i].x), (int)(m->ty + ty + run->glyph[i].y), sbit->buffer, sbit->width, sbit->height, sbit->pitch);
+		}
+	}
+	else if((m->a == 1.0) && (m->b == 0.0) && (m->c == 0.0) && (m->d == 1.0))
 	{
 		tx = txt->metrics.ox;
 		ty = txt->metrics.oy;
@@ -397,7 +515,7 @@ void render_default_text(struct surface_t * s, struct region_t * clip, struct ma
 					}
 					tw += sbit->xadvance;
 					{
-						draw_font_bitmap(s, clip, txt->c, pen.x, pen.y - sbit->top, sbit);
+						draw_font_mask(s, clip, txt->c, pen.x, pen.y - sbit->top, sbit->buffer, sbit->width, sbit->height, sbit->pitch);
 						pen.x += sbit->xadvance;
 						pen.y += sbit->yadvance;
 					}
@@ -0,0 +1,231 @@
+/*
+ * kernel/vision/morphology.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <xboot.h>
+#include <vision/morphology.h>
+
+/*
+ * Separable van Herk/Gil-Werman min/max filter. A window of (2 * r + 1) costs three
+ * compares per pixel and direction whatever the radius. Pixels outside the image are
+ * ignored, which is the same as replicating the edge.
+ *
+ * Both passes work in place with one scratch image: the backward partial results go
+ * to scratch, the forward ones overwrite the source and are read at least one step
+ * ahead of the output, so the output can be written over them.
+ */
+static inline __attribute__((always_inline)) unsigned char morph_pick(unsigned char a, unsigned char b, int dilate)
+{
+	if(dilate)
+		return (a > b) ? a : b;
+	return (a < b) ? a : b;
+}
+
+static inline __attribute__((always_inline)) void morph_row(unsigned char * p, unsigned char * h, int n, int r, const unsigned char * lut, int dilate)
+{
+	int k = 2 * r + 1;
+	int i, j, e, lo, hi;
+
+	for(i = 0; i < n; i += k)
+	{
+		e = min(i + k, n) - 1;
+		h[e] = lut[p[e]];
+		for(j = e - 1; j >= i; j--)
+			h[j] = morph_pick(lut[p[j]], h[j + 1], dilate);
+		p[i] = lut[p[i]];
+		for(j = i + 1; j <= e; j++)
+			p[j] = morph_pick(lut[p[j]], p[j - 1], dilate);
+	}
+	e = min(r, n);
+	for(i = 0; i < e; i++)
+	{
+		hi = min(i + r, n - 1);
+		p[i] = (hi < k) ? p[hi] : morph_pick(h[0], p[hi], dilate);
+	}
+	for(; i < n - r; i++)
+		p[i] = morph_pick(h[i - r], p[i + r], dilate);
+	for(; i < n; i++)
+	{
+		lo = i - r;
+		if(lo / k != (n - 1) / k)
+			p[i] = morph_pick(h[lo], p[n - 1], dilate);
+		else
+			p[i] = (lo % k) ? h[lo] : p[n - 1];
+	}
+}
+
+static inline __attribute__((always_inline)) void morph_span(unsigned char * d, const unsigned char * a, const unsigned char * b, int n, int dilate)
+{
+	for(int x = 0; x < n; x++)
+		d[x] = morph_pick(a[x], b[x], dilate);
+}
+
+static inline __attribute__((always_inline)) void morph_span_lut(unsigned char * d, const unsigned char * a, const unsigned char * b, int n, const unsigned char * lut, int dilate)
+{
+	for(int x = 0; x < n; x++)
+		d[x] = lut[morph_pick(a[x], b[x], dilate)];
+}
+
+static inline __attribute__((always_inline)) void morph_copy_lut(unsigned char * d, const unsigned char * a, int n, const unsigned char * lut)
+{
+	for(int x = 0; x < n; x++)
+		d[x] = lut[a[x]];
+}
+
+/*
+ * The vertical pass, done a whole span of a row at a time so the inner loops are
+ * plain byte wise min/max over contiguous memory
+ */
+static inline __attribute__((always_inline)) void morph_cols(unsigned char * p, unsigned char * h, int stride, int w, int n, int r, const unsigned char * lut, int dilate)
+{
+	int k = 2 * r + 1;
+	int i, j, e, lo, hi;
+
+	for(i = 0; i < n; i += k)
+	{
+		e = min(i + k, n) - 1;
+		memcpy(&h[e * stride], &p[e * stride], w);
+		for(j = e - 1; j >= i; j--)
+			morph_span(&h[j * stride], &p[j * stride], &h[(j + 1) * stride], w, dilate);
+		for(j = i + 1; j <= e; j++)
+			morph_span(&p[j * stride], &p[j * stride], &p[(j - 1) * stride], w, dilate);
+	}
+	e = min(r, n);
+	for(i = 0; i < e; i++)
+	{
+		hi = min(i + r, n - 1);
+		if(hi < k)
+			morph_copy_lut(&p[i * stride], &p[hi * stride], w, lut);
+		else
+			morph_span_lut(&p[i * stride], &h[0], &p[hi * stride], w, lut, dilate);
+	}
+	for(; i < n - r; i++)
+		morph_span_lut(&p[i * stride], &h[(i - r) * stride], &p[(i + r) * stride], w, lut, dilate);
+	for(; i < n; i++)
+	{
+		lo = i - r;
+		if(lo / k != (n - 1) / k)
+			morph_span_lut(&p[i * stride], &h[lo * stride], &p[(n - 1) * stride], w, lut, dilate);
+		else if(lo % k)
+			morph_copy_lut(&p[i * stride], &h[lo * stride], w, lut);
+		else
+			morph_copy_lut(&p[i * stride], &p[(n - 1) * stride], w, lut);
+	}
+}
+
+struct morph_job_t {
+	unsigned char * datas;
+	unsigned char * scratch;
+	const unsigned char * lut;
+	int width;
+	int height;
+	int radius;
+};
+
+static void morph_rows_erode(int start, int end, void * data)
+{
+	struct morph_job_t * job = (struct morph_job_t *)data;
+	for(int y = start; y < end; y++)
+		morph_row(&job->datas[y * job->width], &job->scratch[y * job->width], job->width, job->radius, job->lut, 0);
+}
+
+static void morph_rows_dilate(int start, int end, void * data)
+{
+	struct morph_job_t * job = (struct morph_job_t *)data;
+	for(int y = start; y < end; y++)
+		morph_row(&job->datas[y * job->width], &job->scratch[y * job->width], job->width, job->radius, job->lut, 1);
+}
+
+static void morph_cols_erode(int start, int end, void * data)
+{
+	struct morph_job_t * job = (struct morph_job_t *)data;
+	morph_cols(&job->datas[start], &job->scratch[start], job->width, end - start, job->height, job->radius, job->lut, 0);
+}
+
+static void morph_cols_dilate(int start, int end, void * data)
+{
+	struct morph_job_t * job = (struct morph_job_t *)data;
+	morph_cols(&job->datas[start], &job->scratch[start], job->width, end - start, job->height, job->radius, job->lut, 1);
+}
+
+/*
+ * Horizontal pass over a gray image, the lut is applied to every source pixel
+ * before it is compared. Scratch must hold width * height bytes.
+ */
+void vision_morphology_rows(unsigned char * datas, unsigned char * scratch, int width, int height, int radius, const unsigned char * lut, enum vision_morphology_t type)
+{
+	struct morph_job_t job;
+
+	if(!datas || !scratch || !lut || (width <= 0) || (height <= 0) || (radius <= 0))
+		return;
+	job.datas = datas;
+	job.scratch = scratch;
+	job.lut = lut;
+	job.width = width;
+	job.height = height;
+	job.radius = radius;
+	parallel_for(height, (width * height >= 320 * 240) ? 16 : height, (type == VISION_MORPHOLOGY_DILATE) ? morph_rows_dilate : morph_rows_erode, &job);
+}
+
+/*
+ * Vertical pass over a gray image, the lut is applied to every result pixel.
+ * Columns are split into spans of 64 bytes between the workers.
+ */
+void vision_morphology_cols(unsigned char * datas, unsigned char * scratch, int width, int height, int radius, const unsigned char * lut, enum vision_morphology_t type)
+{
+	struct morph_job_t job;
+
+	if(!datas || !scratch || !lut || (width <= 0) || (height <= 0) || (radius <= 0))
+		return;
+	job.datas = datas;
+	job.scratch = scratch;
+	job.lut = lut;
+	job.width = width;
+	job.height = height;
+	job.radius = radius;
+	parallel_for(width, (width * height >= 320 * 240) ? 64 : width, (type == VISION_MORPHOLOGY_DILATE) ? morph_cols_dilate : morph_cols_erode, &job);
+}
+
+void vision_morphology(struct vision_t * v, int rx, int ry, enum vision_morphology_t type)
+{
+	if(v && (v->type == VISION_TYPE_GRAY) && ((rx > 0) || (ry > 0)))
+	{
+		unsigned char * scratch;
+		unsigned char lut[256];
+
+		scratch = malloc(v->npixel);
+		if(scratch)
+		{
+			for(int i = 0; i < 256; i++)
+				lut[i] = i;
+			vision_morphology_rows(v->datas, scratch, v->width, v->height, rx, lut, type);
+			vision_morphology_cols(v->datas, scratch, v->width, v->height, ry, lut, type);
+			free(scratch);
+		}
+	}
+}
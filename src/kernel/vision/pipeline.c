@@ -0,0 +1,228 @@
+/*
+ * kernel/vision/pipeline.c
+ *
+ * Copyright(c) 2007-2021 Jianjun Jiang <8192542@qq.com>
+ * Official site: http://xboot.org
+ * Mobile phone: +86-18665388956
+ * QQ: 8192542
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+
+#include <xboot.h>
+#include <vision/threshold.h>
+#include <vision/morphology.h>
+#include <vision/pipeline.h>
+
+struct vision_pipeline_t * vision_pipeline_alloc(void)
+{
+	struct vision_pipeline_t * p;
+
+	p = malloc(sizeof(struct vision_pipeline_t));
+	if(!p)
+		return NULL;
+	p->nstep = 0;
+	p->scratch = NULL;
+	p->nscratch = 0;
+	return p;
+}
+
+void vision_pipeline_free(struct vision_pipeline_t * p)
+{
+	if(p)
+	{
+		if(p->scratch)
+			free(p->scratch);
+		free(p);
+	}
+}
+
+void vision_pipeline_clear(struct vision_pipeline_t * p)
+{
+	if(p)
+		p->nstep = 0;
+}
+
+static bool_t vision_pipeline_add(struct vision_pipeline_t * p, enum vision_pipeline_op_t op, int x, int y, const char * type)
+{
+	struct vision_pipeline_step_t * s;
+
+	if(!p || (p->nstep >= VISION_PIPELINE_MAX_STEPS))
+		return FALSE;
+	s = &p->steps[p->nstep++];
+	s->op = op;
+	s->x = x;
+	s->y = y;
+	strlcpy(s->type, type ? type : "", sizeof(s->type));
+	return TRUE;
+}
+
+bool_t vision_pipeline_invert(struct vision_pipeline_t * p)
+{
+	return vision_pipeline_add(p, VISION_PIPELINE_INVERT, 0, 0, NULL);
+}
+
+bool_t vision_pipeline_threshold(struct vision_pipeline_t * p, int threshold, const char * type)
+{
+	return vision_pipeline_add(p, VISION_PIPELINE_THRESHOLD, threshold, 0, type ? type : "binary");
+}
+
+bool_t vision_pipeline_erode(struct vision_pipeline_t * p, int rx, int ry)
+{
+	return vision_pipeline_add(p, VISION_PIPELINE_ERODE, max(rx, 0), max(ry, 0), NULL);
+}
+
+bool_t vision_pipeline_dilate(struct vision_pipeline_t * p, int rx, int ry)
+{
+	return vision_pipeline_add(p, VISION_PIPELINE_DILATE, max(rx, 0), max(ry, 0), NULL);
+}
+
+static inline int is_otsu(int threshold)
+{
+	return (threshold < 0) || (threshold > 255);
+}
+
+/*
+ * Pixel wise steps whose table does not depend on the image
+ */
+static inline int is_fixed(struct vision_pipeline_step_t * s)
+{
+	return (s->op == VISION_PIPELINE_INVERT) || ((s->op == VISION_PIPELINE_THRESHOLD) && !is_otsu(s->x));
+}
+
+static void lut_identity(unsigned char * lut)
+{
+	for(int i = 0; i < 256; i++)
+		lut[i] = i;
+}
+
+static void lut_apply(unsigned char * datas, int n, const unsigned char * lut)
+{
+	for(int i = 0; i < n; i++)
+		datas[i] = lut[datas[i]];
+}
+
+/*
+ * Fold a pixel wise step into the table, an otsu threshold needs the histogram of
+ * the image as the table would leave it
+ */
+static void lut_compose(unsigned char * lut, struct vision_pipeline_step_t * s, struct vision_t * v)
+{
+	unsigned char * pgray = (unsigned char *)v->datas;
+	unsigned char table[256];
+	int histogram[256], count[256];
+	int threshold;
+	int i;
+
+	switch(s->op)
+	{
+	case VISION_PIPELINE_INVERT:
+		for(i = 0; i < 256; i++)
+			lut[i] = 255 - lut[i];
+		break;
+	case VISION_PIPELINE_THRESHOLD:
+		threshold = s->x;
+		if(is_otsu(threshold))
+		{
+			memset(count, 0, sizeof(count));
+			memset(histogram, 0, sizeof(histogram));
+			for(i = 0; i < v->npixel; i++)
+				count[pgray[i]]++;
+			for(i = 0; i < 256; i++)
+				histogram[lut[i]] += count[i];
+			threshold = vision_threshold_otsu(histogram, v->npixel);
+		}
+		vision_threshold_table(table, threshold, s->type);
+		for(i = 0; i < 256; i++)
+			lut[i] = table[lut[i]];
+		break;
+	default:
+		break;
+	}
+}
+
+void vision_pipeline_run(struct vision_pipeline_t * p, struct vision_t * v)
+{
+	struct vision_pipeline_step_t * s;
+	enum vision_morphology_t type;
+	unsigned char lut[256], post[256];
+	int dirty = 0;
+	int i;
+
+	if(!p || !v || (v->type != VISION_TYPE_GRAY) || (p->nstep <= 0))
+		return;
+	lut_identity(lut);
+	for(i = 0; i < p->nstep; i++)
+	{
+		s = &p->steps[i];
+		switch(s->op)
+		{
+		case VISION_PIPELINE_INVERT:
+		case VISION_PIPELINE_THRESHOLD:
+			lut_compose(lut, s, v);
+			dirty = 1;
+			break;
+		case VISION_PIPELINE_ERODE:
+		case VISION_PIPELINE_DILATE:
+			if((s->x <= 0) && (s->y <= 0))
+				break;
+			if(p->nscratch < v->npixel)
+			{
+				if(p->scratch)
+					free(p->scratch);
+				p->scratch = malloc(v->npixel);
+				p->nscratch = p->scratch ? v->npixel : 0;
+				if(!p->scratch)
+					return;
+			}
+			type = (s->op == VISION_PIPELINE_DILATE) ? VISION_MORPHOLOGY_DILATE : VISION_MORPHOLOGY_ERODE;
+			if(s->x > 0)
+				vision_morphology_rows(v->datas, p->scratch, v->width, v->height, s->x, lut, type);
+			else if(dirty)
+				lut_apply(v->datas, v->npixel, lut);
+			dirty = 0;
+
+			/* take the fixed pixel wise steps that follow into the vertical pass */
+			lut_identity(lut);
+			lut_identity(post);
+			while((i + 1 < p->nstep) && is_fixed(&p->steps[i + 1]))
+			{
+				lut_compose(post, &p->steps[i + 1], v);
+				i++;
+				dirty = 1;
+			}
+			if(s->y > 0)
+			{
+				vision_morphology_cols(v->datas, p->scratch, v->width, v->height, s->y, post, type);
+				dirty = 0;
+			}
+			else
+			{
+				memcpy(lut, post, sizeof(lut));
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	if(dirty)
+		lut_apply(v->datas, v->npixel, lut);
+}
@@ -29,119 +29,120 @@
 #include <xboot.h>
 #include <vision/threshold.h>
 
-void vision_threshold(struct vision_t * v, int threshold, const char * type)
+/*
+ * Otsu's method, pick the threshold that maximizes the between class variance
+ */
+int vision_threshold_otsu(const int * histogram, int npixel)
 {
-	if(v && (v->type == VISION_TYPE_GRAY))
+	float tmp, variance = 0;
+	float w0, w1, u0, u1;
+	int minpos = 0;
+	int maxpos = 255;
+	int threshold = 128;
+
+	for(int i = 0; i < 255; i++)
 	{
-		if((threshold < 0) || (threshold > 255))
+		if(histogram[i] != 0)
 		{
-			float tmp, variance = 0;
-			float w0, w1, u0, u1;
-			unsigned char * pgray;
-			int minpos = 0;
-			int maxpos = 255;
-			int histogram[256];
-			threshold = 128;
-			memset(histogram, 0, sizeof(histogram));
-			pgray = (unsigned char *)v->datas;
-			for(int i = 0; i < v->npixel; i++, pgray++)
-				histogram[*pgray]++;
-			for(int i = 0; i < 255; i++)
-			{
-				if(histogram[i] != 0)
-				{
-					minpos = i;
-					break;
-				}
-			}
-			for(int i = 255; i > 0; i--)
-			{
-				if(histogram[i] != 0)
-				{
-					maxpos = i;
-					break;
-				}
-			}
-			for(int i = minpos; i <= maxpos; i++)
-			{
-				w1 = 0;
-				u1 = 0;
-				w0 = 0;
-				u0 = 0;
-				for(int j = 0; j <= i; j++)
-				{
-					w1 += histogram[j];
-					u1 += j * histogram[j];
-				}
-				if(w1 == 0)
-					break;
-				u1 = u1 / w1;
-				w1 = w1 / v->npixel;
-				for(int k = i + 1; k < 255; k++)
-				{
-					w0 += histogram[k];
-					u0 += k * histogram[k];
-				}
-				if(w0 == 0)
-					break;
-				u0 = u0 / w0;
-				w0 = w0 / v->npixel;
-				tmp = w0 * w1 * (u1 - u0) * (u1 - u0);
-				if(variance < tmp)
-				{
-					variance = tmp;
-					threshold = i;
-				}
-			}
+			minpos = i;
+			break;
 		}
-		switch(shash(type))
+	}
+	for(int i = 255; i > 0; i--)
+	{
+		if(histogram[i] != 0)
 		{
-		case 0xf4229cca: /* "binary" */
-			{
-				unsigned char * pgray = (unsigned char *)v->datas;
-				for(int i = 0; i < v->npixel; i++, pgray++)
-					*pgray = (*pgray > threshold) ? 255 : 0;
-			}
-			break;
-		case 0xc880666f: /* "binary-invert" */
-			{
-				unsigned char * pgray = (unsigned char *)v->datas;
-				for(int i = 0; i < v->npixel; i++, pgray++)
-					*pgray = (*pgray > threshold) ? 0 : 255;
-			}
+			maxpos = i;
 			break;
-		case 0x1e92b0a8: /* "tozero" */
-			{
-				unsigned char * pgray = (unsigned char *)v->datas;
-				for(int i = 0; i < v->npixel; i++, pgray++)
-				{
-					if(*pgray <= threshold)
-						*pgray = 0;
-				}
-			}
-			break;
-		case 0x98d3b48d: /* "tozero-invert" */
-			{
-				unsigned char * pgray = (unsigned char *)v->datas;
-				for(int i = 0; i < v->npixel; i++, pgray++)
-				{
-					if(*pgray > threshold)
-						*pgray = 0;
-				}
-			}
-			break;
-		case 0xe9e0dc6b: /* "truncate" */
-			{
-				unsigned char * pgray = (unsigned char *)v->datas;
-				for(int i = 0; i < v->npixel; i++, pgray++)
-				{
-					if(*pgray > threshold)
-						*pgray = threshold;
-				}
-			}
+		}
+	}
+	for(int i = minpos; i <= maxpos; i++)
+	{
+		w1 = 0;
+		u1 = 0;
+		w0 = 0;
+		u0 = 0;
+		for(int j = 0; j <= i; j++)
+		{
+			w1 += histogram[j];
+			u1 += j * histogram[j];
+		}
+		if(w1 == 0)
 			break;
-		default:
+		u1 = u1 / w1;
+		w1 = w1 / npixel;
+		for(int k = i + 1; k < 255; k++)
+		{
+			w0 += histogram[k];
+			u0 += k * histogram[k];
+		}
+		if(w0 == 0)
 			break;
+		u0 = u0 / w0;
+		w0 = w0 / npixel;
+		tmp = w0 * w1 * (u1 - u0) * (u1 - u0);
+		if(variance < tmp)
+		{
+			variance = tmp;
+			threshold = i;
+		}
+	}
+	return threshold;
+}
+
+/*
+ * Build the 256 entries lookup table of a threshold, unknown type gives identity
+ */
+void vision_threshold_table(unsigned char * table, int threshold, const char * type)
+{
+	int i;
+
+	switch(shash(type))
+	{
+	case 0xf4229cca: /* "binary" */
+		for(i = 0; i < 256; i++)
+			table[i] = (i > threshold) ? 255 : 0;
+		break;
+	case 0xc880666f: /* "binary-invert" */
+		for(i = 0; i < 256; i++)
+			table[i] = (i > threshold) ? 0 : 255;
+		break;
+	case 0x1e92b0a8: /* "tozero" */
+		for(i = 0; i < 256; i++)
+			table[i] = (i > threshold) ? i : 0;
+		break;
+	case 0x98d3b48d: /* "tozero-invert" */
+		for(i = 0; i < 256; i++)
+			table[i] = (i > threshold) ? 0 : i;
+		break;
+	case 0xe9e0dc6b: /* "truncate" */
+		for(i = 0; i < 256; i++)
+			table[i] = (i > threshold) ? threshold : i;
+		break;
+	default:
+		for(i = 0; i < 256; i++)
+			table[i] = i;
+		break;
+	}
+}
+
+void vision_threshold(struct vision_t * v, int threshold, const char * type)
+{
+	if(v && (v->type == VISION_TYPE_GRAY))
+	{
+		unsigned char * pgray = (unsigned char *)v->datas;
+		unsigned char table[256];
+		int histogram[256];
+
+		if((threshold < 0) || (threshold > 255))
+		{
+			memset(histogram, 0, sizeof(histogram));
+			for(int i = 0; i < v->npixel; i++)
+				histogram[pgray[i]]++;
+			threshold = vision_threshold_otsu(histogram, v->npixel);
 		}
+		vision_threshold_table(table, threshold, type);
+		for(int i = 0; i < v->npixel; i++)
+			pgray[i] = table[pgray[i]];
 	}
 }
@@ -531,3 +531,26 @@ void surface_apply_vision(struct surface_t * s, struct vision_t * v)
 		}
 	}
 }
+
+/*
+ * Load a camera frame, a gray vision of the frame size takes the luma plane
+ * straight from the frame without an argb pass.
+ */
+void vision_apply_video_frame(struct vision_t * v, struct video_frame_t * frame)
+{
+	struct surface_t * s;
+
+	if(v && frame)
+	{
+		if((v->type == VISION_TYPE_GRAY) && (v->width == frame->width) && (v->height == frame->height))
+		{
+			video_frame_to_gray(frame, v->datas);
+		}
+		else if((s = surface_alloc(frame->width, frame->height, NULL)))
+		{
+			video_frame_to_argb(frame, surface_get_pixels(s));
+			vision_apply_surface(v, s);
+			surface_free(s);
+		}
+	}
+}
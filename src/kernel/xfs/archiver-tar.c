@@ -109,6 +109,7 @@ struct fhandle_tar_t
 	int64_t start;
 	int64_t size;
 	int64_t offset;
+	int64_t mtime;
 	int isdir;
 	int fd;
 };
@@ -213,6 +214,7 @@ static struct mhandle_tar_t * alloc_mhandle(int fd)
 			f->start = off + sizeof(struct tar_header_t);
 			f->size = size;
 			f->offset = 0;
+			f->mtime = strtoll((const char *)(header.mtime), NULL, 8);
 			f->isdir = (header.filetype == FILE_TYPE_DIRECTORY) ? TRUE : FALSE;
 			f->fd = fd;
 			init_list_head(&f->head);
@@ -408,6 +410,12 @@ static s64_t tar_length(void * f)
 	return fh->size;
 }
 
+static u64_t tar_mtime(void * f)
+{
+	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
+	return fh->mtime;
+}
+
 static void tar_close(void * f)
 {
 	struct fhandle_tar_t * fh = (struct fhandle_tar_t *)f;
@@ -429,6 +437,7 @@ static struct xfs_archiver_t archiver_tar = {
 	.seek		= tar_seek,
 	.tell		= tar_tell,
 	.length		= tar_length,
+	.mtime		= tar_mtime,
 	.close		= tar_close,
 };
 
@@ -343,6 +343,13 @@ s64_t xfs_length(struct xfs_file_t * file)
 	return 0;
 }
 
+u64_t xfs_mtime(struct xfs_file_t * file)
+{
+	if(file && file->path->archiver->mtime)
+		return file->path->archiver->mtime(file->fhandle);
+	return 0;
+}
+
 void xfs_close(struct xfs_file_t * file)
 {
 	if(file)
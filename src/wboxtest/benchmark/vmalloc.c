@@ -0,0 +1,132 @@
+/*
+ * wboxtest/benchmark/vmalloc.c
+ */
+
+#include <wboxtest.h>
+#include <vmalloc.h>
+
+struct wbt_vmalloc_pdata_t
+{
+	void ** ptrs;
+	size_t * sizes;
+	int count;
+};
+
+static void * vmalloc_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_vmalloc_pdata_t * pdat;
+	int i;
+
+	pdat = malloc(sizeof(struct wbt_vmalloc_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->count = 4096;
+	pdat->ptrs = malloc(sizeof(void *) * pdat->count);
+	pdat->sizes = malloc(sizeof(size_t) * pdat->count);
+	if(!pdat->ptrs || !pdat->sizes)
+	{
+		free(pdat->ptrs);
+		free(pdat->sizes);
+		free(pdat);
+		return NULL;
+	}
+	for(i = 0; i < pdat->count; i++)
+	{
+		pdat->sizes[i] = (i & 0x7) ? 16 + (rand() & 0x7f) : 256 + (rand() & 0xfff);
+	}
+
+	return pdat;
+}
+
+static void vmalloc_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_vmalloc_pdata_t * pdat = (struct wbt_vmalloc_pdata_t *)data;
+
+	if(pdat)
+	{
+		free(pdat->ptrs);
+		free(pdat->sizes);
+		free(pdat);
+	}
+}
+
+static void vmalloc_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_vmalloc_pdata_t * pdat = (struct wbt_vmalloc_pdata_t *)data;
+	struct vmalloc_t * m;
+	ktime_t t1, t2;
+	int calls;
+	int i;
+
+	if(pdat)
+	{
+		m = vmalloc_alloc(SZ_64K);
+		assert_not_null(m);
+		if(!m)
+			return;
+		for(i = 0; i < pdat->count; i++)
+		{
+			pdat->ptrs[i] = vmalloc_realloc(m, NULL, 0, pdat->sizes[i]);
+			if(!pdat->ptrs[i])
+				break;
+			memset(pdat->ptrs[i], i, pdat->sizes[i]);
+		}
+		assert_true(i < pdat->count);
+		assert_true(m->used <= SZ_64K);
+		while(--i >= 0)
+			vmalloc_realloc(m, pdat->ptrs[i], pdat->sizes[i], 0);
+		assert_equal(m->used, 0);
+		vmalloc_free(m);
+
+		calls = 0;
+		t2 = t1 = ktime_get();
+		do {
+			calls++;
+			for(i = 0; i < pdat->count; i++)
+				pdat->ptrs[i] = malloc(pdat->sizes[i]);
+			for(i = 0; i < pdat->count; i++)
+				free(pdat->ptrs[i]);
+			t2 = ktime_get();
+		} while(ktime_before(t2, ktime_add_ms(t1, 1000)));
+		wboxtest_print(" malloc : %.3f us\r\n", (double)ktime_us_delta(t2, t1) / calls / pdat->count);
+
+		m = vmalloc_alloc(0);
+		assert_not_null(m);
+		if(!m)
+			return;
+		calls = 0;
+		t2 = t1 = ktime_get();
+		do {
+			calls++;
+			for(i = 0; i < pdat->count; i++)
+				pdat->ptrs[i] = vmalloc_realloc(m, NULL, 0, pdat->sizes[i]);
+			for(i = 0; i < pdat->count; i++)
+				vmalloc_realloc(m, pdat->ptrs[i], pdat->sizes[i], 0);
+			t2 = ktime_get();
+		} while(ktime_before(t2, ktime_add_ms(t1, 1000)));
+		wboxtest_print(" vmalloc: %.3f us\r\n", (double)ktime_us_delta(t2, t1) / calls / pdat->count);
+		vmalloc_free(m);
+	}
+}
+
+static struct wboxtest_t wbt_vmalloc = {
+	.group	= "benchmark",
+	.name	= "vmalloc",
+	.setup	= vmalloc_setup,
+	.clean	= vmalloc_clean,
+	.run	= vmalloc_run,
+};
+
+static __init void vmalloc_wbt_init(void)
+{
+	register_wboxtest(&wbt_vmalloc);
+}
+
+static __exit void vmalloc_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_vmalloc);
+}
+
+wboxtest_initcall(vmalloc_wbt_init);
+wboxtest_exitcall(vmalloc_wbt_exit);
@@ -10,12 +10,12 @@ struct wbt_preview_pdata_t
 	struct window_t * w;
 	struct camera_t * c;
 	struct surface_t * s;
-	struct video_frame_t frame;
 };
 
 static void * preview_setup(struct wboxtest_t * wbt)
 {
 	struct wbt_preview_pdata_t * pdat;
+	struct camera_buffer_t * buf;
 	const char * name = NULL;
 
 	pdat = malloc(sizeof(struct wbt_preview_pdata_t));
@@ -37,25 +37,27 @@ static void * preview_setup(struct wboxtest_t * wbt)
 		return NULL;
 	}
 
-	if(!camera_start(pdat->c, VIDEO_FORMAT_MJPG, 320, 240))
+	if(!camera_stream_on(pdat->c, VIDEO_FORMAT_MJPG, 320, 240, 4))
 	{
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
 
-	if(!camera_capture(pdat->c, &pdat->frame, 3000))
+	buf = camera_dequeue(pdat->c, 3000);
+	if(!buf)
 	{
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
 
-	pdat->s = surface_alloc(pdat->frame.width, pdat->frame.height, NULL);
+	pdat->s = surface_alloc(buf->frame.width, buf->frame.height, NULL);
+	camera_enqueue(pdat->c, buf);
 	if(!pdat->s)
 	{
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
@@ -70,7 +72,7 @@ static void preview_clean(struct wboxtest_t * wbt, void * data)
 
 	if(pdat)
 	{
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
@@ -81,10 +83,15 @@ static void draw_preview(struct window_t * w, void * o)
 {
 	struct wbt_preview_pdata_t * pdat = (struct wbt_preview_pdata_t *)o;
 	struct surface_t * s = pdat->w->s;
+	struct camera_buffer_t * buf;
 	struct matrix_t m;
 
-	if(camera_capture(pdat->c, &pdat->frame, 0))
-		video_frame_to_argb(&pdat->frame, pdat->s->pixels);
+	buf = camera_dequeue(pdat->c, 0);
+	if(buf)
+	{
+		video_frame_to_argb(&buf->frame, pdat->s->pixels);
+		camera_enqueue(pdat->c, buf);
+	}
 	matrix_init_identity(&m);
 	matrix_init_translate(&m, (surface_get_width(s) - surface_get_width(pdat->s)) / 2, (surface_get_height(s) - surface_get_height(pdat->s)) / 2);
 	surface_blit(s, NULL, &m, pdat->s, RENDER_TYPE_GOOD);
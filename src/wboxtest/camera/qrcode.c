@@ -11,13 +11,13 @@ struct wbt_qrcode_pdata_t
 	struct window_t * w;
 	struct camera_t * c;
 	struct surface_t * s;
-	struct video_frame_t frame;
 	struct quirc * qr;
 };
 
 static void * qrcode_setup(struct wboxtest_t * wbt)
 {
 	struct wbt_qrcode_pdata_t * pdat;
+	struct camera_buffer_t * buf;
 	const char * name = NULL;
 
 	pdat = malloc(sizeof(struct wbt_qrcode_pdata_t));
@@ -39,25 +39,27 @@ static void * qrcode_setup(struct wboxtest_t * wbt)
 		return NULL;
 	}
 
-	if(!camera_start(pdat->c, VIDEO_FORMAT_MJPG, 640, 480))
+	if(!camera_stream_on(pdat->c, VIDEO_FORMAT_MJPG, 640, 480, 4))
 	{
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
 
-	if(!camera_capture(pdat->c, &pdat->frame, 3000))
+	buf = camera_dequeue(pdat->c, 3000);
+	if(!buf)
 	{
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
 
-	pdat->s = surface_alloc(pdat->frame.width, pdat->frame.height, NULL);
+	pdat->s = surface_alloc(buf->frame.width, buf->frame.height, NULL);
+	camera_enqueue(pdat->c, buf);
 	if(!pdat->s)
 	{
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
@@ -66,17 +68,17 @@ static void * qrcode_setup(struct wboxtest_t * wbt)
 	pdat->qr = quirc_new();
 	if(!pdat->qr)
 	{
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
 		return NULL;
 	}
 
-	if(quirc_resize(pdat->qr, pdat->frame.width, pdat->frame.height) < 0)
+	if(quirc_resize(pdat->qr, surface_get_width(pdat->s), surface_get_height(pdat->s)) < 0)
 	{
 		quirc_destroy(pdat->qr);
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
@@ -93,37 +95,31 @@ static void qrcode_clean(struct wboxtest_t * wbt, void * data)
 	if(pdat)
 	{
 		quirc_destroy(pdat->qr);
-		camera_stop(pdat->c);
+		camera_stream_off(pdat->c);
 		surface_free(pdat->s);
 		window_free(pdat->w);
 		free(pdat);
 	}
 }
 
-static inline void surface_to_gray(struct surface_t * s, uint8_t * gray)
-{
-	int i, len = surface_get_width(s) * surface_get_height(s);
-	unsigned char * p = surface_get_pixels(s);
-
-	for(i = 0; i < len; i++, p += 4)
-		*(gray++) = (p[2] * 19595L + p[1] * 38469L + p[0] * 7472L) >> 16;
-}
-
 static void draw_qrcode(struct window_t * w, void * o)
 {
 	struct wbt_qrcode_pdata_t * pdat = (struct wbt_qrcode_pdata_t *)o;
 	struct surface_t * s = pdat->w->s;
+	struct camera_buffer_t * buf;
 	struct matrix_t m;
 	struct quirc_code code;
 	struct quirc_data data;
 	quirc_decode_error_t err;
 	int i;
 
-	if(camera_capture(pdat->c, &pdat->frame, 0))
+	buf = camera_dequeue(pdat->c, 0);
+	if(buf)
 	{
-		video_frame_to_argb(&pdat->frame, pdat->s->pixels);
-		surface_to_gray(pdat->s, quirc_begin(pdat->qr, NULL, NULL));
+		video_frame_to_gray(&buf->frame, quirc_begin(pdat->qr, NULL, NULL));
 		quirc_end(pdat->qr);
+		video_frame_to_argb(&buf->frame, pdat->s->pixels);
+		camera_enqueue(pdat->c, buf);
 		for(i = 0; i < quirc_count(pdat->qr); i++)
 		{
 			quirc_extract(pdat->qr, i, &code);
@@ -0,0 +1,167 @@
+/*
+ * wboxtest/graphic/filter.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_filter_pdata_t
+{
+	struct surface_t * s[2];
+	struct surface_t * clut;
+};
+
+static void * filter_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_filter_pdata_t * pdat;
+	uint32_t * p;
+	int i, j;
+
+	pdat = malloc(sizeof(struct wbt_filter_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->s[0] = surface_alloc(1280, 720, NULL);
+	pdat->s[1] = surface_alloc(1920, 1080, NULL);
+	pdat->clut = surface_alloc(64, 64, NULL);
+	if(!pdat->s[0] || !pdat->s[1] || !pdat->clut)
+	{
+		surface_free(pdat->s[0]);
+		surface_free(pdat->s[1]);
+		surface_free(pdat->clut);
+		free(pdat);
+		return NULL;
+	}
+	for(i = 0; i < 2; i++)
+	{
+		p = surface_get_pixels(pdat->s[i]);
+		for(j = 0; j < surface_get_width(pdat->s[i]) * surface_get_height(pdat->s[i]); j++)
+			*p++ = 0xff000000 | (rand() & 0xffffff);
+	}
+	p = surface_get_pixels(pdat->clut);
+	for(j = 0; j < 64 * 64; j++)
+		*p++ = 0xff000000 | (rand() & 0xffffff);
+
+	return pdat;
+}
+
+static void filter_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_filter_pdata_t * pdat = (struct wbt_filter_pdata_t *)data;
+
+	if(pdat)
+	{
+		surface_free(pdat->s[0]);
+		surface_free(pdat->s[1]);
+		surface_free(pdat->clut);
+		free(pdat);
+	}
+}
+
+static void filter_apply(struct wbt_filter_pdata_t * pdat, struct surface_t * s, int index)
+{
+	struct surface_filter_t f[] = {
+		{ .type = SURFACE_FILTER_HUE, .value = 45 },
+		{ .type = SURFACE_FILTER_SATURATE, .value = 50 },
+		{ .type = SURFACE_FILTER_BRIGHTNESS, .value = 20 },
+		{ .type = SURFACE_FILTER_CONTRAST, .value = 20 },
+		{ .type = SURFACE_FILTER_OPACITY, .value = 80 },
+	};
+	struct color_t c;
+
+	switch(index)
+	{
+	case 0:
+		surface_filter_gray(s);
+		break;
+	case 1:
+		surface_filter_sepia(s);
+		break;
+	case 2:
+		surface_filter_invert(s);
+		break;
+	case 3:
+		color_init(&c, 0x33, 0x66, 0x99, 0xff);
+		surface_filter_coloring(s, &c);
+		break;
+	case 4:
+		surface_filter_hue(s, 45);
+		break;
+	case 5:
+		surface_filter_saturate(s, 50);
+		break;
+	case 6:
+		surface_filter_brightness(s, 20);
+		break;
+	case 7:
+		surface_filter_contrast(s, 20);
+		break;
+	case 8:
+		surface_filter_opacity(s, 80);
+		break;
+	case 9:
+		surface_filter_haldclut(s, pdat->clut, "trilinear");
+		break;
+	case 10:
+		surface_filter_blur(s, 8);
+		break;
+	case 11:
+		surface_filter_chain(s, f, ARRAY_SIZE(f));
+		break;
+	default:
+		break;
+	}
+}
+
+static void filter_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_filter_pdata_t * pdat = (struct wbt_filter_pdata_t *)data;
+	static const char * names[] = {
+		"gray", "sepia", "invert", "coloring", "hue", "saturate",
+		"brightness", "contrast", "opacity", "haldclut", "blur", "chain",
+	};
+	struct surface_t * s;
+	ktime_t t1, t2;
+	int calls;
+	int i, j;
+
+	if(pdat)
+	{
+		wboxtest_print(" Workers: %d\r\n", parallel_get_workers());
+		for(i = 0; i < 2; i++)
+		{
+			s = pdat->s[i];
+			for(j = 0; j < ARRAY_SIZE(names); j++)
+			{
+				calls = 0;
+				t2 = t1 = ktime_get();
+				do {
+					calls++;
+					filter_apply(pdat, s, j);
+					t2 = ktime_get();
+				} while(ktime_before(t2, ktime_add_ms(t1, 500)));
+				wboxtest_print(" %4dx%-4d %-10s: %.3f ms\r\n", surface_get_width(s), surface_get_height(s), names[j], (double)ktime_us_delta(t2, t1) / 1000.0 / calls);
+			}
+		}
+	}
+}
+
+static struct wboxtest_t wbt_filter = {
+	.group	= "graphic",
+	.name	= "filter",
+	.setup	= filter_setup,
+	.clean	= filter_clean,
+	.run	= filter_run,
+};
+
+static __init void filter_wbt_init(void)
+{
+	register_wboxtest(&wbt_filter);
+}
+
+static __exit void filter_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_filter);
+}
+
+wboxtest_initcall(filter_wbt_init);
+wboxtest_exitcall(filter_wbt_exit);
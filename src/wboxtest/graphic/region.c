@@ -0,0 +1,234 @@
+/*
+ * wboxtest/graphic/region.c
+ */
+
+#include <wboxtest.h>
+
+#define REGION_MAP_SIZE		(64)
+
+enum {
+	REGION_CHECK_UNION		= 0,
+	REGION_CHECK_INTERSECT	= 1,
+	REGION_CHECK_SUBTRACT	= 2,
+};
+
+struct wbt_region_pdata_t
+{
+	struct region_list_t * a;
+	struct region_list_t * b;
+	struct region_list_t * c;
+	uint8_t ma[REGION_MAP_SIZE * REGION_MAP_SIZE];
+	uint8_t mb[REGION_MAP_SIZE * REGION_MAP_SIZE];
+	uint8_t mc[REGION_MAP_SIZE * REGION_MAP_SIZE];
+	uint8_t me[REGION_MAP_SIZE * REGION_MAP_SIZE];
+};
+
+static void * region_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_region_pdata_t * pdat;
+
+	pdat = malloc(sizeof(struct wbt_region_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->a = region_list_alloc(0);
+	pdat->b = region_list_alloc(0);
+	pdat->c = region_list_alloc(0);
+	if(!pdat->a || !pdat->b || !pdat->c)
+	{
+		if(pdat->a)
+			region_list_free(pdat->a);
+		if(pdat->b)
+			region_list_free(pdat->b);
+		if(pdat->c)
+			region_list_free(pdat->c);
+		free(pdat);
+		return NULL;
+	}
+	return pdat;
+}
+
+static void region_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_region_pdata_t * pdat = (struct wbt_region_pdata_t *)data;
+
+	if(pdat)
+	{
+		region_list_free(pdat->a);
+		region_list_free(pdat->b);
+		region_list_free(pdat->c);
+		free(pdat);
+	}
+}
+
+/*
+ * Few enough rectangles that no result reaches the simplify threshold
+ */
+static void region_random(struct region_list_t * rl, uint8_t * map, int n)
+{
+	struct region_t r;
+	int i, x, y;
+
+	region_list_clear(rl);
+	memset(map, 0, REGION_MAP_SIZE * REGION_MAP_SIZE);
+	while(n-- > 0)
+	{
+		x = wboxtest_random_int(0, REGION_MAP_SIZE - 1);
+		y = wboxtest_random_int(0, REGION_MAP_SIZE - 1);
+		region_init(&r, x, y, wboxtest_random_int(1, REGION_MAP_SIZE - x), wboxtest_random_int(1, REGION_MAP_SIZE - y));
+		region_list_add(rl, &r);
+		for(y = r.y; y < r.y + r.h; y++)
+		{
+			for(i = r.x; i < r.x + r.w; i++)
+				map[y * REGION_MAP_SIZE + i] = 1;
+		}
+	}
+}
+
+/*
+ * Rasterize the list, rectangles out of the map or covering a pixel twice fail
+ */
+static int region_paint(struct region_list_t * rl, uint8_t * map)
+{
+	struct region_t * r;
+	unsigned int i;
+	int x, y;
+
+	memset(map, 0, REGION_MAP_SIZE * REGION_MAP_SIZE);
+	for(i = 0; i < rl->count; i++)
+	{
+		r = &rl->region[i];
+		if((r->x < 0) || (r->y < 0) || (r->x + r->w > REGION_MAP_SIZE) || (r->y + r->h > REGION_MAP_SIZE))
+			return 0;
+		for(y = r->y; y < r->y + r->h; y++)
+		{
+			for(x = r->x; x < r->x + r->w; x++)
+			{
+				if(map[y * REGION_MAP_SIZE + x])
+					return 0;
+				map[y * REGION_MAP_SIZE + x] = 1;
+			}
+		}
+	}
+	return 1;
+}
+
+/*
+ * Bands sorted top down with equal heights, spans sorted with gaps between
+ * them, and no two touching bands left with the same spans
+ */
+static int region_canonical(struct region_list_t * rl)
+{
+	struct region_t * r, * p = NULL;
+	unsigned int i, j, e, pn = 0;
+
+	for(i = 0; i < rl->count; i = e)
+	{
+		r = &rl->region[i];
+		if(region_isempty(r))
+			return 0;
+		for(e = i + 1; (e < rl->count) && (rl->region[e].y == r->y); e++)
+		{
+			if(region_isempty(&rl->region[e]) || (rl->region[e].h != r->h))
+				return 0;
+			if(rl->region[e].x <= rl->region[e - 1].x + rl->region[e - 1].w)
+				return 0;
+		}
+		if(p)
+		{
+			if(r->y < p->y + p->h)
+				return 0;
+			if((r->y == p->y + p->h) && (e - i == pn))
+			{
+				for(j = 0; (j < pn) && (r[j].x == p[j].x) && (r[j].w == p[j].w); j++);
+				if(j == pn)
+					return 0;
+			}
+		}
+		p = r;
+		pn = e - i;
+	}
+	return 1;
+}
+
+static int region_check(struct wbt_region_pdata_t * pdat, int op, int count)
+{
+	int fail = 0;
+	int i, j;
+
+	for(i = 0; i < count; i++)
+	{
+		region_random(pdat->a, pdat->ma, wboxtest_random_int(1, 3));
+		region_random(pdat->b, pdat->mb, wboxtest_random_int(1, 2));
+		region_list_clone(pdat->c, pdat->a);
+		for(j = 0; j < REGION_MAP_SIZE * REGION_MAP_SIZE; j++)
+		{
+			switch(op)
+			{
+			case REGION_CHECK_UNION:
+				pdat->me[j] = pdat->ma[j] | pdat->mb[j];
+				break;
+			case REGION_CHECK_INTERSECT:
+				pdat->me[j] = pdat->ma[j] & pdat->mb[j];
+				break;
+			case REGION_CHECK_SUBTRACT:
+				pdat->me[j] = pdat->ma[j] & !pdat->mb[j];
+				break;
+			default:
+				break;
+			}
+		}
+		switch(op)
+		{
+		case REGION_CHECK_UNION:
+			region_list_merge(pdat->c, pdat->b);
+			break;
+		case REGION_CHECK_INTERSECT:
+			region_list_intersect(pdat->c, pdat->b);
+			break;
+		case REGION_CHECK_SUBTRACT:
+			region_list_subtract(pdat->c, pdat->b);
+			break;
+		default:
+			break;
+		}
+		if(!region_canonical(pdat->a) || !region_canonical(pdat->c) || !region_paint(pdat->c, pdat->mc))
+			fail++;
+		else if(memcmp(pdat->mc, pdat->me, REGION_MAP_SIZE * REGION_MAP_SIZE) != 0)
+			fail++;
+	}
+	return fail;
+}
+
+static void region_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_region_pdata_t * pdat = (struct wbt_region_pdata_t *)data;
+
+	if(pdat)
+	{
+		assert_equal(region_check(pdat, REGION_CHECK_UNION, 1000), 0);
+		assert_equal(region_check(pdat, REGION_CHECK_INTERSECT, 1000), 0);
+		assert_equal(region_check(pdat, REGION_CHECK_SUBTRACT, 1000), 0);
+	}
+}
+
+static struct wboxtest_t wbt_region = {
+	.group	= "graphic",
+	.name	= "region",
+	.setup	= region_setup,
+	.clean	= region_clean,
+	.run	= region_run,
+};
+
+static __init void region_wbt_init(void)
+{
+	register_wboxtest(&wbt_region);
+}
+
+static __exit void region_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_region);
+}
+
+wboxtest_initcall(region_wbt_init);
+wboxtest_exitcall(region_wbt_exit);
@@ -0,0 +1,141 @@
+/*
+ * wboxtest/vision/morphology.c
+ */
+
+#include <wboxtest.h>
+
+struct wbt_morphology_pdata_t
+{
+	struct vision_t * v;
+	unsigned char * ref;
+};
+
+static void * morphology_setup(struct wboxtest_t * wbt)
+{
+	struct wbt_morphology_pdata_t * pdat;
+
+	pdat = malloc(sizeof(struct wbt_morphology_pdata_t));
+	if(!pdat)
+		return NULL;
+
+	pdat->v = vision_alloc(VISION_TYPE_GRAY, 97, 61);
+	pdat->ref = malloc(97 * 61);
+	if(!pdat->v || !pdat->ref)
+	{
+		if(pdat->v)
+			vision_free(pdat->v);
+		if(pdat->ref)
+			free(pdat->ref);
+		free(pdat);
+		return NULL;
+	}
+	return pdat;
+}
+
+static void morphology_clean(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_morphology_pdata_t * pdat = (struct wbt_morphology_pdata_t *)data;
+
+	if(pdat)
+	{
+		vision_free(pdat->v);
+		free(pdat->ref);
+		free(pdat);
+	}
+}
+
+/*
+ * Brute force window min/max, pixels outside the image are ignored
+ */
+static void morphology_reference(unsigned char * d, unsigned char * s, int w, int h, int rx, int ry, int dilate)
+{
+	int x, y, i, j, m, v;
+
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			m = dilate ? 0 : 255;
+			for(j = max(y - ry, 0); j <= min(y + ry, h - 1); j++)
+			{
+				for(i = max(x - rx, 0); i <= min(x + rx, w - 1); i++)
+				{
+					v = s[j * w + i];
+					m = dilate ? max(m, v) : min(m, v);
+				}
+			}
+			d[y * w + x] = m;
+		}
+	}
+}
+
+static void morphology_run(struct wboxtest_t * wbt, void * data)
+{
+	struct wbt_morphology_pdata_t * pdat = (struct wbt_morphology_pdata_t *)data;
+	struct vision_pipeline_t * p;
+	struct vision_t * o;
+	unsigned char * datas;
+	int rx, ry, dilate;
+	int i;
+
+	if(pdat)
+	{
+		datas = vision_get_datas(pdat->v);
+		for(rx = 0; rx < 6; rx++)
+		{
+			for(ry = 0; ry < 6; ry++)
+			{
+				for(dilate = 0; dilate < 2; dilate++)
+				{
+					for(i = 0; i < vision_get_npixel(pdat->v); i++)
+						datas[i] = rand() & 0xff;
+					morphology_reference(pdat->ref, datas, vision_get_width(pdat->v), vision_get_height(pdat->v), rx, ry, dilate);
+					vision_morphology(pdat->v, rx, ry, dilate ? VISION_MORPHOLOGY_DILATE : VISION_MORPHOLOGY_ERODE);
+					assert_memory_equal(datas, pdat->ref, vision_get_npixel(pdat->v));
+				}
+			}
+		}
+
+		for(i = 0; i < vision_get_npixel(pdat->v); i++)
+			datas[i] = rand() & 0xff;
+		o = vision_clone(pdat->v, 0, 0, 0, 0);
+		p = vision_pipeline_alloc();
+		if(o && p)
+		{
+			vision_threshold(o, -1, "binary");
+			vision_erode(o, 2);
+			vision_invert(o);
+			vision_dilate(o, 1);
+			vision_pipeline_threshold(p, -1, "binary");
+			vision_pipeline_erode(p, 2, 2);
+			vision_pipeline_invert(p);
+			vision_pipeline_dilate(p, 1, 1);
+			vision_pipeline_run(p, pdat->v);
+			assert_memory_equal(datas, vision_get_datas(o), vision_get_npixel(o));
+		}
+		if(o)
+			vision_free(o);
+		vision_pipeline_free(p);
+	}
+}
+
+static struct wboxtest_t wbt_morphology = {
+	.group	= "vision",
+	.name	= "morphology",
+	.setup	= morphology_setup,
+	.clean	= morphology_clean,
+	.run	= morphology_run,
+};
+
+static __init void morphology_wbt_init(void)
+{
+	register_wboxtest(&wbt_morphology);
+}
+
+static __exit void morphology_wbt_exit(void)
+{
+	unregister_wboxtest(&wbt_morphology);
+}
+
+wboxtest_initcall(morphology_wbt_init);
+wboxtest_exitcall(morphology_wbt_exit);